@@ -23,59 +23,273 @@ extern void log_message(const char* level, const char* format, ...);
 static int g_ipc_listen_fd = -1;
 static NetworkState* g_net = NULL;
 
+// Outbound WebSocket message waiting for the client's writer thread
+typedef struct IpcMsg {
+    struct IpcMsg* next;
+    uint8_t opcode;         // 0x1 text, 0x8 close, 0xA pong
+    int droppable;          // stale focus_update pushes may be discarded
+    int len;
+    char data[];
+} IpcMsg;
+
 typedef struct {
     int fd;
     int in_use;
+    int closing;            // reader gone or slow-consumer policy hit
+    int congested;          // above high watermark, cleared below low watermark
+    IpcMsg* head;
+    IpcMsg* tail;
+    size_t queued_bytes;
+    unsigned long dropped;
+    pthread_cond_t cv;
+    pthread_t writer;
+    WsDeflate* deflate;     // permessage-deflate: compressor used by writer, inflater by reader
 } IpcClient;
 
+// Handed from the accept thread to the client thread
+typedef struct {
+    int fd;
+    WsDeflateParams pmd;
+} IpcAccepted;
+
 static IpcClient g_clients[IPC_MAX_CLIENTS];
 static pthread_mutex_t g_clients_mtx = PTHREAD_MUTEX_INITIALIZER;
 static volatile int g_ipc_running = 1;
 
-// Helpers
-static void add_client(int fd) {
+// Queue limits (override with FOCUS_IPC_TX_HIGH / FOCUS_IPC_TX_LOW / FOCUS_IPC_SLOW_POLICY)
+static size_t g_tx_high = TXQ_HIGH_WATERMARK;
+static size_t g_tx_low = TXQ_LOW_WATERMARK;
+static int g_drop_policy = SLOW_POLICY_DEFAULT_DROP;
+
+static void load_queue_limits(void) {
+    const char* v;
+    if ((v = getenv("FOCUS_IPC_TX_HIGH")) && atol(v) > 0) g_tx_high = (size_t)atol(v);
+    if ((v = getenv("FOCUS_IPC_TX_LOW")) && atol(v) >= 0) g_tx_low = (size_t)atol(v);
+    if ((v = getenv("FOCUS_IPC_SLOW_POLICY"))) g_drop_policy = strcmp(v, "disconnect") != 0;
+    if (g_tx_low >= g_tx_high) g_tx_low = g_tx_high / 4;
+}
+
+// permessage-deflate (override with FOCUS_IPC_DEFLATE=off / FOCUS_IPC_DEFLATE_MIN / FOCUS_IPC_DEFLATE_TAKEOVER=off)
+static WsDeflateConfig g_deflate_cfg = {
+    WS_DEFLATE_ENABLED, WS_DEFLATE_MIN_SIZE, WS_DEFLATE_CONTEXT_TAKEOVER, WS_DEFLATE_LEVEL
+};
+
+static void load_deflate_config(void) {
+    const char* v;
+    if ((v = getenv("FOCUS_IPC_DEFLATE"))) g_deflate_cfg.enabled = strcmp(v, "off") != 0;
+    if ((v = getenv("FOCUS_IPC_DEFLATE_MIN")) && atol(v) >= 0) g_deflate_cfg.min_size = (size_t)atol(v);
+    if ((v = getenv("FOCUS_IPC_DEFLATE_TAKEOVER"))) g_deflate_cfg.context_takeover = strcmp(v, "off") != 0;
+}
+
+static void* ipc_writer_thread(void* arg);
+
+// Helpers (caller holds g_clients_mtx)
+static void free_queue(IpcClient* c) {
+    IpcMsg* m = c->head;
+    while (m) {
+        IpcMsg* next = m->next;
+        free(m);
+        m = next;
+    }
+    c->head = c->tail = NULL;
+    c->queued_bytes = 0;
+}
+
+// Mark a client as going away; its socket is shut down so both the reader
+// and a writer blocked in send() wake up. The reader thread frees the slot.
+static void mark_closing(IpcClient* c) {
+    if (c->closing) return;
+    c->closing = 1;
+    shutdown(c->fd, SHUT_RDWR);
+    pthread_cond_signal(&c->cv);
+}
+
+static void drop_stale(IpcClient* c) {
+    IpcMsg* prev = NULL;
+    IpcMsg* m = c->head;
+    while (m) {
+        IpcMsg* next = m->next;
+        if (m->droppable) {
+            if (prev) prev->next = next;
+            else c->head = next;
+            if (c->tail == m) c->tail = prev;
+            c->queued_bytes -= (size_t)m->len;
+            free(m);
+            c->dropped++;
+        } else {
+            prev = m;
+        }
+        m = next;
+    }
+}
+
+// Enqueue without touching the socket. Applies the slow-consumer policy.
+static void enqueue_locked(IpcClient* c, uint8_t opcode, const char* data, int len, int droppable) {
+    if (c->closing) return;
+    if (!c->congested && c->queued_bytes + (size_t)len > g_tx_high) {
+        c->congested = 1;
+        if (!g_drop_policy) {
+            log_message("WARN", "IPC client fd=%d not reading (%zu bytes queued), disconnecting", c->fd, c->queued_bytes);
+            mark_closing(c);
+            return;
+        }
+        log_message("WARN", "IPC client fd=%d congested, dropping stale focus updates", c->fd);
+    }
+    if (c->congested && droppable) {
+        // Only the newest focus_update is worth delivering to a lagging tab
+        drop_stale(c);
+        if (c->queued_bytes + (size_t)len > g_tx_high) {
+            c->dropped++;
+            return;
+        }
+    }
+
+    IpcMsg* m = (IpcMsg*)malloc(sizeof(IpcMsg) + (size_t)len);
+    if (!m) return;
+    m->next = NULL;
+    m->opcode = opcode;
+    m->droppable = droppable;
+    m->len = len;
+    if (len > 0) memcpy(m->data, data, (size_t)len);
+    if (c->tail) c->tail->next = m;
+    else c->head = m;
+    c->tail = m;
+    c->queued_bytes += (size_t)len;
+    pthread_cond_signal(&c->cv);
+}
+
+static IpcClient* add_client(int fd, WsDeflate* deflate) {
+    IpcClient* slot = NULL;
     pthread_mutex_lock(&g_clients_mtx);
     for (int i = 0; i < IPC_MAX_CLIENTS; ++i) {
         if (!g_clients[i].in_use) {
-            g_clients[i].in_use = 1;
-            g_clients[i].fd = fd;
+            slot = &g_clients[i];
+            memset(slot, 0, sizeof(*slot));
+            slot->in_use = 1;
+            slot->fd = fd;
+            slot->deflate = deflate;
+            pthread_cond_init(&slot->cv, NULL);
+            if (pthread_create(&slot->writer, NULL, ipc_writer_thread, slot) != 0) {
+                pthread_cond_destroy(&slot->cv);
+                slot->in_use = 0;
+                slot = NULL;
+            }
             break;
         }
     }
     pthread_mutex_unlock(&g_clients_mtx);
+    return slot;
 }
 
-static void remove_client(int fd) {
+static void remove_client(IpcClient* c) {
     pthread_mutex_lock(&g_clients_mtx);
-    for (int i = 0; i < IPC_MAX_CLIENTS; ++i) {
-        if (g_clients[i].in_use && g_clients[i].fd == fd) {
-            g_clients[i].in_use = 0;
-            g_clients[i].fd = -1;
-            break;
+    mark_closing(c);
+    pthread_mutex_unlock(&g_clients_mtx);
+    pthread_join(c->writer, NULL);
+
+    pthread_mutex_lock(&g_clients_mtx);
+    if (c->dropped) log_message("INFO", "IPC client fd=%d dropped %lu stale message(s)", c->fd, c->dropped);
+    free_queue(c);
+    pthread_cond_destroy(&c->cv);
+    close(c->fd);
+    c->fd = -1;
+    ws_deflate_free(c->deflate);
+    c->deflate = NULL;
+    c->in_use = 0;
+    pthread_mutex_unlock(&g_clients_mtx);
+}
+
+// One writer per browser tab: a slow tab only ever blocks its own thread
+static void* ipc_writer_thread(void* arg) {
+    IpcClient* c = (IpcClient*)arg;
+    pthread_mutex_lock(&g_clients_mtx);
+    for (;;) {
+        while (!c->head && !c->closing) pthread_cond_wait(&c->cv, &g_clients_mtx);
+        if (c->closing) break;
+
+        IpcMsg* m = c->head;
+        c->head = m->next;
+        if (!c->head) c->tail = NULL;
+        c->queued_bytes -= (size_t)m->len;
+        if (c->congested && c->queued_bytes <= g_tx_low) c->congested = 0;
+        int fd = c->fd;
+        pthread_mutex_unlock(&g_clients_mtx);
+
+        int rc;
+        if (m->opcode == 0xA) rc = websocket_send_pong(fd, m->data, m->len);
+        else if (m->opcode == 0x8) rc = websocket_send_close(fd);
+        else rc = websocket_send_text_deflate(fd, c->deflate, m->data, m->len);
+        uint8_t opcode = m->opcode;
+        free(m);
+
+        pthread_mutex_lock(&g_clients_mtx);
+        if (rc < 0) {
+            log_message("WARN", "IPC send failed, closing client fd=%d", fd);
+            mark_closing(c);
+        } else if (opcode == 0x8) {
+            mark_closing(c);
         }
     }
     pthread_mutex_unlock(&g_clients_mtx);
+    return NULL;
 }
 
-void ipc_broadcast_event(const char* event, const char* data_json) {
-    char buf[4096];
+static int format_event(char* buf, size_t cap, const char* event, const char* data_json) {
     int len = 0;
     if (data_json && data_json[0]) {
-        len = snprintf(buf, sizeof(buf), "{\"event\":\"%s\",\"data\":%s}", event, data_json);
+        len = snprintf(buf, cap, "{\"event\":\"%s\",\"data\":%s}", event, data_json);
     } else {
-        len = snprintf(buf, sizeof(buf), "{\"event\":\"%s\"}", event);
+        len = snprintf(buf, cap, "{\"event\":\"%s\"}", event);
     }
+    if (len >= (int)cap) len = (int)cap - 1;
+    return len;
+}
+
+void ipc_broadcast_event(const char* event, const char* data_json) {
+    char buf[4096];
+    int len = format_event(buf, sizeof(buf), event, data_json);
     if (len <= 0) return;
+    int droppable = strcmp(event, "focus_update") == 0;
 
+    // Chỉ xếp hàng dưới lock, không gửi socket: 1 tab chậm không chặn các tab khác
     pthread_mutex_lock(&g_clients_mtx);
     for (int i = 0; i < IPC_MAX_CLIENTS; ++i) {
         if (!g_clients[i].in_use) continue;
-        if (websocket_send_text(g_clients[i].fd, buf, len) < 0) {
-            log_message("WARN", "IPC send failed, closing client fd=%d", g_clients[i].fd);
-            close(g_clients[i].fd);
-            g_clients[i].in_use = 0;
+        enqueue_locked(&g_clients[i], 0x1, buf, len, droppable);
+    }
+    pthread_mutex_unlock(&g_clients_mtx);
+}
+
+void ipc_send_event(int fd, const char* event, const char* data_json) {
+    if (fd >= 0) {
+        char buf[4096];
+        int len = format_event(buf, sizeof(buf), event, data_json);
+        if (len <= 0) return;
+        pthread_mutex_lock(&g_clients_mtx);
+        for (int i = 0; i < IPC_MAX_CLIENTS; ++i) {
+            IpcClient* c = &g_clients[i];
+            if (c->in_use && !c->closing && c->fd == fd) {
+                enqueue_locked(c, 0x1, buf, len, 0);
+                pthread_mutex_unlock(&g_clients_mtx);
+                return;
+            }
         }
+        pthread_mutex_unlock(&g_clients_mtx);
     }
+    ipc_broadcast_event(event, data_json);
+}
+
+int ipc_has_clients(void) {
+    int any = 0;
+    pthread_mutex_lock(&g_clients_mtx);
+    for (int i = 0; i < IPC_MAX_CLIENTS && !any; ++i) any = g_clients[i].in_use;
+    pthread_mutex_unlock(&g_clients_mtx);
+    return any;
+}
+
+static void send_to_client(IpcClient* c, uint8_t opcode, const char* data, int len) {
+    pthread_mutex_lock(&g_clients_mtx);
+    enqueue_locked(c, opcode, data, len, 0);
     pthread_mutex_unlock(&g_clients_mtx);
 }
 
@@ -97,8 +311,9 @@ static int json_get_string(const char* json, const char* key, char* out, size_t
     return 1;
 }
 
+// Replies to login/register change the relay's shared session, so every tab hears them;
+// query replies (leaderboard, profile) are routed back to the requesting tab by request id.
 static void handle_ipc_command(int fd, const char* payload, int len) {
-    (void)fd;   // Unused but needed for function signature
     (void)len;  // Unused but needed for function signature
     if (!g_net || !g_net->is_connected) {
         ipc_broadcast_event("error", "\"server_not_connected\"");
@@ -114,14 +329,14 @@ static void handle_ipc_command(int fd, const char* payload, int len) {
         char user[64] = {0}, pass[64] = {0};
         json_get_string(payload, "\"username\"", user, sizeof(user));
         json_get_string(payload, "\"password\"", pass, sizeof(pass));
-        if (send_login(g_net, user, pass) < 0) ipc_broadcast_event("error", "\"login_send_failed\"");
+        if (send_login(g_net, user, pass, fd) < 0) ipc_broadcast_event("error", "\"login_send_failed\"");
         return;
     }
     if (strcmp(type, "register") == 0 || strcmp(type, "signup") == 0) {
         char user[64] = {0}, pass[64] = {0};
         json_get_string(payload, "\"username\"", user, sizeof(user));
         json_get_string(payload, "\"password\"", pass, sizeof(pass));
-        if (send_register(g_net, user, pass) < 0) ipc_broadcast_event("error", "\"register_send_failed\"");
+        if (send_register(g_net, user, pass, fd) < 0) ipc_broadcast_event("error", "\"register_send_failed\"");
         return;
     }
     if (strcmp(type, "start_session") == 0) {
@@ -134,11 +349,11 @@ static void handle_ipc_command(int fd, const char* payload, int len) {
         return;
     }
     if (strcmp(type, "get_leaderboard") == 0) {
-        if (send_get_leaderboard(g_net) < 0) ipc_broadcast_event("error", "\"leaderboard_failed\"");
+        if (send_get_leaderboard(g_net, fd) < 0) ipc_broadcast_event("error", "\"leaderboard_failed\"");
         return;
     }
     if (strcmp(type, "get_profile") == 0) {
-        if (send_get_profile(g_net) < 0) ipc_broadcast_event("error", "\"profile_failed\"");
+        if (send_get_profile(g_net, fd) < 0) ipc_broadcast_event("error", "\"profile_failed\"");
         return;
     }
     if (strcmp(type, "stream_frame") == 0) {
@@ -163,22 +378,29 @@ static void handle_ipc_command(int fd, const char* payload, int len) {
 }
 
 static void* ipc_client_thread(void* arg) {
-    int fd = *(int*)arg;
-    free(arg);
-    add_client(fd);
+    IpcAccepted* acc = (IpcAccepted*)arg;
+    int fd = acc->fd;
+    WsDeflate* deflate = ws_deflate_new(&acc->pmd, &g_deflate_cfg, WS_MAX_MESSAGE_SIZE);
+    int want_deflate = acc->pmd.enabled;
+    free(acc);
+    if (want_deflate && !deflate) {
+        log_message("WARN", "IPC deflate init failed, closing fd=%d", fd);
+        close(fd);
+        return NULL;
+    }
+    IpcClient* client = add_client(fd, deflate);
+    if (!client) {
+        log_message("WARN", "IPC client limit reached, closing fd=%d", fd);
+        ws_deflate_free(deflate);
+        close(fd);
+        return NULL;
+    }
     log_message("INFO", "IPC client connected fd=%d", fd);
     fprintf(stderr, "[IPC] client_thread ready to recv frames on fd=%d\n", fd);
     
-    // Send welcome message immediately after handshake
+    // Welcome message goes first through this client's writer queue
     const char* welcome = "{\"event\":\"connected\",\"data\":\"ready\"}";
-    fprintf(stderr, "[IPC] sending welcome message to fd=%d\n", fd);
-    if (websocket_send_text(fd, welcome, strlen(welcome)) < 0) {
-        fprintf(stderr, "[IPC] ERROR: failed to send welcome\n");
-        close(fd);
-        remove_client(fd);
-        return NULL;
-    }
-    fprintf(stderr, "[IPC] ===== WELCOME SENT, NOW WAITING FOR BROWSER MESSAGES =====\n");
+    send_to_client(client, 0x1, welcome, (int)strlen(welcome));
 
     // Set a reasonable timeout to avoid hanging indefinitely
     struct timeval tv;
@@ -188,29 +410,33 @@ static void* ipc_client_thread(void* arg) {
         log_message("WARN", "Failed to set socket timeout on fd=%d", fd);
     }
 
+    WsReader reader;
+    ws_reader_init(&reader);
+    reader.deflate = deflate;
     for (;;) {
-        fprintf(stderr, "[IPC] calling recv_frame on fd=%d\n", fd);
         char* payload = NULL;
         uint8_t opcode = 0;
-        int len = websocket_recv_frame(fd, &payload, &opcode);
-        fprintf(stderr, "[IPC] recv_frame returned %d on fd=%d\n", len, fd);
+        int len = websocket_recv_message(fd, &reader, &payload, &opcode);
         if (len < 0) {
-            log_message("DEBUG", "IPC recv_frame failed fd=%d", fd);
-            fprintf(stderr, "[IPC] recv_frame error, breaking\n");
+            log_message("DEBUG", "IPC recv_message failed fd=%d", fd);
             break;
         }
-        log_message("DEBUG", "IPC recv_frame fd=%d opcode=0x%x len=%d", fd, opcode, len);
-        if (opcode == 0x8) { free(payload); break; } // close
-        if (opcode == 0x9) { websocket_send_pong(fd, payload, len); free(payload); continue; } // ping
-        if (opcode == 0x1 && payload) {
+        log_message("DEBUG", "IPC recv_message fd=%d opcode=0x%x len=%d", fd, opcode, len);
+        if (opcode == 0x8) break; // close
+        if (opcode == 0x9) { send_to_client(client, 0xA, payload, len); continue; } // ping
+        if (opcode == 0x1) {
             log_message("DEBUG", "IPC text message fd=%d: %.100s", fd, payload);
             handle_ipc_command(fd, payload, len);
+        } else if (opcode == 0x2) {
+            // Binary message = raw frame bytes, forwarded without the base64 round-trip
+            if (send_stream_frame_bytes(g_net, payload, len) < 0) {
+                ipc_broadcast_event("error", "\"stream_send_failed\"");
+            }
         }
-        free(payload);
     }
+    ws_reader_free(&reader);
 
-    close(fd);
-    remove_client(fd);
+    remove_client(client);
     log_message("INFO", "IPC client disconnected fd=%d", fd);
     return NULL;
 }
@@ -225,17 +451,18 @@ static void* ipc_accept_thread(void* arg) {
         int flags = fcntl(cfd, F_GETFL, 0);
         if (flags >= 0) fcntl(cfd, F_SETFL, flags & ~O_NONBLOCK);
         log_message("INFO", "IPC accept fd=%d, doing handshake...", cfd);
-        if (websocket_handshake(cfd) != 0) {
+        IpcAccepted* acc = (IpcAccepted*)malloc(sizeof(IpcAccepted));
+        if (!acc) { close(cfd); continue; }
+        acc->fd = cfd;
+        if (websocket_handshake(cfd, &g_deflate_cfg, &acc->pmd) != 0) {
             log_message("WARN", "IPC handshake failed fd=%d, closing", cfd);
+            free(acc);
             close(cfd);
             continue;
         }
-        log_message("INFO", "IPC handshake OK fd=%d", cfd);
-        int* pfd = (int*)malloc(sizeof(int));
-        if (!pfd) { close(cfd); continue; }
-        *pfd = cfd;
+        log_message("INFO", "IPC handshake OK fd=%d%s", cfd, acc->pmd.enabled ? " (permessage-deflate)" : "");
         pthread_t th;
-        pthread_create(&th, NULL, ipc_client_thread, pfd);
+        pthread_create(&th, NULL, ipc_client_thread, acc);
         pthread_detach(th);
     }
     return NULL;
@@ -243,6 +470,8 @@ static void* ipc_accept_thread(void* arg) {
 
 int ipc_start(NetworkState* net) {
     g_net = net;
+    load_queue_limits();
+    load_deflate_config();
     g_ipc_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (g_ipc_listen_fd < 0) {
         log_message("ERROR", "IPC socket create failed");
@@ -286,13 +515,10 @@ int ipc_start(NetworkState* net) {
 void ipc_stop() {
     g_ipc_running = 0;
     if (g_ipc_listen_fd >= 0) close(g_ipc_listen_fd);
+    // Close frame is queued behind pending messages; the writer shuts the socket after it
     pthread_mutex_lock(&g_clients_mtx);
     for (int i = 0; i < IPC_MAX_CLIENTS; ++i) {
-        if (g_clients[i].in_use) {
-            websocket_send_close(g_clients[i].fd);
-            close(g_clients[i].fd);
-            g_clients[i].in_use = 0;
-        }
+        if (g_clients[i].in_use) enqueue_locked(&g_clients[i], 0x8, NULL, 0, 0);
     }
     pthread_mutex_unlock(&g_clients_mtx);
 }
@@ -9,5 +9,9 @@
 int ipc_start(NetworkState* net);
 void ipc_stop();
 void ipc_broadcast_event(const char* event, const char* data_json);
+// Reply to the tab (IPC client fd) that issued the request; broadcast if fd < 0 or the tab is gone
+void ipc_send_event(int fd, const char* event, const char* data_json);
+// 1 if at least one tab is connected (callers skip building JSON nobody would read)
+int ipc_has_clients(void);
 
 #endif
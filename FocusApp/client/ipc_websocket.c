@@ -12,6 +12,9 @@
 #include <errno.h>
 
 #include "base64.h"
+#include "../common/wsmask.h"
+
+extern void log_message(const char* level, const char* format, ...);
 
 // Minimal SHA1 implementation (public domain style)
 typedef struct {
@@ -119,7 +122,7 @@ static void sha1_final(sha1_ctx* ctx, unsigned char digest[20]) {
 
 #define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
 
-int websocket_handshake(int fd) {
+int websocket_handshake(int fd, const WsDeflateConfig* pmd_cfg, WsDeflateParams* pmd) {
     char req[4096];
     int n = recv(fd, req, sizeof(req) - 1, 0);
     if (n <= 0) {
@@ -171,14 +174,18 @@ int websocket_handshake(int fd) {
     base64_encode(digest, 20, accept_b64, sizeof(accept_b64));
     fprintf(stderr, "[WS] accept_b64: %s\n", accept_b64);
 
+    char ext[160] = "";
+    if (pmd_cfg && pmd) ws_deflate_negotiate(pmd_cfg, req, (size_t)n, pmd, ext, sizeof(ext));
+
     char resp[512];
     int resp_len = snprintf(resp, sizeof(resp),
         "HTTP/1.1 101 Switching Protocols\r\n"
         "Upgrade: websocket\r\n"
         "Connection: Upgrade\r\n"
         "Sec-WebSocket-Accept: %s\r\n"
+        "%s"
         "\r\n",
-        accept_b64);
+        accept_b64, ext);
     fprintf(stderr, "[WS] handshake response (%d bytes):\n%s\n", resp_len, resp);
     if (resp_len <= 0 || resp_len >= (int)sizeof(resp)) {
         fprintf(stderr, "[WS] resp_len invalid\n");
@@ -218,63 +225,125 @@ static int read_exact(int fd, void* buf, int len) {
     return got;
 }
 
-int websocket_recv_frame(int fd, char** payload, uint8_t* opcode) {
-    unsigned char hdr[2];
-    fprintf(stderr, "[WS] recv_frame: reading 2-byte header from fd=%d...\n", fd);
-    if (read_exact(fd, hdr, 2) < 0) {
-        fprintf(stderr, "[WS] recv_frame: FAILED to read header\n");
-        return -1;
-    }
-    fprintf(stderr, "[WS] recv_frame: header OK (0x%02x 0x%02x)\n", hdr[0], hdr[1]);
-    *opcode = hdr[0] & 0x0F;
-    int masked = (hdr[1] & 0x80) != 0;
-    uint64_t len = hdr[1] & 0x7F;
-    fprintf(stderr, "[WS] recv_frame: opcode=0x%x masked=%d len=%lu\n", *opcode, masked, (unsigned long)len);
-    if (len == 126) {
-        unsigned char ext[2];
-        if (read_exact(fd, ext, 2) < 0) return -1;
-        len = (ext[0] << 8) | ext[1];
-    } else if (len == 127) {
-        unsigned char ext[8];
-        if (read_exact(fd, ext, 8) < 0) return -1;
-        len = ((uint64_t)ext[4] << 24) | ((uint64_t)ext[5] << 16) | ((uint64_t)ext[6] << 8) | ((uint64_t)ext[7]);
-    }
-    unsigned char mask[4] = {0};
-    if (masked) {
-        if (read_exact(fd, mask, 4) < 0) return -1;
-    }
-    if (len > 4 * 1024 * 1024) {
-        fprintf(stderr, "[WS] recv_frame: payload too large %lu\n", (unsigned long)len);
-        return -1;
-    }
-    fprintf(stderr, "[WS] recv_frame: allocating %lu bytes\n", (unsigned long)len);
-    char* buf = (char*)malloc((size_t)len + 1);
-    if (!buf) {
-        fprintf(stderr, "[WS] recv_frame: malloc FAILED\n");
-        return -1;
-    }
-    fprintf(stderr, "[WS] recv_frame: reading %lu bytes payload...\n", (unsigned long)len);
-    if (read_exact(fd, buf, (int)len) < 0) {
-        fprintf(stderr, "[WS] recv_frame: FAILED to read payload\n");
-        free(buf);
-        return -1;
+void ws_reader_init(WsReader* r) {
+    memset(r, 0, sizeof(*r));
+    r->data = (char*)malloc(WS_READER_INITIAL_SIZE);
+    if (r->data) r->cap = WS_READER_INITIAL_SIZE;
+}
+
+void ws_reader_free(WsReader* r) {
+    free(r->data);
+    free(r->plain);
+    memset(r, 0, sizeof(*r));
+}
+
+// WsInflateSink: append inflated bytes to r->plain (ws_inflate bounds the total size)
+static int ws_reader_plain_sink(void* user, const char* data, size_t len) {
+    WsReader* r = (WsReader*)user;
+    if (r->plain_len + len + 1 > r->plain_cap) {
+        size_t cap = r->plain_cap ? r->plain_cap : WS_READER_INITIAL_SIZE;
+        while (cap < r->plain_len + len + 1) cap *= 2;
+        char* plain = (char*)realloc(r->plain, cap);
+        if (!plain) return -1;
+        r->plain = plain;
+        r->plain_cap = cap;
     }
-    fprintf(stderr, "[WS] recv_frame: payload OK\n");
-    if (masked) {
-        for (uint64_t i = 0; i < len; ++i) {
-            buf[i] ^= mask[i % 4];
+    memcpy(r->plain + r->plain_len, data, len);
+    r->plain_len += len;
+    return 0;
+}
+
+// Make room for `extra` more payload bytes (+1 for the terminating NUL)
+static int ws_reader_reserve(WsReader* r, uint64_t extra) {
+    uint64_t need = (uint64_t)r->len + extra + 1;
+    if (need > WS_MAX_MESSAGE_SIZE + 1) return -1;
+    if (need <= r->cap) return 0;
+    size_t cap = r->cap ? r->cap : WS_READER_INITIAL_SIZE;
+    while (cap < need) cap *= 2;
+    if (cap > WS_MAX_MESSAGE_SIZE + 1) cap = WS_MAX_MESSAGE_SIZE + 1;
+    char* data = (char*)realloc(r->data, cap);
+    if (!data) return -1;
+    r->data = data;
+    r->cap = cap;
+    return 0;
+}
+
+int websocket_recv_message(int fd, WsReader* r, char** payload, uint8_t* opcode) {
+    for (;;) {
+        unsigned char hdr[2];
+        if (read_exact(fd, hdr, 2) < 0) return -1;
+        int fin = (hdr[0] & 0x80) != 0;
+        int rsv1 = (hdr[0] & 0x40) != 0;
+        uint8_t op = hdr[0] & 0x0F;
+        if (hdr[0] & 0x30) return -1;                    // RSV2/RSV3 are never negotiated
+        if (rsv1 && (!r->deflate || op == 0x0 || (op & 0x08))) return -1;
+        int masked = (hdr[1] & 0x80) != 0;
+        uint64_t len = hdr[1] & 0x7F;
+        if (len == 126) {
+            unsigned char ext[2];
+            if (read_exact(fd, ext, 2) < 0) return -1;
+            len = ((uint64_t)ext[0] << 8) | ext[1];
+        } else if (len == 127) {
+            unsigned char ext[8];
+            if (read_exact(fd, ext, 8) < 0) return -1;
+            len = 0;
+            for (int i = 0; i < 8; ++i) len = (len << 8) | ext[i];
+        }
+        unsigned char mask[4] = {0};
+        if (masked && read_exact(fd, mask, 4) < 0) return -1;
+
+        if (op & 0x08) {
+            // Control frames may arrive between fragments; they never touch the message buffer
+            if (!fin || len > WS_MAX_CONTROL_PAYLOAD) return -1;
+            if (len > 0 && read_exact(fd, r->control, (int)len) < 0) return -1;
+            if (masked) ws_unmask(r->control, (size_t)len, mask, 0);
+            r->control[len] = '\0';
+            *opcode = op;
+            *payload = r->control;
+            return (int)len;
+        }
+
+        if (op == 0x0) {
+            if (!r->in_message) return -1; // continuation without a first fragment
+        } else {
+            if (r->in_message) return -1;  // new message before the previous one finished
+            r->opcode = op;
+            r->compressed = rsv1;
+            r->len = 0;
         }
+        if (ws_reader_reserve(r, len) < 0) {
+            log_message("WARN", "[WS] recv_message fd=%d: message larger than %d bytes", fd, WS_MAX_MESSAGE_SIZE);
+            return -1;
+        }
+        char* dst = r->data + r->len;
+        if (len > 0 && read_exact(fd, dst, (int)len) < 0) return -1;
+        if (masked) ws_unmask(dst, (size_t)len, mask, 0);
+        r->len += (size_t)len;
+        r->in_message = !fin;
+        if (!fin) continue;
+
+        *opcode = r->opcode;
+        if (r->compressed) {
+            r->plain_len = 0;
+            if (ws_inflate(r->deflate, r->data, r->len, 1, ws_reader_plain_sink, r) < 0 ||
+                ws_reader_plain_sink(r, "", 0) < 0) {
+                log_message("WARN", "[WS] recv_message fd=%d: bad or oversized compressed message", fd);
+                return -1;
+            }
+            r->plain[r->plain_len] = '\0';
+            *payload = r->plain;
+            return (int)r->plain_len;
+        }
+        r->data[r->len] = '\0';
+        *payload = r->data;
+        return (int)r->len;
     }
-    buf[len] = '\0';
-    *payload = buf;
-    return (int)len;
 }
 
-static int websocket_send_frame(int fd, uint8_t opcode, const char* data, int len) {
-    fprintf(stderr, "[WS] send_frame: fd=%d opcode=0x%x len=%d\n", fd, opcode, len);
+static int websocket_send_frame(int fd, uint8_t opcode, int rsv1, const char* data, int len) {
     unsigned char header[10];
     int hlen = 0;
-    header[hlen++] = 0x80 | (opcode & 0x0F);
+    header[hlen++] = 0x80 | (rsv1 ? 0x40 : 0) | (opcode & 0x0F);
     if (len <= 125) {
         header[hlen++] = (unsigned char)len;
     } else if (len <= 65535) {
@@ -290,30 +359,36 @@ static int websocket_send_frame(int fd, uint8_t opcode, const char* data, int le
         header[hlen++] = len & 0xFF;
     }
     if (send(fd, header, hlen, 0) != hlen) {
-        fprintf(stderr, "[WS] send_frame: FAILED to send header\n");
+        log_message("WARN", "[WS] send_frame fd=%d: failed to send header", fd);
         return -1;
     }
-    fprintf(stderr, "[WS] send_frame: header sent (%d bytes)\n", hlen);
     if (len > 0 && data) {
         if (send(fd, data, len, 0) != len) {
-            fprintf(stderr, "[WS] send_frame: FAILED to send payload\n");
+            log_message("WARN", "[WS] send_frame fd=%d: failed to send %d-byte payload", fd, len);
             return -1;
         }
-        fprintf(stderr, "[WS] send_frame: payload sent (%d bytes)\n", len);
     }
-    fprintf(stderr, "[WS] send_frame: COMPLETE\n");
     return 0;
 }
 
 int websocket_send_text(int fd, const char* data, int len) {
     if (len < 0) len = (int)strlen(data);
-    return websocket_send_frame(fd, 0x1, data, len);
+    return websocket_send_frame(fd, 0x1, 0, data, len);
+}
+
+int websocket_send_text_deflate(int fd, WsDeflate* d, const char* data, int len) {
+    if (len < 0) len = (int)strlen(data);
+    if (!ws_deflate_wants(d, (size_t)len)) return websocket_send_frame(fd, 0x1, 0, data, len);
+    char* out = NULL;
+    size_t out_len = 0;
+    if (ws_deflate_compress(d, 0, NULL, 0, data, (size_t)len, &out, &out_len) < 0) return -1;
+    return websocket_send_frame(fd, 0x1, 1, out, (int)out_len);
 }
 
 int websocket_send_pong(int fd, const char* data, int len) {
-    return websocket_send_frame(fd, 0xA, data, len);
+    return websocket_send_frame(fd, 0xA, 0, data, len);
 }
 
 int websocket_send_close(int fd) {
-    return websocket_send_frame(fd, 0x8, NULL, 0);
+    return websocket_send_frame(fd, 0x8, 0, NULL, 0);
 }
@@ -1,11 +1,42 @@
 #ifndef IPC_WEBSOCKET_H
 #define IPC_WEBSOCKET_H
 
+#include <stddef.h>
 #include <stdint.h>
+#include "../common/wsdeflate.h"
 
-int websocket_handshake(int fd);
-int websocket_recv_frame(int fd, char** payload, uint8_t* opcode);
+#define WS_READER_INITIAL_SIZE (64 * 1024)
+#define WS_MAX_MESSAGE_SIZE (8 * 1024 * 1024)   // base64 of a 2MB frame plus JSON fits
+#define WS_MAX_CONTROL_PAYLOAD 125
+
+// Per-connection receive state: fragments of one message are appended to `data`,
+// which is allocated once and reused (grown on demand) for every message.
+typedef struct {
+    char* data;
+    size_t cap;
+    size_t len;
+    uint8_t opcode;     // opcode of the first fragment
+    int in_message;     // waiting for continuation frames
+    int compressed;     // first fragment had RSV1 set (permessage-deflate)
+    WsDeflate* deflate; // negotiated compression state, NULL if none (not owned)
+    char* plain;        // inflated message, reused like `data`
+    size_t plain_cap;
+    size_t plain_len;
+    char control[WS_MAX_CONTROL_PAYLOAD + 1];
+} WsReader;
+
+// Answer the upgrade request on fd. With a non-NULL pmd_cfg, permessage-deflate
+// is negotiated and the result stored in *pmd.
+int websocket_handshake(int fd, const WsDeflateConfig* pmd_cfg, WsDeflateParams* pmd);
+void ws_reader_init(WsReader* r);
+void ws_reader_free(WsReader* r);
+// Block until a complete data message or a control frame arrives. *payload points
+// into the reader (NUL-terminated) and stays valid until the next call.
+// Returns payload length, or -1 on error/connection close.
+int websocket_recv_message(int fd, WsReader* r, char** payload, uint8_t* opcode);
 int websocket_send_text(int fd, const char* data, int len);
+// Like websocket_send_text, but compressed with `d` when the message is large enough
+int websocket_send_text_deflate(int fd, WsDeflate* d, const char* data, int len);
 int websocket_send_pong(int fd, const char* data, int len);
 int websocket_send_close(int fd);
 
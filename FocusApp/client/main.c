@@ -1,7 +1,10 @@
 /*
  * Mục đích: Ứng dụng Client dạng console (không dùng Webview) để demo giao thức.
  *  - Hiển thị menu thao tác: login/register, start/end session, gửi frame, lấy leaderboard/profile.
- *  - Tạo 1 thread nền (receiver_thread) để nhận thông điệp đẩy từ server (warning, coins update,...).
+ *  - Tạo 1 thread nền (receiver_thread) để nhận thông điệp đẩy từ server (warning, coins update,...)
+ *    và ghép phản hồi về đúng request đang chờ (network_complete_request, theo request_id).
+ *  - MSG_RATE_HINT: áp dụng cho mọi frame gửi sau đó (network_rate_hint) và báo cho tab IPC
+ *    (event "rate_hint") để giao diện chụp thưa hơn / nhỏ hơn thay vì bị bỏ frame.
  *
  * Thành phần chính:
  * - receiver_thread(): Vòng lặp blocking nhận packet và in log/console theo type.
@@ -19,6 +22,7 @@
 #include "network.h"
 #include "../common/protocol.h"
 #include "../common/config.h"
+#include "../common/binresp.h"
 #include "base64.h"
 #include "ipc.h"
 
@@ -27,17 +31,7 @@ extern void log_message(const char* level, const char* format, ...);
 static NetworkState g_network = {0};
 static volatile int g_running = 1;
 
-// Bộ nhớ đệm phản hồi đồng bộ từ server
-typedef struct {
-    int type;
-    int length;
-    char data[2048];
-    int ready; // 1 khi có phản hồi mới
-    pthread_mutex_t mtx;
-    pthread_cond_t cv;
-} ResponseCache;
-
-static ResponseCache g_resp = {0};
+#define RESPONSE_TIMEOUT_MS 3000
 
 static void print_menu() {
     printf("\n=== FocusApp Client (Console) ===\n");
@@ -75,12 +69,26 @@ static int load_file(const char* path, unsigned char** out_buf, size_t* out_len)
     *out_buf = buf; *out_len = (size_t)len; return 0;
 }
 
+// Chờ phản hồi của request `id` gửi từ menu; 1 nếu nhận được đúng loại mong đợi
+static int await_response(int id, int expect_type, NetResponse* resp) {
+    if (id < 0) return 0;
+    return network_wait_response(&g_network, id, RESPONSE_TIMEOUT_MS, resp) && resp->type == expect_type;
+}
+
+// Payload as JSON text: binary responses (FEAT_BINARY_RESP) are converted into buf
+static const char* response_json(int type, const char* payload, int length, char* buf, size_t cap) {
+    if (!(g_network.features & FEAT_BINARY_RESP)) return payload;
+    if (binresp_to_json(type, payload, length, buf, cap) < 0) return "null";
+    return buf;
+}
+
 static void* receiver_thread(void* arg) {
     (void)arg;
     log_message("INFO", "\nReceiver thread started");
     while (g_running && g_network.is_connected) {
         PacketHeader* packet = NULL;
-        int res = network_receive_packet(&g_network, &packet);
+        PacketTag tag;
+        int res = network_receive_packet(&g_network, &packet, &tag);
         if (res < 0) {
             log_message("ERROR", "Receive failed; stopping receiver thread");
             break;
@@ -96,14 +104,29 @@ static void* receiver_thread(void* arg) {
                 ipc_broadcast_event("focus_warn", NULL);
                 fflush(stdout);
                 break;
-            case MSG_FOCUS_UPDATE:
-                printf("[SERVER] Focus score: %s\n", payload);
-                ipc_broadcast_event("focus_update", payload);
+            case MSG_FOCUS_UPDATE: {
+                int score, frames;
+                if (!(g_network.features & FEAT_BINARY_RESP)) {
+                    printf("[SERVER] Focus score: %s\n", payload);
+                    ipc_broadcast_event("focus_update", payload);
+                } else if (binresp_decode_focus_update(payload, packet->length, &score, &frames) == 0) {
+                    // High-rate push: JSON is only built when a tab will read it
+                    printf("[SERVER] Focus score: %d (frame %d)\n", score, frames);
+                    if (ipc_has_clients()) {
+                        char json[64];
+                        ipc_broadcast_event("focus_update", response_json(packet->type, payload, packet->length,
+                                                                          json, sizeof(json)));
+                    }
+                }
                 break;
-            case MSG_UPDATE_COINS:
-                printf("[SERVER] Coins update: %s\n", payload);
-                ipc_broadcast_event("session_result", payload);
+            }
+            case MSG_UPDATE_COINS: {
+                char json[64];
+                const char* data = response_json(packet->type, payload, packet->length, json, sizeof(json));
+                printf("[SERVER] Coins update: %s\n", data);
+                ipc_broadcast_event("session_result", data);
                 break;
+            }
             case MSG_ERROR: {
                 printf("[SERVER] Error: %s\n", payload);
                 char errbuf[512];
@@ -111,21 +134,18 @@ static void* receiver_thread(void* arg) {
                 ipc_broadcast_event("error", errbuf);
                 break;
             }
+            case MSG_HELLO: {
+                int route = NET_ROUTE_WAIT;
+                network_complete_request(&g_network, tag.request_id, packet->type, payload, packet->length, &route);
+                break;
+            }
             case MSG_LOGIN_RES:
             case MSG_REGISTER_RES:
             case MSG_RES_LEADERBOARD:
             case MSG_RES_PROFILE: {
-                // Lưu phản hồi vào cache và báo thức cho thread chính
-                pthread_mutex_lock(&g_resp.mtx);
-                g_resp.type = packet->type;
-                g_resp.length = packet->length;
-                size_t copy_len = (size_t)packet->length;
-                if (copy_len >= sizeof(g_resp.data)) copy_len = sizeof(g_resp.data)-1;
-                memcpy(g_resp.data, payload, copy_len);
-                g_resp.data[copy_len] = '\0';
-                g_resp.ready = 1;
-                pthread_cond_signal(&g_resp.cv);
-                pthread_mutex_unlock(&g_resp.mtx);
+                // Đánh thức request đang chờ (menu) hoặc lấy tab IPC đã gửi request
+                int route = NET_ROUTE_WAIT;
+                network_complete_request(&g_network, tag.request_id, packet->type, payload, packet->length, &route);
 
                 if (packet->type == MSG_LOGIN_RES) {
                     if (strcmp(payload, RESPONSE_OK) == 0) ipc_broadcast_event("login_ok", "\"ok\"");
@@ -139,13 +159,29 @@ static void* receiver_thread(void* arg) {
                         char errbuf[256]; snprintf(errbuf, sizeof(errbuf), "{\"message\":\"%s\"}", payload);
                         ipc_broadcast_event("error", errbuf);
                     }
-                } else if (packet->type == MSG_RES_LEADERBOARD) {
-                    ipc_broadcast_event("leaderboard", payload);
-                } else if (packet->type == MSG_RES_PROFILE) {
-                    ipc_broadcast_event("profile", payload);
+                } else if (ipc_has_clients()) {
+                    char json[2048];
+                    const char* data = response_json(packet->type, payload, packet->length, json, sizeof(json));
+                    ipc_send_event(route, packet->type == MSG_RES_LEADERBOARD ? "leaderboard" : "profile", data);
                 }
                 break;
             }
+            case MSG_RATE_HINT: {
+                RateHintPayload hint;
+                if (network_rate_hint(&g_network, payload, packet->length) < 0) break;
+                memcpy(&hint, payload, sizeof(hint));
+                printf("[SERVER] Rate hint: 1 frame / %u ms, <= %u bytes\n", hint.interval_ms, hint.max_frame);
+                char json[96];
+                snprintf(json, sizeof(json), "{\"interval_ms\":%u,\"max_frame\":%u}", hint.interval_ms, hint.max_frame);
+                ipc_broadcast_event("rate_hint", json);
+                break;
+            }
+            case MSG_PING:
+                // Heartbeat: server đóng kết nối nếu không nhận được gì trong idle timeout
+                network_send_packet(&g_network, MSG_PONG, NULL, 0);
+                break;
+            case MSG_PONG:
+                break;
             default:
                 printf("[SERVER] Unhandled message type: %d (%d bytes)\n", packet->type, packet->length);
                 break;
@@ -159,10 +195,6 @@ static void* receiver_thread(void* arg) {
 int main() {
     log_message("INFO", "=== FocusApp Client (Console) ===");
 
-    // Khởi tạo cache phản hồi
-    pthread_mutex_init(&g_resp.mtx, NULL);
-    pthread_cond_init(&g_resp.cv, NULL);
-
     if (network_init(&g_network) != 0) {
         log_message("ERROR", "Network init failed");
         return 1;
@@ -188,6 +220,7 @@ int main() {
         return 1;
     }
     pthread_detach(th);
+    network_hello(&g_network, CLIENT_HELLO_TIMEOUT_MS);
 
     char input[1024];
     int choice = -1;
@@ -203,49 +236,36 @@ int main() {
             char user[128], pass[128];
             printf("Username: "); fflush(stdout); if (!read_line(user, sizeof(user))) continue;
             printf("Password: "); fflush(stdout); if (!read_line(pass, sizeof(pass))) continue;
-            if (send_login(&g_network, user, pass) < 0) {
+            int id = send_login(&g_network, user, pass, NET_ROUTE_WAIT);
+            if (id < 0) {
                 printf("Send login failed\n");
                 continue;
             }
-            // Chờ phản hồi từ receiver_thread qua cache (timeout ~3s)
-            struct timespec ts; clock_gettime(CLOCK_REALTIME, &ts);
-            ts.tv_sec += 3;
-            int got = 0;
-            pthread_mutex_lock(&g_resp.mtx);
-            while (!g_resp.ready) {
-                if (pthread_cond_timedwait(&g_resp.cv, &g_resp.mtx, &ts) == ETIMEDOUT) break;
-            }
-            if (g_resp.ready && g_resp.type == MSG_LOGIN_RES) {
-                got = 1;
-                if (strcmp(g_resp.data, RESPONSE_OK) == 0) {
+            // Chờ receiver_thread ghép phản hồi về request này (timeout ~3s)
+            NetResponse resp;
+            if (await_response(id, MSG_LOGIN_RES, &resp)) {
+                if (strcmp(resp.data, RESPONSE_OK) == 0) {
                     snprintf(g_network.username, sizeof(g_network.username), "%.49s", user);
                     printf("Login successful as %s\n", user);
                 } else {
-                    printf("Login failed: %s\n", g_resp.data);
+                    printf("Login failed: %s\n", resp.data);
                 }
+            } else {
+                printf("No/invalid response to login\n");
             }
-            g_resp.ready = 0;
-            pthread_mutex_unlock(&g_resp.mtx);
-            if (!got) printf("No/invalid response to login\n");
         } else if (choice == 2) {
             char user[128], pass[128];
             printf("Username: "); fflush(stdout); if (!read_line(user, sizeof(user))) continue;
             printf("Password: "); fflush(stdout); if (!read_line(pass, sizeof(pass))) continue;
-            if (send_register(&g_network, user, pass) < 0) { printf("Send register failed\n"); continue; }
-            struct timespec ts2; clock_gettime(CLOCK_REALTIME, &ts2); ts2.tv_sec += 3;
-            int got2 = 0;
-            pthread_mutex_lock(&g_resp.mtx);
-            while (!g_resp.ready) {
-                if (pthread_cond_timedwait(&g_resp.cv, &g_resp.mtx, &ts2) == ETIMEDOUT) break;
-            }
-            if (g_resp.ready && g_resp.type == MSG_REGISTER_RES) {
-                got2 = 1;
-                if (strcmp(g_resp.data, RESPONSE_OK) == 0) printf("Register successful\n");
-                else printf("Register failed: %s\n", g_resp.data);
+            int id = send_register(&g_network, user, pass, NET_ROUTE_WAIT);
+            if (id < 0) { printf("Send register failed\n"); continue; }
+            NetResponse resp;
+            if (await_response(id, MSG_REGISTER_RES, &resp)) {
+                if (strcmp(resp.data, RESPONSE_OK) == 0) printf("Register successful\n");
+                else printf("Register failed: %s\n", resp.data);
+            } else {
+                printf("No/invalid response to register\n");
             }
-            g_resp.ready = 0;
-            pthread_mutex_unlock(&g_resp.mtx);
-            if (!got2) printf("No/invalid response to register\n");
         } else if (choice == 3) {
             if (send_start_session(&g_network) == 0) printf("Session started\n");
             else printf("Start session failed\n");
@@ -254,8 +274,12 @@ int main() {
             printf("Image path (JPEG/PNG): "); fflush(stdout); if (!read_line(path, sizeof(path))) continue;
             unsigned char* file_buf = NULL; size_t file_len = 0;
             if (load_file(path, &file_buf, &file_len) != 0) { printf("Failed to read file\n"); continue; }
-            if (send_stream_frame_bytes(&g_network, file_buf, (int)file_len) == 0) {
+            int rc = send_stream_frame_bytes(&g_network, file_buf, (int)file_len);
+            if (rc == 0) {
                 printf("Frame sent (binary %zu bytes)\n", file_len);
+            } else if (rc > 0) {
+                printf("Frame skipped: server asked for 1 frame / %u ms, <= %u bytes\n",
+                       g_network.rate_interval_ms, g_network.rate_max_frame);
             } else {
                 printf("Send frame failed\n");
             }
@@ -264,35 +288,25 @@ int main() {
             if (send_end_session(&g_network) == 0) printf("Session ended (await server stats in push)\n");
             else printf("End session failed\n");
         } else if (choice == 6) {
-            if (send_get_leaderboard(&g_network) < 0) { printf("Send failed\n"); continue; }
-            struct timespec ts3; clock_gettime(CLOCK_REALTIME, &ts3); ts3.tv_sec += 3;
-            int got3 = 0;
-            pthread_mutex_lock(&g_resp.mtx);
-            while (!g_resp.ready) {
-                if (pthread_cond_timedwait(&g_resp.cv, &g_resp.mtx, &ts3) == ETIMEDOUT) break;
-            }
-            if (g_resp.ready && g_resp.type == MSG_RES_LEADERBOARD) {
-                got3 = 1;
-                printf("Leaderboard: %s\n", g_resp.data);
+            int id = send_get_leaderboard(&g_network, NET_ROUTE_WAIT);
+            if (id < 0) { printf("Send failed\n"); continue; }
+            NetResponse resp;
+            char json[2048];
+            if (await_response(id, MSG_RES_LEADERBOARD, &resp)) {
+                printf("Leaderboard: %s\n", response_json(resp.type, resp.data, resp.length, json, sizeof(json)));
+            } else {
+                printf("No/invalid response to get_leaderboard\n");
             }
-            g_resp.ready = 0;
-            pthread_mutex_unlock(&g_resp.mtx);
-            if (!got3) printf("No/invalid response to get_leaderboard\n");
         } else if (choice == 7) {
-            if (send_get_profile(&g_network) < 0) { printf("Send failed\n"); continue; }
-            struct timespec ts4; clock_gettime(CLOCK_REALTIME, &ts4); ts4.tv_sec += 3;
-            int got4 = 0;
-            pthread_mutex_lock(&g_resp.mtx);
-            while (!g_resp.ready) {
-                if (pthread_cond_timedwait(&g_resp.cv, &g_resp.mtx, &ts4) == ETIMEDOUT) break;
-            }
-            if (g_resp.ready && g_resp.type == MSG_RES_PROFILE) {
-                got4 = 1;
-                printf("Profile: %s\n", g_resp.data);
+            int id = send_get_profile(&g_network, NET_ROUTE_WAIT);
+            if (id < 0) { printf("Send failed\n"); continue; }
+            NetResponse resp;
+            char json[512];
+            if (await_response(id, MSG_RES_PROFILE, &resp)) {
+                printf("Profile: %s\n", response_json(resp.type, resp.data, resp.length, json, sizeof(json)));
+            } else {
+                printf("No/invalid response to get_profile\n");
             }
-            g_resp.ready = 0;
-            pthread_mutex_unlock(&g_resp.mtx);
-            if (!got4) printf("No/invalid response to get_profile\n");
         } else {
             printf("Unknown choice\n");
         }
@@ -301,8 +315,6 @@ int main() {
     g_running = 0;
     ipc_stop();
     network_close(&g_network);
-    pthread_mutex_destroy(&g_resp.mtx);
-    pthread_cond_destroy(&g_resp.cv);
     log_message("INFO", "Client exited");
     return 0;
 }
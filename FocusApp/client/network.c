@@ -1,13 +1,51 @@
+#define _GNU_SOURCE
 /*
  * Mục đích: Cài đặt lớp giao tiếp mạng của Client bằng POSIX sockets (Linux/WSL).
- *  - Định dạng gói tin TLV: header 8 byte (int32 type, int32 length) + payload.
+ *  - Định dạng gói tin TLV: header 8 byte (int32 type, int32 length) + payload; khi bật header mở
+ *    rộng thì thêm PacketTag (request_id + flags) ngay sau, đánh dấu bằng bit MSG_EXT_HEADER.
  *  - Xử lý gửi/nhận an toàn (loop đến khi đủ byte), validate kích thước payload.
+ *  - Gửi được gọi từ nhiều thread (menu, IPC, receiver trả MSG_PONG) nên có mutex
+ *    để các gói không đan xen nhau trên socket.
+ *  - Bảng request đang chờ (CLIENT_MAX_PENDING ô, mỗi ô 1 condvar riêng): menu console và các
+ *    tab IPC có thể cùng có request đang bay; receiver ghép phản hồi theo request_id. Server
+ *    không gắn tag (header mở rộng tắt) thì phản hồi được ghép với request cũ nhất đang chờ,
+ *    đúng vì server trả lời theo thứ tự nhận.
+ *  - Gom batch (batch_window_ms > 0): gói nhỏ (login, profile, leaderboard...) được chép vào
+ *    buffer chung thay vì gửi ngay; thread batch gửi cả buffer khi hết cửa sổ tính từ gói đầu
+ *    tiên, bọc trong 1 MSG_TLV_BATCH nếu có từ 2 gói. Gói lớn (frame ảnh) đẩy batch đang chờ đi
+ *    trước rồi mới gửi để giữ đúng thứ tự. Buffer dùng chung g_send_mtx với đường gửi thường.
+ *  - Frame ảnh (FEAT_FRAME_CHUNK): send_stream_frame_bytes chép frame vào hàng đợi tải rồi trả về
+ *    ngay; thread upload cắt frame thành MSG_FRAME_CHUNK (FRAME_CHUNK_SIZE byte), xen kẽ tối đa
+ *    FRAME_UPLOAD_STREAMS frame, và nhường socket cho gói điều khiển giữa 2 đoạn bất kỳ (bộ đếm
+ *    g_ctrl_waiting): login/end session/PONG chờ tối đa 1 đoạn thay vì cả frame 2MB.
+ *  - Kênh UDP (FEAT_UDP_FRAMES, đề nghị khi CLIENT_UDP_FRAMES / FOCUS_UDP=on): socket UDP mở sẵn
+ *    lúc kết nối (receiver đã poll nó trước khi MSG_HELLO xong) và connect tới server khi được cấp
+ *    token. Frame <= max_frame được cắt thành datagram UdpFrameHeader + mảnh, gửi theo lô bằng
+ *    sendmmsg ngay trên thread gọi; mất mảnh thì server bỏ frame, không gửi lại. Receiver poll cả 2
+ *    socket và trả datagram phản hồi như 1 gói TLV đẩy từ server. Server báo cổng UDP đóng
+ *    (ECONNREFUSED) thì quay về gửi frame qua TCP.
+ *  - Transport cục bộ (server cùng máy, host loopback, CLIENT_SHM_TRANSPORT / FOCUS_SHM=off để tắt):
+ *    kết nối Unix socket của server, tạo ring bộ nhớ chia sẻ (shmring.h) và chuyển fd qua
+ *    SCM_RIGHTS. Mọi gói gửi đi được ghi thẳng header + payload vào ring (không malloc/chép tạm,
+ *    không qua TCP loopback); phản hồi vẫn nhận trên Unix socket như TCP. Server không có socket
+ *    cục bộ hoặc từ chối ring thì dùng TCP như cũ.
+ *  - Nhịp frame (FEAT_RATE_HINT, đề nghị khi CLIENT_RATE_HINT / FOCUS_RATE_HINT=off để tắt): receiver
+ *    gọi network_rate_hint khi server đẩy MSG_RATE_HINT; send_stream_frame_bytes bỏ frame đến sớm hơn
+ *    interval_ms kể từ frame gửi trước hoặc lớn hơn max_frame (trả 1) trước khi tốn công gửi.
+ *  - MSG_TLV_BATCH nhận về được giữ lại và trả từng bản ghi bên trong cho receiver.
+ *  - MSG_HELLO: client đề nghị FEAT_* theo cấu hình, chỉ dùng những gì server bật (batch chỉ gom
+ *    khi có FEAT_BATCH). Payload có PKT_FLAG_DEFLATE được giải nén ngay khi nhận, trước khi tách
+ *    batch; bộ giải nén giữ context giữa các gói như bộ nén phía server.
  *
  * Hàm chính:
  * - network_init(state): Khởi tạo biến trạng thái.
  * - network_connect(state, host, port): Tạo socket, kết nối TCP.
  * - network_send_packet(state, type, payload, length): Gửi gói tin (header + payload).
- * - network_receive_packet(state, **packet): Nhận đầy đủ 1 gói (cấp phát bộ nhớ cho caller).
+ * - network_receive_packet(state, **packet, tag): Nhận đầy đủ 1 gói (cấp phát bộ nhớ cho caller),
+ *   tách MSG_TLV_BATCH thành từng gói.
+ * - network_send_request/network_wait_response/network_complete_request: Bảng request đang chờ.
+ * - network_hello(state, timeout_ms): Thương lượng version/tính năng với server.
+ * - network_rate_hint(state, payload, length): Áp dụng MSG_RATE_HINT.
  * - network_close(state): Đóng socket và đánh dấu ngắt kết nối.
  *
  * Helper (giao thức nghiệp vụ):
@@ -19,109 +57,812 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/un.h>
+#include <sys/time.h>
 #include "network.h"
 #include "../common/protocol.h"
 #include "../common/config.h"
+#include "../common/wsdeflate.h"
+#include "../common/shmring.h"
 
 extern void log_message(const char* level, const char* format, ...);
 
+static pthread_mutex_t g_send_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+// Outstanding request (id == 0: free slot)
+typedef struct {
+    uint32_t id;
+    int route;              // NET_ROUTE_WAIT or caller-defined routing key
+    int done;               // reply stored in resp, waiter not woken yet
+    unsigned long seq;      // send order, for untagged replies
+    pthread_cond_t cv;
+    NetResponse resp;
+} PendingRequest;
+
+// Coalesced outgoing records; data keeps HEADER_EXT_SIZE bytes of headroom for the envelope
+typedef struct {
+    char* data;
+    size_t len;             // bytes of records after the headroom
+    size_t cap;
+    int count;
+    struct timespec deadline;
+} OutBatch;
+
+// MSG_TLV_BATCH being handed out record by record (receiver thread only)
+typedef struct {
+    char* data;
+    size_t pos;
+    size_t end;
+} InBatch;
+
+static OutBatch g_out_batch;
+static pthread_cond_t g_batch_cv = PTHREAD_COND_INITIALIZER;
+static pthread_t g_batch_thread;
+static int g_batch_running = 0;
+static InBatch g_in_batch;
+
+// Frame queued for chunked upload (FEAT_FRAME_CHUNK)
+typedef struct UploadJob {
+    struct UploadJob* next;
+    uint32_t stream_id;
+    uint32_t sent;
+    uint32_t total;
+    char data[];
+} UploadJob;
+
+static UploadJob* g_upload_head = NULL;
+static UploadJob* g_upload_tail = NULL;
+static int g_upload_queued = 0;
+static int g_upload_running = 0;
+static pthread_t g_upload_thread;
+static pthread_mutex_t g_upload_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_upload_cv = PTHREAD_COND_INITIALIZER;
+static uint32_t g_next_stream_id = 0;
+static int g_chunk_size = FRAME_CHUNK_SIZE;
+static int g_ctrl_waiting = 0;      // control senders blocked on g_send_mtx (atomic)
+
+static PendingRequest g_pending[CLIENT_MAX_PENDING];
+static pthread_mutex_t g_pending_mtx = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t g_next_request_id = 0;
+static unsigned long g_pending_seq = 0;
+
+static void* batch_thread(void* arg);
+static int network_receive_one(NetworkState* state, PacketHeader** packet, PacketTag* tag);
+
 // Initialize network (POSIX)
 int network_init(NetworkState* state) {
     state->socket_fd = -1;
     state->is_connected = 0;
     memset(state->username, 0, sizeof(state->username));
     state->user_id = -1;
+    state->ext_header = CLIENT_EXT_HEADER;
+    const char* v = getenv("FOCUS_EXT_HEADER");
+    if (v) state->ext_header = strcmp(v, "off") != 0;
+    state->batch_window_ms = CLIENT_BATCH_WINDOW_MS;
+    v = getenv("FOCUS_BATCH_WINDOW_MS");
+    if (v) state->batch_window_ms = atoi(v) > 0 ? atoi(v) : 0;
+    state->proto_version = 0;
+    state->frame_codec = FRAME_CODEC_RAW;
+    state->features = 0;
+    state->inflater = NULL;
+    state->ring = NULL;
+    state->udp_fd = -1;
+    state->udp_token = 0;
+    state->udp_seq = 0;
+    state->udp_frag_size = UDP_FRAGMENT_SIZE;
+    state->udp_max_frame = 0;
+    state->rate_interval_ms = 0;
+    state->rate_max_frame = 0;
+    state->rate_last_ms = 0;
+    state->rate_skipped = 0;
+    for (int i = 0; i < CLIENT_MAX_PENDING; ++i) {
+        memset(&g_pending[i], 0, sizeof(g_pending[i]));
+        pthread_cond_init(&g_pending[i].cv, NULL);
+    }
     
     log_message("INFO", "Network initialized");
     return 0;
 }
 
-// Connect to server
-int network_connect(NetworkState* state, const char* host, int port) {
-    struct sockaddr_in server_addr;
-    
-    // Create socket
-    state->socket_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (state->socket_fd < 0) {
-        log_message("ERROR", "Socket creation failed");
+// Same-host server: hand it a shared-memory ring over its Unix socket (see server/shm.h).
+// Returns 0 with state->socket_fd / state->ring set, -1 to fall back to TCP.
+static int network_connect_local(NetworkState* state) {
+    const char* path = getenv("FOCUS_SHM_SOCKET");
+    if (!path) path = SHM_SOCKET_PATH;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        log_message("DEBUG", "No local transport at %s: %s", path, strerror(errno));
+        close(fd);
         return -1;
     }
-    
-    // Setup server address
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(port);
-    
-    if (inet_pton(AF_INET, host, &server_addr.sin_addr) <= 0) {
-        log_message("ERROR", "Invalid address: %s", host);
-        close(state->socket_fd);
+
+    ShmRing* ring = (ShmRing*)malloc(sizeof(ShmRing));
+    if (!ring || shm_ring_create(ring, SHM_RING_SIZE) < 0) {
+        log_message("WARN", "Cannot create shared-memory ring: %s", strerror(errno));
+        free(ring);
+        close(fd);
         return -1;
     }
-    
-    // Connect
-    if (connect(state->socket_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        log_message("ERROR", "Connection failed to %s:%d", host, port);
-        close(state->socket_fd);
+    ShmRingSetup setup = { SHM_RING_MAGIC, ring->size };
+    int fds[3] = { ring->memfd, ring->data_efd, ring->space_efd };
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } ctrl;
+    memset(&ctrl, 0, sizeof(ctrl));
+    struct iovec iov = { &setup, sizeof(setup) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+    struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(c), fds, sizeof(fds));
+
+    // The server echoes the setup once the ring is mapped
+    struct timeval tv = { CLIENT_HELLO_TIMEOUT_MS / 1000, (CLIENT_HELLO_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    ShmRingSetup ack;
+    int ok = sendmsg(fd, &msg, 0) == (ssize_t)sizeof(setup) &&
+             recv(fd, &ack, sizeof(ack), MSG_WAITALL) == (ssize_t)sizeof(ack) &&
+             ack.magic == setup.magic && ack.size == setup.size;
+    tv.tv_sec = tv.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (!ok) {
+        log_message("WARN", "Local transport at %s refused the ring, using TCP", path);
+        shm_ring_close(ring);
+        free(ring);
+        close(fd);
         return -1;
     }
-    
-    state->is_connected = 1;
-    log_message("INFO", "Connected to server %s:%d", host, port);
+    state->socket_fd = fd;
+    state->ring = ring;
     return 0;
 }
 
-// Send packet with header
-int network_send_packet(NetworkState* state, int type, const char* payload, int length) {
+static int host_is_loopback(const char* host) {
+    return strcmp(host, "localhost") == 0 || strncmp(host, "127.", 4) == 0;
+}
+
+// Connect to server
+int network_connect(NetworkState* state, const char* host, int port) {
+    const char* shm = getenv("FOCUS_SHM");
+    if (CLIENT_SHM_TRANSPORT && !(shm && strcmp(shm, "off") == 0) && host_is_loopback(host) &&
+        network_connect_local(state) == 0) {
+        state->is_connected = 1;
+        log_message("INFO", "Connected to local server through a %u-byte shared-memory ring", state->ring->size);
+    } else {
+        struct sockaddr_in server_addr;
+
+        // Create socket
+        state->socket_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (state->socket_fd < 0) {
+            log_message("ERROR", "Socket creation failed");
+            return -1;
+        }
+
+        // Setup server address
+        memset(&server_addr, 0, sizeof(server_addr));
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_port = htons(port);
+
+        if (inet_pton(AF_INET, host, &server_addr.sin_addr) <= 0) {
+            log_message("ERROR", "Invalid address: %s", host);
+            close(state->socket_fd);
+            return -1;
+        }
+
+        // Connect
+        if (connect(state->socket_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+            log_message("ERROR", "Connection failed to %s:%d", host, port);
+            close(state->socket_fd);
+            return -1;
+        }
+
+        state->is_connected = 1;
+        log_message("INFO", "Connected to server %s:%d", host, port);
+    }
+    const char* udp = getenv("FOCUS_UDP");
+    if (!state->ring && (udp ? strcmp(udp, "on") == 0 : CLIENT_UDP_FRAMES)) {
+        // Opened now so the receiver polls it from its first packet; connected once a token is granted
+        state->udp_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (state->udp_fd < 0) log_message("WARN", "UDP socket: %s", strerror(errno));
+    }
+    // Coalescing only saves syscalls, which the shared-memory ring does not make
+    if (state->batch_window_ms > 0 && !state->ring && !g_batch_running) {
+        if (pthread_create(&g_batch_thread, NULL, batch_thread, state) == 0) {
+            g_batch_running = 1;
+            log_message("INFO", "Coalescing requests within %d ms", state->batch_window_ms);
+        } else {
+            log_message("WARN", "Cannot start batch thread, sending requests one by one");
+            state->batch_window_ms = 0;
+        }
+    }
+    return 0;
+}
+
+// Caller holds g_send_mtx
+static int send_all_locked(NetworkState* state, const char* data, size_t len) {
+    if (state->ring) return shm_ring_write(state->ring, data, len, NULL, 0, SEND_TIMEOUT_MS);
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t n = send(state->socket_fd, data + sent, len - sent, 0);
+        if (n <= 0) {
+            log_message("ERROR", "Send failed");
+            return -1;
+        }
+        sent += (size_t)n;
+    }
+    return 0;
+}
+
+// Send whatever is coalesced: a lone record as is, several inside one MSG_TLV_BATCH.
+// Caller holds g_send_mtx.
+static int batch_flush_locked(NetworkState* state) {
+    OutBatch* b = &g_out_batch;
+    if (b->count == 0) return 0;
+    char* start = b->data + HEADER_EXT_SIZE;
+    size_t len = b->len;
+    if (b->count > 1) {
+        PacketHeaderExt header;
+        size_t header_size = state->ext_header ? HEADER_EXT_SIZE : HEADER_SIZE;
+        header.type = state->ext_header ? (MSG_TLV_BATCH | MSG_EXT_HEADER) : MSG_TLV_BATCH;
+        header.length = (int32_t)b->len;
+        header.tag.request_id = 0;
+        header.tag.flags = 0;
+        start -= header_size;
+        len += header_size;
+        memcpy(start, &header, header_size);
+    }
+    log_message("DEBUG", "Flushing %d coalesced packet(s), %zu bytes", b->count, len);
+    b->len = 0;
+    b->count = 0;
+    return send_all_locked(state, start, len);
+}
+
+// Caller holds g_send_mtx
+static int batch_append_locked(NetworkState* state, const char* record, size_t len) {
+    OutBatch* b = &g_out_batch;
+    if (b->len + len > CLIENT_BATCH_MAX_BYTES && batch_flush_locked(state) < 0) return -1;
+    size_t need = HEADER_EXT_SIZE + b->len + len;
+    if (b->cap < need) {
+        size_t cap = b->cap ? b->cap : HEADER_EXT_SIZE + CLIENT_BATCH_MAX_BYTES;
+        while (cap < need) cap *= 2;
+        char* data = (char*)realloc(b->data, cap);
+        if (!data) return -1;
+        b->data = data;
+        b->cap = cap;
+    }
+    memcpy(b->data + HEADER_EXT_SIZE + b->len, record, len);
+    b->len += len;
+    if (b->count++ == 0) {
+        clock_gettime(CLOCK_REALTIME, &b->deadline);
+        b->deadline.tv_nsec += (long)state->batch_window_ms * 1000000L;
+        b->deadline.tv_sec += b->deadline.tv_nsec / 1000000000L;
+        b->deadline.tv_nsec %= 1000000000L;
+        pthread_cond_signal(&g_batch_cv);
+    }
+    return 0;
+}
+
+// Control traffic (requests, PONG, batches) announces itself so the upload thread lets it
+// take the socket between two chunks instead of racing it for g_send_mtx
+static void send_lock_control(void) {
+    __atomic_add_fetch(&g_ctrl_waiting, 1, __ATOMIC_ACQ_REL);
+    pthread_mutex_lock(&g_send_mtx);
+    __atomic_sub_fetch(&g_ctrl_waiting, 1, __ATOMIC_ACQ_REL);
+}
+
+static void send_lock_bulk(void) {
+    for (;;) {
+        while (__atomic_load_n(&g_ctrl_waiting, __ATOMIC_ACQUIRE) > 0) sched_yield();
+        pthread_mutex_lock(&g_send_mtx);
+        if (__atomic_load_n(&g_ctrl_waiting, __ATOMIC_ACQUIRE) == 0) return;
+        pthread_mutex_unlock(&g_send_mtx);
+    }
+}
+
+// Sends the coalesced records once the window opened by the first one has passed
+static void* batch_thread(void* arg) {
+    NetworkState* state = (NetworkState*)arg;
+    pthread_mutex_lock(&g_send_mtx);
+    while (state->is_connected) {
+        if (g_out_batch.count == 0) {
+            pthread_cond_wait(&g_batch_cv, &g_send_mtx);
+            continue;
+        }
+        // Sleep without the socket lock, then queue for it like any other control sender
+        struct timespec deadline = g_out_batch.deadline;
+        pthread_mutex_unlock(&g_send_mtx);
+        clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &deadline, NULL);
+        send_lock_control();
+        if (g_out_batch.count == 0) continue;
+        if (g_out_batch.deadline.tv_sec > deadline.tv_sec ||
+            (g_out_batch.deadline.tv_sec == deadline.tv_sec && g_out_batch.deadline.tv_nsec > deadline.tv_nsec)) {
+            continue; // flushed meanwhile, a newer batch has its own window
+        }
+        if (batch_flush_locked(state) < 0) log_message("ERROR", "Sending coalesced requests failed");
+    }
+    pthread_mutex_unlock(&g_send_mtx);
+    return NULL;
+}
+
+// Send packet with header (extended header carrying request_id when enabled)
+static int network_send_tagged(NetworkState* state, int type, const char* payload, int length, uint32_t request_id) {
     if (!state->is_connected) {
         log_message("ERROR", "Not connected to server");
         return -1;
     }
     
+    // Pack header
+    int header_size = state->ext_header ? (int)HEADER_EXT_SIZE : (int)HEADER_SIZE;
+    int total_size = header_size + length;
+    PacketHeaderExt header;
+    header.type = state->ext_header ? (type | MSG_EXT_HEADER) : type;
+    header.length = length;
+    header.tag.request_id = request_id;
+    header.tag.flags = 0;
+
+    if (state->ring) {
+        // Local transport: header and payload are written once, straight into the shared ring
+        send_lock_control();
+        int rc = shm_ring_write(state->ring, &header, (size_t)header_size, payload, payload ? (size_t)length : 0,
+                                SEND_TIMEOUT_MS);
+        pthread_mutex_unlock(&g_send_mtx);
+        if (rc < 0) {
+            log_message("ERROR", "Shared-memory ring full or server gone");
+            return -1;
+        }
+        log_message("DEBUG", "Sent packet type=%d, length=%d, request_id=%u", type, length, request_id);
+        return 0;
+    }
+
     // Allocate buffer for header + payload
-    int total_size = HEADER_SIZE + length;
     char* buffer = (char*)malloc(total_size);
     if (!buffer) {
         log_message("ERROR", "Memory allocation failed");
         return -1;
     }
-    
-    // Pack header
-    PacketHeader* header = (PacketHeader*)buffer;
-    header->type = type;
-    header->length = length;
+    memcpy(buffer, &header, header_size);
     
     // Copy payload
     if (length > 0 && payload) {
-        memcpy(buffer + HEADER_SIZE, payload, length);
+        memcpy(buffer + header_size, payload, length);
     }
     
-    // Send all data
-    int sent = 0;
-    while (sent < total_size) {
-        int n = send(state->socket_fd, buffer + sent, total_size - sent, 0);
-        if (n <= 0) {
-            log_message("ERROR", "Send failed");
-            free(buffer);
-            return -1;
-        }
-        sent += n;
+    // Small packets wait for the batch window; anything else flushes it first to keep order
+    send_lock_control();
+    int rc;
+    if (g_batch_running && (state->features & FEAT_BATCH) && type != MSG_STREAM_FRAME &&
+        total_size <= CLIENT_BATCH_MAX_RECORD) {
+        rc = batch_append_locked(state, buffer, (size_t)total_size);
+    } else {
+        rc = batch_flush_locked(state);
+        if (rc == 0) rc = send_all_locked(state, buffer, (size_t)total_size);
     }
-    
-    log_message("DEBUG", "Sent packet type=%d, length=%d", type, length);
+    pthread_mutex_unlock(&g_send_mtx);
     free(buffer);
+    if (rc < 0) return -1;
+    
+    log_message("DEBUG", "Sent packet type=%d, length=%d, request_id=%u", type, length, request_id);
     return 0; // success
 }
 
-// Receive packet (blocking)
-int network_receive_packet(NetworkState* state, PacketHeader** packet) {
+// One chunk of a queued frame. Called by the upload thread only.
+static int upload_send_chunk(NetworkState* state, UploadJob* job, char* buf) {
+    uint32_t len = job->total - job->sent;
+    if (len > (uint32_t)g_chunk_size) len = (uint32_t)g_chunk_size;
+    FrameChunkHeader ch = { job->stream_id, job->sent, job->total };
+    PacketHeaderExt header;
+    size_t header_size = state->ext_header ? HEADER_EXT_SIZE : HEADER_SIZE;
+    header.type = state->ext_header ? (MSG_FRAME_CHUNK | MSG_EXT_HEADER) : MSG_FRAME_CHUNK;
+    header.length = (int32_t)(sizeof(ch) + len);
+    header.tag.request_id = 0;
+    header.tag.flags = 0;
+    memcpy(buf, &header, header_size);
+    memcpy(buf + header_size, &ch, sizeof(ch));
+    memcpy(buf + header_size + sizeof(ch), job->data + job->sent, len);
+
+    send_lock_bulk();
+    int rc = state->is_connected ? send_all_locked(state, buf, header_size + sizeof(ch) + len) : -1;
+    pthread_mutex_unlock(&g_send_mtx);
+    job->sent += len;
+    return rc;
+}
+
+// Round-robins chunks of up to FRAME_UPLOAD_STREAMS frames; control packets get the socket
+// between any two chunks
+static void* upload_thread(void* arg) {
+    NetworkState* state = (NetworkState*)arg;
+    UploadJob* active[FRAME_UPLOAD_STREAMS];
+    int nactive = 0;
+    int next = 0;
+    char* buf = (char*)malloc(HEADER_EXT_SIZE + sizeof(FrameChunkHeader) + (size_t)g_chunk_size);
+    if (!buf) {
+        log_message("ERROR", "Upload thread out of memory");
+        return NULL;
+    }
+    for (;;) {
+        pthread_mutex_lock(&g_upload_mtx);
+        while (g_upload_running && nactive == 0 && !g_upload_head) pthread_cond_wait(&g_upload_cv, &g_upload_mtx);
+        if (!g_upload_running) {
+            pthread_mutex_unlock(&g_upload_mtx);
+            break;
+        }
+        while (nactive < FRAME_UPLOAD_STREAMS && g_upload_head) {
+            active[nactive++] = g_upload_head;
+            g_upload_head = g_upload_head->next;
+            if (!g_upload_head) g_upload_tail = NULL;
+            g_upload_queued--;
+            pthread_cond_broadcast(&g_upload_cv); // room for a waiting producer
+        }
+        pthread_mutex_unlock(&g_upload_mtx);
+
+        if (next >= nactive) next = 0;
+        UploadJob* job = active[next];
+        int rc = upload_send_chunk(state, job, buf);
+        if (rc < 0) log_message("ERROR", "Upload of frame stream %u failed", job->stream_id);
+        if (rc < 0 || job->sent == job->total) {
+            free(job);
+            active[next] = active[--nactive];
+        } else {
+            next++;
+        }
+    }
+    for (int i = 0; i < nactive; ++i) free(active[i]);
+    free(buf);
+    return NULL;
+}
+
+// Queue a frame for chunked upload; blocks while CLIENT_UPLOAD_QUEUE frames are waiting
+static int network_upload_frame(NetworkState* state, const void* data, int len) {
+    UploadJob* job = (UploadJob*)malloc(sizeof(UploadJob) + (size_t)len);
+    if (!job) {
+        log_message("ERROR", "Memory allocation failed");
+        return -1;
+    }
+    memcpy(job->data, data, (size_t)len);
+    job->next = NULL;
+    job->sent = 0;
+    job->total = (uint32_t)len;
+
+    pthread_mutex_lock(&g_upload_mtx);
+    if (!g_upload_running) {
+        const char* v = getenv("FOCUS_FRAME_CHUNK");
+        if (v && atoi(v) >= 1024) g_chunk_size = atoi(v);
+        if (pthread_create(&g_upload_thread, NULL, upload_thread, state) != 0) {
+            pthread_mutex_unlock(&g_upload_mtx);
+            free(job);
+            log_message("ERROR", "Cannot start upload thread");
+            return -1;
+        }
+        g_upload_running = 1;
+    }
+    while (g_upload_running && g_upload_queued >= CLIENT_UPLOAD_QUEUE) pthread_cond_wait(&g_upload_cv, &g_upload_mtx);
+    if (!g_upload_running) {
+        pthread_mutex_unlock(&g_upload_mtx);
+        free(job);
+        return -1;
+    }
+    if (++g_next_stream_id == 0) g_next_stream_id = 1;
+    job->stream_id = g_next_stream_id;
+    if (g_upload_tail) g_upload_tail->next = job;
+    else g_upload_head = job;
+    g_upload_tail = job;
+    g_upload_queued++;
+    pthread_cond_broadcast(&g_upload_cv);
+    pthread_mutex_unlock(&g_upload_mtx);
+    return 0;
+}
+
+// Send one frame as UDP datagrams. Loss is not reported: the server drops incomplete frames.
+static int network_udp_frame(NetworkState* state, const void* data, int len) {
+    UdpFrameHeader hdrs[UDP_SEND_BATCH];
+    struct iovec iov[UDP_SEND_BATCH][2];
+    struct mmsghdr msgs[UDP_SEND_BATCH];
+    uint32_t seq = __atomic_add_fetch(&state->udp_seq, 1, __ATOMIC_RELAXED);
+    uint32_t frag_size = (uint32_t)state->udp_frag_size;
+    uint32_t count = ((uint32_t)len + frag_size - 1) / frag_size;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (uint32_t first = 0; first < count; first += UDP_SEND_BATCH) {
+        int n = count - first < UDP_SEND_BATCH ? (int)(count - first) : UDP_SEND_BATCH;
+        for (int i = 0; i < n; ++i) {
+            uint32_t frag = first + (uint32_t)i;
+            uint32_t offset = frag * frag_size;
+            hdrs[i].token = state->udp_token;
+            hdrs[i].seq = seq;
+            hdrs[i].total = (uint32_t)len;
+            hdrs[i].frag = (uint16_t)frag;
+            hdrs[i].frag_size = (uint16_t)frag_size;
+            hdrs[i].flags = 0;
+            iov[i][0].iov_base = &hdrs[i];
+            iov[i][0].iov_len = sizeof(hdrs[i]);
+            iov[i][1].iov_base = (char*)data + offset;
+            iov[i][1].iov_len = (uint32_t)len - offset < frag_size ? (uint32_t)len - offset : frag_size;
+            msgs[i].msg_hdr.msg_iov = iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 2;
+        }
+        for (int sent = 0; sent < n;) {
+            int r = sendmmsg(state->udp_fd, msgs + sent, (unsigned int)(n - sent), 0);
+            if (r < 0 && errno == EINTR) continue;
+            if (r < 0 && errno == ECONNREFUSED) {
+                log_message("WARN", "Server UDP port closed, sending frames over TCP");
+                __atomic_store_n(&state->udp_token, 0, __ATOMIC_RELAXED);
+                return network_send_packet(state, MSG_STREAM_FRAME, (const char*)data, len);
+            }
+            if (r < 0) {
+                log_message("DEBUG", "UDP frame %u dropped: %s", seq, strerror(errno));
+                return 0;
+            }
+            sent += r;
+        }
+    }
+    return 0;
+}
+
+int network_send_packet(NetworkState* state, int type, const char* payload, int length) {
+    return network_send_tagged(state, type, payload, length, 0);
+}
+
+static PendingRequest* pending_find(uint32_t id) {
+    for (int i = 0; i < CLIENT_MAX_PENDING; ++i) {
+        if (g_pending[i].id == id) return &g_pending[i];
+    }
+    return NULL;
+}
+
+// Oldest request still waiting for its reply; only_routed skips ones a thread blocks on
+static PendingRequest* pending_oldest(int only_routed) {
+    PendingRequest* best = NULL;
+    for (int i = 0; i < CLIENT_MAX_PENDING; ++i) {
+        PendingRequest* p = &g_pending[i];
+        if (p->id == 0 || p->done) continue;
+        if (only_routed && p->route == NET_ROUTE_WAIT) continue;
+        if (!best || p->seq < best->seq) best = p;
+    }
+    return best;
+}
+
+int network_send_request(NetworkState* state, int type, const char* payload, int length, int route) {
+    pthread_mutex_lock(&g_pending_mtx);
+    PendingRequest* slot = pending_find(0);
+    if (!slot) {
+        // Table full: the oldest routed request has waited longest for a reply that may never
+        // come (reconnect, server dropped it); nobody blocks on it, so reuse its slot
+        slot = pending_oldest(1);
+        if (slot) log_message("WARN", "Pending table full, forgetting request %u", slot->id);
+    }
+    if (!slot) {
+        pthread_mutex_unlock(&g_pending_mtx);
+        log_message("ERROR", "Too many outstanding requests");
+        return -1;
+    }
+    if (++g_next_request_id == 0) g_next_request_id = 1;
+    uint32_t id = g_next_request_id;
+    slot->id = id;
+    slot->route = route;
+    slot->done = 0;
+    slot->seq = ++g_pending_seq;
+    pthread_mutex_unlock(&g_pending_mtx);
+
+    // Registered before sending so a fast reply always finds its slot
+    if (network_send_tagged(state, type, payload, length, id) < 0) {
+        pthread_mutex_lock(&g_pending_mtx);
+        if (slot->id == id) slot->id = 0;
+        pthread_mutex_unlock(&g_pending_mtx);
+        return -1;
+    }
+    return (int)id;
+}
+
+int network_wait_response(NetworkState* state, int request_id, int timeout_ms, NetResponse* resp) {
+    (void)state;
+    if (request_id <= 0) return 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) { ts.tv_sec++; ts.tv_nsec -= 1000000000L; }
+
+    pthread_mutex_lock(&g_pending_mtx);
+    PendingRequest* slot = pending_find((uint32_t)request_id);
+    int got = 0;
+    if (slot) {
+        while (!slot->done) {
+            if (pthread_cond_timedwait(&slot->cv, &g_pending_mtx, &ts) == ETIMEDOUT) break;
+        }
+        got = slot->done;
+        if (got) *resp = slot->resp;
+        slot->id = 0;
+        slot->done = 0;
+    }
+    pthread_mutex_unlock(&g_pending_mtx);
+    return got;
+}
+
+int network_complete_request(NetworkState* state, uint32_t request_id, int type, const char* payload, int length,
+                             int* route) {
+    (void)state;
+    *route = NET_ROUTE_WAIT;
+    pthread_mutex_lock(&g_pending_mtx);
+    PendingRequest* slot = request_id ? pending_find(request_id) : pending_oldest(0);
+    if (!slot || slot->done) {
+        pthread_mutex_unlock(&g_pending_mtx);
+        return 0;
+    }
+    if (slot->route != NET_ROUTE_WAIT) {
+        *route = slot->route;
+        slot->id = 0;
+    } else {
+        size_t n = length > 0 ? (size_t)length : 0;
+        if (n >= sizeof(slot->resp.data)) n = sizeof(slot->resp.data) - 1;
+        slot->resp.type = type;
+        slot->resp.length = length;
+        if (n) memcpy(slot->resp.data, payload, n);
+        slot->resp.data[n] = '\0';
+        slot->done = 1;
+        pthread_cond_signal(&slot->cv);
+    }
+    pthread_mutex_unlock(&g_pending_mtx);
+    return 1;
+}
+
+typedef struct {
+    char* data;             // HEADER_SIZE bytes reserved for the packet header
+    size_t len;
+    size_t cap;
+} InflateBuf;
+
+static int inflate_sink(void* user, const char* data, size_t len) {
+    InflateBuf* b = (InflateBuf*)user;
+    if (b->cap - b->len < len + 1) {
+        size_t cap = b->cap * 2;
+        while (cap - b->len < len + 1) cap *= 2;
+        char* p = (char*)realloc(b->data, cap);
+        if (!p) return -1;
+        b->data = p;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    return 0;
+}
+
+// Replace a PKT_FLAG_DEFLATE packet by its inflated copy; returns the new payload length
+static int inflate_packet(NetworkState* state, PacketHeader** packet) {
+    if (!state->inflater) return -1;
+    PacketHeader* in = *packet;
+    InflateBuf out;
+    out.cap = HEADER_SIZE + (size_t)in->length * 4 + 64;
+    out.len = HEADER_SIZE;
+    out.data = (char*)malloc(out.cap);
+    if (!out.data) return -1;
+    if (ws_inflate(state->inflater, (const char*)in + HEADER_SIZE, (size_t)in->length, 1, inflate_sink, &out) < 0) {
+        free(out.data);
+        return -1;
+    }
+    PacketHeader hdr;
+    hdr.type = in->type;
+    hdr.length = (int32_t)(out.len - HEADER_SIZE);
+    memcpy(out.data, &hdr, HEADER_SIZE);
+    out.data[out.len] = '\0';
+    free(in);
+    *packet = (PacketHeader*)out.data;
+    return hdr.length;
+}
+
+// Next record of the MSG_TLV_BATCH being unpacked; 0 once it is exhausted
+static int in_batch_next(PacketHeader** packet, PacketTag* tag) {
+    InBatch* b = &g_in_batch;
+    while (b->data && b->pos < b->end) {
+        size_t left = b->end - b->pos;
+        PacketHeader h;
+        PacketTag t = {0, 0};
+        if (left < HEADER_SIZE) break;
+        memcpy(&h, b->data + b->pos, HEADER_SIZE);
+        size_t hsize = PACKET_HEADER_SIZE(h.type);
+        if (h.length < 0 || left < hsize || left - hsize < (size_t)h.length) break;
+        if (hsize > HEADER_SIZE) memcpy(&t, b->data + b->pos + HEADER_SIZE, sizeof(t));
+        h.type = MSG_TYPE(h.type);
+
+        *packet = (PacketHeader*)malloc(HEADER_SIZE + h.length + 1);
+        if (!*packet) break;
+        memcpy(*packet, &h, HEADER_SIZE);
+        memcpy((char*)(*packet) + HEADER_SIZE, b->data + b->pos + hsize, (size_t)h.length);
+        ((char*)(*packet))[HEADER_SIZE + h.length] = '\0';
+        if (tag) *tag = t;
+        b->pos += hsize + (size_t)h.length;
+        return HEADER_SIZE + h.length;
+    }
+    if (b->data && b->pos < b->end) log_message("WARN", "Dropping malformed tail of a batched reply");
+    free(b->data);
+    memset(b, 0, sizeof(*b));
+    return 0;
+}
+
+// Receive packet (blocking); a MSG_TLV_BATCH is handed out one inner record per call
+int network_receive_packet(NetworkState* state, PacketHeader** packet, PacketTag* tag) {
+    for (;;) {
+        int n = in_batch_next(packet, tag);
+        if (n != 0) return n;
+        n = network_receive_one(state, packet, tag);
+        if (n < 0 || (*packet)->type != MSG_TLV_BATCH) return n;
+        g_in_batch.data = (char*)*packet;
+        g_in_batch.pos = HEADER_SIZE;
+        g_in_batch.end = (size_t)n;
+        *packet = NULL;
+    }
+}
+
+// One reply datagram from the UDP channel: a TLV packet with the 8-byte header.
+// Returns its size, or 0 if it was not a valid packet.
+static int udp_receive_one(NetworkState* state, PacketHeader** packet, PacketTag* tag) {
+    char buf[UDP_DATAGRAM_MAX];
+    ssize_t n = recv(state->udp_fd, buf, sizeof(buf), MSG_DONTWAIT);
+    PacketHeader h;
+    if (n < (ssize_t)HEADER_SIZE) return 0;     // ECONNREFUSED etc.: the TCP path reports real failures
+    memcpy(&h, buf, HEADER_SIZE);
+    if (h.length < 0 || (ssize_t)HEADER_SIZE + h.length != n) {
+        log_message("WARN", "Dropping malformed UDP reply (%zd bytes)", n);
+        return 0;
+    }
+    *packet = (PacketHeader*)malloc((size_t)n + 1);
+    if (!*packet) return 0;
+    memcpy(*packet, buf, (size_t)n);
+    ((char*)(*packet))[n] = '\0';
+    if (tag) {
+        tag->request_id = 0;
+        tag->flags = PKT_FLAG_PUSH;
+    }
+    return (int)n;
+}
+
+// Block until the TCP socket is readable (returns 0) or a UDP reply was received (returns its size)
+static int udp_wait(NetworkState* state, PacketHeader** packet, PacketTag* tag) {
+    for (;;) {
+        struct pollfd fds[2] = { { state->socket_fd, POLLIN, 0 }, { state->udp_fd, POLLIN, 0 } };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        if (fds[1].revents & POLLIN) {
+            int n = udp_receive_one(state, packet, tag);
+            if (n > 0) return n;
+        }
+        if (fds[0].revents) return 0;
+        if (fds[1].revents & POLLNVAL) return 0;
+    }
+}
+
+static int network_receive_one(NetworkState* state, PacketHeader** packet, PacketTag* tag) {
     if (!state->is_connected) {
         log_message("ERROR", "Not connected to server");
         return -1;
     }
+    if (state->udp_fd >= 0) {
+        int n = udp_wait(state, packet, tag);
+        if (n > 0) return n;
+    }
     
     // Read header first (8 bytes)
     char header_buf[HEADER_SIZE];
@@ -142,10 +883,26 @@ int network_receive_packet(NetworkState* state, PacketHeader** packet) {
     PacketHeader temp_header;
     memcpy(&temp_header, header_buf, HEADER_SIZE);
     
+    PacketTag temp_tag = {0, 0};
+    if (temp_header.type & MSG_EXT_HEADER) {
+        received = 0;
+        while (received < (int)sizeof(temp_tag)) {
+            int n = recv(state->socket_fd, (char*)&temp_tag + received, (int)sizeof(temp_tag) - received, 0);
+            if (n <= 0) {
+                log_message("ERROR", "Connection closed or error while receiving header");
+                state->is_connected = 0;
+                return -1;
+            }
+            received += n;
+        }
+        temp_header.type = MSG_TYPE(temp_header.type);
+    }
+    if (tag) *tag = temp_tag;
+
     int type = temp_header.type;
     int length = temp_header.length;
     
-    log_message("DEBUG", "Received header: type=%d, length=%d", type, length);
+    log_message("DEBUG", "Received header: type=%d, length=%d, request_id=%u", type, length, temp_tag.request_id);
     
     // Validate length
     if (length < 0 || length > MAX_PAYLOAD_SIZE) {
@@ -182,32 +939,145 @@ int network_receive_packet(NetworkState* state, PacketHeader** packet) {
     }
     // Đặt null-terminator an toàn sau payload để tiện xử lý chuỗi ở caller
     ((char*)(*packet))[HEADER_SIZE + length] = '\0';
+
+    if (temp_tag.flags & PKT_FLAG_DEFLATE) {
+        length = inflate_packet(state, packet);
+        if (length < 0) {
+            log_message("ERROR", "Cannot inflate compressed packet type=%d", type);
+            state->is_connected = 0;
+            return -1;
+        }
+    }
     
     return HEADER_SIZE + length;
 }
 
+int network_hello(NetworkState* state, int timeout_ms) {
+    const char* v = getenv("FOCUS_HELLO");
+    if (!CLIENT_HELLO_ENABLED || (v && strcmp(v, "off") == 0)) return 0;
+
+    HelloPayload hello;
+    hello.version = FOCUS_PROTOCOL_VERSION;
+    hello.frame_codec = FRAME_CODEC_RAW;
+    hello.features = 0;
+    if (state->ext_header) hello.features |= FEAT_EXT_HEADER;
+    if (state->batch_window_ms > 0) hello.features |= FEAT_BATCH;
+    v = getenv("FOCUS_FRAME_CHUNK");
+    if (!(v && strcmp(v, "off") == 0)) hello.features |= FEAT_FRAME_CHUNK;
+    v = getenv("FOCUS_BINARY_RESP");
+    if (CLIENT_BINARY_RESP && !(v && strcmp(v, "off") == 0)) hello.features |= FEAT_BINARY_RESP;
+    if (state->udp_fd >= 0) hello.features |= FEAT_UDP_FRAMES;
+    v = getenv("FOCUS_RATE_HINT");
+    if (CLIENT_RATE_HINT && !(v && strcmp(v, "off") == 0)) hello.features |= FEAT_RATE_HINT;
+    v = getenv("FOCUS_DEFLATE");
+    if (CLIENT_DEFLATE && !(v && strcmp(v, "off") == 0) && state->ext_header && !state->inflater) {
+        // Ready before asking: the first compressed reply may follow the hello right away
+        WsDeflateParams params = { 1, 0, 0, 15 };
+        WsDeflateConfig cfg = { 1, 0, 1, WS_DEFLATE_LEVEL };
+        state->inflater = ws_deflate_new(&params, &cfg, MAX_PAYLOAD_SIZE);
+        if (state->inflater) hello.features |= FEAT_DEFLATE;
+    }
+
+    NetResponse resp;
+    int id = network_send_request(state, MSG_HELLO, (const char*)&hello, (int)sizeof(hello), NET_ROUTE_WAIT);
+    if (id < 0 || !network_wait_response(state, id, timeout_ms, &resp) || resp.type != MSG_HELLO ||
+        resp.length < (int)sizeof(hello)) {
+        log_message("WARN", "Server did not answer MSG_HELLO, using protocol defaults");
+        return 0;
+    }
+    memcpy(&hello, resp.data, sizeof(hello));
+    state->proto_version = hello.version;
+    state->frame_codec = hello.frame_codec;
+    state->features = hello.features;
+    if (state->features & FEAT_EXT_HEADER) state->ext_header = 1;
+    if (state->features & FEAT_UDP_FRAMES) {
+        UdpGrant grant;
+        struct sockaddr_in addr;
+        socklen_t alen = sizeof(addr);
+        if (resp.length >= (int)(sizeof(hello) + sizeof(grant))) {
+            memcpy(&grant, resp.data + sizeof(hello), sizeof(grant));
+        } else {
+            grant.token = 0;
+        }
+        // A fragment size below UDP_MIN_FRAGMENT (0 included) is treated as no grant
+        if (grant.max_fragment < UDP_MIN_FRAGMENT) grant.token = 0;
+        if (grant.token && getpeername(state->socket_fd, (struct sockaddr*)&addr, &alen) == 0) {
+            addr.sin_port = htons(grant.port);
+            if (connect(state->udp_fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+                if (grant.max_fragment < state->udp_frag_size) state->udp_frag_size = grant.max_fragment;
+                // Fragment numbers are 16-bit: larger frames go over TCP
+                uint32_t frame_cap = (uint32_t)state->udp_frag_size * UINT16_MAX;
+                state->udp_max_frame = grant.max_frame < frame_cap ? grant.max_frame : frame_cap;
+                state->udp_token = grant.token;
+                log_message("INFO", "UDP frame channel on port %u (fragment %d bytes)", (unsigned)grant.port,
+                            state->udp_frag_size);
+            }
+        }
+        if (!state->udp_token) {
+            log_message("WARN", "Cannot open the UDP frame channel, frames stay on TCP");
+            state->features &= ~FEAT_UDP_FRAMES;
+        }
+    }
+    log_message("INFO", "Negotiated protocol v%d, features=0x%x, frame codec=%d", state->proto_version,
+                (unsigned)state->features, state->frame_codec);
+    return 1;
+}
+
 // Close connection
 void network_close(NetworkState* state) {
+    pthread_mutex_lock(&g_upload_mtx);
+    int uploading = g_upload_running;
+    g_upload_running = 0;
+    pthread_cond_broadcast(&g_upload_cv);
+    pthread_mutex_unlock(&g_upload_mtx);
+    if (uploading) pthread_join(g_upload_thread, NULL);
+    while (g_upload_head) {
+        UploadJob* job = g_upload_head;
+        g_upload_head = job->next;
+        free(job);
+    }
+    g_upload_tail = NULL;
+    g_upload_queued = 0;
+
+    pthread_mutex_lock(&g_send_mtx);
+    if (state->is_connected && batch_flush_locked(state) < 0) log_message("WARN", "Dropped coalesced requests");
+    state->is_connected = 0;
+    pthread_cond_broadcast(&g_batch_cv);
+    pthread_mutex_unlock(&g_send_mtx);
+    if (g_batch_running) {
+        pthread_join(g_batch_thread, NULL);
+        g_batch_running = 0;
+    }
     if (state->socket_fd >= 0) {
         close(state->socket_fd);
         state->socket_fd = -1;
     }
-    state->is_connected = 0;
+    if (state->udp_fd >= 0) {
+        close(state->udp_fd);
+        state->udp_fd = -1;
+    }
+    state->udp_token = 0;
+    if (state->ring) {
+        shm_ring_close(state->ring);
+        free(state->ring);
+        state->ring = NULL;
+    }
+    state->features = 0;
     log_message("INFO", "Network connection closed");
 }
 
 // Helper: Send login request
-int send_login(NetworkState* state, const char* username, const char* password) {
+int send_login(NetworkState* state, const char* username, const char* password, int route) {
     char payload[200];
     snprintf(payload, sizeof(payload), "%s|%s", username, password);
-    return network_send_packet(state, MSG_LOGIN_REQ, payload, strlen(payload));
+    return network_send_request(state, MSG_LOGIN_REQ, payload, strlen(payload), route);
 }
 
 // Helper: Send register request
-int send_register(NetworkState* state, const char* username, const char* password) {
+int send_register(NetworkState* state, const char* username, const char* password, int route) {
     char payload[200];
     snprintf(payload, sizeof(payload), "%s|%s", username, password);
-    return network_send_packet(state, MSG_REGISTER_REQ, payload, strlen(payload));
+    return network_send_request(state, MSG_REGISTER_REQ, payload, strlen(payload), route);
 }
 
 // Helper: Start session
@@ -225,18 +1095,55 @@ int send_stream_frame(NetworkState* state, const char* base64_data) {
     return network_send_packet(state, MSG_STREAM_FRAME, base64_data, (int)strlen(base64_data));
 }
 
+int network_rate_hint(NetworkState* state, const char* payload, int length) {
+    RateHintPayload hint;
+    if (length < (int)sizeof(hint)) return -1;
+    memcpy(&hint, payload, sizeof(hint));
+    __atomic_store_n(&state->rate_interval_ms, hint.interval_ms, __ATOMIC_RELAXED);
+    __atomic_store_n(&state->rate_max_frame, hint.max_frame, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static uint64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+// Server's MSG_RATE_HINT: 1 if this frame comes too soon after the last one sent, or is too big.
+// Callers on several threads (IPC tabs) race for the slot; the winner's time becomes the last send.
+static int rate_skip(NetworkState* state, int len) {
+    uint32_t max_frame = __atomic_load_n(&state->rate_max_frame, __ATOMIC_RELAXED);
+    uint32_t interval = __atomic_load_n(&state->rate_interval_ms, __ATOMIC_RELAXED);
+    if (max_frame && (uint32_t)len > max_frame) return 1;
+    uint64_t now = monotonic_ms();
+    uint64_t last = __atomic_load_n(&state->rate_last_ms, __ATOMIC_RELAXED);
+    if (interval && last && now - last < interval) return 1;
+    return !__atomic_compare_exchange_n(&state->rate_last_ms, &last, now, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
 // Helper: Send stream frame as raw binary bytes
 int send_stream_frame_bytes(NetworkState* state, const void* data, int len) {
     if (!data || len <= 0) return -1;
+    if (rate_skip(state, len)) {
+        __atomic_add_fetch(&state->rate_skipped, 1, __ATOMIC_RELAXED);
+        return 1;
+    }
+    // Through the local ring a whole frame is one memcpy; chunking and UDP only add work
+    if (state->ring) return network_send_packet(state, MSG_STREAM_FRAME, (const char*)data, len);
+    if (__atomic_load_n(&state->udp_token, __ATOMIC_RELAXED) && (uint32_t)len <= state->udp_max_frame) {
+        return network_udp_frame(state, data, len);
+    }
+    if ((state->features & FEAT_FRAME_CHUNK) && len <= MAX_PAYLOAD_SIZE) return network_upload_frame(state, data, len);
     return network_send_packet(state, MSG_STREAM_FRAME, (const char*)data, len);
 }
 
 // Helper: Get leaderboard
-int send_get_leaderboard(NetworkState* state) {
-    return network_send_packet(state, MSG_GET_LEADERBOARD, NULL, 0);
+int send_get_leaderboard(NetworkState* state, int route) {
+    return network_send_request(state, MSG_GET_LEADERBOARD, NULL, 0, route);
 }
 
 // Helper: Get profile
-int send_get_profile(NetworkState* state) {
-    return network_send_packet(state, MSG_GET_PROFILE, NULL, 0);
+int send_get_profile(NetworkState* state, int route) {
+    return network_send_request(state, MSG_GET_PROFILE, NULL, 0, route);
 }
@@ -1,19 +1,44 @@
 /*
  * Mục đích: Khai báo API mạng cho Client (POSIX TCP), bao gồm
  *  - Kết nối/đóng kết nối tới server
- *  - Gửi/nhận gói tin theo định dạng TLV (header 8 byte: type + length)
+ *  - Gửi/nhận gói tin theo định dạng TLV (header 8 byte: type + length, hoặc 16 byte kèm request_id)
+ *  - Bảng request đang chờ: nhiều request có thể cùng bay (pipeline), phản hồi được ghép
+ *    về đúng request theo request_id (hoặc theo thứ tự gửi nếu header mở rộng bị tắt)
+ *  - Gom request nhỏ gửi trong cùng 1 cửa sổ thời gian thành 1 MSG_TLV_BATCH (tùy chọn), và tách
+ *    MSG_TLV_BATCH nhận được thành từng gói như thể chúng đến riêng lẻ
+ *  - Tải frame ảnh theo đoạn (MSG_FRAME_CHUNK) trên thread riêng, gói điều khiển được ưu tiên
+ *  - Transport cục bộ khi server chạy cùng máy: gói gửi đi qua ring bộ nhớ chia sẻ thay vì TCP loopback
+ *  - Kênh frame UDP (FEAT_UDP_FRAMES, tùy chọn): frame cắt thành datagram, mất mảnh thì server bỏ
+ *    frame; phản hồi điểm qua UDP được trả ra như gói nhận từ TCP
  *  - Các hàm tiện ích gửi thông điệp theo giao thức (login, register, start/end session, stream, leaderboard, profile)
  *
  * Cấu trúc chính:
- * - NetworkState: giữ socket, trạng thái kết nối, username, user_id.
+ * - NetworkState: giữ socket, trạng thái kết nối, username, user_id, có dùng header mở rộng không,
+ *   cửa sổ gom batch, kết quả MSG_HELLO (version, FEAT_*, codec frame), socket + token kênh UDP, ring của transport cục bộ.
+ * - NetResponse: bản sao phản hồi trả cho thread đang chờ.
  *
  * Hàm chính:
  * - network_init(state): Khởi tạo trạng thái mạng (chưa kết nối).
- * - network_connect(state, host, port): Tạo socket và kết nối TCP tới server.
+ * - network_connect(state, host, port): Tạo socket và kết nối TCP tới server (host loopback: thử transport
+ *   cục bộ trước); khởi động thread gửi batch nếu batch_window_ms > 0.
  * - network_send_packet(state, type, payload, length): Gửi 1 gói tin TLV.
- * - network_receive_packet(state, out_packet): Nhận 1 gói tin đầy đủ (blocking), cấp phát bộ nhớ cho out_packet.
+ * - network_receive_packet(state, out_packet, tag): Nhận 1 gói tin đầy đủ (blocking), cấp phát bộ nhớ cho
+ *   out_packet (header luôn 8 byte, type đã bỏ bit mở rộng); request_id/flags ghi vào tag. Bản ghi
+ *   trong MSG_TLV_BATCH được trả lần lượt qua các lần gọi tiếp theo.
+ * - network_send_request(state, type, payload, length, route): Đăng ký request trong bảng chờ rồi gửi;
+ *   trả request id. route = NET_ROUTE_WAIT nếu caller sẽ chờ bằng network_wait_response(), hoặc
+ *   1 giá trị >= 0 (vd fd tab IPC) được trả lại cho receiver khi phản hồi tới.
+ * - network_wait_response(state, id, timeout_ms, resp): Chờ phản hồi của 1 request.
+ * - network_complete_request(state, request_id, type, payload, length, route): Receiver gọi khi nhận
+ *   phản hồi; đánh thức thread chờ hoặc trả route của request.
+ * - network_hello(state, timeout_ms): Gửi MSG_HELLO (version, FEAT_* muốn dùng, codec frame) và ghi
+ *   kết quả vào state; server không trả lời thì giữ mặc định. Gọi sau khi receiver thread chạy.
+ *   Server cấp kênh UDP thì mở socket UDP tới cùng địa chỉ server.
+ * - network_rate_hint(state, payload, length): Ghi nhịp frame server yêu cầu (MSG_RATE_HINT); từ đó
+ *   send_stream_frame_bytes bỏ frame gửi sớm hơn / lớn hơn mức này.
  * - network_close(state): Đóng kết nối, reset trạng thái.
- * - send_login/register/start_session/end_session/stream_frame...: Helper dựng payload và gọi network_send_packet.
+ * - send_login/register/start_session/end_session/stream_frame...: Helper dựng payload và gọi network_send_packet;
+ *   helper có phản hồi (login, register, leaderboard, profile) nhận route và trả request id.
  */
 #ifndef NETWORK_H
 #define NETWORK_H
@@ -27,31 +52,72 @@ typedef struct {
     int is_connected;
     char username[50];
     int user_id;
+    int ext_header;         // gửi PacketHeaderExt kèm request_id (CLIENT_EXT_HEADER / FOCUS_EXT_HEADER)
+    int batch_window_ms;    // > 0: gom gói nhỏ thành MSG_TLV_BATCH (CLIENT_BATCH_WINDOW_MS / FOCUS_BATCH_WINDOW_MS)
+    int proto_version;      // version chung sau MSG_HELLO (0: chưa thương lượng)
+    int frame_codec;        // FRAME_CODEC_* server đã chấp nhận
+    uint32_t features;      // FEAT_* server đã bật cho kết nối
+    struct WsDeflate* inflater; // giải nén payload PKT_FLAG_DEFLATE (FEAT_DEFLATE)
+    struct ShmRing* ring;   // transport cục bộ: gói gửi đi ghi vào ring, socket_fd là Unix socket (NULL: TCP)
+    int udp_fd;             // FEAT_UDP_FRAMES: socket UDP đã connect tới server (-1: gửi frame qua TCP)
+    uint64_t udp_token;     // UdpGrant.token
+    uint32_t udp_seq;       // số thứ tự frame gần nhất gửi qua UDP
+    int udp_frag_size;      // byte ảnh mỗi datagram
+    uint32_t udp_max_frame; // frame lớn hơn đi qua TCP
+    uint32_t rate_interval_ms; // MSG_RATE_HINT: khoảng cách tối thiểu giữa 2 frame (0: không giới hạn)
+    uint32_t rate_max_frame;   // MSG_RATE_HINT: byte tối đa mỗi frame (0: không giới hạn)
+    uint64_t rate_last_ms;     // lúc gửi frame gần nhất (đồng hồ monotonic)
+    unsigned long rate_skipped; // frame bỏ theo hint
 } NetworkState;
 
+typedef struct {
+    int type;
+    int length;
+    char data[2048];        // NUL-terminated, truncated if longer
+} NetResponse;
+
+#define NET_ROUTE_WAIT (-1)     // caller blocks in network_wait_response()
+
 // Initialize network
 int network_init(NetworkState* state);
 
 // Connect to server
 int network_connect(NetworkState* state, const char* host, int port);
 
-// Send packet
+// Send packet (untagged)
 int network_send_packet(NetworkState* state, int type, const char* payload, int length);
 
-// Receive packet (blocking)
-int network_receive_packet(NetworkState* state, PacketHeader** packet);
+// Receive packet (blocking); tag may be NULL
+int network_receive_packet(NetworkState* state, PacketHeader** packet, PacketTag* tag);
+
+// Pipelined requests. Returns request id (> 0) or -1.
+int network_send_request(NetworkState* state, int type, const char* payload, int length, int route);
+// Returns 1 with *resp filled, 0 on timeout
+int network_wait_response(NetworkState* state, int request_id, int timeout_ms, NetResponse* resp);
+// Returns 1 if the reply matched an outstanding request; *route is NET_ROUTE_WAIT for waited ones
+int network_complete_request(NetworkState* state, uint32_t request_id, int type, const char* payload, int length,
+                             int* route);
+
+// Capability handshake. Returns 1 if the server answered, 0 if it kept protocol defaults.
+int network_hello(NetworkState* state, int timeout_ms);
+
+// Apply a MSG_RATE_HINT payload. Returns -1 if it is malformed.
+int network_rate_hint(NetworkState* state, const char* payload, int length);
 
 // Close connection
 void network_close(NetworkState* state);
 
 // Helper functions
-int send_login(NetworkState* state, const char* username, const char* password);
-int send_register(NetworkState* state, const char* username, const char* password);
+int send_login(NetworkState* state, const char* username, const char* password, int route);
+int send_register(NetworkState* state, const char* username, const char* password, int route);
 int send_start_session(NetworkState* state);
 int send_end_session(NetworkState* state);
 int send_stream_frame(NetworkState* state, const char* base64_data);
+// Sent as datagrams when FEAT_UDP_FRAMES is on, else queued for chunked upload when FEAT_FRAME_CHUNK
+// is on (data is copied, returns at once). Returns 1 without sending when the server's rate hint
+// says the frame is too early or too big.
 int send_stream_frame_bytes(NetworkState* state, const void* data, int len);
-int send_get_leaderboard(NetworkState* state);
-int send_get_profile(NetworkState* state);
+int send_get_leaderboard(NetworkState* state, int route);
+int send_get_profile(NetworkState* state, int route);
 
 #endif // NETWORK_H
@@ -0,0 +1,147 @@
+/*
+ * Mục đích: Cài đặt mã hoá/giải mã phản hồi nhị phân (xem binresp.h).
+ *
+ * Ghi chú:
+ * - Byte được ghi từng cái theo little-endian nên kết quả không phụ thuộc CPU và không cần
+ *   căn chỉnh (con trỏ có thể nằm giữa buffer gửi).
+ * - JSON sinh ra giữ nguyên thứ tự trường và cách viết của phản hồi JSON gốc để FE không
+ *   phân biệt được hai kiểu mã hoá.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "binresp.h"
+#include "protocol.h"
+
+static void put_u16(char* p, uint32_t v) {
+    p[0] = (char)(v & 0xFF);
+    p[1] = (char)((v >> 8) & 0xFF);
+}
+
+static void put_u32(char* p, uint32_t v) {
+    p[0] = (char)(v & 0xFF);
+    p[1] = (char)((v >> 8) & 0xFF);
+    p[2] = (char)((v >> 16) & 0xFF);
+    p[3] = (char)((v >> 24) & 0xFF);
+}
+
+static uint32_t get_u16(const char* p) {
+    const unsigned char* u = (const unsigned char*)p;
+    return (uint32_t)u[0] | ((uint32_t)u[1] << 8);
+}
+
+static uint32_t get_u32(const char* p) {
+    const unsigned char* u = (const unsigned char*)p;
+    return (uint32_t)u[0] | ((uint32_t)u[1] << 8) | ((uint32_t)u[2] << 16) | ((uint32_t)u[3] << 24);
+}
+
+// Length-prefixed string; returns bytes written or -1
+static int put_str(char* p, size_t cap, const char* s) {
+    size_t n = s ? strlen(s) : 0;
+    if (n > BINRESP_MAX_NAME) n = BINRESP_MAX_NAME;
+    if (cap < 1 + n) return -1;
+    p[0] = (char)n;
+    if (n) memcpy(p + 1, s, n);
+    return (int)(1 + n);
+}
+
+// Reads a length-prefixed string into a NUL-terminated buffer; returns bytes consumed or -1
+static int get_str(const char* p, size_t len, char* out, size_t cap) {
+    if (len < 1) return -1;
+    size_t n = (unsigned char)p[0];
+    if (len < 1 + n || cap < n + 1) return -1;
+    memcpy(out, p + 1, n);
+    out[n] = '\0';
+    return (int)(1 + n);
+}
+
+int binresp_focus_update(char* out, size_t cap, int score, int frames) {
+    if (cap < 5) return -1;
+    out[0] = (char)(score < 0 ? 0 : score > 255 ? 255 : score);
+    put_u32(out + 1, (uint32_t)frames);
+    return 5;
+}
+
+int binresp_session_result(char* out, size_t cap, int seconds, int coins) {
+    if (cap < 8) return -1;
+    put_u32(out, (uint32_t)seconds);
+    put_u32(out + 4, (uint32_t)coins);
+    return 8;
+}
+
+int binresp_profile(char* out, size_t cap, const char* username, int coins, int sessions, int seconds) {
+    if (cap < 12) return -1;
+    put_u32(out, (uint32_t)coins);
+    put_u32(out + 4, (uint32_t)sessions);
+    put_u32(out + 8, (uint32_t)seconds);
+    int n = put_str(out + 12, cap - 12, username);
+    return n < 0 ? -1 : 12 + n;
+}
+
+int binresp_leaderboard_begin(char* out, size_t cap) {
+    if (cap < 2) return -1;
+    put_u16(out, 0);
+    return 2;
+}
+
+int binresp_leaderboard_add(char* out, size_t cap, size_t* off, const char* username, int coins, int sessions) {
+    if (cap < *off + 8) return -1;
+    int n = put_str(out + *off + 8, cap - *off - 8, username);
+    if (n < 0) return -1;
+    put_u32(out + *off, (uint32_t)coins);
+    put_u32(out + *off + 4, (uint32_t)sessions);
+    *off += 8 + (size_t)n;
+    put_u16(out, get_u16(out) + 1);
+    return 0;
+}
+
+int binresp_decode_focus_update(const char* p, int len, int* score, int* frames) {
+    if (len < 5) return -1;
+    *score = (unsigned char)p[0];
+    *frames = (int)get_u32(p + 1);
+    return 0;
+}
+
+int binresp_to_json(int type, const char* p, int len, char* out, size_t cap) {
+    char name[BINRESP_MAX_NAME + 1];
+    size_t ulen = len > 0 ? (size_t)len : 0;
+    int n;
+    switch (type) {
+        case MSG_FOCUS_UPDATE: {
+            int score, frames;
+            if (binresp_decode_focus_update(p, len, &score, &frames) < 0) return -1;
+            n = snprintf(out, cap, "{\"score\":%d,\"frames\":%d}", score, frames);
+            break;
+        }
+        case MSG_UPDATE_COINS:
+            if (ulen < 8) return -1;
+            n = snprintf(out, cap, "{\"seconds\":%d,\"coins\":%d}", (int)get_u32(p), (int)get_u32(p + 4));
+            break;
+        case MSG_RES_PROFILE:
+            if (ulen < 12 || get_str(p + 12, ulen - 12, name, sizeof(name)) < 0) return -1;
+            n = snprintf(out, cap, "{\"username\":\"%s\",\"coins\":%d,\"sessions\":%d,\"seconds\":%d}",
+                         name, (int)get_u32(p), (int)get_u32(p + 4), (int)get_u32(p + 8));
+            break;
+        case MSG_RES_LEADERBOARD: {
+            if (ulen < 2) return -1;
+            uint32_t count = get_u16(p);
+            size_t pos = 2;
+            n = snprintf(out, cap, "[");
+            for (uint32_t i = 0; i < count && n >= 0 && (size_t)n < cap; ++i) {
+                if (ulen - pos < 8) return -1;
+                int used = get_str(p + pos + 8, ulen - pos - 8, name, sizeof(name));
+                if (used < 0) return -1;
+                n += snprintf(out + n, cap - (size_t)n, "%s{\"username\":\"%s\",\"coins\":%d,\"sessions\":%d}",
+                              i ? "," : "", name, (int)get_u32(p + pos), (int)get_u32(p + pos + 4));
+                pos += 8 + (size_t)used;
+            }
+            if (n >= 0 && (size_t)n < cap) n += snprintf(out + n, cap - (size_t)n, "]");
+            break;
+        }
+        default:
+            return -1;
+    }
+    if (n < 0 || (size_t)n >= cap) return -1;
+    return n;
+}
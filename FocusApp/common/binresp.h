@@ -0,0 +1,38 @@
+/*
+ * Mục đích: Mã hoá nhị phân gọn cho phản hồi của server (FEAT_BINARY_RESP) dùng chung cho
+ * Server (mã hoá) và Client/cầu nối IPC (giải mã, đổi sang JSON khi trình duyệt cần).
+ *
+ * Định dạng (little-endian, không padding; chuỗi = uint8 độ dài + byte, không NUL):
+ * - MSG_FOCUS_UPDATE:    uint8 score, uint32 frames                          (5 byte)
+ * - MSG_UPDATE_COINS:    uint32 seconds, uint32 coins                        (8 byte)
+ * - MSG_RES_PROFILE:     uint32 coins, uint32 sessions, uint32 seconds, str username
+ * - MSG_RES_LEADERBOARD: uint16 count, rồi count × { uint32 coins, uint32 sessions, str username }
+ *
+ * Hàm:
+ * - binresp_focus_update/session_result/profile: Ghi thẳng 1 phản hồi vào out; trả số byte
+ *   đã ghi hoặc -1 nếu thiếu chỗ.
+ * - binresp_leaderboard_begin/add: Ghi từng mục bảng xếp hạng nối tiếp vào out (vd ngay trong
+ *   lúc giữ mutex duyệt bảng user), count ở đầu được cập nhật sau mỗi mục.
+ * - binresp_decode_focus_update: Đọc điểm/số frame để hiển thị mà không qua JSON.
+ * - binresp_to_json: Đổi 1 phản hồi nhị phân sang đúng JSON mà server gửi khi không bật
+ *   FEAT_BINARY_RESP; trả độ dài JSON, -1 nếu type không có dạng nhị phân hoặc payload hỏng.
+ */
+#ifndef BINRESP_H
+#define BINRESP_H
+
+#include <stddef.h>
+
+#define BINRESP_MAX_NAME 255
+
+int binresp_focus_update(char* out, size_t cap, int score, int frames);
+int binresp_session_result(char* out, size_t cap, int seconds, int coins);
+int binresp_profile(char* out, size_t cap, const char* username, int coins, int sessions, int seconds);
+
+int binresp_leaderboard_begin(char* out, size_t cap);
+// Appends one entry at *off; returns 0, or -1 (nothing written) when it does not fit
+int binresp_leaderboard_add(char* out, size_t cap, size_t* off, const char* username, int coins, int sessions);
+
+int binresp_decode_focus_update(const char* p, int len, int* score, int* frames);
+int binresp_to_json(int type, const char* p, int len, char* out, size_t cap);
+
+#endif // BINRESP_H
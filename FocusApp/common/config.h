@@ -3,8 +3,21 @@
  *
  * Các nhóm cấu hình chính:
  * - Network: SERVER_HOST, SERVER_PORT, kích thước buffer, số client tối đa.
+ * - Request ID: header mở rộng cho client pipeline request, số request đang chờ tối đa.
+ * - Hello: bật/tắt MSG_HELLO, thời gian chờ phản hồi, đề nghị nén payload / phản hồi nhị phân.
+ * - Chunked upload: kích thước đoạn frame, số stream tải xen kẽ, hàng đợi frame phía client.
+ * - Local: Unix socket + ring bộ nhớ chia sẻ khi client và server chạy cùng máy.
+ * - UDP: cổng kênh frame UDP, kích thước mảnh/frame, client có đề nghị kênh UDP không.
+ * - Batch: cửa sổ thời gian và kích thước khi client gom request nhỏ vào 1 MSG_TLV_BATCH.
+ * - Server I/O: số reactor thread (chế độ epoll), kích thước ring/buffer io_uring.
+ * - Backpressure: ngưỡng cao/thấp của hàng đợi gửi, policy với client chậm.
+ * - Heartbeat: timer wheel, chu kỳ PING, thời gian idle tối đa trước khi đóng kết nối.
+ * - WebSocket: nén permessage-deflate (ngưỡng kích thước, giữ context nén).
  * - Session/AI demo: STREAM_INTERVAL_MS, FOCUS_THRESHOLD.
- * - File server (placeholder): đường dẫn lưu dữ liệu nếu cần.
+ * - Rate control: server giãn khoảng cách frame của client (MSG_RATE_HINT) theo tải chấm điểm và độ ổn định điểm.
+ * - Scoring: backend chấm điểm mặc định, số thread của scoring pool, lưới ảnh xám backend "pixel".
+ * - File server (placeholder): đường dẫn lưu dữ liệu nếu cần, thời gian gom lần lưu users.txt; kích thước
+ *   ban đầu/tải tối đa bảng user.
  * - Gamification: hệ số thưởng, xu/phút (tham khảo).
  * - DEBUG_MODE: bật/tắt log chi tiết.
  */
@@ -17,13 +30,123 @@
 #define BUFFER_SIZE 4096
 #define MAX_CLIENTS 100
 
+// Request IDs (header mở rộng, xem protocol.h)
+#define CLIENT_EXT_HEADER 1          // Client gửi header 16 byte kèm request_id (FOCUS_EXT_HEADER=off để tắt)
+#define CLIENT_MAX_PENDING 32        // Số request chờ phản hồi cùng lúc phía client
+
+// Capability handshake (MSG_HELLO) phía client
+#define CLIENT_HELLO_ENABLED 1       // Gửi MSG_HELLO sau khi kết nối (FOCUS_HELLO=off để tắt)
+#define CLIENT_HELLO_TIMEOUT_MS 1000 // Server cũ không trả lời thì dùng mặc định của giao thức
+#define CLIENT_DEFLATE 1             // Đề nghị FEAT_DEFLATE khi build có zlib (FOCUS_DEFLATE=off để tắt)
+#define CLIENT_BINARY_RESP 1         // Đề nghị phản hồi nhị phân FEAT_BINARY_RESP (FOCUS_BINARY_RESP=off để tắt)
+
+// Tải frame theo đoạn (MSG_FRAME_CHUNK, FEAT_FRAME_CHUNK)
+#define FRAME_CHUNK_SIZE 16384       // Byte ảnh mỗi đoạn: gói điều khiển chờ tối đa 1 đoạn (FOCUS_FRAME_CHUNK=N, =off: gửi nguyên frame)
+#define FRAME_UPLOAD_STREAMS 4       // Số frame tải xen kẽ cùng lúc (client) / ghép dở tối đa mỗi kết nối (server)
+#define CLIENT_UPLOAD_QUEUE 8        // Số frame chờ tải phía client; đầy thì caller chờ
+
+// Transport cục bộ (client cùng máy): Unix socket để bắt tay + ring bộ nhớ chia sẻ cho gói client → server
+#define SHM_SOCKET_PATH "/tmp/focusapp.sock" // --shm-socket=PATH phía server (=off để tắt), FOCUS_SHM_SOCKET phía client
+#define SHM_RING_SIZE (8 * 1024 * 1024)      // Vùng dữ liệu ring; phải chứa được 2 gói lớn nhất (2 x 2MB)
+#define CLIENT_SHM_TRANSPORT 1               // Client dùng transport cục bộ khi host là loopback (FOCUS_SHM=off để tắt)
+
+// Kênh frame UDP (FEAT_UDP_FRAMES): mất gói thì bỏ frame, frame mới nhất thắng
+#define SERVER_UDP_PORT SERVER_PORT  // Cổng UDP phía server (--udp-port=N, 0 = tắt)
+#define UDP_FRAGMENT_SIZE 1200       // Byte ảnh mỗi datagram: header + mảnh vừa MTU 1500 thông thường
+#define UDP_MIN_FRAGMENT 256         // Server cấp mảnh nhỏ hơn thì client không dùng kênh UDP
+#define UDP_DATAGRAM_MAX 2048        // Datagram lớn nhất server nhận (header + mảnh)
+#define UDP_MAX_FRAME (512 * 1024)   // Frame lớn hơn thì client gửi qua TCP
+#define UDP_RECV_BATCH 16            // Số datagram mỗi lần recvmmsg phía server
+#define UDP_SEND_BATCH 32            // Số datagram mỗi lần sendmmsg phía client
+#define CLIENT_UDP_FRAMES 0          // Client đề nghị kênh UDP (FOCUS_UDP=on/off để ghi đè)
+
+// Gom request nhỏ thành MSG_TLV_BATCH phía client (console + IPC relay)
+#define CLIENT_BATCH_WINDOW_MS 0     // Cửa sổ gom (ms), 0 = tắt (FOCUS_BATCH_WINDOW_MS=N để bật; cần FEAT_BATCH)
+#define CLIENT_BATCH_MAX_RECORD 1024 // Chỉ gom gói có header + payload <= ngưỡng này (không gom frame ảnh)
+#define CLIENT_BATCH_MAX_BYTES 16384 // Batch đầy thì gửi ngay, không chờ hết cửa sổ
+
+// Server I/O (epoll multi-reactor)
+#define REACTOR_THREADS 4        // Số reactor thread mặc định (--reactors=N)
+#define REACTOR_MAX_THREADS 64
+#define REACTOR_MAX_EVENTS 256   // Số sự kiện tối đa mỗi lần epoll_wait
+#define SEND_TIMEOUT_MS 5000     // Chờ tối đa khi socket non-blocking đầy buffer gửi
+#define RXBUF_INITIAL_SIZE 16384 // Buffer nhận ban đầu mỗi kết nối (tăng dần khi có frame lớn)
+#define RXBUF_READ_CHUNK 16384   // Chỗ trống tối thiểu cho mỗi lần recv()
+#define TXQ_SMALL_PAYLOAD 2048   // Gói phản hồi <= ngưỡng này dùng lại node trong free-list
+
+// Backpressure: giới hạn hàng đợi gửi mỗi kết nối (server và IPC relay)
+#define TXQ_HIGH_WATERMARK (256 * 1024)  // Vượt ngưỡng: ngừng đọc / áp dụng policy
+#define TXQ_LOW_WATERMARK (64 * 1024)    // Xuống dưới ngưỡng: đọc lại bình thường
+#define SLOW_POLICY_DEFAULT_DROP 1       // 1: bỏ MSG_FOCUS_UPDATE cũ, 0: ngắt kết nối
+
+// Heartbeat / idle reaper (timer wheel mỗi reactor/worker)
+#define TIMER_TICK_MS 100        // Độ phân giải của timer wheel
+#define TIMER_WHEEL_SLOTS 512    // Số ô (1 vòng = 51.2 giây)
+#define PING_INTERVAL_SEC 15     // Im lặng quá lâu thì server gửi MSG_PING (--ping-interval)
+#define IDLE_TIMEOUT_SEC 45      // Không nhận được gì (kể cả MSG_PONG) thì đóng (--idle-timeout, 0 = tắt)
+
+// WebSocket permessage-deflate (server: --ws-deflate..., IPC relay: FOCUS_IPC_DEFLATE...)
+#define WS_DEFLATE_ENABLED 1
+#define WS_DEFLATE_MIN_SIZE 256          // Message ngắn hơn ngưỡng này gửi không nén
+#define WS_DEFLATE_CONTEXT_TAKEOVER 1    // 0: reset bộ nén sau mỗi message (ít RAM, nén kém hơn)
+#define WS_DEFLATE_LEVEL 6
+#define WS_INFLATE_MAX_MESSAGE (5 * 1024 * 1024)  // Giới hạn byte giải nén / message (chặn zip bomb)
+
+// Server I/O (io_uring backend, --io=uring)
+#define URING_ENTRIES 1024       // Số SQE mỗi ring (CQ gấp 4 lần)
+#define URING_BUF_COUNT 256      // Số provided buffer mỗi worker (lũy thừa của 2)
+#define URING_BUF_SIZE 32768     // Kích thước mỗi provided buffer
+
 // Session Configuration
-#define STREAM_INTERVAL_MS 1000  // Gửi frame mỗi 1 giây
+#define STREAM_INTERVAL_MS 1000  // Khoảng cách frame khi server rảnh và điểm còn dao động (--stream-interval=MS)
 #define FOCUS_THRESHOLD 60       // Ngưỡng độ tập trung cảnh báo (%)
 
+// Điều khiển tốc độ stream từ server (ratectl.h, MSG_RATE_HINT)
+#define RATE_CONTROL 1                   // Server gửi MSG_RATE_HINT (--rate-control=on|off)
+#define RATE_UPDATE_MS 1000              // Chu kỳ đo tải của pipeline chấm điểm
+#define RATE_SCALE_MAX 8                 // Quá tải kéo dài: khoảng cách frame tối đa = base x N
+#define RATE_STABLE_FACTOR 3             // Điểm ổn định hẳn: giãn thêm tối đa N lần
+#define RATE_STABLE_DELTA 10             // |Δ điểm| trung bình từ mức này trở lên = không ổn định
+#define RATE_STABLE_MIN_SCORES 5         // Số điểm tối thiểu trước khi xét độ ổn định
+#define RATE_MAX_INTERVAL_MS 30000       // Trần khoảng cách frame
+#define RATE_MAX_FRAME (512 * 1024)      // Byte tối đa mỗi frame khi server rảnh
+#define RATE_MIN_FRAME (64 * 1024)       // Sàn khi quá tải
+#define RATE_HINT_CHANGE_PCT 20          // Chỉ gửi hint mới khi lệch hint cũ từ N% trở lên
+#define CLIENT_RATE_HINT 1               // Client đề nghị FEAT_RATE_HINT (FOCUS_RATE_HINT=off để tắt)
+
+// Chấm điểm tập trung phía server (scorer.h, scorepool.h)
+#define SCORER_DEFAULT "pixel"           // Backend chấm điểm (--scorer=pixel|checksum); build không có zlib dùng checksum
+#define SCORE_THREADS 2                  // Thread của scoring pool (--score-threads=N)
+#define SCORE_BATCH_MAX 8                // Frame (của nhiều kết nối) chấm chung 1 lượt tối đa (--score-batch=N)
+#define SCORE_BATCH_LIMIT 64             // Giới hạn trên của --score-batch
+#define SCORE_BATCH_WAIT_US 2000         // Chờ tối đa để gom đủ 1 lượt, 0 = chấm ngay (--score-batch-wait=US)
+#define PIXEL_GRID_W 80                  // Lưới xám của backend "pixel"
+#define PIXEL_GRID_H 60
+#define PIXEL_MAX_DIM 4096               // PNG lớn hơn thì chấm bằng checksum
+#define PIXEL_MAX_RAW (16 * 1024 * 1024) // Giới hạn byte giải nén mỗi frame
+#define PIXEL_PHASH_HISTORY 4            // Hash cảm quan của N frame gần nhất mỗi phiên
+#define PIXEL_PHASH_NEAR 3               // Khác tối đa N/64 bit = gần trùng: dùng lại kết quả dò mặt
+
+// Lưu frame xuống đĩa (archive.h)
+#define ARCHIVE_DIR "frames"             // Thư mục archive (--archive-dir=PATH|off)
+#define ARCHIVE_THREADS 1                // Writer thread (--archive-threads=N)
+#define ARCHIVE_QUEUE_BYTES (32 * 1024 * 1024) // Byte frame chờ ghi tối đa; đầy thì bỏ frame, không chờ đĩa
+#define ARCHIVE_SEGMENT_MAX (8 * 1024 * 1024)  // Segment lớn hơn thì mở segment mới
+#define ARCHIVE_SEGMENT_AGE_SEC 600      // Segment cũ hơn thì mở segment mới (và đóng fd của user đã ngừng gửi)
+#define ARCHIVE_MAX_MB 1024              // Tổng dung lượng giữ lại (--archive-max-mb=N, 0 = không giới hạn)
+#define ARCHIVE_MAX_AGE_SEC (7 * 24 * 3600) // Xoá segment cũ hơn (--archive-max-age=SEC, 0 = giữ mãi)
+#define ARCHIVE_FSYNC_DEFAULT "batch"    // --archive-fsync=none|batch|always
+#define ARCHIVE_SWEEP_SEC 60             // Chu kỳ quét retention
+#define ARCHIVE_OPEN_SEGMENTS 64         // Segment mở sẵn mỗi writer
+#define ARCHIVE_IOV_MAX 64               // Frame tối đa mỗi lệnh writev
+#define ARCHIVE_DEDUP_RECENT 8           // Frame vừa ghi mỗi segment được nhớ để ghi bản trùng bằng tham chiếu
+
 // File paths (Server side)
 #define USERS_FILE "data/users.txt"
 #define HISTORY_FILE "data/history.txt"
+#define USERS_SAVE_DELAY_MS 200          // Yêu cầu lưu users.txt trong khoảng này được gom thành 1 lần ghi
+#define USER_STORE_INITIAL 256           // Bản ghi user cấp sẵn (bảng tự nhân đôi khi đầy, không giới hạn số user)
+#define USER_STORE_MAX_LOAD 50           // % ô chỉ mục băm được dùng tối đa trước khi nhân đôi số ô
 
 // Gamification
 #define COINS_PER_MINUTE 2       // 2 xu/phút học tập
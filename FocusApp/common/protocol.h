@@ -2,6 +2,25 @@
  * Mục đích: Định nghĩa giao thức TLV dùng chung giữa Client/Server.
  *  - MessageType: liệt kê các loại thông điệp (đăng nhập, bắt đầu/kết thúc phiên, stream, cảnh báo, thống kê...).
  *  - PacketHeader: header cố định 8 byte (int32 type + int32 length) theo đúng format Phase 1.
+ *  - PacketHeaderExt: header mở rộng 16 byte (thêm request_id + flags), đánh dấu bằng bit
+ *    MSG_EXT_HEADER trong `type`. Kết nối chuyển sang header mở rộng khi client gửi gói mở rộng
+ *    đầu tiên; từ đó server gắn request_id của request vào mọi phản hồi (0 + PKT_FLAG_PUSH cho
+ *    thông điệp server tự đẩy) để client pipeline nhiều request cùng lúc.
+ *  - MSG_TLV_BATCH: gói bọc nhiều bản ghi TLV (mỗi bản ghi giữ header riêng, có thể là header mở
+ *    rộng với request_id riêng). Server xử lý lần lượt từng bản ghi như gói độc lập và trả mọi
+ *    phản hồi trong 1 MSG_TLV_BATCH. Không lồng batch trong batch.
+ *  - MSG_HELLO: client gửi ngay sau khi kết nối version + FEAT_* muốn dùng + codec frame ảnh;
+ *    server trả version chung, tập FEAT_* được bật cho kết nối và codec được chấp nhận. Client
+ *    cũ không gửi MSG_HELLO thì kết nối giữ nguyên hành vi trước đó.
+ *  - MSG_FRAME_CHUNK: frame ảnh lớn cắt thành nhiều đoạn (stream_id + offset + total) để gói điều
+ *    khiển chen được vào giữa; server ghép lại theo stream_id rồi xử lý như MSG_STREAM_FRAME.
+ *  - Kênh UDP (FEAT_UDP_FRAMES): phản hồi MSG_HELLO kèm UdpGrant (token + cổng). Frame ảnh gửi qua
+ *    UDP, mỗi datagram = UdpFrameHeader + 1 mảnh; frame mới hơn thay frame đang ghép dở (mất mảnh
+ *    thì bỏ cả frame). Server trả MSG_FOCUS_UPDATE/MSG_FOCUS_WARN bằng datagram chứa 1 gói TLV
+ *    header 8 byte. Login/phiên/bảng xếp hạng vẫn đi trên TCP.
+ *  - MSG_RATE_HINT (FEAT_RATE_HINT): server đẩy khoảng cách frame mục tiêu + kích thước frame tối đa
+ *    cho kết nối (RateHintPayload) theo tải của pipeline chấm điểm và độ ổn định điểm của user;
+ *    client bỏ frame gửi sớm hơn / lớn hơn mức đó. Đi cùng đường với MSG_FOCUS_UPDATE (TCP hoặc UDP).
  *  - Macro: HEADER_SIZE, MAX_PAYLOAD_SIZE, mã phản hồi, và alias tương thích (MSG_START_POMO, MSG_WARNING...).
  */
 #ifndef PROTOCOL_H
@@ -37,7 +56,19 @@ typedef enum {
     // Heartbeat & Error
     MSG_PING,
     MSG_PONG,
-    MSG_ERROR
+    MSG_ERROR,
+
+    // Envelope
+    MSG_TLV_BATCH,          // Payload = nhiều bản ghi TLV nối tiếp (tên MSG_BATCH trùng cờ sendmmsg của glibc)
+
+    // Capability handshake
+    MSG_HELLO,              // Payload = HelloPayload (client đề nghị, server trả tập được bật)
+
+    // Chunked upload
+    MSG_FRAME_CHUNK,        // Payload = FrameChunkHeader + 1 đoạn của frame ảnh (FEAT_FRAME_CHUNK)
+
+    // Flow control
+    MSG_RATE_HINT           // Payload = RateHintPayload (server đẩy, FEAT_RATE_HINT)
 } MessageType;
 
 // Packet Header Structure (Fixed 8 bytes)
@@ -47,10 +78,77 @@ typedef struct {
     char payload[0];        // Flexible Array Member (C99)
 } PacketHeader;
 
+// Extended header tail: correlates replies with pipelined requests
+typedef struct {
+    uint32_t request_id;    // chosen by the client, echoed in every reply (0 = untagged)
+    uint32_t flags;         // PKT_FLAG_*
+} PacketTag;
+
+typedef struct {
+    int32_t type;           // MessageType | MSG_EXT_HEADER
+    int32_t length;
+    PacketTag tag;
+} PacketHeaderExt;
+
 // Helper macros
 #define HEADER_SIZE (sizeof(int32_t) * 2)
+#define HEADER_EXT_SIZE (HEADER_SIZE + sizeof(PacketTag))
+#define MSG_EXT_HEADER 0x40000000           // bit in `type`: a PacketTag follows the 8-byte header
+#define MSG_TYPE(t) ((t) & ~MSG_EXT_HEADER)
+#define PACKET_HEADER_SIZE(t) (((t) & MSG_EXT_HEADER) ? HEADER_EXT_SIZE : HEADER_SIZE)
+#define PKT_FLAG_PUSH 0x1                   // server-initiated, not a reply to any request
+#define PKT_FLAG_DEFLATE 0x2                // payload is raw deflate (FEAT_DEFLATE), length is the compressed size
 #define MAX_PAYLOAD_SIZE (1024 * 1024 * 2)  // 2MB for images
 
+// MSG_HELLO payload, same byte order as the header
+typedef struct {
+    uint16_t version;       // FOCUS_PROTOCOL_VERSION của bên gửi; phản hồi = min(client, server)
+    uint16_t frame_codec;   // FRAME_CODEC_* cho MSG_STREAM_FRAME; phản hồi = codec server chấp nhận
+    uint32_t features;      // FEAT_*: client đề nghị, phản hồi = tập con server bật cho kết nối
+} HelloPayload;
+
+#define FOCUS_PROTOCOL_VERSION 2            // 1 = Phase 1, chưa có MSG_HELLO
+#define FEAT_EXT_HEADER 0x01                // PacketHeaderExt + request_id ngay từ đầu
+#define FEAT_DEFLATE 0x02                   // server nén payload lớn (PKT_FLAG_DEFLATE); cần FEAT_EXT_HEADER, chỉ TLV thuần
+#define FEAT_BATCH 0x04                     // MSG_TLV_BATCH
+#define FEAT_BINARY_RESP 0x08               // phản hồi mã hoá nhị phân thay cho JSON (bố cục: binresp.h)
+#define FEAT_FRAME_CHUNK 0x10               // frame ảnh gửi bằng MSG_FRAME_CHUNK
+#define FEAT_UDP_FRAMES 0x20                // frame ảnh gửi qua kênh UDP (UdpGrant sau HelloPayload); chỉ TLV thuần
+#define FEAT_RATE_HINT 0x40                 // server đẩy MSG_RATE_HINT, client giãn frame theo đó
+#define FRAME_CODEC_RAW 0                   // byte ảnh nguyên văn (mặc định)
+#define FRAME_CODEC_BASE64 1                // ảnh mã hoá Base64 (send_stream_frame kiểu cũ)
+
+// MSG_FRAME_CHUNK payload prefix; the chunk bytes follow. Chunks of one stream arrive in order.
+typedef struct {
+    uint32_t stream_id;     // client chọn, không trùng với frame khác đang tải dở
+    uint32_t offset;        // vị trí đoạn này trong frame
+    uint32_t total;         // kích thước cả frame (<= MAX_PAYLOAD_SIZE)
+} FrameChunkHeader;
+
+// Appended to the MSG_HELLO reply when FEAT_UDP_FRAMES is granted
+typedef struct {
+    uint64_t token;         // ngẫu nhiên, gắn với kết nối TCP đã cấp; hết hiệu lực khi kết nối đóng
+    uint16_t port;          // cổng UDP của server (cùng địa chỉ IP với kết nối TCP)
+    uint16_t max_fragment;  // byte ảnh tối đa mỗi datagram
+    uint32_t max_frame;     // frame lớn hơn thì gửi qua TCP
+} UdpGrant;
+
+// Datagram prefix on the UDP channel; the fragment bytes follow
+typedef struct {
+    uint64_t token;         // UdpGrant.token
+    uint32_t seq;           // số thứ tự frame, tăng dần: frame mới hơn thay frame đang ghép dở
+    uint32_t total;         // kích thước cả frame
+    uint16_t frag;          // chỉ số mảnh, vị trí = frag * frag_size
+    uint16_t frag_size;     // byte mỗi mảnh (mọi mảnh trừ mảnh cuối đều đủ), giống nhau trong 1 frame
+    uint32_t flags;         // 0, dành cho mở rộng
+} UdpFrameHeader;
+
+// MSG_RATE_HINT payload, same byte order as the header
+typedef struct {
+    uint32_t interval_ms;   // khoảng cách tối thiểu giữa 2 frame gửi đi
+    uint32_t max_frame;     // byte tối đa mỗi frame; lớn hơn thì không gửi
+} RateHintPayload;
+
 // Response codes
 #define RESPONSE_OK "OK"
 #define RESPONSE_FAIL "FAIL"
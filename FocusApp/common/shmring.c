@@ -0,0 +1,195 @@
+#define _GNU_SOURCE
+/*
+ * Mục đích: Cài đặt ring buffer bộ nhớ chia sẻ SPSC (xem shmring.h).
+ *  - head chỉ producer ghi, tail chỉ consumer ghi; bên kia đọc bằng acquire nên thấy đủ byte
+ *    của bản ghi trước khi thấy vị trí mới.
+ *  - Cờ *_waiting + fence seq_cst: bên sắp ngủ bật cờ rồi kiểm tra lại, bên kia cập nhật vị trí
+ *    rồi mới đọc cờ, nên không mất lần đánh thức nào.
+ *  - Consumer coi nội dung ring là dữ liệu không tin cậy: kích thước lấy từ lúc attach, memfd phải
+ *    được niêm phong (F_SEAL_SHRINK) để producer không thu nhỏ file gây SIGBUS, mọi header bản ghi
+ *    được kiểm tra với lượng dữ liệu thật sự đã publish.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+
+#include "shmring.h"
+#include "protocol.h"
+
+#define SHM_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+static void ring_reset(ShmRing* ring) {
+    memset(ring, 0, sizeof(*ring));
+    ring->memfd = ring->data_efd = ring->space_efd = -1;
+}
+
+static void efd_signal(int fd) {
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) < 0) {
+        // EAGAIN: counter saturated, the peer is woken anyway
+    }
+}
+
+static void efd_drain(int fd) {
+    uint64_t n;
+    while (read(fd, &n, sizeof(n)) > 0) {}
+}
+
+int shm_ring_create(ShmRing* ring, uint32_t size) {
+    ring_reset(ring);
+    size &= ~7u;
+    ring->size = size;
+    ring->map_len = SHM_RING_HEADER_SIZE + (size_t)size;
+    ring->memfd = memfd_create("focus-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (ring->memfd < 0 || ftruncate(ring->memfd, (off_t)ring->map_len) < 0 ||
+        fcntl(ring->memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+        goto fail;
+    }
+    void* map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, ring->memfd, 0);
+    if (map == MAP_FAILED) goto fail;
+    ring->hdr = (ShmRingHeader*)map;
+    ring->data = (char*)map + SHM_RING_HEADER_SIZE;
+    ring->hdr->magic = SHM_RING_MAGIC;
+    ring->hdr->size = size;
+    ring->data_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ring->space_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ring->data_efd < 0 || ring->space_efd < 0) goto fail;
+    return 0;
+fail:
+    shm_ring_close(ring);
+    return -1;
+}
+
+int shm_ring_attach(ShmRing* ring, int memfd, int data_efd, int space_efd) {
+    ring_reset(ring);
+    ring->memfd = memfd;
+    ring->data_efd = data_efd;
+    ring->space_efd = space_efd;
+    struct stat st;
+    int seals = fcntl(memfd, F_GET_SEALS);
+    if (fstat(memfd, &st) < 0 || seals < 0 || !(seals & F_SEAL_SHRINK) || st.st_size <= SHM_RING_HEADER_SIZE) goto fail;
+    fcntl(data_efd, F_SETFL, O_NONBLOCK);
+    fcntl(space_efd, F_SETFL, O_NONBLOCK);
+
+    ring->map_len = (size_t)st.st_size;
+    void* map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (map == MAP_FAILED) {
+        ring->map_len = 0;
+        goto fail;
+    }
+    ring->hdr = (ShmRingHeader*)map;
+    ring->data = (char*)map + SHM_RING_HEADER_SIZE;
+    ring->size = ring->hdr->size;
+    // The largest record must fit whatever the wrap position
+    if (ring->hdr->magic != SHM_RING_MAGIC || (ring->size & 7) ||
+        SHM_RING_HEADER_SIZE + (size_t)ring->size != ring->map_len ||
+        ring->size < 2 * SHM_ALIGN(HEADER_EXT_SIZE + MAX_PAYLOAD_SIZE)) {
+        goto fail;
+    }
+    return 0;
+fail:
+    shm_ring_close(ring);
+    return -1;
+}
+
+void shm_ring_close(ShmRing* ring) {
+    if (ring->hdr && ring->map_len) munmap(ring->hdr, ring->map_len);
+    if (ring->memfd >= 0) close(ring->memfd);
+    if (ring->data_efd >= 0) close(ring->data_efd);
+    if (ring->space_efd >= 0) close(ring->space_efd);
+    ring_reset(ring);
+}
+
+int shm_ring_write(ShmRing* ring, const void* a, size_t alen, const void* b, size_t blen, int timeout_ms) {
+    ShmRingHeader* h = ring->hdr;
+    size_t rec = SHM_ALIGN(alen + blen);
+    if (rec > ring->size / 2) return -1;
+
+    uint64_t head = __atomic_load_n(&h->head, __ATOMIC_RELAXED);
+    size_t off = (size_t)(head % ring->size);
+    size_t pad = ring->size - off < rec ? ring->size - off : 0;
+    for (;;) {
+        uint64_t tail = __atomic_load_n(&h->tail, __ATOMIC_ACQUIRE);
+        if (ring->size - (head - tail) >= pad + rec) break;
+        __atomic_store_n(&h->producer_waiting, 1, __ATOMIC_SEQ_CST);
+        tail = __atomic_load_n(&h->tail, __ATOMIC_SEQ_CST);
+        if (ring->size - (head - tail) < pad + rec) {
+            struct pollfd pfd = { ring->space_efd, POLLIN, 0 };
+            int pr = poll(&pfd, 1, timeout_ms);
+            if (pr == 0 || (pr < 0 && errno != EINTR)) {
+                __atomic_store_n(&h->producer_waiting, 0, __ATOMIC_RELAXED);
+                return -1;
+            }
+            efd_drain(ring->space_efd);
+        }
+        __atomic_store_n(&h->producer_waiting, 0, __ATOMIC_RELAXED);
+    }
+
+    if (pad) {
+        int32_t marker = SHM_RING_PAD;
+        memcpy(ring->data + off, &marker, sizeof(marker));
+        head += pad;
+        off = 0;
+    }
+    memcpy(ring->data + off, a, alen);
+    if (blen) memcpy(ring->data + off + alen, b, blen);
+    __atomic_store_n(&h->head, head + rec, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&h->consumer_waiting, __ATOMIC_SEQ_CST)) efd_signal(ring->data_efd);
+    return 0;
+}
+
+int shm_ring_peek(ShmRing* ring, const char** rec, size_t* len) {
+    ShmRingHeader* h = ring->hdr;
+    if (__atomic_load_n(&h->consumer_waiting, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&h->consumer_waiting, 0, __ATOMIC_RELAXED);
+        efd_drain(ring->data_efd);
+    }
+    for (;;) {
+        uint64_t head = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+        uint64_t tail = __atomic_load_n(&h->tail, __ATOMIC_RELAXED);
+        uint64_t avail = head - tail;
+        if (avail == 0) return 0;
+        if (avail > ring->size || (avail & 7)) return -1;
+        size_t off = (size_t)(tail % ring->size);
+
+        PacketHeader ph;
+        memcpy(&ph, ring->data + off, sizeof(int32_t));
+        if (ph.type == SHM_RING_PAD) {
+            if (off == 0 || ring->size - off > avail) return -1;
+            shm_ring_release(ring, ring->size - off);
+            continue;
+        }
+        if (avail < HEADER_SIZE) return -1;
+        memcpy(&ph, ring->data + off, HEADER_SIZE);
+        size_t need = PACKET_HEADER_SIZE(ph.type) + (size_t)ph.length;
+        if (ph.length < 0 || ph.length > MAX_PAYLOAD_SIZE || SHM_ALIGN(need) > avail || off + need > ring->size) {
+            return -1;
+        }
+        *rec = ring->data + off;
+        *len = need;
+        return 1;
+    }
+}
+
+void shm_ring_release(ShmRing* ring, size_t len) {
+    ShmRingHeader* h = ring->hdr;
+    uint64_t tail = __atomic_load_n(&h->tail, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->tail, tail + SHM_ALIGN(len), __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&h->producer_waiting, __ATOMIC_SEQ_CST)) efd_signal(ring->space_efd);
+}
+
+int shm_ring_idle(ShmRing* ring) {
+    ShmRingHeader* h = ring->hdr;
+    __atomic_store_n(&h->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&h->head, __ATOMIC_SEQ_CST) != __atomic_load_n(&h->tail, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&h->consumer_waiting, 0, __ATOMIC_RELAXED);
+        return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,72 @@
+/*
+ * Mục đích: Ring buffer bộ nhớ chia sẻ 1 producer / 1 consumer cho transport cục bộ giữa
+ * FocusClient và FocusServer chạy cùng máy (thay loopback TCP cho luồng client → server).
+ *
+ * Bố cục: memfd gồm 1 trang header (ShmRingHeader) + vùng dữ liệu `size` byte. Vị trí head/tail
+ * là bộ đếm byte tăng dần (offset = pos % size). Mỗi bản ghi là 1 gói TLV nguyên vẹn (header 8
+ * hoặc 16 byte + payload), căn 8 byte và luôn nằm liền 1 khối: không đủ chỗ tới cuối vùng thì
+ * producer ghi bản ghi đệm SHM_RING_PAD rồi quay về đầu. Consumer đọc payload ngay trong vùng
+ * chia sẻ, xử lý xong mới nhả chỗ.
+ *
+ * Đánh thức: 2 eventfd. data_efd (producer → consumer) chỉ được ghi khi consumer đã báo sắp ngủ
+ * (consumer_waiting), space_efd (consumer → producer) chỉ khi producer đang chờ chỗ trống — lúc
+ * cả 2 bên đều bận thì không có syscall nào.
+ *
+ * Hàm:
+ * - shm_ring_create(ring, size): Producer tạo memfd + 2 eventfd (fds chuyển cho consumer qua
+ *   SCM_RIGHTS).
+ * - shm_ring_attach(ring, memfd, data_efd, space_efd): Consumer map ring nhận được, kiểm tra kích thước.
+ * - shm_ring_write(ring, a, alen, b, blen, timeout_ms): Ghi 1 bản ghi từ 2 đoạn (header + payload),
+ *   chờ chỗ trống tối đa timeout_ms.
+ * - shm_ring_peek / shm_ring_release: Consumer lấy bản ghi kế tiếp tại chỗ rồi nhả sau khi xử lý.
+ * - shm_ring_idle: Consumer báo sắp ngủ; trả 0 nếu trong lúc đó đã có dữ liệu mới (đọc tiếp).
+ * - shm_ring_close: Unmap và đóng mọi fd.
+ */
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHM_RING_MAGIC 0x464f4352u      // "FOCR"
+#define SHM_RING_HEADER_SIZE 4096       // data area starts on its own page
+#define SHM_RING_PAD (-1)               // record type: skip to the start of the data area
+
+typedef struct {
+    uint32_t magic;
+    uint32_t size;                      // data area bytes (multiple of 8)
+    uint64_t head __attribute__((aligned(64)));  // producer: bytes published
+    uint32_t consumer_waiting;
+    uint64_t tail __attribute__((aligned(64)));  // consumer: bytes released
+    uint32_t producer_waiting;
+} ShmRingHeader;
+
+// Sent with the fds (SCM_RIGHTS) when setting up, and echoed back by the server when accepted
+typedef struct {
+    uint32_t magic;
+    uint32_t size;
+} ShmRingSetup;
+
+typedef struct ShmRing {
+    ShmRingHeader* hdr;
+    char* data;
+    uint32_t size;
+    size_t map_len;
+    int memfd;
+    int data_efd;
+    int space_efd;
+} ShmRing;
+
+int shm_ring_create(ShmRing* ring, uint32_t size);
+int shm_ring_attach(ShmRing* ring, int memfd, int data_efd, int space_efd);
+void shm_ring_close(ShmRing* ring);
+
+// Producer. Returns 0, or -1 on timeout / record larger than the ring.
+int shm_ring_write(ShmRing* ring, const void* a, size_t alen, const void* b, size_t blen, int timeout_ms);
+
+// Consumer. Returns 1 with a whole TLV record at *rec, 0 if empty, -1 if the ring is corrupt.
+int shm_ring_peek(ShmRing* ring, const char** rec, size_t* len);
+void shm_ring_release(ShmRing* ring, size_t len);
+int shm_ring_idle(ShmRing* ring);
+
+#endif // SHMRING_H
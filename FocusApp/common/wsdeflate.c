@@ -0,0 +1,280 @@
+/*
+ * Mục đích: Cài đặt permessage-deflate (xem wsdeflate.h).
+ *  - Thương lượng: chấp nhận server_no_context_takeover, client_no_context_takeover,
+ *    server_max_window_bits (9..15) và client_max_window_bits; offer có tham số lạ
+ *    hoặc window 8 bit (zlib không hỗ trợ raw deflate 8 bit) bị bỏ qua.
+ *  - Nén: deflate Z_SYNC_FLUSH rồi bỏ 4 byte 00 00 ff ff cuối; không giữ context thì
+ *    deflateReset sau mỗi message.
+ *  - Giải nén: stream từng đoạn, thêm 00 00 ff ff khi hết message; giới hạn tổng số byte
+ *    giải nén của 1 message (max_message) để chặn "zip bomb".
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "wsdeflate.h"
+
+#if defined(FOCUS_HAVE_ZLIB)
+#include <zlib.h>
+
+#define WS_DEFLATE_TOKEN "permessage-deflate"
+#define WS_INFLATE_CHUNK 16384
+
+// Find header `name` (case-insensitive) at the start of a line; returns its value
+static const char* find_header(const char* headers, size_t len, const char* name, size_t* value_len) {
+    size_t nlen = strlen(name);
+    size_t pos = 0;
+    while (pos < len) {
+        const char* line = headers + pos;
+        const char* eol = (const char*)memchr(line, '\n', len - pos);
+        size_t llen = eol ? (size_t)(eol - line) : len - pos;
+        if (llen > nlen && strncasecmp(line, name, nlen) == 0 && line[nlen] == ':') {
+            const char* v = line + nlen + 1;
+            const char* end = line + llen;
+            while (v < end && (*v == ' ' || *v == '\t')) v++;
+            while (end > v && (end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t')) end--;
+            *value_len = (size_t)(end - v);
+            return v;
+        }
+        pos += llen + 1;
+    }
+    return NULL;
+}
+
+// Trim spaces and optional quotes around [*s, *e)
+static void trim_token(const char** s, const char** e) {
+    while (*s < *e && isspace((unsigned char)**s)) (*s)++;
+    while (*e > *s && isspace((unsigned char)(*e)[-1])) (*e)--;
+    if (*e - *s >= 2 && **s == '"' && (*e)[-1] == '"') { (*s)++; (*e)--; }
+}
+
+static int token_is(const char* s, const char* e, const char* word) {
+    size_t n = strlen(word);
+    return (size_t)(e - s) == n && strncasecmp(s, word, n) == 0;
+}
+
+// Parse one offer "permessage-deflate; p1; p2=v". Returns 0 if acceptable.
+static int parse_offer(const char* s, const char* e, WsDeflateParams* p) {
+    memset(p, 0, sizeof(*p));
+    p->server_max_window_bits = 15;
+    const char* semi = (const char*)memchr(s, ';', (size_t)(e - s));
+    const char* name_end = semi ? semi : e;
+    const char* ns = s;
+    trim_token(&ns, &name_end);
+    if (!token_is(ns, name_end, WS_DEFLATE_TOKEN)) return -1;
+
+    while (semi) {
+        const char* ps = semi + 1;
+        semi = (const char*)memchr(ps, ';', (size_t)(e - ps));
+        const char* pe = semi ? semi : e;
+        const char* eq = (const char*)memchr(ps, '=', (size_t)(pe - ps));
+        const char* ke = eq ? eq : pe;
+        const char* ks = ps;
+        trim_token(&ks, &ke);
+        int value = -1;
+        if (eq) {
+            const char* vs = eq + 1;
+            const char* ve = pe;
+            trim_token(&vs, &ve);
+            value = 0;
+            for (const char* c = vs; c < ve; ++c) {
+                if (!isdigit((unsigned char)*c)) return -1;
+                value = value * 10 + (*c - '0');
+                if (value > 15) return -1;
+            }
+            if (vs == ve) return -1;
+        }
+        if (token_is(ks, ke, "server_no_context_takeover") && !eq) {
+            p->server_no_context_takeover = 1;
+        } else if (token_is(ks, ke, "client_no_context_takeover") && !eq) {
+            p->client_no_context_takeover = 1;
+        } else if (token_is(ks, ke, "server_max_window_bits") && eq) {
+            if (value < 9 || value > 15) return -1;
+            p->server_max_window_bits = value;
+        } else if (token_is(ks, ke, "client_max_window_bits")) {
+            if (eq && (value < 8 || value > 15)) return -1; // our inflater always uses 15
+        } else {
+            return -1;
+        }
+    }
+    p->enabled = 1;
+    return 0;
+}
+
+int ws_deflate_negotiate(const WsDeflateConfig* cfg, const char* headers, size_t len,
+                         WsDeflateParams* params, char* out, size_t cap) {
+    memset(params, 0, sizeof(*params));
+    if (!cfg || !cfg->enabled) return 0;
+    size_t vlen = 0;
+    const char* v = find_header(headers, len, "Sec-WebSocket-Extensions", &vlen);
+    if (!v) return 0;
+
+    // Offers are comma separated, in the client's order of preference
+    const char* end = v + vlen;
+    const char* s = v;
+    while (s < end) {
+        const char* comma = (const char*)memchr(s, ',', (size_t)(end - s));
+        const char* e = comma ? comma : end;
+        WsDeflateParams p;
+        if (parse_offer(s, e, &p) == 0) {
+            if (!cfg->context_takeover) p.server_no_context_takeover = 1;
+            char bits[40] = "";
+            if (p.server_max_window_bits < 15) {
+                snprintf(bits, sizeof(bits), "; server_max_window_bits=%d", p.server_max_window_bits);
+            }
+            int n = snprintf(out, cap, "Sec-WebSocket-Extensions: %s%s%s%s\r\n", WS_DEFLATE_TOKEN,
+                             p.server_no_context_takeover ? "; server_no_context_takeover" : "",
+                             p.client_no_context_takeover ? "; client_no_context_takeover" : "",
+                             bits);
+            if (n <= 0 || (size_t)n >= cap) return 0;
+            *params = p;
+            return n;
+        }
+        s = comma ? comma + 1 : end;
+    }
+    return 0;
+}
+
+struct WsDeflate {
+    WsDeflateParams params;
+    size_t min_size;
+    size_t max_message;
+    size_t inflated;        // bytes produced for the message being inflated
+    z_stream def;
+    z_stream inf;
+    char* buf;              // compressed output, reused across messages
+    size_t cap;
+};
+
+WsDeflate* ws_deflate_new(const WsDeflateParams* params, const WsDeflateConfig* cfg, size_t max_message) {
+    if (!params || !params->enabled) return NULL;
+    WsDeflate* d = (WsDeflate*)calloc(1, sizeof(WsDeflate));
+    if (!d) return NULL;
+    d->params = *params;
+    d->min_size = cfg->min_size;
+    d->max_message = max_message;
+    if (deflateInit2(&d->def, cfg->level, Z_DEFLATED, -params->server_max_window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        free(d);
+        return NULL;
+    }
+    if (inflateInit2(&d->inf, -15) != Z_OK) {
+        deflateEnd(&d->def);
+        free(d);
+        return NULL;
+    }
+    return d;
+}
+
+void ws_deflate_free(WsDeflate* d) {
+    if (!d) return;
+    deflateEnd(&d->def);
+    inflateEnd(&d->inf);
+    free(d->buf);
+    free(d);
+}
+
+int ws_deflate_wants(const WsDeflate* d, size_t len) {
+    return d && len >= d->min_size;
+}
+
+static int deflate_feed(WsDeflate* d, size_t* used, const void* data, size_t len, int flush) {
+    d->def.next_in = (Bytef*)data;
+    d->def.avail_in = (uInt)len;
+    do {
+        if (d->cap - *used < 64) {
+            size_t cap = d->cap * 2;
+            char* buf = (char*)realloc(d->buf, cap);
+            if (!buf) return -1;
+            d->buf = buf;
+            d->cap = cap;
+        }
+        d->def.next_out = (Bytef*)(d->buf + *used);
+        d->def.avail_out = (uInt)(d->cap - *used);
+        int rc = deflate(&d->def, flush);
+        if (rc != Z_OK && rc != Z_BUF_ERROR) return -1;
+        *used = d->cap - d->def.avail_out;
+    } while (d->def.avail_in > 0 || (flush == Z_SYNC_FLUSH && d->def.avail_out == 0));
+    return 0;
+}
+
+int ws_deflate_compress(WsDeflate* d, size_t headroom, const void* a, size_t alen, const void* b, size_t blen,
+                        char** out, size_t* out_len) {
+    size_t need = headroom + deflateBound(&d->def, (uLong)(alen + blen)) + 16;
+    if (d->cap < need) {
+        char* buf = (char*)realloc(d->buf, need);
+        if (!buf) return -1;
+        d->buf = buf;
+        d->cap = need;
+    }
+    size_t used = headroom;
+    if (alen > 0 && deflate_feed(d, &used, a, alen, Z_NO_FLUSH) < 0) return -1;
+    if (deflate_feed(d, &used, b, blen, Z_SYNC_FLUSH) < 0) return -1;
+    if (used < headroom + 4) return -1;
+    used -= 4; // strip the 00 00 ff ff sync-flush trailer (RFC 7692 §7.2.1)
+    if (d->params.server_no_context_takeover) deflateReset(&d->def);
+
+    *out = d->buf + headroom;
+    *out_len = used - headroom;
+    return 0;
+}
+
+static int inflate_run(WsDeflate* d, const char* in, size_t len, WsInflateSink sink, void* user) {
+    char chunk[WS_INFLATE_CHUNK];
+    d->inf.next_in = (Bytef*)in;
+    d->inf.avail_in = (uInt)len;
+    do {
+        d->inf.next_out = (Bytef*)chunk;
+        d->inf.avail_out = sizeof(chunk);
+        int rc = inflate(&d->inf, Z_SYNC_FLUSH);
+        if (rc != Z_OK && rc != Z_BUF_ERROR && rc != Z_STREAM_END) return -1;
+        size_t produced = sizeof(chunk) - d->inf.avail_out;
+        if (produced == 0) break;
+        d->inflated += produced;
+        if (d->inflated > d->max_message) return -1;
+        if (sink(user, chunk, produced) < 0) return -1;
+    } while (d->inf.avail_in > 0 || d->inf.avail_out == 0);
+    return 0;
+}
+
+int ws_inflate(WsDeflate* d, const char* in, size_t len, int final, WsInflateSink sink, void* user) {
+    static const char tail[4] = { 0x00, 0x00, (char)0xff, (char)0xff };
+    if (len > 0 && inflate_run(d, in, len, sink, user) < 0) return -1;
+    if (!final) return 0;
+    int rc = inflate_run(d, tail, sizeof(tail), sink, user);
+    d->inflated = 0;
+    if (d->params.client_no_context_takeover) inflateReset(&d->inf);
+    return rc;
+}
+
+#else // !FOCUS_HAVE_ZLIB
+
+int ws_deflate_negotiate(const WsDeflateConfig* cfg, const char* headers, size_t len,
+                         WsDeflateParams* params, char* out, size_t cap) {
+    (void)cfg; (void)headers; (void)len; (void)out; (void)cap;
+    memset(params, 0, sizeof(*params));
+    return 0;
+}
+
+WsDeflate* ws_deflate_new(const WsDeflateParams* params, const WsDeflateConfig* cfg, size_t max_message) {
+    (void)params; (void)cfg; (void)max_message;
+    return NULL;
+}
+
+void ws_deflate_free(WsDeflate* d) { (void)d; }
+
+int ws_deflate_wants(const WsDeflate* d, size_t len) { (void)d; (void)len; return 0; }
+
+int ws_deflate_compress(WsDeflate* d, size_t headroom, const void* a, size_t alen, const void* b, size_t blen,
+                        char** out, size_t* out_len) {
+    (void)d; (void)headroom; (void)a; (void)alen; (void)b; (void)blen; (void)out; (void)out_len;
+    return -1;
+}
+
+int ws_inflate(WsDeflate* d, const char* in, size_t len, int final, WsInflateSink sink, void* user) {
+    (void)d; (void)in; (void)len; (void)final; (void)sink; (void)user;
+    return -1;
+}
+
+#endif // FOCUS_HAVE_ZLIB
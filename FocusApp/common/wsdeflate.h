@@ -0,0 +1,59 @@
+/*
+ * Mục đích: Nén WebSocket permessage-deflate (RFC 7692) dùng chung cho Server và cầu nối IPC.
+ *
+ * Cấu trúc:
+ * - WsDeflateConfig: cấu hình phía server (bật/tắt, ngưỡng kích thước, giữ context nén).
+ * - WsDeflateParams: kết quả thương lượng cho 1 kết nối (no_context_takeover, window bits).
+ * - WsDeflate: trạng thái nén/giải nén của 1 kết nối (z_stream ẩn bên trong). Bộ nén chỉ
+ *   được dùng bởi thread gửi, bộ giải nén chỉ bởi thread nhận nên không cần khoá.
+ *
+ * Hàm:
+ * - ws_deflate_negotiate(cfg, headers, len, params, out, cap): Đọc Sec-WebSocket-Extensions
+ *   trong request, chọn offer permessage-deflate đầu tiên chấp nhận được và ghi dòng header
+ *   phản hồi (kết thúc bằng CRLF) vào out. Trả độ dài header, 0 nếu không bật nén.
+ * - ws_deflate_new(params, cfg, max_message)/ws_deflate_free: Tạo/giải phóng trạng thái.
+ * - ws_deflate_wants(d, len): Message dài `len` có nên nén không (>= ngưỡng min_size).
+ * - ws_deflate_compress(d, headroom, a, alen, b, blen, &out, &out_len): Nén a+b thành 1
+ *   message (bỏ đuôi 00 00 ff ff). out trỏ vào buffer tái sử dụng của d, trước out có đúng
+ *   `headroom` byte trống để caller ghi header frame mà không cần chép.
+ * - ws_inflate(d, in, len, final, sink, user): Giải nén từng đoạn payload, đẩy dữ liệu ra
+ *   sink theo từng khối; final = 1 ở đoạn cuối của message.
+ *
+ * Khi build không có zlib (FOCUS_HAVE_ZLIB chưa định nghĩa) thì không bao giờ thương lượng nén.
+ */
+#ifndef WSDEFLATE_H
+#define WSDEFLATE_H
+
+#include <stddef.h>
+
+typedef struct {
+    int enabled;
+    size_t min_size;            // messages shorter than this go out uncompressed
+    int context_takeover;       // 0: reset our compressor after every message
+    int level;                  // zlib compression level
+} WsDeflateConfig;
+
+typedef struct {
+    int enabled;
+    int server_no_context_takeover;
+    int client_no_context_takeover;
+    int server_max_window_bits; // 9..15
+} WsDeflateParams;
+
+typedef struct WsDeflate WsDeflate;
+
+// Receives inflated bytes. Return <0 to abort.
+typedef int (*WsInflateSink)(void* user, const char* data, size_t len);
+
+int ws_deflate_negotiate(const WsDeflateConfig* cfg, const char* headers, size_t len,
+                         WsDeflateParams* params, char* out, size_t cap);
+
+WsDeflate* ws_deflate_new(const WsDeflateParams* params, const WsDeflateConfig* cfg, size_t max_message);
+void ws_deflate_free(WsDeflate* d);
+
+int ws_deflate_wants(const WsDeflate* d, size_t len);
+int ws_deflate_compress(WsDeflate* d, size_t headroom, const void* a, size_t alen, const void* b, size_t blen,
+                        char** out, size_t* out_len);
+int ws_inflate(WsDeflate* d, const char* in, size_t len, int final, WsInflateSink sink, void* user);
+
+#endif // WSDEFLATE_H
@@ -0,0 +1,114 @@
+/*
+ * Mục đích: Cài đặt ws_unmask (xem wsmask.h).
+ *  - Khoá được xoay theo phase rồi nhân bản thành từ 64 bit / vector 128 / 256 bit,
+ *    phần đuôi không đủ 1 khối xử lý từng byte.
+ *  - Bản AVX2 được biên dịch bằng __attribute__((target)) nên không cần -mavx2 cho cả file;
+ *    __builtin_cpu_supports() chọn bản phù hợp ở lần gọi đầu tiên.
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include "wsmask.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define WSMASK_X86 1
+#include <immintrin.h>
+#endif
+
+typedef void (*UnmaskFn)(char* data, size_t len, uint32_t key);
+
+// Key rotated so that byte 0 of `data` lines up with mask[phase % 4]
+static uint32_t rotated_key(const unsigned char mask[4], size_t phase) {
+    unsigned char k[4];
+    for (int i = 0; i < 4; ++i) k[i] = mask[(phase + (size_t)i) & 3];
+    uint32_t key;
+    memcpy(&key, k, sizeof(key));
+    return key;
+}
+
+static void unmask_tail(char* data, size_t len, uint32_t key) {
+    unsigned char k[4];
+    memcpy(k, &key, sizeof(k));
+    for (size_t i = 0; i < len; ++i) data[i] ^= (char)k[i & 3];
+}
+
+static void unmask_scalar(char* data, size_t len, uint32_t key) {
+    uint64_t key64 = ((uint64_t)key << 32) | key;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        memcpy(&v, data + i, sizeof(v));
+        v ^= key64;
+        memcpy(data + i, &v, sizeof(v));
+    }
+    unmask_tail(data + i, len - i, key);
+}
+
+#ifdef WSMASK_X86
+
+__attribute__((target("sse2")))
+static void unmask_sse2(char* data, size_t len, uint32_t key) {
+    __m128i k = _mm_set1_epi32((int)key);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        _mm_storeu_si128((__m128i*)(data + i), _mm_xor_si128(v, k));
+    }
+    unmask_tail(data + i, len - i, key);
+}
+
+__attribute__((target("avx2")))
+static void unmask_avx2(char* data, size_t len, uint32_t key) {
+    __m256i k = _mm256_set1_epi32((int)key);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+        _mm256_storeu_si256((__m256i*)(data + i), _mm256_xor_si256(v, k));
+    }
+    // 16..31 leftover bytes still fit one 128-bit lane (4-byte aligned key period)
+    if (i + 16 <= len) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        _mm_storeu_si128((__m128i*)(data + i), _mm_xor_si128(v, _mm256_castsi256_si128(k)));
+        i += 16;
+    }
+    unmask_tail(data + i, len - i, key);
+}
+
+#endif // WSMASK_X86
+
+static UnmaskFn g_unmask = NULL;
+static const char* g_unmask_name = "scalar";
+
+static UnmaskFn unmask_select(void) {
+    UnmaskFn fn = g_unmask;
+    if (fn) return fn;
+    fn = unmask_scalar;
+    const char* name = "scalar";
+#ifdef WSMASK_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        fn = unmask_avx2;
+        name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        fn = unmask_sse2;
+        name = "sse2";
+    }
+#endif
+    // Every thread computes the same answer, so a racy first call is harmless
+    g_unmask_name = name;
+    __atomic_store_n(&g_unmask, fn, __ATOMIC_RELEASE);
+    return fn;
+}
+
+size_t ws_unmask(char* data, size_t len, const unsigned char mask[4], size_t phase) {
+    if (len == 0) return phase;
+    UnmaskFn fn = __atomic_load_n(&g_unmask, __ATOMIC_ACQUIRE);
+    if (!fn) fn = unmask_select();
+    fn(data, len, rotated_key(mask, phase));
+    return phase + len;
+}
+
+const char* ws_unmask_impl_name(void) {
+    unmask_select();
+    return g_unmask_name;
+}
@@ -0,0 +1,21 @@
+/*
+ * Mục đích: Giải mask payload WebSocket (RFC 6455 §5.3) dùng chung cho Server và cầu nối IPC.
+ *
+ * Hàm:
+ * - ws_unmask(data, len, mask, phase): XOR tại chỗ `len` byte với khoá 4 byte. `phase` là
+ *   số byte của frame đã giải trước đó (payload được xử lý thành nhiều đoạn khi stream).
+ *   Trả về phase mới (phase + len).
+ * - ws_unmask_impl_name(): Tên cài đặt đang dùng ("avx2", "sse2" hoặc "scalar").
+ *
+ * Trên x86 cài đặt được chọn 1 lần lúc chạy theo CPU (AVX2 32 byte/lần, SSE2 16 byte/lần);
+ * kiến trúc khác dùng bản scalar xử lý 8 byte/lần.
+ */
+#ifndef WSMASK_H
+#define WSMASK_H
+
+#include <stddef.h>
+
+size_t ws_unmask(char* data, size_t len, const unsigned char mask[4], size_t phase);
+const char* ws_unmask_impl_name(void);
+
+#endif // WSMASK_H
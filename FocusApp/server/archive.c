@@ -0,0 +1,571 @@
+/*
+ * Mục đích: Cài đặt archive frame (xem archive.h).
+ *  - Mỗi writer có hàng đợi riêng (mutex + condvar) và bảng segment đang mở (tối đa
+ *    ARCHIVE_OPEN_SEGMENTS, đầy thì đóng segment lâu không dùng nhất).
+ *  - 1 lượt ghi: lấy cả hàng đợi, xếp frame vào segment của từng user (giữ thứ tự nhận), rồi mỗi
+ *    segment ghi bằng writev tối đa ARCHIVE_IOV_MAX frame mỗi lệnh + 1 lệnh write cho index.
+ *  - Frame trùng: segment nhớ hash/offset của ARCHIVE_DEDUP_RECENT frame vừa ghi; frame có cùng
+ *    hash và độ dài chỉ thêm 1 entry index trỏ tới byte đã có trong segment (không ghi lại dữ liệu).
+ *    Tham chiếu không vượt qua segment nên xoá 1 segment không làm hỏng segment khác.
+ *  - Ghi lỗi: segment bị đóng, frame còn lại của lượt đó bị bỏ; frame sau mở segment mới nên
+ *    offset trong index luôn khớp dữ liệu.
+ *  - Tên user được làm sạch (chỉ chữ, số, '-', '_', '.'; không bắt đầu bằng '.') trước khi thành
+ *    tên thư mục.
+ */
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "archive.h"
+#include "../common/config.h"
+
+extern void log_message(const char* level, const char* format, ...);
+
+typedef struct ArchiveRecord {
+    struct ArchiveRecord* next;
+    char user[64];
+    uint32_t frame_no;
+    uint32_t length;
+    int64_t time_ms;
+    uint64_t hash;
+    char data[];
+} ArchiveRecord;
+
+typedef struct {
+    uint64_t hash;
+    uint64_t offset;
+    uint32_t length;            // 0 = empty
+} ArchiveRef;
+
+typedef struct {
+    char user[64];              // "" = free slot
+    int fd;
+    int idx_fd;
+    uint64_t size;
+    int64_t start_ms;
+    uint64_t used;              // writer round of the last append (LRU)
+    ArchiveRecord* head;        // frames of the current round
+    ArchiveRecord* tail;
+    uint64_t pending;
+    ArchiveRef recent[ARCHIVE_DEDUP_RECENT];    // frames already in this segment
+    int recent_pos;
+} ArchiveSegment;
+
+typedef struct {
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+    ArchiveRecord* head;
+    ArchiveRecord* tail;
+    size_t bytes;
+    size_t cap;
+    unsigned long dropped;
+    int id;
+    uint64_t round;
+    ArchiveSegment segs[ARCHIVE_OPEN_SEGMENTS];
+} ArchiveWriter;
+
+static ArchiveConfig g_cfg;
+static ArchiveWriter* g_writers = NULL;
+static int g_nwriters = 0;
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void safe_name(const char* user, char* out, size_t cap) {
+    if (!user || !user[0]) user = "guest";
+    size_t n = 0;
+    for (; user[n] && n + 1 < cap; ++n) {
+        unsigned char c = (unsigned char)user[n];
+        out[n] = (isalnum(c) || c == '-' || c == '_' || (c == '.' && n > 0)) ? (char)c : '_';
+    }
+    out[n] = '\0';
+}
+
+// snprintf for paths: -1 instead of a silently truncated name
+static int path_fmt(char* buf, size_t cap, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, cap, fmt, ap);
+    va_end(ap);
+    return (n < 0 || (size_t)n >= cap) ? -1 : 0;
+}
+
+static uint32_t name_hash(const char* s) {
+    uint32_t h = 2166136261u;       // FNV-1a
+    for (; *s; ++s) h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+int archive_fsync_parse(const char* value, ArchiveFsync* out) {
+    if (strcmp(value, "none") == 0) *out = ARCHIVE_FSYNC_NONE;
+    else if (strcmp(value, "batch") == 0) *out = ARCHIVE_FSYNC_BATCH;
+    else if (strcmp(value, "always") == 0) *out = ARCHIVE_FSYNC_ALWAYS;
+    else return -1;
+    return 0;
+}
+
+int archive_submit(const char* user, int frame_no, const char* data, int length, uint64_t hash) {
+    if (g_nwriters == 0 || length <= 0) return -1;
+    ArchiveRecord* r = (ArchiveRecord*)malloc(sizeof(ArchiveRecord) + (size_t)length);
+    if (!r) return -1;
+    r->next = NULL;
+    safe_name(user, r->user, sizeof(r->user));
+    r->frame_no = (uint32_t)frame_no;
+    r->length = (uint32_t)length;
+    r->time_ms = now_ms();
+    r->hash = hash;
+    memcpy(r->data, data, (size_t)length);
+
+    ArchiveWriter* w = &g_writers[name_hash(r->user) % (uint32_t)g_nwriters];
+    pthread_mutex_lock(&w->mtx);
+    if (w->bytes + (size_t)length > w->cap) {
+        unsigned long dropped = ++w->dropped;
+        pthread_mutex_unlock(&w->mtx);
+        free(r);
+        if (dropped == 1 || dropped % 100 == 0) {
+            log_message("WARN", "[Archive] writer %d behind the disk, %lu frame(s) not archived", w->id, dropped);
+        }
+        return 1;
+    }
+    if (w->tail) w->tail->next = r;
+    else {
+        w->head = r;
+        pthread_cond_signal(&w->cond);
+    }
+    w->tail = r;
+    w->bytes += (size_t)length;
+    pthread_mutex_unlock(&w->mtx);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Segments
+// ---------------------------------------------------------------------------
+
+static int write_all(int fd, const void* buf, size_t len) {
+    const char* p = (const char*)buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int writev_all(int fd, struct iovec* iov, int cnt) {
+    while (cnt > 0) {
+        ssize_t n = writev(fd, iov, cnt);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        while (cnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if (cnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+    return 0;
+}
+
+static void segment_close(ArchiveSegment* seg) {
+    while (seg->head) {
+        ArchiveRecord* next = seg->head->next;
+        free(seg->head);
+        seg->head = next;
+    }
+    seg->tail = NULL;
+    seg->pending = 0;
+    if (seg->fd >= 0) close(seg->fd);
+    if (seg->idx_fd >= 0) close(seg->idx_fd);
+    seg->fd = seg->idx_fd = -1;
+    seg->user[0] = '\0';
+}
+
+static int segment_open(ArchiveSegment* seg, const char* user, int64_t start_ms) {
+    char path[512];
+    path_fmt(path, sizeof(path), "%s/%s", g_cfg.dir, user);
+    if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+        log_message("ERROR", "[Archive] mkdir %s: %s", path, strerror(errno));
+        return -1;
+    }
+    path_fmt(path, sizeof(path), "%s/%s/%lld.seg", g_cfg.dir, user, (long long)start_ms);
+    seg->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    path_fmt(path, sizeof(path), "%s/%s/%lld.idx", g_cfg.dir, user, (long long)start_ms);
+    seg->idx_fd = seg->fd >= 0 ? open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644) : -1;
+    if (seg->fd < 0 || seg->idx_fd < 0) {
+        log_message("ERROR", "[Archive] open segment for %s: %s", user, strerror(errno));
+        segment_close(seg);
+        return -1;
+    }
+    off_t end = lseek(seg->fd, 0, SEEK_END);
+    seg->size = end > 0 ? (uint64_t)end : 0;
+    seg->start_ms = start_ms;
+    memset(seg->recent, 0, sizeof(seg->recent));
+    seg->recent_pos = 0;
+    snprintf(seg->user, sizeof(seg->user), "%s", user);
+    return 0;
+}
+
+// Offset of a frame with the same bytes already in seg (or earlier in this write), -1 if none
+static int64_t segment_find(const ArchiveSegment* seg, const ArchiveRecord* r) {
+    for (int i = 0; i < ARCHIVE_DEDUP_RECENT; ++i) {
+        const ArchiveRef* ref = &seg->recent[i];
+        if (ref->length == r->length && ref->hash == r->hash) return (int64_t)ref->offset;
+    }
+    return -1;
+}
+
+static void segment_remember(ArchiveSegment* seg, const ArchiveRecord* r, uint64_t offset) {
+    ArchiveRef* ref = &seg->recent[seg->recent_pos];
+    seg->recent_pos = (seg->recent_pos + 1) % ARCHIVE_DEDUP_RECENT;
+    ref->hash = r->hash;
+    ref->offset = offset;
+    ref->length = r->length;
+}
+
+// Write the frames collected for seg this round: data first, then their index entries
+static void segment_flush(ArchiveSegment* seg) {
+    const int per_call = g_cfg.fsync == ARCHIVE_FSYNC_ALWAYS ? 1 : ARCHIVE_IOV_MAX;
+    struct iovec iov[ARCHIVE_IOV_MAX];
+    ArchiveIndexEntry ent[ARCHIVE_IOV_MAX];
+    int wrote = 0;
+    while (seg->head) {
+        int n = 0, niov = 0;
+        uint64_t off = seg->size;
+        for (ArchiveRecord* r = seg->head; r && n < per_call; r = r->next, ++n) {
+            int64_t same = segment_find(seg, r);
+            ent[n].frame_no = r->frame_no;
+            ent[n].length = r->length;
+            ent[n].time_ms = r->time_ms;
+            if (same >= 0) {
+                ent[n].offset = (uint64_t)same;     // duplicate: index entry only
+                continue;
+            }
+            iov[niov].iov_base = r->data;
+            iov[niov++].iov_len = r->length;
+            ent[n].offset = off;
+            segment_remember(seg, r, off);
+            off += r->length;
+        }
+        if (writev_all(seg->fd, iov, niov) < 0 || write_all(seg->idx_fd, ent, sizeof(ent[0]) * (size_t)n) < 0) {
+            log_message("ERROR", "[Archive] write segment of %s: %s", seg->user, strerror(errno));
+            segment_close(seg);     // drops the rest of this round; the next frame starts a new segment
+            return;
+        }
+        seg->size = off;
+        for (int i = 0; i < n; ++i) {
+            ArchiveRecord* next = seg->head->next;
+            free(seg->head);
+            seg->head = next;
+        }
+        if (g_cfg.fsync == ARCHIVE_FSYNC_ALWAYS) {
+            fdatasync(seg->fd);
+            fdatasync(seg->idx_fd);
+        }
+        wrote = 1;
+    }
+    seg->tail = NULL;
+    seg->pending = 0;
+    if (wrote && g_cfg.fsync == ARCHIVE_FSYNC_BATCH) {
+        fdatasync(seg->fd);
+        fdatasync(seg->idx_fd);
+    }
+}
+
+static int segment_due(const ArchiveSegment* seg, uint32_t add, int64_t now) {
+    uint64_t size = seg->size + seg->pending;
+    return (size > 0 && size + add > ARCHIVE_SEGMENT_MAX) || now - seg->start_ms > (int64_t)ARCHIVE_SEGMENT_AGE_SEC * 1000;
+}
+
+// Segment that takes r: the user's open one, or a new one after rotation / in a free or LRU slot
+static ArchiveSegment* writer_segment(ArchiveWriter* w, const ArchiveRecord* r, int64_t now) {
+    ArchiveSegment* seg = NULL;
+    ArchiveSegment* victim = NULL;
+    for (int i = 0; i < ARCHIVE_OPEN_SEGMENTS; ++i) {
+        ArchiveSegment* s = &w->segs[i];
+        if (s->user[0] && strcmp(s->user, r->user) == 0) {
+            seg = s;
+            break;
+        }
+        // Prefer a free slot, otherwise the least recently used segment
+        if (!s->user[0]) {
+            if (!victim || victim->user[0]) victim = s;
+        } else if (!victim || (victim->user[0] && s->used < victim->used)) {
+            victim = s;
+        }
+    }
+    if (seg && segment_due(seg, r->length, now)) {
+        segment_flush(seg);
+        segment_close(seg);
+        victim = seg;
+        seg = NULL;
+    }
+    if (!seg) {
+        if (victim->user[0]) {
+            segment_flush(victim);
+            segment_close(victim);
+        }
+        if (segment_open(victim, r->user, r->time_ms) < 0) return NULL;
+        seg = victim;
+    }
+    seg->used = w->round;
+    return seg;
+}
+
+static void writer_round(ArchiveWriter* w, ArchiveRecord* batch, int64_t now) {
+    w->round++;
+    while (batch) {
+        ArchiveRecord* r = batch;
+        batch = r->next;
+        r->next = NULL;
+        ArchiveSegment* seg = writer_segment(w, r, now);
+        if (!seg) {
+            free(r);
+            continue;
+        }
+        if (seg->tail) seg->tail->next = r;
+        else seg->head = r;
+        seg->tail = r;
+        seg->pending += r->length;
+    }
+    for (int i = 0; i < ARCHIVE_OPEN_SEGMENTS; ++i) {
+        if (w->segs[i].head) segment_flush(&w->segs[i]);
+    }
+}
+
+// Close segments that are old enough to rotate anyway, so idle users do not hold descriptors
+static void writer_close_idle(ArchiveWriter* w, int64_t now) {
+    for (int i = 0; i < ARCHIVE_OPEN_SEGMENTS; ++i) {
+        ArchiveSegment* s = &w->segs[i];
+        if (s->user[0] && segment_due(s, 0, now)) segment_close(s);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Retention
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    char path[512];             // .seg path
+    time_t mtime;
+    uint64_t bytes;             // .seg + .idx
+    int64_t start_ms;
+} SweepFile;
+
+static int sweep_cmp(const void* a, const void* b) {
+    const SweepFile* x = (const SweepFile*)a;
+    const SweepFile* y = (const SweepFile*)b;
+    return x->mtime < y->mtime ? -1 : (x->mtime > y->mtime ? 1 : 0);
+}
+
+static void sweep_remove(const SweepFile* f) {
+    char idx[512];
+    unlink(f->path);
+    if (path_fmt(idx, sizeof(idx), "%.*s.idx", (int)(strlen(f->path) - 4), f->path) == 0) unlink(idx);
+}
+
+static void archive_sweep(void) {
+    if (!g_cfg.max_bytes && !g_cfg.max_age_sec) return;
+    DIR* top = opendir(g_cfg.dir);
+    if (!top) return;
+    SweepFile* files = NULL;
+    size_t count = 0, cap = 0;
+    uint64_t total = 0;
+    struct dirent* ue;
+    while ((ue = readdir(top)) != NULL) {
+        if (ue->d_name[0] == '.') continue;
+        char udir[512];
+        DIR* d = path_fmt(udir, sizeof(udir), "%s/%s", g_cfg.dir, ue->d_name) == 0 ? opendir(udir) : NULL;
+        if (!d) continue;
+        ssize_t newest = -1;
+        struct dirent* e;
+        while ((e = readdir(d)) != NULL) {
+            size_t len = strlen(e->d_name);
+            if (len < 5 || strcmp(e->d_name + len - 4, ".seg") != 0) continue;
+            if (count == cap) {
+                size_t ncap = cap ? cap * 2 : 64;
+                SweepFile* nf = (SweepFile*)realloc(files, ncap * sizeof(SweepFile));
+                if (!nf) break;
+                files = nf;
+                cap = ncap;
+            }
+            SweepFile* f = &files[count];
+            struct stat st;
+            if (path_fmt(f->path, sizeof(f->path), "%s/%s", udir, e->d_name) < 0 || stat(f->path, &st) < 0) continue;
+            f->mtime = st.st_mtime;
+            f->bytes = (uint64_t)st.st_size;
+            f->start_ms = strtoll(e->d_name, NULL, 10);
+            char idx[512];
+            if (path_fmt(idx, sizeof(idx), "%s/%.*s.idx", udir, (int)(len - 4), e->d_name) == 0 && stat(idx, &st) == 0) f->bytes += (uint64_t)st.st_size;
+            total += f->bytes;
+            if (newest < 0 || f->start_ms > files[newest].start_ms) newest = (ssize_t)count;
+            count++;
+        }
+        closedir(d);
+        // The newest segment of each user may still be open for writing: always keep it
+        if (newest >= 0) {
+            files[newest] = files[count - 1];
+            count--;
+        }
+    }
+    closedir(top);
+
+    time_t now = time(NULL);
+    size_t removed = 0;
+    uint64_t freed = 0;
+    qsort(files, count, sizeof(SweepFile), sweep_cmp);
+    for (size_t i = 0; i < count; ++i) {
+        int too_old = g_cfg.max_age_sec > 0 && now - files[i].mtime > g_cfg.max_age_sec;
+        int too_big = g_cfg.max_bytes > 0 && total > g_cfg.max_bytes;
+        if (!too_old && !too_big) break;    // oldest first: nothing after this one qualifies either
+        sweep_remove(&files[i]);
+        total -= files[i].bytes;
+        freed += files[i].bytes;
+        removed++;
+    }
+    free(files);
+    if (removed) {
+        log_message("INFO", "[Archive] retention removed %zu segment(s), %llu bytes, %llu bytes kept", removed,
+                    (unsigned long long)freed, (unsigned long long)total);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Writers
+// ---------------------------------------------------------------------------
+
+static void* archive_writer(void* arg) {
+    ArchiveWriter* w = (ArchiveWriter*)arg;
+    int64_t next_sweep = 0;
+    for (;;) {
+        pthread_mutex_lock(&w->mtx);
+        if (!w->head) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += 1;
+            pthread_cond_timedwait(&w->cond, &w->mtx, &ts);
+        }
+        ArchiveRecord* batch = w->head;
+        w->head = w->tail = NULL;
+        w->bytes = 0;
+        pthread_mutex_unlock(&w->mtx);
+
+        int64_t now = now_ms();
+        if (batch) writer_round(w, batch, now);
+        writer_close_idle(w, now);
+        if (w->id == 0 && now >= next_sweep) {
+            archive_sweep();
+            next_sweep = now + (int64_t)ARCHIVE_SWEEP_SEC * 1000;
+        }
+    }
+    return NULL;
+}
+
+int archive_start(const ArchiveConfig* cfg) {
+    if (!cfg->dir[0] || cfg->threads <= 0) return -1;
+    g_cfg = *cfg;
+    if (mkdir(g_cfg.dir, 0755) < 0 && errno != EEXIST) {
+        log_message("ERROR", "[Archive] mkdir %s: %s", g_cfg.dir, strerror(errno));
+        return -1;
+    }
+    g_writers = (ArchiveWriter*)calloc((size_t)cfg->threads, sizeof(ArchiveWriter));
+    if (!g_writers) return -1;
+    int started = 0;
+    for (int i = 0; i < cfg->threads; ++i) {
+        ArchiveWriter* w = &g_writers[i];
+        pthread_mutex_init(&w->mtx, NULL);
+        pthread_cond_init(&w->cond, NULL);
+        w->id = i;
+        w->cap = cfg->queue_bytes / (size_t)cfg->threads;
+        for (int k = 0; k < ARCHIVE_OPEN_SEGMENTS; ++k) w->segs[k].fd = w->segs[k].idx_fd = -1;
+        pthread_t th;
+        if (pthread_create(&th, NULL, archive_writer, w) != 0) break;
+        pthread_detach(th);
+        started++;
+    }
+    if (started == 0) return -1;
+    g_nwriters = started;
+    static const char* const fsync_names[] = { "none", "batch", "always" };
+    log_message("INFO", "[Archive] %d writer(s) archiving frames into %s/ (fsync=%s)", started, g_cfg.dir,
+                fsync_names[g_cfg.fsync]);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Lookup
+// ---------------------------------------------------------------------------
+
+static int cmp_desc_i64(const void* a, const void* b) {
+    int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+    return x > y ? -1 : (x < y ? 1 : 0);
+}
+
+int archive_lookup(const char* dir, const char* user, uint32_t frame_no, char** out, size_t* out_len) {
+    char name[64], udir[512], path[512];
+    safe_name(user, name, sizeof(name));
+    DIR* d = path_fmt(udir, sizeof(udir), "%s/%s", dir, name) == 0 ? opendir(udir) : NULL;
+    if (!d) return -1;
+    int64_t* starts = NULL;
+    size_t count = 0, cap = 0;
+    struct dirent* e;
+    while ((e = readdir(d)) != NULL) {
+        size_t len = strlen(e->d_name);
+        if (len < 5 || strcmp(e->d_name + len - 4, ".idx") != 0) continue;
+        if (count == cap) {
+            size_t ncap = cap ? cap * 2 : 16;
+            int64_t* ns = (int64_t*)realloc(starts, ncap * sizeof(int64_t));
+            if (!ns) break;
+            starts = ns;
+            cap = ncap;
+        }
+        starts[count++] = strtoll(e->d_name, NULL, 10);
+    }
+    closedir(d);
+    qsort(starts, count, sizeof(int64_t), cmp_desc_i64);
+
+    int rc = -1;
+    for (size_t i = 0; i < count && rc < 0; ++i) {
+        FILE* f = path_fmt(path, sizeof(path), "%s/%lld.idx", udir, (long long)starts[i]) == 0 ? fopen(path, "rb") : NULL;
+        if (!f) continue;
+        ArchiveIndexEntry ent, hit = { 0, 0, 0, 0 };
+        int found = 0;
+        while (fread(&ent, sizeof(ent), 1, f) == 1) {
+            if (ent.frame_no == frame_no) {
+                hit = ent;                  // keep the latest entry of this segment
+                found = 1;
+            }
+        }
+        fclose(f);
+        if (!found) continue;
+        int fd = path_fmt(path, sizeof(path), "%s/%lld.seg", udir, (long long)starts[i]) == 0 ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+        char* buf = fd >= 0 ? (char*)malloc(hit.length ? hit.length : 1) : NULL;
+        if (buf && pread(fd, buf, hit.length, (off_t)hit.offset) == (ssize_t)hit.length) {
+            *out = buf;
+            *out_len = hit.length;
+            rc = 0;
+        } else {
+            free(buf);
+        }
+        if (fd >= 0) close(fd);
+    }
+    free(starts);
+    return rc;
+}
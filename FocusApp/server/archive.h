@@ -0,0 +1,60 @@
+/*
+ * Mục đích: Lưu frame nhận được xuống đĩa bất đồng bộ (archive).
+ *  - Thread nhận frame chỉ chép frame vào hàng đợi trong bộ nhớ (giới hạn theo byte) của writer
+ *    phụ trách user đó rồi đi tiếp; hàng đợi đầy thì frame bị bỏ (đếm + log), không bao giờ chờ đĩa.
+ *  - Writer thread riêng gom mọi frame đang chờ, ghi nối tiếp vào segment của từng user bằng
+ *    writev (1 lệnh ghi cho nhiều frame), cùng 1 file index. Mỗi user luôn do cùng 1 writer ghi
+ *    (chia theo hash tên) nên không cần khoá file.
+ *  - Bố cục: <dir>/<user>/<start_ms>.seg chứa byte frame nối liền nhau; <start_ms>.idx chứa các
+ *    ArchiveIndexEntry (số frame, offset, độ dài, thời điểm). Index chỉ được ghi sau dữ liệu nên
+ *    không bao giờ trỏ quá cuối segment. Frame giống hệt 1 frame vừa ghi trong cùng segment (so hash
+ *    nội dung) chỉ có entry index trỏ tới offset của bản đã ghi. Segment quá ARCHIVE_SEGMENT_MAX byte hoặc quá
+ *    ARCHIVE_SEGMENT_AGE_SEC giây thì mở segment mới.
+ *  - Retention: writer đầu tiên quét định kỳ, xoá segment cũ hơn max_age_sec rồi xoá segment cũ
+ *    nhất cho đến khi tổng dung lượng <= max_bytes (segment đang ghi của mỗi user được giữ).
+ *  - fsync: none (để kernel tự ghi), batch (fdatasync mỗi segment sau mỗi lượt ghi), always
+ *    (fdatasync sau từng frame).
+ *
+ * Hàm:
+ * - archive_start(cfg): Tạo thư mục và writer thread; -1 nếu không dùng được (frame không được lưu).
+ * - archive_submit(user, frame_no, data, length, hash): Chép frame vào hàng đợi; 1 nếu bị bỏ vì đầy.
+ *   hash = frame_hash64 của frame (framehash.h).
+ * - archive_lookup(dir, user, frame_no, out, out_len): Tìm frame mới nhất có số frame_no qua index
+ *   (tools/archive_cat, tests/test_archive); *out cấp bằng malloc.
+ * - archive_fsync_parse(value, out): "none" | "batch" | "always".
+ */
+#ifndef SERVER_ARCHIVE_H
+#define SERVER_ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    ARCHIVE_FSYNC_NONE = 0,
+    ARCHIVE_FSYNC_BATCH,
+    ARCHIVE_FSYNC_ALWAYS
+} ArchiveFsync;
+
+typedef struct {
+    char dir[256];              // rỗng = tắt archive
+    int threads;
+    size_t queue_bytes;         // byte frame chờ ghi tối đa (mọi writer cộng lại)
+    uint64_t max_bytes;         // 0 = không giới hạn dung lượng
+    int max_age_sec;            // 0 = không xoá theo tuổi
+    ArchiveFsync fsync;
+} ArchiveConfig;
+
+// On-disk index entry (host byte order)
+typedef struct {
+    uint32_t frame_no;
+    uint32_t length;
+    uint64_t offset;            // of the frame bytes in the .seg file
+    int64_t time_ms;            // wall clock when the frame was received
+} ArchiveIndexEntry;
+
+int archive_start(const ArchiveConfig* cfg);
+int archive_submit(const char* user, int frame_no, const char* data, int length, uint64_t hash);
+int archive_lookup(const char* dir, const char* user, uint32_t frame_no, char** out, size_t* out_len);
+int archive_fsync_parse(const char* value, ArchiveFsync* out);
+
+#endif // SERVER_ARCHIVE_H
@@ -0,0 +1,234 @@
+/*
+ * Mục đích: Cài đặt sniff giao thức + codec TLV/WebSocket cho mỗi kết nối (xem codec.h).
+ *
+ * Ghi chú:
+ * - Payload frame dữ liệu được giải mask từng đoạn ngay trong RxBuffer của kết nối (ws_unmask
+ *   nhớ phase giữa các đoạn) rồi đưa qua tlv_feed(): gói TLV nằm trọn trong đoạn vừa nhận được
+ *   dispatch tại chỗ, chỉ phần gói dở dang mới chép vào cc->inner. Frame lớn vì vậy không bao
+ *   giờ phải nằm trọn trong bộ nhớ; giới hạn kích thước do tầng TLV (MAX_PAYLOAD_SIZE) áp dụng.
+ * - Frame điều khiển (<= 125 byte) được chờ đủ rồi xử lý một lần; chúng có thể chen giữa
+ *   các mảnh của 1 message phân mảnh.
+ * - Frame text không thuộc giao thức (server chỉ nhận frame nhị phân chứa TLV): đóng với mã 1003.
+ * - PING được trả PONG ngay; mọi frame nhận được đều tính là peer còn sống cho heartbeat.
+ * - permessage-deflate: thương lượng lúc handshake theo g_options.ws_deflate. Payload message
+ *   nén được giải nén từng đoạn (ws_inflate) rồi mới vào tlv_feed; đuôi 00 00 ff ff được bổ
+ *   sung khi gặp frame cuối. Kích thước sau giải nén bị chặn bởi WS_INFLATE_MAX_MESSAGE.
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include "codec.h"
+#include "websocket.h"
+#include "timerwheel.h"
+#include "options.h"
+#include "../common/wsmask.h"
+
+extern void log_message(const char* level, const char* format, ...);
+
+#define WS_CLOSE_PROTOCOL_ERROR 1002
+#define WS_CLOSE_UNSUPPORTED_DATA 1003
+#define WS_CLOSE_TOO_BIG 1009
+
+void codec_init(ConnCodec* cc) {
+    memset(cc, 0, sizeof(*cc));
+    rxbuf_init(&cc->inner);
+}
+
+void codec_free(ConnCodec* cc) {
+    rxbuf_free(&cc->inner);
+    ws_deflate_free(cc->deflate);
+    cc->deflate = NULL;
+}
+
+// Control frames carry at most 125 bytes, so they are built on the stack
+static int codec_send_control(ClientContext* ctx, uint8_t opcode, const char* payload, size_t len) {
+    unsigned char frame[WS_MAX_FRAME_HEADER + WS_MAX_CONTROL_PAYLOAD];
+    if (len > WS_MAX_CONTROL_PAYLOAD) len = WS_MAX_CONTROL_PAYLOAD;
+    int hlen = websocket_frame_header(frame, opcode, len);
+    if (len > 0) memcpy(frame + hlen, payload, len);
+    return ctx_send_raw(ctx, frame, hlen + (int)len);
+}
+
+static int codec_close(ConnCodec* cc, ClientContext* ctx, int status) {
+    char code[2] = { (char)((status >> 8) & 0xFF), (char)(status & 0xFF) };
+    cc->kind = CODEC_CLOSED;
+    codec_send_control(ctx, WS_OPCODE_CLOSE, code, sizeof(code));
+    return -1;
+}
+
+static void codec_sniff(ConnCodec* cc, ClientContext* ctx, char first) {
+    if (first == 'G') {
+        cc->kind = CODEC_WS_HANDSHAKE;
+        log_message("INFO", "[Codec] fd=%d speaks WebSocket", ctx->client_fd);
+    } else {
+        cc->kind = CODEC_TLV;
+    }
+}
+
+static int codec_on_control(ConnCodec* cc, ClientContext* ctx, uint8_t opcode, const char* payload, size_t len) {
+    switch (opcode) {
+        case WS_OPCODE_PING:
+            codec_send_control(ctx, WS_OPCODE_PONG, payload, len);
+            return 0;
+        case WS_OPCODE_PONG:
+            return 0;
+        case WS_OPCODE_CLOSE:
+            // Echo the peer's status code, then close once the reply is flushed
+            cc->kind = CODEC_CLOSED;
+            codec_send_control(ctx, WS_OPCODE_CLOSE, payload, len >= 2 ? 2 : 0);
+            return -1;
+        default:
+            return codec_close(cc, ctx, WS_CLOSE_PROTOCOL_ERROR);
+    }
+}
+
+// Validate a data frame header against the fragmentation state
+static int codec_begin_data(ConnCodec* cc, ClientContext* ctx, const WsFrameHeader* h) {
+    switch (h->opcode) {
+        case WS_OPCODE_BINARY:
+            if (cc->in_message) return codec_close(cc, ctx, WS_CLOSE_PROTOCOL_ERROR);
+            break;
+        case WS_OPCODE_CONTINUATION:
+            if (!cc->in_message) return codec_close(cc, ctx, WS_CLOSE_PROTOCOL_ERROR);
+            break;
+        case WS_OPCODE_TEXT:
+            log_message("WARN", "[Codec] fd=%d sent a text frame, only binary TLV frames are accepted", ctx->client_fd);
+            return codec_close(cc, ctx, WS_CLOSE_UNSUPPORTED_DATA);
+        default:
+            return codec_close(cc, ctx, WS_CLOSE_PROTOCOL_ERROR);
+    }
+    if (h->rsv1) {
+        // RSV1 is only valid with a negotiated extension, and only on the first frame
+        if (!cc->deflate || h->opcode == WS_OPCODE_CONTINUATION) return codec_close(cc, ctx, WS_CLOSE_PROTOCOL_ERROR);
+        cc->compressed = 1;
+    } else if (h->opcode != WS_OPCODE_CONTINUATION) {
+        cc->compressed = 0;
+    }
+    // Frame boundaries carry no meaning: payloads form one TLV byte stream
+    cc->in_message = !h->fin;
+    cc->frame = *h;
+    cc->frame_left = h->length;
+    cc->frame_phase = 0;
+    return 0;
+}
+
+typedef struct {
+    RxBuffer* inner;
+    TlvHandler handler;
+    void* user;
+    int count;
+} CodecInflateSink;
+
+static int codec_inflate_sink(void* user, const char* data, size_t len) {
+    CodecInflateSink* s = (CodecInflateSink*)user;
+    int rc = tlv_feed(s->inner, data, len, s->handler, s->user);
+    if (rc < 0) return -1;
+    s->count += rc;
+    return 0;
+}
+
+// Unmask and dispatch whatever part of the current data frame's payload is buffered
+static int codec_stream_payload(ConnCodec* cc, ClientContext* ctx, RxBuffer* rx, TlvHandler handler, void* user) {
+    size_t used = rxbuf_used(rx);
+    size_t n = cc->frame_left < used ? (size_t)cc->frame_left : used;
+    char* p = rx->data + rx->head;
+    if (cc->frame.masked) cc->frame_phase = ws_unmask(p, n, cc->frame.mask, cc->frame_phase);
+    rx->head += n;
+    cc->frame_left -= n;
+    if (!cc->compressed) return tlv_feed(&cc->inner, p, n, handler, user);
+
+    CodecInflateSink sink = { &cc->inner, handler, user, 0 };
+    int final = cc->frame_left == 0 && cc->frame.fin;
+    if (ws_inflate(cc->deflate, p, n, final, codec_inflate_sink, &sink) < 0) {
+        log_message("WARN", "[Codec] fd=%d bad or oversized compressed message", ctx->client_fd);
+        return codec_close(cc, ctx, WS_CLOSE_TOO_BIG);
+    }
+    return sink.count;
+}
+
+static int codec_handshake(ConnCodec* cc, ClientContext* ctx, RxBuffer* rx) {
+    char resp[512];
+    size_t consumed = 0;
+    WsDeflateParams pmd;
+    int n = websocket_handshake_response(rx->data + rx->head, rxbuf_used(rx), &consumed, resp, sizeof(resp),
+                                         &g_options.ws_deflate, &pmd);
+    if (n < 0) {
+        static const char bad[] = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+        log_message("WARN", "[Codec] fd=%d invalid WebSocket upgrade request", ctx->client_fd);
+        cc->kind = CODEC_CLOSED;
+        ctx_send_raw(ctx, bad, (int)sizeof(bad) - 1);
+        return -1;
+    }
+    if (n == 0) return 0;
+    rx->head += consumed;
+    if (ctx_send_raw(ctx, resp, n) < 0) return -1;
+    rx->opaque = 1;
+    cc->kind = CODEC_WS;
+    ctx->is_websocket = true;
+    if (pmd.enabled) {
+        cc->deflate = ws_deflate_new(&pmd, &g_options.ws_deflate, WS_INFLATE_MAX_MESSAGE);
+        if (!cc->deflate) return -1; // the 101 already promised compression
+        ctx->ws_deflate = cc->deflate;
+        log_message("INFO", "[Codec] fd=%d permessage-deflate on (window=%d, takeover=%s)", ctx->client_fd,
+                    pmd.server_max_window_bits, pmd.server_no_context_takeover ? "off" : "on");
+    }
+    return 0;
+}
+
+int codec_parse(ConnCodec* cc, ClientContext* ctx, RxBuffer* rx, TlvHandler handler, void* user) {
+    if (cc->kind == CODEC_UNKNOWN) {
+        if (rxbuf_used(rx) == 0) return 0;
+        codec_sniff(cc, ctx, rx->data[rx->head]);
+    }
+    if (cc->kind == CODEC_TLV) return tlv_parse(rx, handler, user);
+    if (cc->kind == CODEC_CLOSED) return -1;
+
+    if (cc->kind == CODEC_WS_HANDSHAKE && codec_handshake(cc, ctx, rx) < 0) return -1;
+
+    if (cc->kind == CODEC_WS) ctx->last_rx_ms = tw_now_ms();
+    int count = 0;
+    while (cc->kind == CODEC_WS && rxbuf_used(rx) > 0) {
+        if (cc->frame_left > 0) {
+            int rc = codec_stream_payload(cc, ctx, rx, handler, user);
+            if (rc < 0) return -1;
+            count += rc;
+            continue;
+        }
+
+        WsFrameHeader h;
+        const char* p = rx->data + rx->head;
+        size_t used = rxbuf_used(rx);
+        int hlen = websocket_parse_header(p, used, &h);
+        if (hlen < 0) return codec_close(cc, ctx, WS_CLOSE_PROTOCOL_ERROR);
+        if (hlen == 0) break;
+
+        if (h.opcode & 0x08) {
+            if (used - (size_t)hlen < h.length) break;
+            char* payload = rx->data + rx->head + hlen;
+            if (h.masked) ws_unmask(payload, (size_t)h.length, h.mask, 0);
+            rx->head += (size_t)hlen + (size_t)h.length;
+            if (codec_on_control(cc, ctx, h.opcode, payload, (size_t)h.length) < 0) return -1;
+            continue;
+        }
+        if (codec_begin_data(cc, ctx, &h) < 0) return -1;
+        rx->head += (size_t)hlen;
+        if (h.length == 0 && cc->compressed && h.fin) {
+            // Empty final fragment still terminates the compressed message
+            CodecInflateSink sink = { &cc->inner, handler, user, 0 };
+            if (ws_inflate(cc->deflate, NULL, 0, 1, codec_inflate_sink, &sink) < 0) {
+                return codec_close(cc, ctx, WS_CLOSE_PROTOCOL_ERROR);
+            }
+            count += sink.count;
+        }
+    }
+    if (rx->head == rx->tail) rx->head = rx->tail = 0;
+    return count;
+}
+
+int codec_feed(ConnCodec* cc, ClientContext* ctx, RxBuffer* rx, const char* data, size_t len,
+               TlvHandler handler, void* user) {
+    if (cc->kind == CODEC_UNKNOWN && len > 0) codec_sniff(cc, ctx, data[0]);
+    if (cc->kind == CODEC_TLV) return tlv_feed(rx, data, len, handler, user);
+    if (rxbuf_append(rx, data, len) < 0) return -1;
+    return codec_parse(cc, ctx, rx, handler, user);
+}
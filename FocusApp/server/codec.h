@@ -0,0 +1,59 @@
+/*
+ * Mục đích: Nhận diện giao thức của mỗi kết nối trên cổng server và giải mã luồng byte.
+ *  - Byte đầu tiên quyết định codec: 'G' (HTTP GET) là WebSocket, còn lại là TLV thuần
+ *    (type TLV luôn là số nhỏ nên byte đầu không bao giờ là 'G').
+ *  - WebSocket: trả 101 Switching Protocols, sau đó mỗi frame nhị phân mang 1 đoạn byte
+ *    TLV (gói TLV có thể nằm trong nhiều frame hoặc nhiều gói trong 1 frame). Phản hồi
+ *    gửi lại dưới dạng frame nhị phân chứa nguyên gói TLV (xem ClientContext.is_websocket).
+ *  - Cả 2 codec cùng gọi 1 TlvHandler nên handler không cần biết kết nối là loại nào.
+ *
+ * Cấu trúc:
+ * - ConnCodec: codec đã chọn + RxBuffer ráp lại byte TLV từ payload các frame WebSocket.
+ *   Payload frame dữ liệu được stream: mỗi đoạn nhận được giải mask (SIMD, wsmask.h) và
+ *   tách gói TLV ngay, không chờ/chép trọn frame; message phân mảnh (continuation) được
+ *   nối tiếp vào cùng luồng TLV. Message có RSV1 (permessage-deflate) được giải nén theo
+ *   cùng kiểu stream trước khi tách TLV.
+ *
+ * Hàm:
+ * - codec_init/codec_free: Khởi tạo/giải phóng.
+ * - codec_parse(cc, ctx, rx, handler, user): Xử lý dữ liệu đang có trong rx (sniff, handshake,
+ *   frame WebSocket hoặc TLV); byte ngoài TLV (101, pong, close) gửi qua ctx_send_raw().
+ * - codec_feed(cc, ctx, rx, data, len, handler, user): Như trên cho dữ liệu nằm ngoài rx
+ *   (buffer io_uring); kết nối TLV vẫn được tách gói tại chỗ.
+ */
+#ifndef SERVER_CODEC_H
+#define SERVER_CODEC_H
+
+#include <stddef.h>
+#include "handlers.h"
+#include "rxbuf.h"
+#include "websocket.h"
+
+typedef enum {
+    CODEC_UNKNOWN = 0,      // chưa nhận byte nào
+    CODEC_TLV,
+    CODEC_WS_HANDSHAKE,     // đang chờ đủ header HTTP Upgrade
+    CODEC_WS,
+    CODEC_CLOSED            // đã gửi/nhận close frame
+} ConnCodecKind;
+
+typedef struct {
+    ConnCodecKind kind;
+    RxBuffer inner;         // WebSocket: TLV bytes carried by data frames
+    WsFrameHeader frame;    // data frame whose payload is being streamed
+    uint64_t frame_left;    // payload bytes of `frame` not received yet
+    size_t frame_phase;     // mask offset of the next payload byte
+    int in_message;         // fragmented message open, expecting continuation frames
+    int compressed;         // current message had RSV1 set
+    WsDeflate* deflate;     // negotiated permessage-deflate state, NULL if none
+} ConnCodec;
+
+void codec_init(ConnCodec* cc);
+void codec_free(ConnCodec* cc);
+
+// Returns number of TLV records dispatched, or -1 if the connection should be closed
+int codec_parse(ConnCodec* cc, ClientContext* ctx, RxBuffer* rx, TlvHandler handler, void* user);
+int codec_feed(ConnCodec* cc, ClientContext* ctx, RxBuffer* rx, const char* data, size_t len,
+               TlvHandler handler, void* user);
+
+#endif // SERVER_CODEC_H
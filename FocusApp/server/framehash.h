@@ -0,0 +1,19 @@
+/*
+ * Mục đích: Hash nội dung frame (không mật mã, nhanh cỡ memcpy) để nhận ra frame trùng byte.
+ *  - Thread nhận frame tính 1 lần cho mỗi frame; scorepool.c dùng để bỏ qua chấm lại frame giống
+ *    hệt frame trước (dùng lại điểm), archive.c dùng để ghi frame trùng bằng tham chiếu.
+ *  - Thuật toán XXH64 (seed 0): 4 làn 64-bit song song trên khối 32 byte rồi trộn phần đuôi.
+ *    Chỉ dùng trong tiến trình (không ghi ra đĩa) nên đọc theo byte order của máy.
+ *
+ * Hàm:
+ * - frame_hash64(data, len): Hash 64-bit của len byte.
+ */
+#ifndef SERVER_FRAMEHASH_H
+#define SERVER_FRAMEHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint64_t frame_hash64(const void* data, size_t len);
+
+#endif // SERVER_FRAMEHASH_H
@@ -5,11 +5,28 @@
  *
  * Hàm quan trọng:
  * - recv_all / send_all / send_packet: I/O socket an toàn, đóng gói TLV.
- * - shared_find_or_add_user / shared_add_session_result: Quản lý UserStat trong SharedState (có mutex).
+ * - shared_find_or_add_user / shared_add_session_result: Quản lý UserStat trong SharedState qua userstore.h
+ *     (chỉ mục băm theo username; tra cứu, đọc hồ sơ/bảng xếp hạng không khoá, bộ đếm mỗi user có seqlock riêng).
+ * - save_users_to_file: Chỉ đánh dấu cần lưu; thread lưu (users_saver_start) gom các yêu cầu trong
+ *     USERS_SAVE_DELAY_MS rồi chụp bảng không khoá và ghi file tạm + rename. Thread I/O không bao giờ
+ *     chạm đĩa vì users.txt; users_save_flush chờ mọi yêu cầu đã có được ghi xong (lúc tắt server).
+ * - append_history_record: Xếp dòng history vào hàng đợi của cùng thread lưu, ghi nối trong lượt ghi
+ *     users.txt kế tiếp (1 lần mở file cho cả lô). Thư mục data/ chỉ tạo 1 lần lúc khởi động (ensure_data_dir).
  * - handle_login / handle_start_session / handle_end_session / handle_stream_frame:
- *     Xử lý logic xác thực, bắt đầu/kết thúc phiên, phát cảnh báo định kỳ.
- * - handle_get_leaderboard / handle_get_profile: Trả JSON dữ liệu bảng xếp hạng và hồ sơ.
- * - client_thread(void*): Vòng lặp nhận gói và gọi handler tương ứng cho 1 kết nối.
+ *     Xử lý logic xác thực, bắt đầu/kết thúc phiên; frame được giao cho scoring pool (scorepool.h)
+ *     và writer lưu frame (archive.h).
+ * - handle_focus_result: Gửi điểm đã chấm xong (MSG_FOCUS_UPDATE, kèm MSG_FOCUS_WARN nếu dưới ngưỡng,
+ *     kèm MSG_RATE_HINT khi ratectl đổi nhịp frame của kết nối).
+ * - handle_get_leaderboard / handle_get_profile: Trả JSON dữ liệu bảng xếp hạng và hồ sơ (hoặc dạng
+ *     nhị phân binresp.h khi kết nối đã bật FEAT_BINARY_RESP; áp dụng cả cho điểm tập trung/kết quả phiên).
+ * - handle_packet: Dispatch 1 gói TLV tới handler theo MessageType (dùng chung cho mọi chế độ I/O).
+ * - handle_frame_chunk: Ghép MSG_FRAME_CHUNK theo stream_id, đủ frame thì xử lý như MSG_STREAM_FRAME.
+ * - handle_hello: Thương lượng version, FEAT_* và codec frame ảnh; lưu kết quả vào ClientContext.
+ *     Cấp token kênh UDP (UdpGrant sau HelloPayload) khi bật FEAT_UDP_FRAMES.
+ * - handle_batch: Tách MSG_TLV_BATCH, dispatch từng bản ghi qua handle_packet, gom phản hồi thành 1 MSG_TLV_BATCH.
+ * - handle_keepalive / handle_disconnect: Heartbeat PING/PONG, idle timeout, tự kết thúc phiên khi mất kết nối.
+ * - client_thread(void*) / client_serve(fd, ring): Vòng lặp nhận gói và gọi handler tương ứng cho 1 kết nối;
+ *     kết nối cục bộ đọc gói tại chỗ từ ring bộ nhớ chia sẻ (shmring.h).
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -21,19 +38,56 @@
 #include <time.h>
 #include <errno.h>
 #include <ctype.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <sys/time.h>
 
 #include "handlers.h"
+#include "rxbuf.h"
+#include "txqueue.h"
+#include "timerwheel.h"
+#include "options.h"
+#include "codec.h"
+#include "websocket.h"
+#include "udp.h"
+#include "scorepool.h"
+#include "scorer.h"
+#include "archive.h"
+#include "framehash.h"
+#include "../common/shmring.h"
 #include "../client/base64.h"
+#include "../common/binresp.h"
 
 extern void log_message(const char* level, const char* format, ...);
 
-SharedState g_shared; // zeroed in main; mutex initialized in main
+SharedState g_shared; // users initialized in main
 
-// Forward declarations
-static int shared_find_or_add_user_unlocked(const char* username);
-static int shared_find_user_unlocked(const char* username);
+static pthread_mutex_t g_save_mtx = PTHREAD_MUTEX_INITIALIZER; // one writer of USERS_FILE at a time
 
-// Ensure data directory exists
+// One finished session waiting to be appended to HISTORY_FILE
+typedef struct HistoryLine {
+    struct HistoryLine* next;
+    char text[128];
+} HistoryLine;
+
+// users.txt saver: requests are counted, the saver thread writes once for everything requested so far.
+// History lines are queued to the same thread and appended in the same pass.
+static struct {
+    pthread_mutex_t mtx;
+    pthread_cond_t wake;        // saver: a request, a history line or a flush arrived
+    pthread_cond_t done;        // flushers: `written` / `history_written` moved
+    unsigned long requested;    // save requests so far
+    unsigned long written;      // requests covered by the last finished write
+    HistoryLine* history;       // queued history lines, oldest first
+    HistoryLine** history_tail;
+    unsigned long history_queued;  // history lines queued so far
+    unsigned long history_written; // history lines taken by a finished append
+    int flushing;               // flushers waiting: skip the coalescing delay
+    int running;                // 0 = callers write USERS_FILE / HISTORY_FILE themselves
+} g_saver = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0,
+              NULL, &g_saver.history, 0, 0, 0, 0 };
+
+// Ensure data directory exists (once at startup: the writers below assume it)
 void ensure_data_dir() {
     int ret = system("mkdir -p data");
     if (ret != 0) {
@@ -43,12 +97,11 @@ void ensure_data_dir() {
 
 // Load users from USERS_FILE into shared state (overwrites current in-memory)
 void load_users_from_file() {
-    ensure_data_dir();
     FILE* f = fopen(USERS_FILE, "r");
     if (!f) return; // if file absent, ignore
 
-    pthread_mutex_lock(&g_shared.mtx);
-    memset(&g_shared.users, 0, sizeof(g_shared.users));
+    // Startup only: no other thread touches the table yet
+    userstore_clear(&g_shared.users);
 
     char line[256];
     while (fgets(line, sizeof(line), f)) {
@@ -59,84 +112,156 @@ void load_users_from_file() {
             strcpy(pass, "");
         }
         if (n >= 4) {
-            int idx = shared_find_or_add_user_unlocked(user);
+            int idx = userstore_add(&g_shared.users, user, pass, NULL);
             if (idx >= 0) {
-                strncpy(g_shared.users[idx].password, pass, sizeof(g_shared.users[idx].password)-1);
-                g_shared.users[idx].password[sizeof(g_shared.users[idx].password)-1] = '\0';
-                g_shared.users[idx].total_coins = coins;
-                g_shared.users[idx].total_sessions = sessions;
-                g_shared.users[idx].total_seconds = seconds;
+                UserTotals totals = { coins, sessions, seconds };
+                userstore_set_totals(&g_shared.users, idx, &totals);
             }
         }
     }
-    pthread_mutex_unlock(&g_shared.mtx);
+    unsigned count = userstore_count(&g_shared.users);
     fclose(f);
-    log_message("INFO", "[Persist] Loaded users from %s", USERS_FILE);
+    log_message("INFO", "[Persist] Loaded %u users from %s", count, USERS_FILE);
 }
 
-// Save all users to USERS_FILE (overwrite)
-void save_users_to_file() {
-    ensure_data_dir();
-    FILE* f = fopen(USERS_FILE, "w");
+// Write all users to USERS_FILE (overwrite). Records are read lock-free while the file is written;
+// a write that overlaps a session end sees it or the next write does.
+static void write_users_file(unsigned long requests) {
+    pthread_mutex_lock(&g_save_mtx);
+    FILE* f = fopen(USERS_FILE ".tmp", "w");
     if (!f) {
-        log_message("ERROR", "[Persist] Cannot open %s to save users: %s", USERS_FILE, strerror(errno));
+        pthread_mutex_unlock(&g_save_mtx);
+        log_message("ERROR", "[Persist] Cannot open %s to save users: %s", USERS_FILE ".tmp", strerror(errno));
         return;
     }
-    pthread_mutex_lock(&g_shared.mtx);
-    for (int i = 0; i < MAX_USERS; ++i) {
-        if (!g_shared.users[i].in_use) continue;
+    uint32_t count = userstore_count(&g_shared.users);
+    for (uint32_t i = 0; i < count; ++i) {
+        const UserStat* u = userstore_at(&g_shared.users, (int)i);
+        UserTotals t;
+        userstore_read(&g_shared.users, (int)i, &t);
         fprintf(f, "%s|%s|%d|%d|%d\n",
-                g_shared.users[i].username,
-                g_shared.users[i].password,
-                g_shared.users[i].total_coins,
-                g_shared.users[i].total_sessions,
-                g_shared.users[i].total_seconds);
+                u->username,
+                u->password,
+                t.coins,
+                t.sessions,
+                t.seconds);
     }
-    pthread_mutex_unlock(&g_shared.mtx);
-    fclose(f);
-    log_message("INFO", "[Persist] Saved users to %s", USERS_FILE);
+    int failed = ferror(f);
+    if (fclose(f) != 0) failed = 1;
+    if (failed || rename(USERS_FILE ".tmp", USERS_FILE) != 0) {
+        pthread_mutex_unlock(&g_save_mtx);
+        log_message("ERROR", "[Persist] Cannot save users to %s: %s", USERS_FILE, strerror(errno));
+        return;
+    }
+    pthread_mutex_unlock(&g_save_mtx);
+    log_message("INFO", "[Persist] Saved %u users to %s (%lu request(s))", count, USERS_FILE, requests);
 }
 
-// Append history record for a session
-void append_history_record(const char* username, int seconds, int coins) {
-    ensure_data_dir();
+// Append queued lines to HISTORY_FILE with one open; frees the list
+static void write_history_lines(HistoryLine* lines) {
     FILE* f = fopen(HISTORY_FILE, "a");
-    if (!f) {
-        log_message("ERROR", "[Persist] Cannot append history to %s: %s", HISTORY_FILE, strerror(errno));
-        return;
+    if (!f) log_message("ERROR", "[Persist] Cannot append history to %s: %s", HISTORY_FILE, strerror(errno));
+    while (lines) {
+        HistoryLine* next = lines->next;
+        if (f) fputs(lines->text, f);
+        free(lines);
+        lines = next;
     }
-    time_t now = time(NULL);
-    fprintf(f, "%s|%d|%d|%ld\n", username, seconds, coins, (long)now);
-    fclose(f);
+    if (f) fclose(f);
 }
 
-// Internal find/add without locking (caller must hold g_shared.mtx)
-static int shared_find_user_unlocked(const char* username) {
-    for (int i = 0; i < MAX_USERS; ++i) {
-        if (g_shared.users[i].in_use && strcmp(g_shared.users[i].username, username) == 0) {
-            return i;
+static void* users_saver(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&g_saver.mtx);
+    for (;;) {
+        while (g_saver.written == g_saver.requested && !g_saver.history) {
+            pthread_cond_wait(&g_saver.wake, &g_saver.mtx);
         }
+        // Sessions tend to end in bursts (a shared timer, a reconnect storm): one write covers the burst
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (long)USERS_SAVE_DELAY_MS * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        while (!g_saver.flushing && pthread_cond_timedwait(&g_saver.wake, &g_saver.mtx, &deadline) != ETIMEDOUT) {
+        }
+        unsigned long target = g_saver.requested;
+        unsigned long requests = target - g_saver.written;
+        unsigned long history_target = g_saver.history_queued;
+        HistoryLine* history = g_saver.history;
+        g_saver.history = NULL;
+        g_saver.history_tail = &g_saver.history;
+        pthread_mutex_unlock(&g_saver.mtx);
+        if (requests > 0) write_users_file(requests);
+        write_history_lines(history);
+        pthread_mutex_lock(&g_saver.mtx);
+        // A failed write is logged and not retried until the next request, so flushers never hang
+        g_saver.written = target;
+        g_saver.history_written = history_target;
+        pthread_cond_broadcast(&g_saver.done);
     }
-    return -1;
+    return NULL;
+}
+
+int users_saver_start(void) {
+    pthread_t th;
+    if (pthread_create(&th, NULL, users_saver, NULL) != 0) return -1;
+    pthread_detach(th);
+    pthread_mutex_lock(&g_saver.mtx);
+    g_saver.running = 1;
+    pthread_mutex_unlock(&g_saver.mtx);
+    return 0;
 }
 
-static int shared_find_or_add_user_unlocked(const char* username) {
-    int idx = -1, free_idx = -1;
-    for (int i = 0; i < MAX_USERS; ++i) {
-        if (g_shared.users[i].in_use && strcmp(g_shared.users[i].username, username) == 0) {
-            idx = i; break;
+// Ask for USERS_FILE to be rewritten; returns at once when the saver thread runs
+void save_users_to_file() {
+    pthread_mutex_lock(&g_saver.mtx);
+    int queued = g_saver.running;
+    if (queued) {
+        g_saver.requested++;
+        pthread_cond_signal(&g_saver.wake);
+    }
+    pthread_mutex_unlock(&g_saver.mtx);
+    if (!queued) write_users_file(1);
+}
+
+void users_save_flush(void) {
+    pthread_mutex_lock(&g_saver.mtx);
+    if (g_saver.running) {
+        unsigned long target = g_saver.requested;
+        unsigned long history_target = g_saver.history_queued;
+        g_saver.flushing++;
+        pthread_cond_signal(&g_saver.wake);
+        while (g_saver.written < target || g_saver.history_written < history_target) {
+            pthread_cond_wait(&g_saver.done, &g_saver.mtx);
         }
-        if (!g_shared.users[i].in_use && free_idx == -1) free_idx = i;
+        g_saver.flushing--;
+    }
+    pthread_mutex_unlock(&g_saver.mtx);
+}
+
+// Append history record for a session; queued to the saver thread when it runs
+void append_history_record(const char* username, int seconds, int coins) {
+    HistoryLine* line = (HistoryLine*)malloc(sizeof(HistoryLine));
+    if (!line) {
+        log_message("ERROR", "[Persist] Out of memory, history of %s dropped", username);
+        return;
     }
-    if (idx == -1 && free_idx != -1) {
-        strncpy(g_shared.users[free_idx].username, username, sizeof(g_shared.users[free_idx].username)-1);
-        g_shared.users[free_idx].username[sizeof(g_shared.users[free_idx].username)-1] = '\0';
-        g_shared.users[free_idx].in_use = 1;
-        idx = free_idx;
+    line->next = NULL;
+    snprintf(line->text, sizeof(line->text), "%s|%d|%d|%ld\n", username, seconds, coins, (long)time(NULL));
+    pthread_mutex_lock(&g_saver.mtx);
+    int queued = g_saver.running;
+    if (queued) {
+        *g_saver.history_tail = line;
+        g_saver.history_tail = &line->next;
+        g_saver.history_queued++;
+        pthread_cond_signal(&g_saver.wake);
     }
-    return idx;
+    pthread_mutex_unlock(&g_saver.mtx);
+    if (!queued) write_history_lines(line);
 }
 
+
 int recv_all(int fd, void* buf, int len) {
     int total = 0;
     char* p = (char*)buf;
@@ -148,49 +273,206 @@ int recv_all(int fd, void* buf, int len) {
     return total;
 }
 
+// Wait until a (possibly non-blocking) socket becomes writable
+static int wait_writable(int fd, int timeout_ms) {
+    struct pollfd pfd = { .fd = fd, .events = POLLOUT, .revents = 0 };
+    for (;;) {
+        int r = poll(&pfd, 1, timeout_ms);
+        if (r < 0 && errno == EINTR) continue;
+        return (r > 0 && !(pfd.revents & (POLLERR | POLLNVAL))) ? 0 : -1;
+    }
+}
+
 int send_all(int fd, const void* buf, int len) {
     int total = 0;
     const char* p = (const char*)buf;
     while (total < len) {
-        int n = send(fd, p + total, len - total, 0);
+        int n = send(fd, p + total, len - total, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Socket non-blocking (chế độ epoll): chờ ghi được rồi thử lại
+            if (wait_writable(fd, SEND_TIMEOUT_MS) < 0) return -1;
+            continue;
+        }
         if (n <= 0) return -1;
         total += n;
     }
     return total;
 }
 
+// Header + payload gom trong 1 lần sendmsg thay vì 2 lần send
+static int send_header_payload(int fd, const void* hdr, size_t hsize, const void* payload, int length) {
+    if (length < 0 || !payload) length = 0;
+
+    struct iovec iov[2];
+    iov[0].iov_base = (void*)hdr;
+    iov[0].iov_len = hsize;
+    iov[1].iov_base = (void*)payload;
+    iov[1].iov_len = (size_t)length;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = length > 0 ? 2 : 1;
+
+    ssize_t n;
+    do {
+        n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+        n = 0;
+    }
+
+    // Short write: finish the remainder byte-exactly
+    if (n < (ssize_t)hsize) {
+        if (send_all(fd, (const char*)hdr + n, (int)(hsize - (size_t)n)) < 0) return -1;
+        n = (ssize_t)hsize;
+    }
+    int sent_payload = (int)(n - (ssize_t)hsize);
+    if (sent_payload < length) {
+        if (send_all(fd, (const char*)payload + sent_payload, length - sent_payload) < 0) return -1;
+    }
+    return 0;
+}
+
 int send_packet(int fd, int type, const void* payload, int length) {
     PacketHeader hdr;
     hdr.type = type;
     hdr.length = length;
-    if (send_all(fd, &hdr, HEADER_SIZE) < 0) return -1;
-    if (length > 0 && payload) {
-        if (send_all(fd, payload, length) < 0) return -1;
+    return send_header_payload(fd, &hdr, HEADER_SIZE, payload, length);
+}
+
+int ctx_packet_header(const ClientContext* ctx, int type, int length, PacketHeaderExt* hdr) {
+    hdr->type = type;
+    hdr->length = length;
+    if (!ctx->ext_header) return (int)HEADER_SIZE;
+    hdr->type |= MSG_EXT_HEADER;
+    hdr->tag.request_id = ctx->reply_id;
+    hdr->tag.flags = ctx->reply_id ? 0 : PKT_FLAG_PUSH;
+    return (int)HEADER_EXT_SIZE;
+}
+
+// Compress header+payload into one RSV1 frame. The frame header is written into the
+// headroom in front of the deflate output so the frame leaves as a single raw message.
+// Compressed frames depend on the shared compression context, so they are never dropped.
+static int ctx_send_deflated(ClientContext* ctx, int type, const void* payload, int length) {
+    PacketHeaderExt hdr;
+    int hsize = ctx_packet_header(ctx, type, length, &hdr);
+    char* out = NULL;
+    size_t out_len = 0;
+    if (ws_deflate_compress(ctx->ws_deflate, WS_MAX_FRAME_HEADER, &hdr, (size_t)hsize,
+                            payload, (size_t)length, &out, &out_len) < 0) return -1;
+    unsigned char frame[WS_MAX_FRAME_HEADER];
+    int hlen = websocket_frame_header_ex(frame, WS_OPCODE_BINARY, 1, out_len);
+    memcpy(out - hlen, frame, (size_t)hlen);
+    return ctx_send_raw(ctx, out - hlen, hlen + (int)out_len);
+}
+
+// Replies produced while a MSG_TLV_BATCH is dispatched, encoded as back-to-back TLV records
+struct TlvBatch {
+    char* data;
+    size_t len;
+    size_t cap;
+    uint32_t id;    // request_id of the envelope, also used for untagged inner records
+};
+
+static int batch_flush(ClientContext* ctx) {
+    struct TlvBatch* b = ctx->batch;
+    if (b->len == 0) return 0;
+    uint32_t reply_id = ctx->reply_id;
+    ctx->batch = NULL;
+    ctx->reply_id = b->id;
+    int rc = ctx_send(ctx, MSG_TLV_BATCH, b->data, (int)b->len);
+    ctx->reply_id = reply_id;
+    ctx->batch = b;
+    b->len = 0;
+    return rc;
+}
+
+static int batch_append(ClientContext* ctx, int type, const void* payload, int length) {
+    struct TlvBatch* b = ctx->batch;
+    if (length < 0 || !payload) length = 0;
+    PacketHeaderExt hdr;
+    size_t hsize = (size_t)ctx_packet_header(ctx, type, length, &hdr);
+    size_t need = hsize + (size_t)length;
+    if (b->len + need > MAX_PAYLOAD_SIZE && batch_flush(ctx) < 0) return -1;
+    if (need > MAX_PAYLOAD_SIZE) {
+        // Too large for any envelope: let it go out on its own
+        ctx->batch = NULL;
+        int rc = ctx_send(ctx, type, payload, length);
+        ctx->batch = b;
+        return rc;
+    }
+    if (b->cap - b->len < need) {
+        size_t cap = b->cap ? b->cap : 1024;
+        while (cap - b->len < need) cap *= 2;
+        char* data = (char*)realloc(b->data, cap);
+        if (!data) return -1;
+        b->data = data;
+        b->cap = cap;
     }
+    memcpy(b->data + b->len, &hdr, hsize);
+    if (length > 0) memcpy(b->data + b->len + hsize, payload, (size_t)length);
+    b->len += need;
     return 0;
 }
 
+// FEAT_DEFLATE on plain TLV: only the payload is compressed, the header stays readable and
+// carries PKT_FLAG_DEFLATE. Like the WebSocket path, the result leaves as a raw message.
+static int ctx_send_tlv_deflated(ClientContext* ctx, int type, const void* payload, int length) {
+    PacketHeaderExt hdr;
+    int hsize = ctx_packet_header(ctx, type, 0, &hdr);
+    char* out = NULL;
+    size_t out_len = 0;
+    if (ws_deflate_compress(ctx->tlv_deflate, (size_t)hsize, NULL, 0, payload, (size_t)length,
+                            &out, &out_len) < 0) return -1;
+    hdr.length = (int32_t)out_len;
+    hdr.tag.flags |= PKT_FLAG_DEFLATE;
+    memcpy(out - hsize, &hdr, (size_t)hsize);
+    return ctx_send_raw(ctx, out - hsize, hsize + (int)out_len);
+}
+
+int ctx_send(ClientContext* ctx, int type, const void* payload, int length) {
+    if (ctx->batch) return batch_append(ctx, type, payload, length);
+    if (ctx->tlv_deflate && length > 0 && ws_deflate_wants(ctx->tlv_deflate, (size_t)length)) {
+        return ctx_send_tlv_deflated(ctx, type, payload, length);
+    }
+    if (ctx->ws_deflate && length >= 0 && ws_deflate_wants(ctx->ws_deflate, HEADER_SIZE + (size_t)length)) {
+        return ctx_send_deflated(ctx, type, payload, length);
+    }
+    if (ctx->send_fn) return ctx->send_fn(ctx, type, payload, length);
+    PacketHeaderExt hdr;
+    int hsize = ctx_packet_header(ctx, type, length, &hdr);
+    if (ctx->is_websocket) {
+        unsigned char frame[WS_MAX_FRAME_HEADER];
+        int hlen = websocket_frame_header(frame, WS_OPCODE_BINARY, (uint64_t)hsize + (uint64_t)(length > 0 ? length : 0));
+        if (send_all(ctx->client_fd, frame, hlen) < 0) return -1;
+    }
+    return send_header_payload(ctx->client_fd, &hdr, (size_t)hsize, payload, length);
+}
+
+int ctx_send_raw(ClientContext* ctx, const void* data, int length) {
+    if (ctx->send_raw_fn) return ctx->send_raw_fn(ctx, data, length);
+    return send_all(ctx->client_fd, data, length) < 0 ? -1 : 0;
+}
+
 int shared_find_or_add_user(const char* username) {
-    pthread_mutex_lock(&g_shared.mtx);
-    int idx = shared_find_or_add_user_unlocked(username);
-    pthread_mutex_unlock(&g_shared.mtx);
+    int idx = userstore_add(&g_shared.users, username, "", NULL);
+    if (idx < 0) log_message("ERROR", "[Users] Cannot grow user table for %s", username);
     return idx;
 }
 
 void shared_add_session_result(const char* username, int seconds, int coins) {
-    pthread_mutex_lock(&g_shared.mtx);
-    int idx = shared_find_or_add_user_unlocked(username);
+    int idx = shared_find_or_add_user(username);
     if (idx >= 0) {
-        g_shared.users[idx].total_sessions += 1;
-        g_shared.users[idx].total_seconds += seconds;
-        g_shared.users[idx].total_coins += coins;
+        UserTotals delta = { coins, 1, seconds };
+        userstore_add_totals(&g_shared.users, idx, &delta);
     }
-    pthread_mutex_unlock(&g_shared.mtx);
 }
 
 static void send_error(ClientContext* ctx, const char* where, const char* message) {
     (void)where;
-    send_packet(ctx->client_fd, MSG_ERROR, message, (int)strlen(message));
+    ctx_send(ctx, MSG_ERROR, message, (int)strlen(message));
 }
 
 static int parse_user_pass(const char* payload, int length, char* user, int ulen, char* pass, int plen) {
@@ -212,21 +494,18 @@ static int handle_login(ClientContext* ctx, const char* payload, int length) {
         return -1;
     }
 
-    pthread_mutex_lock(&g_shared.mtx);
-    int idx = shared_find_user_unlocked(user);
-        if (idx < 0 || strcmp(g_shared.users[idx].password, pass) != 0) {
-            pthread_mutex_unlock(&g_shared.mtx);
+    int idx = userstore_find(&g_shared.users, user);
+        if (idx < 0 || strcmp(userstore_at(&g_shared.users, idx)->password, pass) != 0) {
             send_error(ctx, "login", "Sai tài khoản hoặc mật khẩu");
             return -1;
         }
-    pthread_mutex_unlock(&g_shared.mtx);
 
     strncpy(ctx->username, user, sizeof(ctx->username) - 1);
     ctx->username[sizeof(ctx->username) - 1] = '\0';
     ctx->logged_in = 1;
 
     const char* ok = RESPONSE_OK;
-        send_packet(ctx->client_fd, MSG_LOGIN_RES, ok, (int)strlen(ok));
+        ctx_send(ctx, MSG_LOGIN_RES, ok, (int)strlen(ok));
     log_message("INFO", "[Auth] User %s logged in", ctx->username);
     return 0;
 }
@@ -238,38 +517,38 @@ static int handle_register(ClientContext* ctx, const char* payload, int length)
         return -1;
     }
 
-    pthread_mutex_lock(&g_shared.mtx);
-    int idx = shared_find_user_unlocked(user);
-    if (idx >= 0) {
-        pthread_mutex_unlock(&g_shared.mtx);
+    // Password is set before the record is published, so a concurrent login never sees it half-made
+    int created = 0;
+    int idx = userstore_add(&g_shared.users, user, pass, &created);
+    if (idx >= 0 && !created) {
             send_error(ctx, "register", "Tài khoản đã tồn tại");
             return -1;
         }
-    int new_idx = shared_find_or_add_user_unlocked(user);
-    if (new_idx >= 0) {
-        strncpy(g_shared.users[new_idx].password, pass, sizeof(g_shared.users[new_idx].password) - 1);
-        g_shared.users[new_idx].password[sizeof(g_shared.users[new_idx].password) - 1] = '\0';
-        g_shared.users[new_idx].total_coins = 0;
-        g_shared.users[new_idx].total_sessions = 0;
-        g_shared.users[new_idx].total_seconds = 0;
+    if (idx < 0) {
+        log_message("ERROR", "[Users] Cannot grow user table for %s", user);
+        send_error(ctx, "register", "Server không thể tạo tài khoản");
+        return -1;
     }
-    pthread_mutex_unlock(&g_shared.mtx);
 
     save_users_to_file();
 
     const char* ok = RESPONSE_OK;
-        send_packet(ctx->client_fd, MSG_REGISTER_RES, ok, (int)strlen(ok));
+        ctx_send(ctx, MSG_REGISTER_RES, ok, (int)strlen(ok));
     log_message("INFO", "[Auth] User %s registered", user);
     return 0;
 }
 
 static void handle_start_session(ClientContext* ctx) {
     ctx->session_start = time(NULL);
+    ctx->session_active = 1;
     ctx->frame_count = 0;
+    udp_reset_frames(ctx->udp_token, ctx->username);
     log_message("INFO", "[Pomo] %s started session", ctx->username[0]?ctx->username:"<guest>");
 }
 
-static void handle_end_session(ClientContext* ctx) {
+// notify = 0 when the client is already gone (auto-end on disconnect)
+static void finish_session(ClientContext* ctx, int notify) {
+    ctx->session_active = 0;
     time_t now = time(NULL);
     int seconds = (int)difftime(now, ctx->session_start);
     if (seconds < 0) seconds = 0;
@@ -282,119 +561,529 @@ static void handle_end_session(ClientContext* ctx) {
     save_users_to_file();
     append_history_record(user, seconds, coins);
 
+    if (!notify) {
+        log_message("INFO", "[Pomo] %s disconnected mid-session, auto-ended: %d sec, %d coins", user, seconds, coins);
+        return;
+    }
     char json[256];
-    snprintf(json, sizeof(json), "{\"seconds\":%d,\"coins\":%d}", seconds, coins);
-        send_packet(ctx->client_fd, MSG_UPDATE_COINS, json, (int)strlen(json));
+    if (ctx->features & FEAT_BINARY_RESP) {
+        ctx_send(ctx, MSG_UPDATE_COINS, json, binresp_session_result(json, sizeof(json), seconds, coins));
+    } else {
+        snprintf(json, sizeof(json), "{\"seconds\":%d,\"coins\":%d}", seconds, coins);
+        ctx_send(ctx, MSG_UPDATE_COINS, json, (int)strlen(json));
+    }
     log_message("INFO", "[Pomo] %s ended session: %d sec, %d coins", user, seconds, coins);
 }
 
+static void handle_end_session(ClientContext* ctx) {
+    finish_session(ctx, 1);
+}
+
+int focus_update_payload(char* buf, size_t cap, uint32_t features, int score, int frames) {
+    if (features & FEAT_BINARY_RESP) return binresp_focus_update(buf, cap, score, frames);
+    int n = snprintf(buf, cap, "{\"score\":%d,\"frames\":%d}", score, frames);
+    return (n < 0 || (size_t)n >= cap) ? -1 : n;
+}
+
 static void handle_stream_frame(ClientContext* ctx, const char* data, int length) {
+    unsigned char* decoded = NULL;
+    if (ctx->frame_codec == FRAME_CODEC_BASE64 && length > 0) {
+        size_t need = base64_decoded_size(data, (size_t)length);
+        decoded = (unsigned char*)malloc(need ? need : 1);
+        int n = decoded ? base64_decode(data, (size_t)length, decoded, need) : -1;
+        if (n < 0) {
+            free(decoded);
+            send_error(ctx, "stream", "Frame Base64 không hợp lệ");
+            return;
+        }
+        data = (const char*)decoded;
+        length = n;
+    }
     ctx->frame_count++;
+    uint64_t hash = frame_hash64(data, (size_t)length);     // 1 lần cho cả archive và chấm điểm
 
-    const char* user = ctx->username[0] ? ctx->username : "guest";
+    // Lưu frame: chỉ chép vào hàng đợi của writer archive, không chờ đĩa
+    archive_submit(ctx->username, ctx->frame_count, data, length, hash);
 
-    // Tính điểm tập trung đơn giản dựa trên checksum payload (demo)
-    unsigned long long sum = 0;
-    int step = (length > 4096) ? length / 4096 : 1;
-    for (int i = 0; i < length; i += step) sum += (unsigned char)data[i];
-    int score = (int)((sum % 10100) / 100); // 0..100
+    // Chấm điểm trên scoring pool; kết quả quay về thread sở hữu kết nối (handle_focus_result)
+    if (!ctx->score) ctx->score = score_session_open(ctx, ctx->score_mailbox);
+    if (ctx->score) {
+        score_submit(ctx->score, data, length, ctx->frame_count, hash);
+    } else {
+        handle_focus_result(ctx, scorer_checksum(data, length), ctx->frame_count);
+    }
+    free(decoded);
+}
 
+void handle_focus_result(ClientContext* ctx, int score, int frame_no) {
     char json[128];
-    snprintf(json, sizeof(json), "{\"score\":%d,\"frames\":%d}", score, ctx->frame_count);
-        send_packet(ctx->client_fd, MSG_FOCUS_UPDATE, json, (int)strlen(json));
-        if (score < FOCUS_THRESHOLD) send_packet(ctx->client_fd, MSG_FOCUS_WARN, NULL, 0);
-    log_message("INFO", "[Stream] Frame %d from %s, score=%d", ctx->frame_count, user, score);
+    ctx_send(ctx, MSG_FOCUS_UPDATE, json, focus_update_payload(json, sizeof(json), ctx->features, score, frame_no));
+    if (score < FOCUS_THRESHOLD) ctx_send(ctx, MSG_FOCUS_WARN, NULL, 0);
+    log_message("INFO", "[Stream] Frame %d from %s, score=%d", frame_no, ctx->username[0] ? ctx->username : "guest", score);
+    RateHintPayload hint;
+    if ((ctx->features & FEAT_RATE_HINT) && ratectl_observe(&ctx->rate, score, &hint)) {
+        ctx_send(ctx, MSG_RATE_HINT, &hint, (int)sizeof(hint));
+        log_message("DEBUG", "[Rate] %s: 1 frame / %u ms, <= %u bytes", ctx->username[0] ? ctx->username : "guest",
+                    hint.interval_ms, hint.max_frame);
+    }
+}
+
+// Frame being reassembled from MSG_FRAME_CHUNK; the buffer is kept for the next frame
+struct FrameUpload {
+    uint32_t stream_id;
+    uint32_t total;
+    uint32_t received;      // chunks of a stream arrive in order, so this is also the next offset
+    int active;
+    char* data;
+    size_t cap;
+};
+
+static void frame_upload_reset(struct FrameUpload* up) {
+    up->active = 0;
+    up->received = 0;
+    // Do not pin a full-size buffer per slot after one large frame
+    if (up->cap > FRAME_CHUNK_SIZE * 16) {
+        free(up->data);
+        up->data = NULL;
+        up->cap = 0;
+    }
+}
+
+static struct FrameUpload* frame_upload_find(ClientContext* ctx, uint32_t stream_id, int create) {
+    if (!ctx->uploads) {
+        if (!create) return NULL;
+        ctx->uploads = (struct FrameUpload*)calloc(FRAME_UPLOAD_STREAMS, sizeof(struct FrameUpload));
+        if (!ctx->uploads) return NULL;
+    }
+    struct FrameUpload* free_slot = NULL;
+    for (int i = 0; i < FRAME_UPLOAD_STREAMS; ++i) {
+        struct FrameUpload* up = &ctx->uploads[i];
+        if (up->active && up->stream_id == stream_id) return up;
+        if (!up->active && !free_slot) free_slot = up;
+    }
+    return create ? free_slot : NULL;
+}
+
+static void handle_frame_chunk(ClientContext* ctx, const char* payload, int length) {
+    FrameChunkHeader ch;
+    if (length < (int)sizeof(ch)) {
+        send_error(ctx, "chunk", "MSG_FRAME_CHUNK thiếu header");
+        return;
+    }
+    memcpy(&ch, payload, sizeof(ch));
+    const char* data = payload + sizeof(ch);
+    uint32_t len = (uint32_t)length - (uint32_t)sizeof(ch);
+    if (ch.total == 0 || ch.total > MAX_PAYLOAD_SIZE || ch.offset > ch.total || len > ch.total - ch.offset) {
+        send_error(ctx, "chunk", "MSG_FRAME_CHUNK sai kích thước");
+        return;
+    }
+
+    struct FrameUpload* up = frame_upload_find(ctx, ch.stream_id, 0);
+    if (!up && ch.offset == 0 && len == ch.total) {
+        handle_stream_frame(ctx, data, (int)len); // single-chunk frame: no copy
+        return;
+    }
+    if (!up) {
+        if (ch.offset != 0) {
+            // Rest of a stream that was already rejected, the error went out with its first bad chunk
+            log_message("DEBUG", "fd=%d dropping chunk of unknown stream %u", ctx->client_fd, ch.stream_id);
+            return;
+        }
+        up = frame_upload_find(ctx, ch.stream_id, 1);
+        if (!up) {
+            send_error(ctx, "chunk", "Quá nhiều frame đang tải dở");
+            return;
+        }
+        if (up->cap < ch.total) {
+            char* buf = (char*)realloc(up->data, ch.total);
+            if (!buf) {
+                send_error(ctx, "chunk", "Hết bộ nhớ khi ghép frame");
+                return;
+            }
+            up->data = buf;
+            up->cap = ch.total;
+        }
+        up->active = 1;
+        up->stream_id = ch.stream_id;
+        up->total = ch.total;
+        up->received = 0;
+    }
+    if (ch.offset != up->received || ch.total != up->total) {
+        log_message("WARN", "fd=%d stream %u: chunk at %u, expected %u", ctx->client_fd, ch.stream_id, ch.offset,
+                    up->received);
+        frame_upload_reset(up);
+        send_error(ctx, "chunk", "MSG_FRAME_CHUNK sai thứ tự");
+        return;
+    }
+    memcpy(up->data + up->received, data, len);
+    up->received += len;
+    if (up->received == up->total) {
+        handle_stream_frame(ctx, up->data, (int)up->total);
+        frame_upload_reset(up);
+    }
+}
+
+// Binary leaderboard: entries are encoded straight from the user table (lock-free reads, userstore.h)
+static void handle_get_leaderboard_binary(ClientContext* ctx) {
+    char buf[2048];
+    size_t off = (size_t)binresp_leaderboard_begin(buf, sizeof(buf));
+
+    uint32_t users = userstore_count(&g_shared.users);
+    int count = 0;
+    for (uint32_t i = 0; i < users && count < 10; ++i) {
+        UserTotals t;
+        userstore_read(&g_shared.users, (int)i, &t);
+        if (binresp_leaderboard_add(buf, sizeof(buf), &off, userstore_at(&g_shared.users, (int)i)->username,
+                                    t.coins, t.sessions) < 0) break;
+        count++;
+    }
+
+    ctx_send(ctx, MSG_RES_LEADERBOARD, buf, (int)off);
 }
 
 static void handle_get_leaderboard(ClientContext* ctx) {
+    if (ctx->features & FEAT_BINARY_RESP) {
+        handle_get_leaderboard_binary(ctx);
+        return;
+    }
     // Build simple JSON array of top users (first N)
     char buf[2048];
     int off = 0;
     off += snprintf(buf+off, sizeof(buf)-off, "[");
 
-    pthread_mutex_lock(&g_shared.mtx);
+    uint32_t users = userstore_count(&g_shared.users);
     int count = 0;
-    for (int i = 0; i < MAX_USERS && count < 10; ++i) {
-        if (!g_shared.users[i].in_use) continue;
+    for (uint32_t i = 0; i < users && count < 10; ++i) {
+        UserTotals t;
+        userstore_read(&g_shared.users, (int)i, &t);
         if (count > 0) off += snprintf(buf+off, sizeof(buf)-off, ",");
         off += snprintf(buf+off, sizeof(buf)-off, "{\"username\":\"%s\",\"coins\":%d,\"sessions\":%d}",
-                        g_shared.users[i].username, g_shared.users[i].total_coins, g_shared.users[i].total_sessions);
+                        userstore_at(&g_shared.users, (int)i)->username, t.coins, t.sessions);
         count++;
     }
-    pthread_mutex_unlock(&g_shared.mtx);
 
     off += snprintf(buf+off, sizeof(buf)-off, "]");
-        send_packet(ctx->client_fd, MSG_RES_LEADERBOARD, buf, (int)strlen(buf));
+        ctx_send(ctx, MSG_RES_LEADERBOARD, buf, (int)strlen(buf));
 }
 
 static void handle_get_profile(ClientContext* ctx) {
     char buf[512];
-    pthread_mutex_lock(&g_shared.mtx);
-    int idx = shared_find_or_add_user_unlocked(ctx->username);
-    int coins = 0, sessions = 0, seconds = 0;
-    if (idx >= 0) {
-        coins = g_shared.users[idx].total_coins;
-        sessions = g_shared.users[idx].total_sessions;
-        seconds = g_shared.users[idx].total_seconds;
-    }
-    pthread_mutex_unlock(&g_shared.mtx);
+    int idx = shared_find_or_add_user(ctx->username);
+    UserTotals t = { 0, 0, 0 };
+    if (idx >= 0) userstore_read(&g_shared.users, idx, &t);
+    int coins = t.coins, sessions = t.sessions, seconds = t.seconds;
 
+    if (ctx->features & FEAT_BINARY_RESP) {
+        ctx_send(ctx, MSG_RES_PROFILE, buf, binresp_profile(buf, sizeof(buf), ctx->username, coins, sessions, seconds));
+        return;
+    }
     snprintf(buf, sizeof(buf), "{\"username\":\"%s\",\"coins\":%d,\"sessions\":%d,\"seconds\":%d}",
              ctx->username, coins, sessions, seconds);
-        send_packet(ctx->client_fd, MSG_RES_PROFILE, buf, (int)strlen(buf));
+        ctx_send(ctx, MSG_RES_PROFILE, buf, (int)strlen(buf));
 }
 
-void* client_thread(void* arg) {
-    int fd = *(int*)arg;
-    free(arg);
+static void handle_batch(ClientContext* ctx, const char* payload, int length);
+
+// Features this server can turn on for the connection
+static uint32_t hello_server_features(const ClientContext* ctx) {
+    uint32_t features = FEAT_EXT_HEADER | FEAT_BATCH | FEAT_BINARY_RESP | FEAT_FRAME_CHUNK;
+    // WebSocket peers already get permessage-deflate from the handshake
+    if (g_options.ws_deflate.enabled && !ctx->is_websocket) features |= FEAT_DEFLATE;
+    // Browsers cannot open the UDP side channel
+    if (udp_port() && !ctx->is_websocket) features |= FEAT_UDP_FRAMES;
+    if (g_options.rate_control) features |= FEAT_RATE_HINT;
+    return features;
+}
+
+static void handle_hello(ClientContext* ctx, const char* payload, int length) {
+    HelloPayload hello;
+    if (length < (int)sizeof(hello)) {
+        send_error(ctx, "hello", "MSG_HELLO thiếu trường");
+        return;
+    }
+    if (ctx->proto_version) {
+        send_error(ctx, "hello", "MSG_HELLO chỉ được gửi 1 lần");
+        return;
+    }
+    memcpy(&hello, payload, sizeof(hello));
+
+    HelloPayload reply;
+    reply.version = hello.version < FOCUS_PROTOCOL_VERSION ? hello.version : FOCUS_PROTOCOL_VERSION;
+    reply.frame_codec = hello.frame_codec == FRAME_CODEC_BASE64 ? FRAME_CODEC_BASE64 : FRAME_CODEC_RAW;
+    reply.features = hello.features & hello_server_features(ctx);
+    if (!(reply.features & FEAT_EXT_HEADER)) reply.features &= ~FEAT_DEFLATE; // the flag lives in the tag
+    struct WsDeflate* deflate = NULL;
+    if (reply.features & FEAT_DEFLATE) {
+        WsDeflateParams pmd = { 1, !g_options.ws_deflate.context_takeover, 0, 15 };
+        deflate = ws_deflate_new(&pmd, &g_options.ws_deflate, MAX_PAYLOAD_SIZE);
+        if (!deflate) reply.features &= ~FEAT_DEFLATE;
+    }
+    if (reply.version == 0) reply.version = 1;
+    // Registered before the reply goes out: the first datagram may beat this handler's return
+    UdpGrant grant;
+    memset(&grant, 0, sizeof(grant));
+    if (reply.features & FEAT_UDP_FRAMES) {
+        grant.token = udp_register(ctx, reply.features);
+        grant.port = (uint16_t)udp_port();
+        grant.max_fragment = (uint16_t)(UDP_DATAGRAM_MAX - sizeof(UdpFrameHeader));
+        grant.max_frame = UDP_MAX_FRAME;
+        if (!grant.token) reply.features &= ~FEAT_UDP_FRAMES;
+    }
+
+    // Reply under the old settings, then switch: the client learns the result from this packet
+    char out[sizeof(HelloPayload) + sizeof(UdpGrant)];
+    int out_len = (int)sizeof(reply);
+    memcpy(out, &reply, sizeof(reply));
+    if (reply.features & FEAT_UDP_FRAMES) {
+        memcpy(out + sizeof(reply), &grant, sizeof(grant));
+        out_len += (int)sizeof(grant);
+    }
+    ctx_send(ctx, MSG_HELLO, out, out_len);
+    ctx->proto_version = reply.version;
+    ctx->frame_codec = reply.frame_codec;
+    ctx->features = reply.features;
+    ctx->tlv_deflate = deflate;
+    ctx->udp_token = grant.token;
+    if (reply.features & FEAT_EXT_HEADER) ctx->ext_header = true;
+    log_message("INFO", "fd=%d hello: version=%u features=0x%x codec=%u", ctx->client_fd,
+                (unsigned)reply.version, (unsigned)reply.features, (unsigned)reply.frame_codec);
+}
+
+int handle_packet(ClientContext* ctx, int type, const char* payload, int length, const PacketTag* tag) {
+    ctx->last_rx_ms = tw_now_ms(); // any packet (MSG_PONG included) proves the peer is alive
+    if (tag) {
+        // First extended header opts the connection in; replies below carry this request's id
+        if (!ctx->ext_header) log_message("DEBUG", "fd=%d switched to extended headers", ctx->client_fd);
+        ctx->ext_header = true;
+        ctx->reply_id = tag->request_id;
+    }
+    switch (type) {
+        case MSG_LOGIN_REQ:
+            handle_login(ctx, payload, length);
+            break;
+        case MSG_REGISTER_REQ:
+            handle_register(ctx, payload, length);
+            break;
+        case MSG_START_SESSION:
+            handle_start_session(ctx);
+            break;
+        case MSG_END_SESSION:
+            handle_end_session(ctx);
+            break;
+        case MSG_STREAM_FRAME:
+            handle_stream_frame(ctx, payload, length);
+            break;
+        case MSG_FRAME_CHUNK:
+            handle_frame_chunk(ctx, payload, length);
+            break;
+        case MSG_GET_LEADERBOARD:
+            handle_get_leaderboard(ctx);
+            break;
+        case MSG_GET_PROFILE:
+            handle_get_profile(ctx);
+            break;
+        case MSG_PING:
+            ctx_send(ctx, MSG_PONG, NULL, 0);
+            break;
+        case MSG_PONG:
+            break;
+        case MSG_TLV_BATCH:
+            handle_batch(ctx, payload, length);
+            break;
+        case MSG_HELLO:
+            handle_hello(ctx, payload, length);
+            break;
+        default:
+            log_message("DEBUG", "Unhandled type %d (len=%d)", type, length);
+            break;
+    }
+    ctx->reply_id = 0; // anything sent outside a request is a push
+    return 0;
+}
+
+static int handle_batch_record(void* user, int type, const char* payload, int length, const PacketTag* tag) {
+    ClientContext* ctx = (ClientContext*)user;
+    if (ctx->closing) return -1; // torn down mid-batch: the rest of the envelope has no connection
+    if (!tag) ctx->reply_id = ctx->batch->id; // untagged records answer under the envelope's id
+    return handle_packet(ctx, type, payload, length, tag);
+}
+
+// Each inner record goes through the regular dispatch; ctx_send collects the replies meanwhile
+static void handle_batch(ClientContext* ctx, const char* payload, int length) {
+    if (ctx->batch) {
+        send_error(ctx, "batch", "MSG_TLV_BATCH không được lồng nhau");
+        return;
+    }
+    struct TlvBatch batch = { NULL, 0, 0, ctx->reply_id };
+    ctx->batch = &batch;
+    int count = length > 0 ? tlv_dispatch(payload, (size_t)length, handle_batch_record, ctx) : 0;
+    ctx->reply_id = batch.id;
+    if (ctx->closing) {
+        ctx->batch = NULL;
+        free(batch.data);
+        return;
+    }
+    if (count < 0) send_error(ctx, "batch", "MSG_TLV_BATCH sai định dạng");
+    batch_flush(ctx);
+    ctx->batch = NULL;
+    free(batch.data);
+    log_message("DEBUG", "fd=%d batch of %d records", ctx->client_fd, count);
+}
+
+int handle_keepalive(ClientContext* ctx, uint64_t now_ms) {
+    uint64_t ping_ms = (uint64_t)g_options.ping_interval_sec * 1000u;
+    uint64_t idle_ms = (uint64_t)g_options.idle_timeout_sec * 1000u;
+    uint64_t idle = now_ms > ctx->last_rx_ms ? now_ms - ctx->last_rx_ms : 0;
+
+    if (idle_ms > 0 && idle >= idle_ms) {
+        log_message("WARN", "[Heartbeat] fd=%d silent for %llu ms, closing", ctx->client_fd, (unsigned long long)idle);
+        return -1;
+    }
+    uint64_t next = ping_ms - (idle % ping_ms);
+    if (idle >= ping_ms && now_ms - ctx->last_ping_ms >= ping_ms) {
+        ctx_send(ctx, MSG_PING, NULL, 0);
+        ctx->last_ping_ms = now_ms;
+        next = ping_ms;
+    }
+    if (idle_ms > 0 && idle_ms - idle < next) next = idle_ms - idle;
+    return (int)next;
+}
+
+void handle_disconnect(ClientContext* ctx) {
+    ctx->closing = true;
+    if (ctx->session_active) finish_session(ctx, 0);
+    ws_deflate_free(ctx->tlv_deflate);
+    ctx->tlv_deflate = NULL;
+    udp_unregister(ctx->udp_token);
+    ctx->udp_token = 0;
+    score_session_close(ctx->score);
+    ctx->score = NULL;
+    if (ctx->uploads) {
+        for (int i = 0; i < FRAME_UPLOAD_STREAMS; ++i) free(ctx->uploads[i].data);
+        free(ctx->uploads);
+        ctx->uploads = NULL;
+    }
+}
+
+int handle_tlv_record(void* user, int type, const char* payload, int length, const PacketTag* tag) {
+    ClientContext* ctx = (ClientContext*)user;
+    if (ctx->closing) return -1;
+    return handle_packet(ctx, type, payload, length, tag);
+}
+
+// Threaded mode: replies are corked in a per-thread TxQueue and flushed once per read
+static int thread_queue_send(ClientContext* ctx, int type, const void* payload, int length) {
+    TxQueue* tx = (TxQueue*)ctx->transport;
+    tx->websocket = ctx->is_websocket;
+    tx->ext_header = ctx->ext_header;
+    tx->reply_id = ctx->reply_id;
+    return txq_push(tx, type, payload, length);
+}
 
+static int thread_queue_send_raw(ClientContext* ctx, const void* data, int length) {
+    return txq_push_raw((TxQueue*)ctx->transport, data, length);
+}
+
+// Drain up to SHM_DRAIN_BATCH records in place; returns 1 if more are waiting, -1 to close
+#define SHM_DRAIN_BATCH 64
+static int shm_drain(ClientContext* ctx, ShmRing* ring) {
+    for (int i = 0; i < SHM_DRAIN_BATCH; ++i) {
+        const char* rec;
+        size_t len;
+        int n = shm_ring_peek(ring, &rec, &len);
+        if (n < 0) {
+            log_message("WARN", "fd=%d shared-memory ring is corrupt", ctx->client_fd);
+            return -1;
+        }
+        if (n == 0) return 0;
+        int rc = tlv_dispatch(rec, len, handle_tlv_record, ctx);
+        shm_ring_release(ring, len);
+        if (rc < 0) return -1;
+    }
+    return 1;
+}
+
+// Score results for this thread's connection go out with the rest of its replies
+static void thread_deliver_score(void* user, ClientContext* ctx, int score, int frame_no) {
+    (void)user;
+    handle_focus_result(ctx, score, frame_no);
+}
+
+void client_serve(int fd, ShmRing* ring) {
     ClientContext ctx = {0};
     ctx.client_fd = fd;
+    ScoreMailbox scores;
+    if (score_mailbox_init(&scores, -1) == 0) ctx.score_mailbox = &scores;
+    RxBuffer rx;
+    rxbuf_init(&rx);
+    TxQueue tx;
+    txq_init(&tx);
+    ConnCodec codec;
+    codec_init(&codec);
+    ctx.send_fn = thread_queue_send;
+    ctx.send_raw_fn = thread_queue_send_raw;
+    ctx.transport = &tx;
 
-    // TLV mode only
+    // Client ngừng đọc thì send() hết hạn sau SEND_TIMEOUT_MS thay vì treo thread mãi
+    struct timeval snd_tv;
+    snd_tv.tv_sec = SEND_TIMEOUT_MS / 1000;
+    snd_tv.tv_usec = (SEND_TIMEOUT_MS % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &snd_tv, sizeof(snd_tv));
+
+    // Mỗi lần recv đọc hết những gì socket có, tách mọi gói hoàn chỉnh (TLV thuần hoặc
+    // TLV trong frame WebSocket, tự nhận diện từ byte đầu), rồi gửi mọi phản hồi sinh ra
+    // trong lượt đó bằng 1 lần flush.
+    // poll() hết hạn thì kiểm tra heartbeat (gửi PING / đóng kết nối im lặng).
+    // Có ring (transport cục bộ) thì gói của client đến qua ring: poll thêm eventfd của ring,
+    // socket chỉ còn mang phản hồi và báo đóng kết nối.
+    // Eventfd của mailbox báo điểm do scoring pool chấm xong, gửi đi cùng lượt flush kế tiếp.
+    ctx.last_rx_ms = tw_now_ms();
+    int wait_ms = handle_keepalive(&ctx, ctx.last_rx_ms);
+    int ring_busy = 0;
     for (;;) {
-        PacketHeader hdr;
-        if (recv_all(fd, &hdr, HEADER_SIZE) <= 0) break;
-        if (hdr.length < 0 || hdr.length > MAX_PAYLOAD_SIZE) break;
-
-        char* payload = NULL;
-        if (hdr.length > 0) {
-            payload = (char*)malloc(hdr.length);
-            if (!payload) break;
-            if (recv_all(fd, payload, hdr.length) <= 0) { free(payload); break; }
+        struct pollfd pfd[3] = {
+            { .fd = fd, .events = POLLIN },
+            { .fd = -1, .events = POLLIN },
+            { .fd = ctx.score_mailbox ? scores.efd : -1, .events = POLLIN },
+        };
+        if (ring) {
+            if (!ring_busy && !shm_ring_idle(ring)) ring_busy = 1;
+            if (!ring_busy) pfd[1].fd = ring->data_efd;
         }
-
-        switch (hdr.type) {
-            case MSG_LOGIN_REQ:
-                handle_login(&ctx, payload, hdr.length);
-                break;
-            case MSG_REGISTER_REQ:
-                handle_register(&ctx, payload, hdr.length);
-                break;
-            case MSG_START_SESSION:
-                handle_start_session(&ctx);
-                break;
-            case MSG_END_SESSION:
-                handle_end_session(&ctx);
-                break;
-            case MSG_STREAM_FRAME:
-                handle_stream_frame(&ctx, payload, hdr.length);
-                break;
-            case MSG_GET_LEADERBOARD:
-                handle_get_leaderboard(&ctx);
-                break;
-            case MSG_GET_PROFILE:
-                handle_get_profile(&ctx);
-                break;
-            default:
-                log_message("DEBUG", "Unhandled type %d (len=%d)", hdr.type, hdr.length);
-                break;
+        int pr = poll(pfd, 3, ring_busy ? 0 : wait_ms);
+        if (pr < 0 && errno != EINTR) break;
+        if (pr <= 0 && !ring_busy) {
+            wait_ms = handle_keepalive(&ctx, tw_now_ms());
+            if (wait_ms < 0 || txq_flush(&tx, fd) < 0) break;
+            continue;
+        }
+        if (ring && (ring_busy || pfd[1].revents)) {
+            ring_busy = shm_drain(&ctx, ring);
+            if (ring_busy < 0 || txq_flush(&tx, fd) < 0) break;
+        }
+        if (pfd[0].revents) {
+            if (rxbuf_recv(&rx, fd) <= 0) break;
+            int rc = codec_parse(&codec, &ctx, &rx, handle_tlv_record, &ctx);
+            if (txq_flush(&tx, fd) < 0 || rc < 0) break;
+        }
+        if (pfd[2].revents) {
+            score_mailbox_drain(&scores, thread_deliver_score, NULL);
+            if (txq_flush(&tx, fd) < 0) break;
         }
-
-        if (payload) free(payload);
     }
 
-    close(fd);
+    handle_disconnect(&ctx);
+    if (ctx.score_mailbox) score_mailbox_destroy(&scores);
+    txq_free(&tx);
+    codec_free(&codec);
+    rxbuf_free(&rx);
     log_message("INFO", "Client disconnected");
+}
+
+void* client_thread(void* arg) {
+    int fd = *(int*)arg;
+    free(arg);
+    client_serve(fd, NULL);
+    close(fd);
     return NULL;
 }
@@ -4,13 +4,40 @@
  * Cấu trúc:
  * - UserStat: Thống kê người dùng (coins, số phiên, tổng giây học...).
  * - ClientContext: Trạng thái theo kết nối client (fd, username, thời điểm bắt đầu phiên...).
- * - SharedState: Bộ nhớ chia sẻ toàn server (mảng UserStat + mutex bảo vệ).
+ * - SharedState: Bộ nhớ chia sẻ toàn server (bảng UserStat tra theo username, userstore.h; tự đồng bộ,
+ *   không có khoá chung).
  *
  * Hàm:
  * - recv_all/send_all: Đảm bảo nhận/gửi đủ số byte yêu cầu trên socket.
  * - send_packet: Gửi gói tin TLV (header + payload).
+ * - ctx_send: Gửi gói tin TLV tới 1 client qua backend I/O của kết nối đó (bọc frame nếu là WebSocket,
+ *   nén permessage-deflate hoặc nén payload FEAT_DEFLATE khi đã thương lượng và gói đủ lớn).
+ * - ctx_send_raw: Gửi byte nguyên văn (handshake/control frame WebSocket) theo cùng thứ tự với ctx_send.
+ * - ctx_packet_header: Dựng header cho gói gửi đi (8 byte, hoặc 16 byte kèm request_id khi client
+ *   dùng header mở rộng); backend I/O gọi hàm này thay vì tự điền PacketHeader.
  * - shared_find_or_add_user, shared_add_session_result: Cập nhật/tìm người dùng trong bảng xếp hạng.
- * - client_thread(void*): Hàm chạy trong mỗi thread xử lý 1 client.
+ * - handle_packet: Dispatch 1 gói TLV đã nhận đủ tới handler tương ứng; mọi phản hồi sinh ra trong
+ *   lúc đó mang request_id của gói (request pipeline được xử lý và trả lời đúng thứ tự).
+ *   MSG_TLV_BATCH được tách và dispatch từng bản ghi qua cùng đường này; phản hồi gom vào ctx->batch
+ *   rồi gửi đi trong 1 MSG_TLV_BATCH.
+ * - MSG_HELLO: thương lượng version, FEAT_* và codec frame; kết quả lưu trong ClientContext.
+ *   FEAT_UDP_FRAMES cấp token kênh UDP (udp.h) cho kết nối, thu hồi khi kết nối đóng.
+ * - MSG_STREAM_FRAME: frame được chép sang scoring pool (scorepool.h) qua ScoreSession của kết nối;
+ *   backend I/O gắn ScoreMailbox của thread sở hữu kết nối vào ctx->score_mailbox và khi mailbox
+ *   báo có kết quả thì gọi handle_focus_result để gửi MSG_FOCUS_UPDATE/MSG_FOCUS_WARN.
+ * - MSG_RATE_HINT: khi bật FEAT_RATE_HINT, mỗi điểm giao về kết nối được đưa qua ratectl (ctx->rate)
+ *   và hint mới (nếu có) được gửi ngay sau MSG_FOCUS_UPDATE.
+ * - focus_update_payload: Dựng payload MSG_FOCUS_UPDATE (JSON hoặc nhị phân), dùng chung cho
+ *   TCP và kênh UDP.
+ * - handle_keepalive: Gửi MSG_PING khi kết nối im lặng, báo đóng khi quá idle timeout.
+ * - handle_disconnect: Tự kết thúc (và cộng điểm) phiên còn mở khi kết nối mất.
+ * - save_users_to_file: Yêu cầu lưu users.txt (không chờ); users_saver_start tạo thread lưu gom yêu cầu
+ *   (lỗi thì thread gọi tự ghi file), users_save_flush chờ các yêu cầu đã có được ghi xong.
+ * - append_history_record: Xếp 1 dòng history cho thread lưu (không chạm đĩa trên thread I/O).
+ * - ensure_data_dir: Tạo thư mục data/, gọi 1 lần trong main trước mọi lần lưu.
+ * - client_thread(void*): Hàm chạy trong mỗi thread xử lý 1 client (TLV hoặc WebSocket, xem codec.h).
+ * - client_serve(fd, ring): Thân của client_thread; ring != NULL với kết nối cục bộ (shm.h): gói đọc
+ *   tại chỗ từ ring bộ nhớ chia sẻ, fd chỉ mang phản hồi. Không đóng fd.
  */
 #ifndef SERVER_HANDLERS_H
 #define SERVER_HANDLERS_H
@@ -21,31 +48,47 @@
 #include <stdbool.h>
 #include "../common/protocol.h"
 #include "../common/config.h"
+#include "ratectl.h"
+#include "userstore.h"
 
-// Shared leaderboard/profile state (in-memory)
-#define MAX_USERS 128
+typedef struct ClientContext ClientContext;
 
-typedef struct {
-    char username[64];
-    char password[64];
-    int total_coins;
-    int total_sessions;
-    int total_seconds;
-    int in_use; // 1 if populated
-} UserStat;
+// Transport hook: lets an I/O backend (io_uring, ...) own the outbound path.
+typedef int (*ClientSendFn)(ClientContext* ctx, int type, const void* payload, int length);
+typedef int (*ClientSendRawFn)(ClientContext* ctx, const void* data, int length);
 
-typedef struct {
+struct ClientContext {
     int client_fd;
     char username[64];
     time_t session_start;
     int frame_count;
     int logged_in;
-    bool is_websocket;
-} ClientContext;
+    int session_active;     // START đã nhận, chưa END
+    bool closing;           // handle_disconnect đã chạy: bản ghi TLV còn lại không được xử lý
+    uint64_t last_rx_ms;    // tw_now_ms() lúc nhận gói gần nhất
+    uint64_t last_ping_ms;
+    bool is_websocket;      // codec.c đã nâng cấp kết nối: phản hồi đi trong frame nhị phân
+    bool ext_header;        // client đã gửi header mở rộng: mọi gói gửi đi dùng PacketHeaderExt
+    uint32_t reply_id;      // request_id của gói đang xử lý (0 ngoài handle_packet → PKT_FLAG_PUSH)
+    struct WsDeflate* ws_deflate; // permessage-deflate đã thương lượng (NULL: không nén)
+    struct TlvBatch* batch; // != NULL khi đang xử lý MSG_TLV_BATCH: ctx_send gom phản hồi vào đây
+    uint16_t proto_version; // version chung sau MSG_HELLO (0: client chưa/không gửi MSG_HELLO)
+    uint16_t frame_codec;   // FRAME_CODEC_* của MSG_STREAM_FRAME
+    uint32_t features;      // FEAT_* đã thương lượng, quyết định đường gửi/nhận nhanh
+    struct WsDeflate* tlv_deflate; // FEAT_DEFLATE trên TLV thuần: nén payload (PKT_FLAG_DEFLATE)
+    struct FrameUpload* uploads; // FRAME_UPLOAD_STREAMS ô ghép MSG_FRAME_CHUNK (cấp khi có đoạn đầu tiên)
+    uint64_t udp_token;     // FEAT_UDP_FRAMES: token kênh UDP của kết nối (0: không dùng)
+    struct ScoreMailbox* score_mailbox; // Mailbox kết quả chấm điểm của thread sở hữu kết nối (backend I/O gán)
+    struct ScoreSession* score; // Phiên chấm điểm (mở khi có frame đầu tiên, đóng khi kết nối đóng)
+    RateState rate;         // FEAT_RATE_HINT: độ ổn định điểm + hint đã gửi (thread sở hữu kết nối)
+    ClientSendFn send_fn;   // NULL → send_packet() trực tiếp trên client_fd
+    ClientSendRawFn send_raw_fn; // NULL → send_all() trực tiếp trên client_fd
+    void* transport;        // Dữ liệu riêng của backend I/O
+};
 
+// Shared leaderboard/profile state (in-memory)
 typedef struct {
-    UserStat users[MAX_USERS];
-    pthread_mutex_t mtx;
+    UserStore users;
 } SharedState;
 
 extern SharedState g_shared;
@@ -54,18 +97,46 @@ extern SharedState g_shared;
 int recv_all(int fd, void* buf, int len);
 int send_all(int fd, const void* buf, int len);
 int send_packet(int fd, int type, const void* payload, int length);
+int ctx_send(ClientContext* ctx, int type, const void* payload, int length);
+int ctx_send_raw(ClientContext* ctx, const void* data, int length);
+// Fill the outgoing header for ctx's framing; returns its size (HEADER_SIZE or HEADER_EXT_SIZE)
+int ctx_packet_header(const ClientContext* ctx, int type, int length, PacketHeaderExt* hdr);
 
 // User stats helpers
 int shared_find_or_add_user(const char* username);
 void shared_add_session_result(const char* username, int seconds, int coins);
 
-// Client thread entry
+// Returns the MSG_FOCUS_UPDATE payload length written to buf (binary when features has FEAT_BINARY_RESP), -1 if cap is too small
+int focus_update_payload(char* buf, size_t cap, uint32_t features, int score, int frames);
+
+// Dispatch one complete TLV packet. Returns <0 if the connection should be closed.
+// tag is NULL for packets that used the basic 8-byte header.
+int handle_packet(ClientContext* ctx, int type, const char* payload, int length, const PacketTag* tag);
+
+// Send a score finished by the scoring pool (owner thread, from score_mailbox_drain)
+void handle_focus_result(ClientContext* ctx, int score, int frame_no);
+
+// Heartbeat check, called from the connection's timer.
+// Returns ms until the next check, or -1 if the connection is idle and should be closed.
+int handle_keepalive(ClientContext* ctx, uint64_t now_ms);
+
+// Called once by the I/O backend when a connection goes away
+void handle_disconnect(ClientContext* ctx);
+
+// TlvHandler-compatible wrapper (user = ClientContext*), see rxbuf.h
+int handle_tlv_record(void* user, int type, const char* payload, int length, const PacketTag* tag);
+
+// Client thread entry (threaded I/O mode)
 void* client_thread(void* arg);
+struct ShmRing;
+void client_serve(int fd, struct ShmRing* ring);
 
 // Persistence helpers
 void ensure_data_dir();
 void load_users_from_file();
 void save_users_to_file();
+int users_saver_start(void);
+void users_save_flush(void);
 void append_history_record(const char* username, int seconds, int coins);
 
 #endif // SERVER_HANDLERS_H
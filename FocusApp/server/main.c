@@ -1,8 +1,17 @@
 /*
  * Mục đích: Điểm vào (entry) của Server.
- *  - Khởi tạo SharedState và mutex.
- *  - Tạo socket lắng nghe, accept kết nối và spawn thread cho mỗi client.
- *  - Mỗi thread chạy client_thread() (định nghĩa trong handlers.c).
+ *  - Khởi tạo SharedState, nạp users.txt và chạy thread lưu users.txt (handlers.c).
+ *  - SIGINT/SIGTERM được 1 thread riêng nhận (sigwait): ghi nốt users.txt đang chờ rồi thoát.
+ *  - Đọc tham số dòng lệnh (options.c): --io=threaded|epoll|uring, --reactors=N.
+ *  - Tạo socket lắng nghe và accept kết nối:
+ *      + uring: N worker io_uring tự accept/recv/send (uring.c), lỗi thì dùng epoll.
+ *      + epoll (mặc định): giao socket cho N reactor thread (reactor.c).
+ *      + threaded: spawn thread cho mỗi client chạy client_thread() (handlers.c).
+ *  - Chọn backend chấm điểm (--scorer, lỗi thì dùng checksum) và khởi động scoring pool (scorepool.c).
+ *  - Mở kênh frame UDP (udp.c) trên --udp-port nếu bật; lỗi thì chỉ tắt kênh UDP.
+ *  - Mở Unix socket cho client cùng máy (shm.c, --shm-socket); lỗi thì client cục bộ dùng TCP.
+ *  - Khởi động writer lưu frame (archive.c, --archive-dir); lỗi thì frame không được lưu.
+ *  - Điều khiển tốc độ stream (ratectl.c, --stream-interval, --rate-control).
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,23 +20,69 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <pthread.h>
+#include <signal.h>
 
 #include "handlers.h"
+#include "options.h"
+#include "reactor.h"
+#include "uring.h"
+#include "udp.h"
+#include "shm.h"
+#include "scorer.h"
+#include "scorepool.h"
+#include "archive.h"
+#include "ratectl.h"
 #include "../common/config.h"
 
 extern void log_message(const char* level, const char* format, ...);
 
-int main() {
-    // Initialize shared state and mutex
+// Saves of users.txt are queued for the saver thread: let them reach the disk before exiting
+static void* shutdown_thread(void* arg) {
+    sigset_t* set = (sigset_t*)arg;
+    int sig = 0;
+    sigwait(set, &sig);
+    log_message("INFO", "Signal %d received, saving users and shutting down", sig);
+    users_save_flush();
+    exit(0);
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    options_init_defaults(&g_options);
+    if (options_parse(&g_options, argc, argv) < 0) {
+        options_print_usage(argv[0]);
+        return 1;
+    }
+
+    // Peer đóng kết nối giữa chừng không được làm chết cả server
+    signal(SIGPIPE, SIG_IGN);
+
+    // Blocked before any thread starts so every thread inherits the mask and only sigwait sees them
+    static sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+    pthread_t stop_th;
+    if (pthread_create(&stop_th, NULL, shutdown_thread, &stop_signals) == 0) {
+        pthread_detach(stop_th);
+    } else {
+        pthread_sigmask(SIG_UNBLOCK, &stop_signals, NULL);
+    }
+
+    // Initialize shared state
     memset(&g_shared, 0, sizeof(g_shared));
-    if (pthread_mutex_init(&g_shared.mtx, NULL) != 0) {
-        fprintf(stderr, "pthread_mutex_init failed\n");
+    if (userstore_init(&g_shared.users) < 0) {
+        fprintf(stderr, "userstore_init failed\n");
         return 1;
     }
 
     // Ensure data dir and load persisted users
     ensure_data_dir();
     load_users_from_file();
+    if (users_saver_start() < 0) {
+        log_message("WARN", "users.txt saver thread unavailable, users are saved on the I/O threads");
+    }
 
     int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (listen_fd < 0) {
@@ -50,13 +105,62 @@ int main() {
         return 1;
     }
 
-    if (listen(listen_fd, 16) < 0) {
+    if (listen(listen_fd, SOMAXCONN) < 0) {
         perror("listen");
         close(listen_fd);
         return 1;
     }
 
-    log_message("INFO", "Server listening on port %d", SERVER_PORT);
+    if (scorer_select(g_options.scorer) < 0) {
+        log_message("WARN", "Falling back to the checksum scorer");
+        scorer_select("checksum");
+    }
+    if (score_pool_start(g_options.score_threads, g_options.score_batch, g_options.score_batch_wait_us) < 0) {
+        log_message("WARN", "Scoring pool unavailable, frames are scored on the I/O threads");
+    }
+    if (g_options.rate_control) ratectl_start(g_options.stream_interval_ms);
+    if (g_options.archive.dir[0] && archive_start(&g_options.archive) < 0) {
+        log_message("WARN", "Frame archive disabled, frames are not saved");
+    }
+    if (g_options.udp_port && udp_start(g_options.udp_port) < 0) {
+        log_message("WARN", "UDP frame channel disabled, frames stay on TCP");
+    }
+    if (g_options.shm_socket[0] && shm_listener_start(g_options.shm_socket) < 0) {
+        log_message("WARN", "Shared-memory transport disabled, local clients use TCP");
+    }
+
+    if (g_options.io_mode == IO_MODE_URING && uring_pool_start(listen_fd, g_options.reactor_threads) < 0) {
+        log_message("WARN", "io_uring unavailable, falling back to epoll mode");
+        g_options.io_mode = IO_MODE_EPOLL;
+    }
+    if (g_options.io_mode == IO_MODE_EPOLL && reactor_pool_start(g_options.reactor_threads) < 0) {
+        log_message("WARN", "Reactor start failed, falling back to threaded mode");
+        g_options.io_mode = IO_MODE_THREADED;
+    }
+
+    log_message("INFO", "Server listening on port %d (io=%s)", SERVER_PORT,
+                options_io_mode_name(g_options.io_mode));
+
+    if (g_options.io_mode == IO_MODE_URING) {
+        // Worker io_uring tự accept qua multishot accept; thread chính chỉ chờ
+        for (;;) pause();
+    }
+
+    if (g_options.io_mode == IO_MODE_EPOLL) {
+        for (;;) {
+            struct sockaddr_in cli;
+            socklen_t clilen = sizeof(cli);
+            int fd = accept(listen_fd, (struct sockaddr*)&cli, &clilen);
+            if (fd < 0) {
+                perror("accept");
+                continue;
+            }
+            char ip[64];
+            inet_ntop(AF_INET, &cli.sin_addr, ip, sizeof(ip));
+            log_message("INFO", "Accepted connection from %s:%d", ip, ntohs(cli.sin_port));
+            if (reactor_pool_add_client(fd) < 0) close(fd);
+        }
+    }
 
     for (;;) {
         struct sockaddr_in cli;
@@ -84,6 +188,7 @@ int main() {
     }
 
     close(listen_fd);
-    pthread_mutex_destroy(&g_shared.mtx);
+    users_save_flush();
+    userstore_free(&g_shared.users);
     return 0;
 }
@@ -0,0 +1,291 @@
+/*
+ * Mục đích: Cài đặt đọc tham số dòng lệnh cho Server.
+ *  - Mặc định lấy từ common/config.h, có thể ghi đè bằng --key=value.
+ *
+ * Ví dụ:
+ *   ./FocusServer --io=epoll --reactors=4
+ *   ./FocusServer --io=uring --reactors=2
+ *   ./FocusServer --io=threaded
+ *   ./FocusServer --tx-high=512k --tx-low=128k --slow-policy=disconnect
+ *   ./FocusServer --ping-interval=10 --idle-timeout=30
+ *   ./FocusServer --ws-deflate=on --ws-deflate-min=512 --ws-context-takeover=off
+ *   ./FocusServer --udp-port=9090   (--udp-port=0 tắt kênh frame UDP)
+ *   ./FocusServer --shm-socket=/run/focus.sock   (--shm-socket=off tắt transport cục bộ)
+ *   ./FocusServer --scorer=checksum --score-threads=4
+ *   ./FocusServer --score-batch=16 --score-batch-wait=5000   (--score-batch=1 chấm từng frame)
+ *   ./FocusServer --archive-dir=/var/lib/focus/frames --archive-max-mb=4096 --archive-fsync=always
+ *   ./FocusServer --stream-interval=500 --rate-control=on   (--rate-control=off: client tự chọn nhịp)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "options.h"
+#include "../common/config.h"
+
+ServerOptions g_options;
+
+void options_init_defaults(ServerOptions* opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->io_mode = IO_MODE_EPOLL;
+    opts->reactor_threads = REACTOR_THREADS;
+    opts->tx_limits.high_watermark = TXQ_HIGH_WATERMARK;
+    opts->tx_limits.low_watermark = TXQ_LOW_WATERMARK;
+    opts->tx_limits.policy = SLOW_POLICY_DEFAULT_DROP ? SLOW_POLICY_DROP : SLOW_POLICY_DISCONNECT;
+    opts->ping_interval_sec = PING_INTERVAL_SEC;
+    opts->idle_timeout_sec = IDLE_TIMEOUT_SEC;
+    opts->ws_deflate.enabled = WS_DEFLATE_ENABLED;
+    opts->ws_deflate.min_size = WS_DEFLATE_MIN_SIZE;
+    opts->ws_deflate.context_takeover = WS_DEFLATE_CONTEXT_TAKEOVER;
+    opts->ws_deflate.level = WS_DEFLATE_LEVEL;
+    opts->udp_port = SERVER_UDP_PORT;
+    snprintf(opts->shm_socket, sizeof(opts->shm_socket), "%s", SHM_SOCKET_PATH);
+    snprintf(opts->scorer, sizeof(opts->scorer), "%s", SCORER_DEFAULT);
+    opts->score_threads = SCORE_THREADS;
+    opts->score_batch = SCORE_BATCH_MAX;
+    opts->score_batch_wait_us = SCORE_BATCH_WAIT_US;
+    snprintf(opts->archive.dir, sizeof(opts->archive.dir), "%s", ARCHIVE_DIR);
+    opts->archive.threads = ARCHIVE_THREADS;
+    opts->archive.queue_bytes = ARCHIVE_QUEUE_BYTES;
+    opts->archive.max_bytes = (uint64_t)ARCHIVE_MAX_MB * 1024 * 1024;
+    opts->archive.max_age_sec = ARCHIVE_MAX_AGE_SEC;
+    archive_fsync_parse(ARCHIVE_FSYNC_DEFAULT, &opts->archive.fsync);
+    opts->stream_interval_ms = STREAM_INTERVAL_MS;
+    opts->rate_control = RATE_CONTROL;
+}
+
+const char* options_io_mode_name(ServerIoMode mode) {
+    switch (mode) {
+        case IO_MODE_THREADED: return "threaded";
+        case IO_MODE_EPOLL: return "epoll";
+        case IO_MODE_URING: return "uring";
+    }
+    return "unknown";
+}
+
+void options_print_usage(const char* prog) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --io=threaded|epoll|uring     I/O mode (default: epoll; uring falls back to epoll)\n"
+        "  --reactors=N                  Epoll reactor / io_uring worker threads (default: %d)\n"
+        "  --tx-high=BYTES[k|m]          Per-connection send queue high watermark (default: %d)\n"
+        "  --tx-low=BYTES[k|m]           Resume reading below this many queued bytes (default: %d)\n"
+        "  --slow-policy=drop|disconnect Drop stale focus updates or disconnect slow clients\n"
+        "  --ping-interval=SEC           Send MSG_PING after this much silence (default: %d)\n"
+        "  --idle-timeout=SEC            Close connections silent this long, 0 = never (default: %d)\n"
+        "  --ws-deflate=on|off           Negotiate permessage-deflate with WebSocket clients\n"
+        "  --ws-deflate-min=BYTES[k|m]   Send smaller WebSocket messages uncompressed (default: %d)\n"
+        "  --ws-context-takeover=on|off  Keep the compression window across messages\n"
+        "  --udp-port=N                  UDP port for lossy frame streaming, 0 = off (default: %d)\n"
+        "  --shm-socket=PATH|off         Unix socket for same-host clients using a shared-memory ring\n"
+        "                                (default: %s)\n"
+        "  --scorer=pixel|checksum       Focus scoring backend (default: %s)\n"
+        "  --score-threads=N             Threads scoring frames off the I/O path (default: %d)\n"
+        "  --score-batch=N               Frames from many connections scored together (default: %d)\n"
+        "  --score-batch-wait=US         Longest wait to fill a batch, 0 = never wait (default: %d)\n"
+        "  --archive-dir=PATH|off        Directory for per-user frame segments (default: %s)\n"
+        "  --archive-threads=N           Archive writer threads (default: %d)\n"
+        "  --archive-max-mb=N            Keep at most this much archive, 0 = unlimited (default: %d)\n"
+        "  --archive-max-age=SEC         Delete segments older than this, 0 = keep (default: %d)\n"
+        "  --archive-fsync=MODE          none|batch|always: when archive writes reach the disk (default: %s)\n"
+        "  --stream-interval=MS          Frame interval asked of clients when idle (default: %d)\n"
+        "  --rate-control=on|off         Push MSG_RATE_HINT: slow clients down under load / stable scores\n"
+        "  --help                        Show this help\n",
+        prog, REACTOR_THREADS, TXQ_HIGH_WATERMARK, TXQ_LOW_WATERMARK, PING_INTERVAL_SEC, IDLE_TIMEOUT_SEC,
+        WS_DEFLATE_MIN_SIZE, SERVER_UDP_PORT, SHM_SOCKET_PATH, SCORER_DEFAULT, SCORE_THREADS,
+        SCORE_BATCH_MAX, SCORE_BATCH_WAIT_US, ARCHIVE_DIR, ARCHIVE_THREADS, ARCHIVE_MAX_MB, ARCHIVE_MAX_AGE_SEC,
+        ARCHIVE_FSYNC_DEFAULT, STREAM_INTERVAL_MS);
+}
+
+// Parse a positive integer option value, returns -1 on error
+static int parse_positive_int(const char* value, int* out) {
+    char* end = NULL;
+    long v = strtol(value, &end, 10);
+    if (!value[0] || *end != '\0' || v <= 0 || v > 1024 * 1024) return -1;
+    *out = (int)v;
+    return 0;
+}
+
+// Parse a byte size with optional k/m suffix, returns -1 on error
+static int parse_size(const char* value, size_t* out) {
+    char* end = NULL;
+    long long v = strtoll(value, &end, 10);
+    if (!value[0] || v <= 0) return -1;
+    if (*end == 'k' || *end == 'K') { v *= 1024; end++; }
+    else if (*end == 'm' || *end == 'M') { v *= 1024 * 1024; end++; }
+    if (*end != '\0') return -1;
+    *out = (size_t)v;
+    return 0;
+}
+
+// Parse on/off (also 1/0), returns -1 on error
+static int parse_switch(const char* value, int* out) {
+    if (strcmp(value, "on") == 0 || strcmp(value, "1") == 0) *out = 1;
+    else if (strcmp(value, "off") == 0 || strcmp(value, "0") == 0) *out = 0;
+    else return -1;
+    return 0;
+}
+
+// Match "--name" or "--name=value" (keylen = length before '=')
+static int is_option(const char* arg, size_t keylen, const char* name) {
+    return strlen(name) == keylen && strncmp(arg, name, keylen) == 0;
+}
+
+int options_parse(ServerOptions* opts, int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* eq = strchr(arg, '=');
+        const char* value = eq ? eq + 1 : "";
+        size_t keylen = eq ? (size_t)(eq - arg) : strlen(arg);
+
+        if (is_option(arg, keylen, "--io")) {
+            if (strcmp(value, "threaded") == 0) opts->io_mode = IO_MODE_THREADED;
+            else if (strcmp(value, "epoll") == 0) opts->io_mode = IO_MODE_EPOLL;
+            else if (strcmp(value, "uring") == 0) opts->io_mode = IO_MODE_URING;
+            else {
+                fprintf(stderr, "Unknown I/O mode: %s\n", value);
+                return -1;
+            }
+        } else if (is_option(arg, keylen, "--reactors")) {
+            if (parse_positive_int(value, &opts->reactor_threads) < 0 || opts->reactor_threads > REACTOR_MAX_THREADS) {
+                fprintf(stderr, "Invalid reactor count: %s (1..%d)\n", value, REACTOR_MAX_THREADS);
+                return -1;
+            }
+        } else if (is_option(arg, keylen, "--tx-high")) {
+            if (parse_size(value, &opts->tx_limits.high_watermark) < 0) {
+                fprintf(stderr, "Invalid --tx-high: %s\n", value);
+                return -1;
+            }
+        } else if (is_option(arg, keylen, "--tx-low")) {
+            if (parse_size(value, &opts->tx_limits.low_watermark) < 0) {
+                fprintf(stderr, "Invalid --tx-low: %s\n", value);
+                return -1;
+            }
+        } else if (is_option(arg, keylen, "--slow-policy")) {
+            if (strcmp(value, "drop") == 0) opts->tx_limits.policy = SLOW_POLICY_DROP;
+            else if (strcmp(value, "disconnect") == 0) opts->tx_limits.policy = SLOW_POLICY_DISCONNECT;
+            else {
+                fprintf(stderr, "Unknown slow-consumer policy: %s\n", value);
+                return -1;
+            }
+        } else if (is_option(arg, keylen, "--ping-interval")) {
+            if (parse_positive_int(value, &opts->ping_interval_sec) < 0) {
+                fprintf(stderr, "Invalid --ping-interval: %s\n", value);
+                return -1;
+            }
+        } else if (is_option(arg, keylen, "--idle-timeout")) {
+            if (strcmp(value, "0") == 0) opts->idle_timeout_sec = 0;
+            else if (parse_positive_int(value, &opts->idle_timeout_sec) < 0) {
+                fprintf(stderr, "Invalid --idle-timeout: %s\n", value);
+                return -1;
+            }
+        } else if (is_option(arg, keylen, "--ws-deflate")) {
+            if (parse_switch(value, &opts->ws_deflate.enabled) < 0) {
+                fprintf(stderr, "Invalid --ws-deflate: %s (on|off)\n", value);
+                return -1;
+            }
+        } else if (is_option(arg, keylen, "--ws-deflate-min")) {
+            if (strcmp(value, "0") == 0) opts->ws_deflate.min_size = 0;
+            else if (parse_size(value, &opts->ws_deflate.min_size) < 0) {
+                fprintf(stderr, "Invalid --ws-deflate-min: %s\n", value);
+                return -1;
+            }
+        } else if (is_option(arg, keylen, "--ws-context-takeover")) {
+            if (parse_switch(value, &opts->ws_deflate.context_takeover) < 0) {
+                fprintf(stderr, "Invalid --ws-context-takeover: %s (on|off)\n", value);
+                return -1;
+            }
+        } else if (is_option(arg, keylen, "--udp-port")) {
+            if (strcmp(value, "0") == 0) opts->udp_port = 0;
+            else if (parse_positive_int(value, &opts->udp_port) < 0 || opts->udp_port > 65535) {
+                fprintf(stderr, "Invalid --udp-port: %s (0..65535)\n", value);
+                return -1;
+            }
+        } else if (is_option(arg, keylen, "--shm-socket")) {
+            if (strcmp(value, "off") == 0) opts->shm_socket[0] = '\0';
+            else if (!value[0] || strlen(value) >= sizeof(opts->shm_socket)) {
+                fprintf(stderr, "Invalid --shm-socket: %s\n", value);
+                return -1;
+            } else {
+                snprintf(opts->shm_socket, sizeof(opts->shm_socket), "%s", value);
+            }
+        } else if (is_option(arg, keylen, "--scorer")) {
+            if (!value[0] || strlen(value) >= sizeof(opts->scorer)) {
+                fprintf(stderr, "Invalid --scorer: %s\n", value);
+                return -1;
+            }
+            snprintf(opts->scorer, sizeof(opts->scorer), "%s", value);
+        } else if (is_option(arg, keylen, "--score-threads")) {
+            if (parse_positive_int(value, &opts->score_threads) < 0 || opts->score_threads > REACTOR_MAX_THREADS) {
+                fprintf(stderr, "Invalid --score-threads: %s (1..%d)\n", value, REACTOR_MAX_THREADS);
+                return -1;
+            }
+        } else if (is_option(arg, keylen, "--score-batch")) {
+            if (parse_positive_int(value, &opts->score_batch) < 0 || opts->score_batch > SCORE_BATCH_LIMIT) {
+                fprintf(stderr, "Invalid --score-batch: %s (1..%d)\n", value, SCORE_BATCH_LIMIT);
+                return -1;
+            }
+        } else if (is_option(arg, keylen, "--score-batch-wait")) {
+            if (strcmp(value, "0") == 0) opts->score_batch_wait_us = 0;
+            else if (parse_positive_int(value, &opts->score_batch_wait_us) < 0) {
+                fprintf(stderr, "Invalid --score-batch-wait: %s\n", value);
+                return -1;
+            }
+        } else if (is_option(arg, keylen, "--archive-dir")) {
+            if (strcmp(value, "off") == 0) opts->archive.dir[0] = '\0';
+            else if (!value[0] || strlen(value) >= sizeof(opts->archive.dir)) {
+                fprintf(stderr, "Invalid --archive-dir: %s\n", value);
+                return -1;
+            } else {
+                snprintf(opts->archive.dir, sizeof(opts->archive.dir), "%s", value);
+            }
+        } else if (is_option(arg, keylen, "--archive-threads")) {
+            if (parse_positive_int(value, &opts->archive.threads) < 0 || opts->archive.threads > REACTOR_MAX_THREADS) {
+                fprintf(stderr, "Invalid --archive-threads: %s (1..%d)\n", value, REACTOR_MAX_THREADS);
+                return -1;
+            }
+        } else if (is_option(arg, keylen, "--archive-max-mb")) {
+            int mb = 0;
+            if (strcmp(value, "0") != 0 && parse_positive_int(value, &mb) < 0) {
+                fprintf(stderr, "Invalid --archive-max-mb: %s\n", value);
+                return -1;
+            }
+            opts->archive.max_bytes = (uint64_t)mb * 1024 * 1024;
+        } else if (is_option(arg, keylen, "--archive-max-age")) {
+            if (strcmp(value, "0") == 0) opts->archive.max_age_sec = 0;
+            else if (parse_positive_int(value, &opts->archive.max_age_sec) < 0) {
+                fprintf(stderr, "Invalid --archive-max-age: %s\n", value);
+                return -1;
+            }
+        } else if (is_option(arg, keylen, "--archive-fsync")) {
+            if (archive_fsync_parse(value, &opts->archive.fsync) < 0) {
+                fprintf(stderr, "Invalid --archive-fsync: %s (none|batch|always)\n", value);
+                return -1;
+            }
+        } else if (is_option(arg, keylen, "--stream-interval")) {
+            if (parse_positive_int(value, &opts->stream_interval_ms) < 0 || opts->stream_interval_ms > RATE_MAX_INTERVAL_MS) {
+                fprintf(stderr, "Invalid --stream-interval: %s (1..%d)\n", value, RATE_MAX_INTERVAL_MS);
+                return -1;
+            }
+        } else if (is_option(arg, keylen, "--rate-control")) {
+            if (parse_switch(value, &opts->rate_control) < 0) {
+                fprintf(stderr, "Invalid --rate-control: %s\n", value);
+                return -1;
+            }
+        } else if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+            return -1;
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            return -1;
+        }
+    }
+    if (opts->tx_limits.low_watermark >= opts->tx_limits.high_watermark) {
+        fprintf(stderr, "--tx-low must be smaller than --tx-high\n");
+        return -1;
+    }
+    if (opts->idle_timeout_sec > 0 && opts->ping_interval_sec >= opts->idle_timeout_sec) {
+        fprintf(stderr, "--ping-interval must be smaller than --idle-timeout\n");
+        return -1;
+    }
+    return 0;
+}
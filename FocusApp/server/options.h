@@ -0,0 +1,54 @@
+/*
+ * Mục đích: Tham số chạy của Server (đọc từ dòng lệnh khi khởi động).
+ *
+ * Cấu trúc:
+ * - ServerIoMode: chế độ I/O (thread mỗi client, multi-reactor epoll hoặc io_uring).
+ * - ServerOptions: chế độ I/O, số reactor thread, giới hạn hàng đợi gửi (TxLimits),
+ *   chu kỳ PING và idle timeout, cấu hình nén WebSocket (WsDeflateConfig), cổng kênh frame UDP, Unix socket của transport cục bộ,
+ *   backend chấm điểm và số thread của scoring pool, cấu hình lưu frame (ArchiveConfig), nhịp frame
+ *   mặc định và điều khiển tốc độ (MSG_RATE_HINT)...
+ *
+ * Hàm:
+ * - options_init_defaults(opts): Gán giá trị mặc định từ config.h.
+ * - options_parse(opts, argc, argv): Đọc tham số dạng --key=value, trả -1 nếu sai.
+ * - options_print_usage(prog): In hướng dẫn sử dụng.
+ */
+#ifndef SERVER_OPTIONS_H
+#define SERVER_OPTIONS_H
+
+#include "txqueue.h"
+#include "archive.h"
+#include "../common/wsdeflate.h"
+
+typedef enum {
+    IO_MODE_THREADED = 0,   // 1 pthread cho mỗi client (chế độ cũ, dự phòng)
+    IO_MODE_EPOLL,          // N reactor thread, mỗi thread 1 epoll instance
+    IO_MODE_URING           // N worker io_uring (fallback sang epoll nếu kernel không hỗ trợ)
+} ServerIoMode;
+
+typedef struct {
+    ServerIoMode io_mode;
+    int reactor_threads;
+    TxLimits tx_limits;
+    int ping_interval_sec;
+    int idle_timeout_sec;       // 0 = không đóng kết nối im lặng
+    WsDeflateConfig ws_deflate;
+    int udp_port;               // kênh frame UDP (FEAT_UDP_FRAMES), 0 = tắt
+    char shm_socket[108];       // Unix socket của transport cục bộ (shm.h), rỗng = tắt
+    char scorer[16];            // Backend chấm điểm (scorer.h)
+    int score_threads;          // Thread của scoring pool (scorepool.h)
+    int score_batch;            // Frame chấm chung 1 lượt tối đa
+    int score_batch_wait_us;    // Chờ gom lượt tối đa (µs), 0 = không chờ
+    ArchiveConfig archive;      // Lưu frame xuống đĩa (archive.h), dir rỗng = tắt
+    int stream_interval_ms;     // Khoảng cách frame khi server rảnh (ratectl.h)
+    int rate_control;           // Cấp FEAT_RATE_HINT cho client
+} ServerOptions;
+
+extern ServerOptions g_options;
+
+void options_init_defaults(ServerOptions* opts);
+int options_parse(ServerOptions* opts, int argc, char** argv);
+void options_print_usage(const char* prog);
+const char* options_io_mode_name(ServerIoMode mode);
+
+#endif // SERVER_OPTIONS_H
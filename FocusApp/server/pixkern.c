@@ -0,0 +1,350 @@
+/*
+ * Mục đích: Cài đặt kernel ảnh (xem pixkern.h).
+ *  - Bản SSE4.1 / AVX2 được biên dịch bằng __attribute__((target)) như wsmask.c nên không cần cờ
+ *    -msse4.1/-mavx2 cho cả file; bảng hàm được chọn ở lần gọi pixkern_get() đầu tiên.
+ *  - Luma: pixel được xếp lại thành R,G,B,0 (pshufb với RGB), mở rộng 16 bit rồi pmaddwd với trọng số
+ *    (77, 150, 29, 0) — tổng tối đa 255 * 256 nên không tràn, kết quả trùng bản scalar.
+ *  - Histogram không vector hoá được có lợi (scatter), mọi bản dùng chung cách đếm 4 bảng phụ để
+ *    tránh phụ thuộc store → load giữa các pixel cùng mức xám.
+ *  - Integral image: tổng tiền tố theo dòng là chuỗi phụ thuộc nên làm scalar; phần cộng với dòng
+ *    trên (chiếm nửa số phép tính) được vector hoá.
+ *  - Phần đuôi không đủ 1 khối luôn đi qua bản scalar.
+ */
+#include <string.h>
+
+#include "pixkern.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PIXKERN_X86 1
+#include <immintrin.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// Scalar reference
+// ---------------------------------------------------------------------------
+
+static void gray_row_scalar(const uint8_t* px, int w, int bpp, uint8_t* out) {
+    switch (bpp) {
+        case 1:
+            memcpy(out, px, (size_t)w);
+            break;
+        case 2:
+            for (int x = 0; x < w; ++x) out[x] = px[2 * x];
+            break;
+        default:
+            for (int x = 0; x < w; ++x, px += bpp) out[x] = (uint8_t)((77u * px[0] + 150u * px[1] + 29u * px[2]) >> 8);
+            break;
+    }
+}
+
+static void accumulate_row_scalar(uint32_t* acc, const uint8_t* row, int w) {
+    for (int x = 0; x < w; ++x) acc[x] += row[x];
+}
+
+static uint32_t abs_diff_sum_scalar(const uint8_t* a, const uint8_t* b, size_t n) {
+    uint32_t total = 0;
+    for (size_t i = 0; i < n; ++i) total += a[i] > b[i] ? (uint32_t)(a[i] - b[i]) : (uint32_t)(b[i] - a[i]);
+    return total;
+}
+
+static void histogram_any(const uint8_t* img, size_t n, uint32_t hist[256]) {
+    uint32_t sub[4][256];
+    memset(sub, 0, sizeof(sub));
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        sub[0][img[i]]++;
+        sub[1][img[i + 1]]++;
+        sub[2][img[i + 2]]++;
+        sub[3][img[i + 3]]++;
+    }
+    for (; i < n; ++i) sub[0][img[i]]++;
+    for (int v = 0; v < 256; ++v) hist[v] += sub[0][v] + sub[1][v] + sub[2][v] + sub[3][v];
+}
+
+// Row y+1 of the integral images holds the prefix sums of image row y alone
+static void integral_prefix_row(const uint8_t* row, int w, uint32_t* dst, uint64_t* dst2) {
+    uint32_t s = 0;
+    uint64_t s2 = 0;
+    dst[0] = 0;
+    dst2[0] = 0;
+    for (int x = 0; x < w; ++x) {
+        s += row[x];
+        s2 += (uint64_t)row[x] * row[x];
+        dst[x + 1] = s;
+        dst2[x + 1] = s2;
+    }
+}
+
+static void integral_scalar(const uint8_t* img, int w, int h, uint32_t* ii, uint64_t* ii2) {
+    const int stride = w + 1;
+    memset(ii, 0, sizeof(uint32_t) * (size_t)stride);
+    memset(ii2, 0, sizeof(uint64_t) * (size_t)stride);
+    for (int y = 0; y < h; ++y) {
+        uint32_t* dst = ii + (size_t)(y + 1) * stride;
+        uint64_t* dst2 = ii2 + (size_t)(y + 1) * stride;
+        integral_prefix_row(img + (size_t)y * w, w, dst, dst2);
+        for (int x = 1; x <= w; ++x) {
+            dst[x] += dst[x - stride];
+            dst2[x] += dst2[x - stride];
+        }
+    }
+}
+
+static const PixelKernels g_kernels_scalar = {
+    "scalar", gray_row_scalar, accumulate_row_scalar, abs_diff_sum_scalar, histogram_any, integral_scalar
+};
+
+#ifdef PIXKERN_X86
+
+// ---------------------------------------------------------------------------
+// SSE4.1 (pshufb from SSSE3, pmovzx / packusdw from SSE4.1)
+// ---------------------------------------------------------------------------
+
+// 4 pixels laid out as R,G,B,0 bytes -> 4 x int32 luma
+__attribute__((target("sse4.1")))
+static inline __m128i luma4_sse4(__m128i rgb0) {
+    const __m128i wts = _mm_setr_epi16(77, 150, 29, 0, 77, 150, 29, 0);
+    __m128i lo = _mm_madd_epi16(_mm_cvtepu8_epi16(rgb0), wts);
+    __m128i hi = _mm_madd_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(rgb0, 8)), wts);
+    return _mm_srli_epi32(_mm_hadd_epi32(lo, hi), 8);
+}
+
+__attribute__((target("sse4.1")))
+static void gray_row_sse4(const uint8_t* px, int w, int bpp, uint8_t* out) {
+    const __m128i rgb_to_rgb0 = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i rgba_to_rgb0 = _mm_setr_epi8(0, 1, 2, -1, 4, 5, 6, -1, 8, 9, 10, -1, 12, 13, 14, -1);
+    const __m128i even_bytes = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, -1, -1, -1, -1, -1, -1, -1, -1);
+    int x = 0;
+    if (bpp == 4) {
+        for (; x + 8 <= w; x += 8) {
+            const uint8_t* p = px + (size_t)x * 4;
+            __m128i a = luma4_sse4(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)p), rgba_to_rgb0));
+            __m128i b = luma4_sse4(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + 16)), rgba_to_rgb0));
+            __m128i w16 = _mm_packus_epi32(a, b);
+            _mm_storel_epi64((__m128i*)(out + x), _mm_packus_epi16(w16, w16));
+        }
+    } else if (bpp == 3) {
+        // The second 16-byte load of each block reads 4 bytes past its 8th pixel
+        for (; (x + 8) * 3 + 4 <= w * 3; x += 8) {
+            const uint8_t* p = px + (size_t)x * 3;
+            __m128i a = luma4_sse4(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)p), rgb_to_rgb0));
+            __m128i b = luma4_sse4(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + 12)), rgb_to_rgb0));
+            __m128i w16 = _mm_packus_epi32(a, b);
+            _mm_storel_epi64((__m128i*)(out + x), _mm_packus_epi16(w16, w16));
+        }
+    } else if (bpp == 2) {
+        for (; x + 8 <= w; x += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(px + (size_t)x * 2));
+            _mm_storel_epi64((__m128i*)(out + x), _mm_shuffle_epi8(v, even_bytes));
+        }
+    }
+    gray_row_scalar(px + (size_t)x * bpp, w - x, bpp, out + x);
+}
+
+__attribute__((target("sse4.1")))
+static void accumulate_row_sse4(uint32_t* acc, const uint8_t* row, int w) {
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(row + x));
+        for (int k = 0; k < 4; ++k) {
+            __m128i* dst = (__m128i*)(acc + x + 4 * k);
+            _mm_storeu_si128(dst, _mm_add_epi32(_mm_loadu_si128(dst), _mm_cvtepu8_epi32(v)));
+            v = _mm_srli_si128(v, 4);
+        }
+    }
+    accumulate_row_scalar(acc + x, row + x, w - x);
+}
+
+__attribute__((target("sse4.1")))
+static uint32_t abs_diff_sum_sse4(const uint8_t* a, const uint8_t* b, size_t n) {
+    __m128i total = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        total = _mm_add_epi64(total, _mm_sad_epu8(va, vb));
+    }
+    uint32_t sum = (uint32_t)(_mm_cvtsi128_si64(total) + _mm_extract_epi64(total, 1));
+    return sum + abs_diff_sum_scalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("sse4.1")))
+static void integral_sse4(const uint8_t* img, int w, int h, uint32_t* ii, uint64_t* ii2) {
+    const int stride = w + 1;
+    memset(ii, 0, sizeof(uint32_t) * (size_t)stride);
+    memset(ii2, 0, sizeof(uint64_t) * (size_t)stride);
+    for (int y = 0; y < h; ++y) {
+        uint32_t* dst = ii + (size_t)(y + 1) * stride;
+        uint64_t* dst2 = ii2 + (size_t)(y + 1) * stride;
+        const uint32_t* up = dst - stride;
+        const uint64_t* up2 = dst2 - stride;
+        integral_prefix_row(img + (size_t)y * w, w, dst, dst2);
+        int x = 1;
+        for (; x + 4 <= w + 1; x += 4) {
+            __m128i v = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(dst + x)), _mm_loadu_si128((const __m128i*)(up + x)));
+            _mm_storeu_si128((__m128i*)(dst + x), v);
+            for (int k = 0; k < 4; k += 2) {
+                __m128i v2 = _mm_add_epi64(_mm_loadu_si128((const __m128i*)(dst2 + x + k)),
+                                           _mm_loadu_si128((const __m128i*)(up2 + x + k)));
+                _mm_storeu_si128((__m128i*)(dst2 + x + k), v2);
+            }
+        }
+        for (; x <= w; ++x) {
+            dst[x] += up[x];
+            dst2[x] += up2[x];
+        }
+    }
+}
+
+static const PixelKernels g_kernels_sse4 = {
+    "sse4", gray_row_sse4, accumulate_row_sse4, abs_diff_sum_sse4, histogram_any, integral_sse4
+};
+
+// ---------------------------------------------------------------------------
+// AVX2
+// ---------------------------------------------------------------------------
+
+// 8 pixels (two groups of 4 laid out as R,G,B,0) -> 8 x int32 luma in pixel order
+__attribute__((target("avx2")))
+static inline __m256i luma8_avx2(__m128i q0, __m128i q1) {
+    const __m256i wts = _mm256_setr_epi16(77, 150, 29, 0, 77, 150, 29, 0, 77, 150, 29, 0, 77, 150, 29, 0);
+    __m256i a = _mm256_madd_epi16(_mm256_cvtepu8_epi16(q0), wts);   // p0 p0 p1 p1 | p2 p2 p3 p3
+    __m256i b = _mm256_madd_epi16(_mm256_cvtepu8_epi16(q1), wts);   // p4 p4 p5 p5 | p6 p6 p7 p7
+    __m256i h = _mm256_hadd_epi32(a, b);                            // p0 p1 p4 p5 | p2 p3 p6 p7
+    h = _mm256_permute4x64_epi64(h, _MM_SHUFFLE(3, 1, 2, 0));
+    return _mm256_srli_epi32(h, 8);
+}
+
+__attribute__((target("avx2")))
+static void store16_luma_avx2(uint8_t* out, __m256i l0, __m256i l1) {
+    __m256i w16 = _mm256_permute4x64_epi64(_mm256_packus_epi32(l0, l1), _MM_SHUFFLE(3, 1, 2, 0));
+    __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(w16), _mm256_extracti128_si256(w16, 1));
+    _mm_storeu_si128((__m128i*)out, bytes);
+}
+
+__attribute__((target("avx2")))
+static void gray_row_avx2(const uint8_t* px, int w, int bpp, uint8_t* out) {
+    const __m128i rgb_to_rgb0 = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i rgba_to_rgb0 = _mm_setr_epi8(0, 1, 2, -1, 4, 5, 6, -1, 8, 9, 10, -1, 12, 13, 14, -1);
+    int x = 0;
+    if (bpp == 4) {
+        for (; x + 16 <= w; x += 16) {
+            const __m128i* p = (const __m128i*)(px + (size_t)x * 4);
+            __m256i l0 = luma8_avx2(_mm_shuffle_epi8(_mm_loadu_si128(p), rgba_to_rgb0),
+                                    _mm_shuffle_epi8(_mm_loadu_si128(p + 1), rgba_to_rgb0));
+            __m256i l1 = luma8_avx2(_mm_shuffle_epi8(_mm_loadu_si128(p + 2), rgba_to_rgb0),
+                                    _mm_shuffle_epi8(_mm_loadu_si128(p + 3), rgba_to_rgb0));
+            store16_luma_avx2(out + x, l0, l1);
+        }
+    } else if (bpp == 3) {
+        // The last 16-byte load of each block reads 4 bytes past its 16th pixel
+        for (; (x + 16) * 3 + 4 <= w * 3; x += 16) {
+            const uint8_t* p = px + (size_t)x * 3;
+            __m256i l0 = luma8_avx2(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)p), rgb_to_rgb0),
+                                    _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + 12)), rgb_to_rgb0));
+            __m256i l1 = luma8_avx2(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + 24)), rgb_to_rgb0),
+                                    _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + 36)), rgb_to_rgb0));
+            store16_luma_avx2(out + x, l0, l1);
+        }
+    } else if (bpp == 2) {
+        const __m256i even_bytes = _mm256_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                    0, 2, 4, 6, 8, 10, 12, 14, -1, -1, -1, -1, -1, -1, -1, -1);
+        for (; x + 16 <= w; x += 16) {
+            __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(px + (size_t)x * 2)), even_bytes);
+            v = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0));
+            _mm_storeu_si128((__m128i*)(out + x), _mm256_castsi256_si128(v));
+        }
+    }
+    gray_row_scalar(px + (size_t)x * bpp, w - x, bpp, out + x);
+}
+
+__attribute__((target("avx2")))
+static void accumulate_row_avx2(uint32_t* acc, const uint8_t* row, int w) {
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(row + x)));
+        __m256i* dst = (__m256i*)(acc + x);
+        _mm256_storeu_si256(dst, _mm256_add_epi32(_mm256_loadu_si256(dst), v));
+    }
+    accumulate_row_scalar(acc + x, row + x, w - x);
+}
+
+__attribute__((target("avx2")))
+static uint32_t abs_diff_sum_avx2(const uint8_t* a, const uint8_t* b, size_t n) {
+    __m256i total = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(va, vb));
+    }
+    __m128i t = _mm_add_epi64(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+    uint32_t sum = (uint32_t)(_mm_cvtsi128_si64(t) + _mm_extract_epi64(t, 1));
+    return sum + abs_diff_sum_scalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void integral_avx2(const uint8_t* img, int w, int h, uint32_t* ii, uint64_t* ii2) {
+    const int stride = w + 1;
+    memset(ii, 0, sizeof(uint32_t) * (size_t)stride);
+    memset(ii2, 0, sizeof(uint64_t) * (size_t)stride);
+    for (int y = 0; y < h; ++y) {
+        uint32_t* dst = ii + (size_t)(y + 1) * stride;
+        uint64_t* dst2 = ii2 + (size_t)(y + 1) * stride;
+        const uint32_t* up = dst - stride;
+        const uint64_t* up2 = dst2 - stride;
+        integral_prefix_row(img + (size_t)y * w, w, dst, dst2);
+        int x = 1;
+        for (; x + 8 <= w + 1; x += 8) {
+            __m256i v = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(dst + x)),
+                                         _mm256_loadu_si256((const __m256i*)(up + x)));
+            _mm256_storeu_si256((__m256i*)(dst + x), v);
+            for (int k = 0; k < 8; k += 4) {
+                __m256i v2 = _mm256_add_epi64(_mm256_loadu_si256((const __m256i*)(dst2 + x + k)),
+                                              _mm256_loadu_si256((const __m256i*)(up2 + x + k)));
+                _mm256_storeu_si256((__m256i*)(dst2 + x + k), v2);
+            }
+        }
+        for (; x <= w; ++x) {
+            dst[x] += up[x];
+            dst2[x] += up2[x];
+        }
+    }
+}
+
+static const PixelKernels g_kernels_avx2 = {
+    "avx2", gray_row_avx2, accumulate_row_avx2, abs_diff_sum_avx2, histogram_any, integral_avx2
+};
+
+#endif // PIXKERN_X86
+
+static const PixelKernels* g_kernels = NULL;
+
+const PixelKernels* pixkern_get(void) {
+    const PixelKernels* k = __atomic_load_n(&g_kernels, __ATOMIC_ACQUIRE);
+    if (k) return k;
+    k = &g_kernels_scalar;
+#ifdef PIXKERN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) k = &g_kernels_avx2;
+    else if (__builtin_cpu_supports("sse4.1")) k = &g_kernels_sse4;
+#endif
+    // Every thread computes the same answer, so a racy first call is harmless
+    __atomic_store_n(&g_kernels, k, __ATOMIC_RELEASE);
+    return k;
+}
+
+const PixelKernels* pixkern_scalar(void) {
+    return &g_kernels_scalar;
+}
+
+int pixkern_variants(const PixelKernels* out[], int max) {
+    int n = 0;
+    if (n < max) out[n++] = &g_kernels_scalar;
+#ifdef PIXKERN_X86
+    __builtin_cpu_init();
+    if (n < max && __builtin_cpu_supports("sse4.1")) out[n++] = &g_kernels_sse4;
+    if (n < max && __builtin_cpu_supports("avx2")) out[n++] = &g_kernels_avx2;
+#endif
+    return n;
+}
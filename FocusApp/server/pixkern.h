@@ -0,0 +1,42 @@
+/*
+ * Mục đích: Kernel xử lý ảnh cho backend chấm điểm "pixel" (scorer_pixel.c): đổi sang ảnh xám,
+ * cộng dồn dòng cho box downsampling, tổng |chênh lệch| giữa 2 frame, histogram độ sáng, integral image.
+ *
+ * Cấu trúc:
+ * - PixelKernels: bảng hàm của 1 cài đặt. Mọi cài đặt cho kết quả giống hệt bản scalar từng bit
+ *   (chỉ dùng số nguyên: luma BT.601 = (77 R + 150 G + 29 B) >> 8).
+ *
+ * Hàm:
+ * - pixkern_get(): Cài đặt nhanh nhất cho CPU này (AVX2, SSE4.1 hoặc scalar), chọn 1 lần lúc chạy
+ *   bằng __builtin_cpu_supports như wsmask.c; kiến trúc khác dùng scalar.
+ * - pixkern_scalar(): Bản tham chiếu.
+ * - pixkern_variants(out, max): Mọi cài đặt CPU này chạy được (scalar đứng đầu), trả về số phần tử;
+ *   dùng cho test so khớp từng bit và benchmark (tests/).
+ *
+ * Kernel:
+ * - gray_row(px, w, bpp, out): 1 dòng w pixel (bpp 1 xám, 2 xám+alpha, 3 RGB, 4 RGBA) → w byte xám.
+ * - accumulate_row(acc, row, w): acc[x] += row[x] (cộng dồn các dòng nguồn rơi vào cùng 1 dòng lưới).
+ * - abs_diff_sum(a, b, n): Σ |a[i] - b[i]| (năng lượng chuyển động).
+ * - histogram(img, n, hist): Cộng histogram 256 mức xám (hist không bị xoá trước).
+ * - integral(img, w, h, ii, ii2): Integral image và integral bình phương, kích thước (w+1) x (h+1).
+ */
+#ifndef SERVER_PIXKERN_H
+#define SERVER_PIXKERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    const char* name;
+    void (*gray_row)(const uint8_t* px, int w, int bpp, uint8_t* out);
+    void (*accumulate_row)(uint32_t* acc, const uint8_t* row, int w);
+    uint32_t (*abs_diff_sum)(const uint8_t* a, const uint8_t* b, size_t n);
+    void (*histogram)(const uint8_t* img, size_t n, uint32_t hist[256]);
+    void (*integral)(const uint8_t* img, int w, int h, uint32_t* ii, uint64_t* ii2);
+} PixelKernels;
+
+const PixelKernels* pixkern_get(void);
+const PixelKernels* pixkern_scalar(void);
+int pixkern_variants(const PixelKernels* out[], int max);
+
+#endif // SERVER_PIXKERN_H
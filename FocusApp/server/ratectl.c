@@ -0,0 +1,104 @@
+/*
+ * Mục đích: Cài đặt điều khiển tốc độ stream (xem ratectl.h).
+ *  - Hệ số giãn chung lưu theo phần nghìn, đọc không khoá; thread giao điểm đầu tiên thấy đã tới hạn
+ *    đo lại tải (trylock: các thread khác dùng hệ số cũ thay vì chờ).
+ */
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "ratectl.h"
+#include "scorepool.h"
+#include "timerwheel.h"
+#include "../common/config.h"
+
+extern void log_message(const char* level, const char* format, ...);
+
+#define RATE_SCALE_ONE 1000         // scale is kept in thousandths
+#define RATE_DELTA_WEIGHT 0.25f     // weight of the newest |score change| in the moving average
+
+static struct {
+    pthread_mutex_t mtx;
+    uint32_t base_ms;
+    uint32_t scale;             // interval multiplier x RATE_SCALE_ONE (atomic)
+    uint64_t next_ms;           // next load sample (atomic)
+    unsigned long frames;       // pool counters at the last sample
+    unsigned long superseded;
+} g_rate = { PTHREAD_MUTEX_INITIALIZER, STREAM_INTERVAL_MS, RATE_SCALE_ONE, 0, 0, 0 };
+
+void ratectl_start(int base_interval_ms) {
+    g_rate.base_ms = base_interval_ms > 0 ? (uint32_t)base_interval_ms : STREAM_INTERVAL_MS;
+    log_message("INFO", "[Rate] frame interval %u ms when idle, up to x%d under load, x%d more for stable scores",
+                g_rate.base_ms, RATE_SCALE_MAX, RATE_STABLE_FACTOR);
+}
+
+// AIMD on the interval: back off fast while the pipeline drops frames, creep back when it idles
+static void rate_sample(uint64_t now) {
+    if (pthread_mutex_trylock(&g_rate.mtx) != 0) return;
+    if (now < __atomic_load_n(&g_rate.next_ms, __ATOMIC_RELAXED)) {
+        pthread_mutex_unlock(&g_rate.mtx);
+        return;
+    }
+    ScorePoolLoad load;
+    score_pool_load(&load);
+    unsigned long frames = load.frames - g_rate.frames;
+    unsigned long lost = load.superseded - g_rate.superseded;
+    g_rate.frames = load.frames;
+    g_rate.superseded = load.superseded;
+
+    uint32_t old = __atomic_load_n(&g_rate.scale, __ATOMIC_RELAXED);
+    uint32_t scale = old;
+    if (lost * 20 > frames || load.waiting > load.capacity) {
+        scale = old * 3 / 2;
+        if (scale > RATE_SCALE_MAX * RATE_SCALE_ONE) scale = RATE_SCALE_MAX * RATE_SCALE_ONE;
+    } else if (lost == 0 && load.waiting * 2 <= load.capacity) {
+        scale = old > RATE_SCALE_ONE + 100 ? old - 100 : RATE_SCALE_ONE;
+    }
+    __atomic_store_n(&g_rate.scale, scale, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_rate.next_ms, now + RATE_UPDATE_MS, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&g_rate.mtx);
+
+    if (scale != old) {
+        log_message("INFO", "[Rate] %lu of %lu frame(s) superseded, %d session(s) waiting: interval x%.1f",
+                    lost, frames, load.waiting, (double)scale / RATE_SCALE_ONE);
+    }
+}
+
+// a differs from the hint b it would replace by RATE_HINT_CHANGE_PCT % or more
+static int hint_moved(uint32_t a, uint32_t b) {
+    uint64_t diff = a > b ? a - b : b - a;
+    return diff * 100 >= (uint64_t)b * RATE_HINT_CHANGE_PCT;
+}
+
+int ratectl_observe(RateState* rs, int score, RateHintPayload* hint) {
+    if (rs->scores > 0) {
+        float d = (float)abs(score - rs->last_score);
+        rs->delta = rs->scores == 1 ? d : rs->delta + RATE_DELTA_WEIGHT * (d - rs->delta);
+    }
+    rs->last_score = score;
+    rs->scores++;
+
+    uint64_t now = tw_now_ms();
+    if (now >= __atomic_load_n(&g_rate.next_ms, __ATOMIC_RELAXED)) rate_sample(now);
+    uint32_t scale = __atomic_load_n(&g_rate.scale, __ATOMIC_RELAXED);
+
+    float stable = 0.0f;
+    if (rs->scores >= RATE_STABLE_MIN_SCORES) {
+        stable = 1.0f - rs->delta / (float)RATE_STABLE_DELTA;
+        if (stable < 0.0f) stable = 0.0f;
+    }
+    float interval = (float)g_rate.base_ms * (float)scale / RATE_SCALE_ONE * (1.0f + (RATE_STABLE_FACTOR - 1) * stable);
+    if (interval > RATE_MAX_INTERVAL_MS) interval = RATE_MAX_INTERVAL_MS;
+    if (interval < (float)g_rate.base_ms) interval = (float)g_rate.base_ms;
+    uint64_t max_frame = (uint64_t)RATE_MAX_FRAME * RATE_SCALE_ONE / scale;
+    if (max_frame < RATE_MIN_FRAME) max_frame = RATE_MIN_FRAME;
+
+    hint->interval_ms = (uint32_t)interval;
+    hint->max_frame = (uint32_t)max_frame;
+    if (rs->sent_interval && !hint_moved(hint->interval_ms, rs->sent_interval) &&
+        !hint_moved(hint->max_frame, rs->sent_max_frame)) {
+        return 0;
+    }
+    rs->sent_interval = hint->interval_ms;
+    rs->sent_max_frame = hint->max_frame;
+    return 1;
+}
@@ -0,0 +1,35 @@
+/*
+ * Mục đích: Điều khiển tốc độ stream frame từ phía server (MSG_RATE_HINT, FEAT_RATE_HINT).
+ *  - Tải chung: mỗi RATE_UPDATE_MS đo pipeline chấm điểm (score_pool_load): frame bị frame mới hơn
+ *    thay (pipeline không theo kịp) hoặc số phiên chờ vượt 1 lượt của mọi worker thì nhân hệ số giãn
+ *    lên 1.5 (tối đa RATE_SCALE_MAX); pipeline rảnh thì bớt dần 0.1 về 1 (AIMD, tổng frame nhận vào
+ *    bám theo sức chấm điểm thay vì vượt quá rồi bị bỏ).
+ *  - Mỗi kết nối: trung bình trượt |Δ điểm| giữa 2 frame liên tiếp; điểm càng ổn định (ít dao động)
+ *    thì khoảng cách frame giãn thêm, tối đa RATE_STABLE_FACTOR lần.
+ *  - Hint = base x hệ số giãn x hệ số ổn định (trong [base, RATE_MAX_INTERVAL_MS]) + kích thước
+ *    frame tối đa RATE_MAX_FRAME / hệ số giãn (không dưới RATE_MIN_FRAME). Chỉ gửi khi lệch hint
+ *    đã gửi từ RATE_HINT_CHANGE_PCT % trở lên.
+ *
+ * Hàm:
+ * - ratectl_start(base_interval_ms): Khoảng cách frame khi server rảnh (--stream-interval).
+ * - ratectl_observe(rs, score, hint): Ghi nhận điểm vừa chấm của 1 kết nối (thread đang giao điểm);
+ *   1 nếu cần gửi *hint mới cho client. RateState zero = chưa có điểm, chưa gửi hint.
+ */
+#ifndef SERVER_RATECTL_H
+#define SERVER_RATECTL_H
+
+#include <stdint.h>
+#include "../common/protocol.h"
+
+typedef struct {
+    int scores;                 // scores observed so far
+    int last_score;
+    float delta;                // moving average of |score change|
+    uint32_t sent_interval;     // last hint sent, 0 = none yet
+    uint32_t sent_max_frame;
+} RateState;
+
+void ratectl_start(int base_interval_ms);
+int ratectl_observe(RateState* rs, int score, RateHintPayload* hint);
+
+#endif // SERVER_RATECTL_H
@@ -0,0 +1,305 @@
+/*
+ * Mục đích: Cài đặt multi-reactor epoll.
+ *  - Mỗi Reactor có 1 epoll fd và 1 pthread chạy vòng lặp epoll_wait.
+ *  - Thread accept (main.c) đặt socket non-blocking rồi đưa kết nối vào inbox của
+ *    reactor được chọn và đánh thức nó qua eventfd; reactor tự đăng ký vào epoll.
+ *  - Mỗi kết nối có 1 RxBuffer (rxbuf.c): đọc hết dữ liệu socket đang có, tách mọi
+ *    gói TLV hoàn chỉnh và gọi handle_packet(). Kết nối chỉ được truy cập bởi reactor
+ *    sở hữu nó. Byte đầu tiên chọn codec TLV hoặc WebSocket (codec.c).
+ *  - Phản hồi được đưa vào TxQueue (txqueue.c) và flush 1 lần sau mỗi lượt đọc;
+ *    phần chưa ghi hết được gửi tiếp khi có EPOLLOUT.
+ *  - Backpressure: hàng đợi vượt high watermark thì ngừng đọc kết nối đó (bỏ EPOLLIN)
+ *    cho tới khi xuống dưới low watermark; policy drop/disconnect áp cho phần vượt.
+ *  - Heartbeat: mỗi reactor có 1 timer wheel (timerwheel.c), mỗi kết nối 1 timer gọi
+ *    handle_keepalive(); epoll_wait dùng timeout = 1 tick khi còn timer.
+ *  - Điểm do scoring pool chấm xong về ScoreMailbox của reactor (dùng chung eventfd đánh thức
+ *    với inbox), được gửi và flush ngay trên thread reactor.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include "reactor.h"
+#include "handlers.h"
+#include "rxbuf.h"
+#include "txqueue.h"
+#include "options.h"
+#include "timerwheel.h"
+#include "codec.h"
+#include "scorepool.h"
+#include "../common/config.h"
+#include "../common/protocol.h"
+
+extern void log_message(const char* level, const char* format, ...);
+
+// Max recv() calls per readiness event so one busy client cannot starve others
+#define REACTOR_READ_BUDGET 16
+
+typedef struct ReactorConn ReactorConn;
+
+typedef struct {
+    int index;
+    int epfd;
+    int wakefd;             // eventfd: new connections waiting in inbox / scores in mailbox
+    pthread_t thread;
+    pthread_mutex_t inbox_mtx;
+    ReactorConn* inbox;
+    ScoreMailbox scores;    // results from the scoring pool, posted with wakefd
+    TimerWheel wheel;       // owned by the reactor thread
+} Reactor;
+
+struct ReactorConn {
+    ClientContext ctx;
+    Reactor* reactor;
+    ReactorConn* next_new;  // inbox link
+    TimerNode timer;
+    RxBuffer rx;
+    ConnCodec codec;
+    TxQueue tx;
+    uint32_t events;    // current epoll interest mask
+    int paused;         // reading stopped until tx drains below the low watermark
+    int overflow;       // slow-consumer policy asked to disconnect
+    unsigned long dropped;
+};
+
+static Reactor* g_reactors = NULL;
+static int g_reactor_count = 0;
+static unsigned int g_next_reactor = 0;
+
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static void conn_close(Reactor* r, ReactorConn* c) {
+    tw_cancel(&r->wheel, &c->timer);
+    handle_disconnect(&c->ctx);
+    epoll_ctl(r->epfd, EPOLL_CTL_DEL, c->ctx.client_fd, NULL);
+    close(c->ctx.client_fd);
+    rxbuf_free(&c->rx);
+    codec_free(&c->codec);
+    txq_free(&c->tx);
+    free(c);
+    log_message("INFO", "Client disconnected");
+}
+
+static int conn_set_events(ReactorConn* c, uint32_t events) {
+    if (c->events == events) return 0;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = c;
+    if (epoll_ctl(c->reactor->epfd, EPOLL_CTL_MOD, c->ctx.client_fd, &ev) < 0) return -1;
+    c->events = events;
+    return 0;
+}
+
+static int reactor_send(ClientContext* ctx, int type, const void* payload, int length) {
+    ReactorConn* c = (ReactorConn*)ctx->transport;
+    c->tx.websocket = ctx->is_websocket;
+    c->tx.ext_header = ctx->ext_header;
+    c->tx.reply_id = ctx->reply_id;
+    int rc = txq_push_bounded(&c->tx, &g_options.tx_limits, type, payload, length);
+    if (rc == TXQ_DROPPED) {
+        c->paused = 1; // congested: stop reading until the queue drains
+        if (c->dropped++ == 0) log_message("WARN", "[Reactor] slow consumer fd=%d: dropping stale focus updates", ctx->client_fd);
+    } else if (rc == TXQ_OVERFLOW) {
+        if (!c->overflow) log_message("WARN", "[Reactor] slow consumer fd=%d: send queue over %zu bytes, disconnecting",
+                                      ctx->client_fd, g_options.tx_limits.high_watermark);
+        c->overflow = 1;
+        return -1;
+    }
+    return 0;
+}
+
+// Handshake/control bytes are tiny and never dropped by the slow-consumer policy
+static int reactor_send_raw(ClientContext* ctx, const void* data, int length) {
+    ReactorConn* c = (ReactorConn*)ctx->transport;
+    return txq_push_raw(&c->tx, data, length);
+}
+
+// Write queued replies; arm EPOLLOUT only while something is left over and
+// stop reading while the peer is not draining its replies.
+static int conn_flush(ReactorConn* c) {
+    if (c->overflow) return -1;
+    int rc = txq_flush(&c->tx, c->ctx.client_fd);
+    if (rc < 0) return -1;
+
+    const TxLimits* lim = &g_options.tx_limits;
+    if (!c->paused && c->tx.bytes >= lim->high_watermark) c->paused = 1;
+    else if (c->paused && c->tx.bytes <= lim->low_watermark) c->paused = 0;
+
+    uint32_t events = (rc == 0 ? EPOLLOUT : 0);
+    if (!c->paused) events |= EPOLLIN | EPOLLRDHUP;
+    return conn_set_events(c, events);
+}
+
+// Read what the socket has and dispatch every complete TLV record (plain or inside WebSocket frames).
+// Returns 0 to keep the connection, -1 to close it.
+static int conn_on_readable(ReactorConn* c) {
+    for (int budget = 0; budget < REACTOR_READ_BUDGET && !c->paused; ++budget) {
+        ssize_t n = rxbuf_recv(&c->rx, c->ctx.client_fd);
+        if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        if (n == 0) return -1;
+        if (codec_parse(&c->codec, &c->ctx, &c->rx, handle_tlv_record, &c->ctx) < 0) return -1;
+    }
+    return 0; // budget exhausted, level-triggered epoll will report again
+}
+
+static void conn_on_timer(TimerNode* t, void* arg) {
+    (void)t;
+    ReactorConn* c = (ReactorConn*)arg;
+    Reactor* r = c->reactor;
+    int next = handle_keepalive(&c->ctx, tw_now_ms());
+    if (next < 0 || conn_flush(c) < 0) {
+        conn_close(r, c);
+        return;
+    }
+    tw_schedule(&r->wheel, &c->timer, (uint64_t)next, conn_on_timer, c);
+}
+
+// Register connections handed over by the accept thread
+static void reactor_drain_inbox(Reactor* r) {
+    uint64_t n;
+    while (read(r->wakefd, &n, sizeof(n)) > 0) {}
+
+    pthread_mutex_lock(&r->inbox_mtx);
+    ReactorConn* c = r->inbox;
+    r->inbox = NULL;
+    pthread_mutex_unlock(&r->inbox_mtx);
+
+    while (c) {
+        ReactorConn* next = c->next_new;
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = c->events;
+        ev.data.ptr = c;
+        if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, c->ctx.client_fd, &ev) < 0) {
+            log_message("ERROR", "[Reactor] epoll_ctl ADD fd=%d: %s", c->ctx.client_fd, strerror(errno));
+            close(c->ctx.client_fd);
+            rxbuf_free(&c->rx);
+            codec_free(&c->codec);
+            txq_free(&c->tx);
+            free(c);
+        } else {
+            c->ctx.last_rx_ms = tw_now_ms();
+            conn_on_timer(&c->timer, c); // schedules the first heartbeat check
+        }
+        c = next;
+    }
+}
+
+static void reactor_deliver_score(void* user, ClientContext* ctx, int score, int frame_no) {
+    ReactorConn* c = (ReactorConn*)ctx->transport;
+    handle_focus_result(ctx, score, frame_no);
+    if (conn_flush(c) < 0) conn_close((Reactor*)user, c);
+}
+
+static void* reactor_thread(void* arg) {
+    Reactor* r = (Reactor*)arg;
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+
+    log_message("INFO", "[Reactor %d] started", r->index);
+    for (;;) {
+        int n = epoll_wait(r->epfd, events, REACTOR_MAX_EVENTS, tw_timeout_ms(&r->wheel));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            log_message("ERROR", "[Reactor %d] epoll_wait: %s", r->index, strerror(errno));
+            break;
+        }
+        int woken = 0;
+        for (int i = 0; i < n; ++i) {
+            ReactorConn* c = (ReactorConn*)events[i].data.ptr;
+            if (!c) {
+                reactor_drain_inbox(r);
+                woken = 1;
+                continue;
+            }
+            uint32_t ev = events[i].events;
+            // Drain pending data first so a final request before FIN is still handled
+            int rc = 0;
+            if (ev & EPOLLIN) rc = conn_on_readable(c);
+            // Replies produced by this whole batch go out in one vectored write
+            if (conn_flush(c) < 0 || rc < 0 || (ev & (EPOLLERR | EPOLLHUP))) conn_close(r, c);
+        }
+        // Scores and timers run after the batch so no closed connection is left in events[]
+        if (woken) score_mailbox_drain(&r->scores, reactor_deliver_score, r);
+        tw_advance(&r->wheel, tw_now_ms());
+    }
+    return NULL;
+}
+
+int reactor_pool_start(int nthreads) {
+    if (nthreads <= 0) nthreads = 1;
+    g_reactors = (Reactor*)calloc((size_t)nthreads, sizeof(Reactor));
+    if (!g_reactors) return -1;
+
+    for (int i = 0; i < nthreads; ++i) {
+        Reactor* r = &g_reactors[i];
+        r->index = i;
+        r->epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (r->epfd < 0) {
+            log_message("ERROR", "[Reactor] epoll_create1: %s", strerror(errno));
+            return -1;
+        }
+        r->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        struct epoll_event wev;
+        memset(&wev, 0, sizeof(wev));
+        wev.events = EPOLLIN;
+        wev.data.ptr = NULL; // marks the wake-up eventfd
+        if (r->wakefd < 0 || epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->wakefd, &wev) < 0) {
+            log_message("ERROR", "[Reactor] eventfd: %s", strerror(errno));
+            close(r->epfd);
+            return -1;
+        }
+        pthread_mutex_init(&r->inbox_mtx, NULL);
+        score_mailbox_init(&r->scores, r->wakefd);
+        tw_init(&r->wheel, tw_now_ms());
+        if (pthread_create(&r->thread, NULL, reactor_thread, r) != 0) {
+            log_message("ERROR", "[Reactor] pthread_create failed");
+            close(r->epfd);
+            return -1;
+        }
+        pthread_detach(r->thread);
+        g_reactor_count = i + 1;
+    }
+    log_message("INFO", "[Reactor] %d reactor thread(s) running", g_reactor_count);
+    return 0;
+}
+
+int reactor_pool_add_client(int fd) {
+    if (g_reactor_count <= 0) return -1;
+    if (set_nonblocking(fd) < 0) return -1;
+
+    ReactorConn* c = (ReactorConn*)calloc(1, sizeof(ReactorConn));
+    if (!c) return -1;
+    Reactor* r = &g_reactors[__atomic_fetch_add(&g_next_reactor, 1, __ATOMIC_RELAXED) % (unsigned)g_reactor_count];
+    c->ctx.client_fd = fd;
+    c->ctx.send_fn = reactor_send;
+    c->ctx.send_raw_fn = reactor_send_raw;
+    c->ctx.transport = c;
+    c->ctx.score_mailbox = &r->scores;
+    c->reactor = r;
+    c->events = EPOLLIN | EPOLLRDHUP;
+    rxbuf_init(&c->rx);
+    codec_init(&c->codec);
+    txq_init(&c->tx);
+
+    pthread_mutex_lock(&r->inbox_mtx);
+    c->next_new = r->inbox;
+    r->inbox = c;
+    pthread_mutex_unlock(&r->inbox_mtx);
+    uint64_t one = 1;
+    if (write(r->wakefd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        log_message("ERROR", "[Reactor] wake fd=%d: %s", fd, strerror(errno));
+    }
+    return 0;
+}
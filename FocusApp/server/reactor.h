@@ -0,0 +1,17 @@
+/*
+ * Mục đích: Chế độ I/O hướng sự kiện (multi-reactor epoll) cho Server.
+ *  - N reactor thread, mỗi thread sở hữu 1 epoll instance và tập kết nối riêng.
+ *  - Socket client ở chế độ non-blocking; handler trong handlers.c được gọi khi
+ *    một gói TLV đã nhận đủ (không còn thread/stack riêng cho mỗi client).
+ *
+ * Hàm:
+ * - reactor_pool_start(nthreads): Tạo N reactor thread.
+ * - reactor_pool_add_client(fd): Giao 1 socket vừa accept cho reactor (round-robin).
+ */
+#ifndef SERVER_REACTOR_H
+#define SERVER_REACTOR_H
+
+int reactor_pool_start(int nthreads);
+int reactor_pool_add_client(int fd);
+
+#endif // SERVER_REACTOR_H
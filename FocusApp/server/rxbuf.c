@@ -0,0 +1,147 @@
+/*
+ * Mục đích: Cài đặt RxBuffer và bộ tách TLV tăng dần (xem rxbuf.h).
+ *
+ * Chiến lược bộ nhớ:
+ * - Dung lượng ban đầu RXBUF_INITIAL_SIZE, tăng gấp đôi khi 1 gói lớn hơn chỗ trống.
+ * - Khi đã biết độ dài gói đang dở, đảm bảo buffer đủ chứa trọn gói để payload
+ *   luôn liền mạch (handler nhận view, không copy).
+ * - Dồn dữ liệu (memmove) chỉ xảy ra khi còn 1 gói dở ở cuối buffer.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include "rxbuf.h"
+#include "../common/config.h"
+#include "../common/protocol.h"
+
+#define RXBUF_MAX_SIZE (HEADER_EXT_SIZE + MAX_PAYLOAD_SIZE)
+
+void rxbuf_init(RxBuffer* rx) {
+    memset(rx, 0, sizeof(*rx));
+}
+
+void rxbuf_free(RxBuffer* rx) {
+    free(rx->data);
+    memset(rx, 0, sizeof(*rx));
+}
+
+size_t rxbuf_used(const RxBuffer* rx) {
+    return rx->tail - rx->head;
+}
+
+// Size the next read should have room for: the rest of a partially received
+// packet if its header is known, otherwise a plain chunk.
+static size_t rxbuf_wanted(const RxBuffer* rx) {
+    size_t used = rxbuf_used(rx);
+    if (!rx->opaque && used >= HEADER_SIZE) {
+        PacketHeader hdr;
+        memcpy(&hdr, rx->data + rx->head, HEADER_SIZE);
+        if (hdr.length >= 0 && hdr.length <= MAX_PAYLOAD_SIZE) {
+            size_t total = PACKET_HEADER_SIZE(hdr.type) + (size_t)hdr.length;
+            if (total > used) return total - used;
+        }
+    }
+    return RXBUF_READ_CHUNK;
+}
+
+// Ensure at least `need` contiguous bytes free after tail
+static int rxbuf_reserve(RxBuffer* rx, size_t need) {
+    size_t used = rxbuf_used(rx);
+    if (used == 0) rx->head = rx->tail = 0;
+    if (rx->cap - rx->tail >= need) return 0;
+
+    // Compact the partial packet to the front if that makes enough room
+    if (rx->head > 0 && rx->cap - used >= need) {
+        memmove(rx->data, rx->data + rx->head, used);
+        rx->head = 0;
+        rx->tail = used;
+        return 0;
+    }
+
+    size_t cap = rx->cap ? rx->cap : RXBUF_INITIAL_SIZE;
+    while (cap - used < need) cap *= 2;
+    if (cap > RXBUF_MAX_SIZE + RXBUF_READ_CHUNK) cap = RXBUF_MAX_SIZE + RXBUF_READ_CHUNK;
+    if (cap - used < need) return -1;
+
+    char* data = (char*)malloc(cap);
+    if (!data) return -1;
+    if (used) memcpy(data, rx->data + rx->head, used);
+    free(rx->data);
+    rx->data = data;
+    rx->cap = cap;
+    rx->head = 0;
+    rx->tail = used;
+    return 0;
+}
+
+ssize_t rxbuf_recv(RxBuffer* rx, int fd) {
+    size_t want = rxbuf_wanted(rx);
+    if (want < RXBUF_READ_CHUNK) want = RXBUF_READ_CHUNK;
+    if (rxbuf_reserve(rx, want) < 0) {
+        // Could not grow by a full chunk, settle for the exact remainder
+        if (rxbuf_reserve(rx, rxbuf_wanted(rx)) < 0) {
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    ssize_t n;
+    do {
+        n = recv(fd, rx->data + rx->tail, rx->cap - rx->tail, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n > 0) rx->tail += (size_t)n;
+    return n;
+}
+
+int rxbuf_append(RxBuffer* rx, const char* data, size_t len) {
+    if (len == 0) return 0;
+    if (rxbuf_reserve(rx, len) < 0) return -1;
+    memcpy(rx->data + rx->tail, data, len);
+    rx->tail += len;
+    return 0;
+}
+
+// Walk complete records in [*pos, end). Returns records dispatched or -1.
+static int tlv_dispatch_span(const char* base, size_t* pos, size_t end, TlvHandler handler, void* user) {
+    int count = 0;
+    while (end - *pos >= HEADER_SIZE) {
+        PacketHeaderExt hdr;
+        memcpy(&hdr, base + *pos, HEADER_SIZE);
+        if (hdr.length < 0 || hdr.length > MAX_PAYLOAD_SIZE) return -1;
+        size_t hsize = PACKET_HEADER_SIZE(hdr.type);
+        if (end - *pos < hsize || end - *pos - hsize < (size_t)hdr.length) break;
+        if (hsize > HEADER_SIZE) memcpy(&hdr.tag, base + *pos + HEADER_SIZE, sizeof(hdr.tag));
+
+        const char* payload = hdr.length ? base + *pos + hsize : NULL;
+        *pos += hsize + (size_t)hdr.length;
+        count++;
+        if (handler(user, MSG_TYPE(hdr.type), payload, hdr.length, hsize > HEADER_SIZE ? &hdr.tag : NULL) < 0) return -1;
+    }
+    return count;
+}
+
+int tlv_parse(RxBuffer* rx, TlvHandler handler, void* user) {
+    int count = tlv_dispatch_span(rx->data, &rx->head, rx->tail, handler, user);
+    if (rx->head == rx->tail) rx->head = rx->tail = 0;
+    return count;
+}
+
+int tlv_feed(RxBuffer* rx, const char* data, size_t len, TlvHandler handler, void* user) {
+    if (rxbuf_used(rx) > 0) {
+        if (rxbuf_append(rx, data, len) < 0) return -1;
+        return tlv_parse(rx, handler, user);
+    }
+    size_t pos = 0;
+    int count = tlv_dispatch_span(data, &pos, len, handler, user);
+    if (count < 0) return -1;
+    if (pos < len && rxbuf_append(rx, data + pos, len - pos) < 0) return -1;
+    return count;
+}
+
+int tlv_dispatch(const char* data, size_t len, TlvHandler handler, void* user) {
+    size_t pos = 0;
+    int count = tlv_dispatch_span(data, &pos, len, handler, user);
+    if (count < 0 || pos != len) return -1;
+    return count;
+}
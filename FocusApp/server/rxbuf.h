@@ -0,0 +1,56 @@
+/*
+ * Mục đích: Buffer nhận tái sử dụng cho mỗi kết nối + bộ tách gói TLV tăng dần.
+ *
+ * Cấu trúc:
+ * - RxBuffer: vùng nhớ [head, tail) chứa byte đã nhận nhưng chưa xử lý. Khi rỗng thì
+ *   head/tail quay về 0 (như ring buffer); khi thiếu chỗ ở cuối thì dồn phần dở dang
+ *   về đầu hoặc tăng dung lượng (tối đa HEADER_SIZE + MAX_PAYLOAD_SIZE). Buffer được
+ *   giữ lại giữa các gói nên không còn malloc/free cho mỗi frame. `opaque` = 1 khi nội dung
+ *   không phải TLV (frame WebSocket): khi đó mỗi lần đọc chỉ xin 1 chunk cố định.
+ *
+ * Hàm:
+ * - rxbuf_init/rxbuf_free: Khởi tạo/giải phóng.
+ * - rxbuf_recv(rx, fd): Đọc 1 lần recv() vào chỗ trống (mở rộng nếu cần).
+ * - rxbuf_append(rx, data, len): Chép dữ liệu nhận từ nơi khác (io_uring buffer...).
+ * - tlv_parse(rx, handler, user): Tách mọi gói TLV hoàn chỉnh và gọi handler với payload
+ *   là con trỏ trỏ thẳng vào buffer (chỉ hợp lệ trong lúc handler chạy). Gói dùng header
+ *   mở rộng (MSG_EXT_HEADER) được tách đúng 16 byte header; handler nhận type đã bỏ bit
+ *   mở rộng và PacketTag (NULL nếu gói dùng header 8 byte).
+ * - tlv_feed(rx, data, len, handler, user): Như tlv_parse nhưng xử lý tại chỗ trên `data`
+ *   khi rx đang rỗng; chỉ phần gói dở dang mới được chép vào rx.
+ * - tlv_dispatch(data, len, handler, user): Tách các bản ghi nằm trọn trong 1 vùng nhớ (payload
+ *   MSG_TLV_BATCH); byte thừa không đủ 1 bản ghi bị coi là lỗi định dạng.
+ */
+#ifndef SERVER_RXBUF_H
+#define SERVER_RXBUF_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "../common/protocol.h"
+
+typedef struct {
+    char* data;
+    size_t cap;
+    size_t head;    // first unread byte
+    size_t tail;    // one past last received byte
+    int opaque;     // not TLV framed: do not size reads from a TLV header
+} RxBuffer;
+
+// Called for every complete TLV record; tag is NULL for records with the basic header.
+// Return <0 to stop parsing and close.
+typedef int (*TlvHandler)(void* user, int type, const char* payload, int length, const PacketTag* tag);
+
+void rxbuf_init(RxBuffer* rx);
+void rxbuf_free(RxBuffer* rx);
+size_t rxbuf_used(const RxBuffer* rx);
+
+// Returns bytes read, 0 on orderly shutdown, -1 on error (errno preserved, EAGAIN included)
+ssize_t rxbuf_recv(RxBuffer* rx, int fd);
+int rxbuf_append(RxBuffer* rx, const char* data, size_t len);
+
+// Returns number of records dispatched, or -1 on malformed header / handler asking to close
+int tlv_parse(RxBuffer* rx, TlvHandler handler, void* user);
+int tlv_feed(RxBuffer* rx, const char* data, size_t len, TlvHandler handler, void* user);
+int tlv_dispatch(const char* data, size_t len, TlvHandler handler, void* user);
+
+#endif // SERVER_RXBUF_H
@@ -0,0 +1,561 @@
+/*
+ * Mục đích: Cài đặt pipeline chấm điểm (xem scorepool.h).
+ *  - 1 mutex chung bảo vệ 2 hàng đợi stage (decode, score) và mọi ScoreSession (slot frame, cờ
+ *    closed, refcount); không bao giờ giữ mutex trong lúc giải mã / chấm điểm.
+ *  - Mỗi phiên có 1 slot cho mỗi stage, frame mới hơn thay frame cũ chưa xử lý (latest wins, frame
+ *    cũ được đếm vào drops). Phiên nằm trên hàng đợi của 1 stage tối đa 1 lần (`queued[stage]`, kể cả
+ *    lúc đang xử lý) nên mỗi hàng đợi dài tối đa bằng số phiên, và mỗi phiên giữ tối đa 1 frame chưa
+ *    giải mã + 1 frame đã giải mã + 1 kết quả chưa gửi: độ trễ không tăng theo tải.
+ *  - Worker ưu tiên stage score (việc gần client nhất) rồi mới giải mã frame mới; xử lý xong 1 việc
+ *    thì phiên có việc tiếp theo quay lại cuối hàng đợi nên các phiên được phục vụ xoay vòng.
+ *  - Gom lượt: worker lấy tối đa batch_max phiên từ hàng đợi score rồi chấm chung 1 lượt
+ *    (score_batch của backend). Chưa đủ thì chờ thêm tối đa batch_wait_us tính từ lúc bắt đầu gom;
+ *    trong lúc chờ, worker giải mã frame đang chờ (có thể vào ngay lượt này) thay vì ngồi không.
+ *  - Refcount: chủ kết nối giữ 1, mỗi stage phiên đang `queued` giữ 1, kết quả chờ trong mailbox giữ 1.
+ *  - Mailbox chỉ ghi eventfd khi danh sách đang rỗng: chủ đang bận thì thêm kết quả không tốn syscall.
+ *    Kết quả được đưa vào mailbox trong lúc giữ mutex của pool, nên sau score_session_close() không
+ *    còn kết quả nào của phiên đó vào mailbox nữa. `posted` (kết quả đang chờ trong mailbox) do
+ *    mutex của mailbox bảo vệ; thứ tự khoá: mutex pool trước, mutex mailbox sau.
+ *  - Frame trùng: frame có hash nội dung bằng frame gửi ngay trước của phiên được đánh dấu `dup`
+ *    lúc submit và bỏ qua stage giải mã; stage score dùng lại điểm đã lưu nếu frame chấm ngay trước
+ *    có cùng hash (frame đó có thể đã bị frame mới hơn thay thì chấm nguyên frame như bình thường).
+ *    `cached_*` chỉ stage score đụng tới, như trạng thái backend.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "scorepool.h"
+#include "scorer.h"
+#include "../common/config.h"
+
+extern void log_message(const char* level, const char* format, ...);
+
+enum { STAGE_DECODE, STAGE_SCORE, STAGE_QUEUES, STAGE_PUBLISH = STAGE_QUEUES, STAGE_COUNT };
+
+static const char* const STAGE_NAMES[STAGE_COUNT] = { "decode", "score", "publish" };
+
+typedef struct ScoreJob {
+    int frame_no;
+    int length;
+    int score;                  // >= 0: already known (checksum fallback), passed through in order
+    int dup;                    // same bytes as the frame submitted before it: not decoded
+    uint64_t hash;              // frame_hash64 of data
+    void* decoded;              // scorer->decode output, NULL = scored from data
+    char data[];
+} ScoreJob;
+
+struct ScoreResult {
+    ScoreResult* next;
+    ScoreSession* session;
+    int score;
+    int frame_no;
+};
+
+struct ScoreSession {
+    ScoreSession* next[STAGE_QUEUES];
+    int queued[STAGE_QUEUES];   // on the stage's queue or being processed by it
+    int refs;
+    int closed;
+    ScoreJob* slot[STAGE_QUEUES];   // latest frame waiting for each stage
+    ScoreResult* posted;        // result not yet taken by the owner (guarded by mb->mtx)
+    unsigned long dropped;
+    ClientContext* ctx;         // owner's context, only dereferenced by the owner while !closed
+    ScoreMailbox* mb;
+    ScoreDirectFn direct;
+    uint64_t key;
+    const FocusScorer* scorer;
+    void* state;                // backend state, used by the score stage only
+    uint64_t submit_hash;       // last frame submitted (guarded by g_pool.mtx)
+    int has_submit;
+    uint64_t cached_hash;       // last frame scored and its score (score stage only)
+    int cached_score;           // -1 = none yet
+};
+
+static struct {
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+    ScoreSession* head[STAGE_QUEUES];
+    ScoreSession* tail[STAGE_QUEUES];
+    int threads;
+    int batch_max;
+    int batch_wait_us;
+    unsigned long frames;
+    unsigned long dropped[STAGE_COUNT];     // frames superseded before reaching each stage
+    unsigned long batches;
+    unsigned long batched;                  // sessions scored in those batches
+    unsigned long reused;                   // duplicate frames answered with the cached score
+    int waiting;                            // sessions on the decode and score queues
+} g_pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, { NULL, NULL }, { NULL, NULL }, 0, 1, 0, 0, { 0, 0, 0 }, 0, 0, 0, 0 };
+
+static void job_free(ScoreJob* job) {
+    if (!job) return;
+    free(job->decoded);
+    free(job);
+}
+
+static void session_free(ScoreSession* s) {
+    for (int i = 0; i < STAGE_QUEUES; ++i) job_free(s->slot[i]);
+    if (s->scorer->session_free) s->scorer->session_free(s->state);
+    free(s);
+}
+
+// Drop one reference; frees the session on the last one (call without g_pool.mtx)
+static void session_release(ScoreSession* s) {
+    pthread_mutex_lock(&g_pool.mtx);
+    int last = --s->refs == 0;
+    pthread_mutex_unlock(&g_pool.mtx);
+    if (last) session_free(s);
+}
+
+static void stage_push_locked(int stage, ScoreSession* s) {
+    s->next[stage] = NULL;
+    if (g_pool.tail[stage]) g_pool.tail[stage]->next[stage] = s;
+    else g_pool.head[stage] = s;
+    g_pool.tail[stage] = s;
+    g_pool.waiting++;
+}
+
+static ScoreSession* stage_pop_locked(int stage) {
+    ScoreSession* s = g_pool.head[stage];
+    g_pool.head[stage] = s->next[stage];
+    if (!g_pool.head[stage]) g_pool.tail[stage] = NULL;
+    g_pool.waiting--;
+    return s;
+}
+
+// Put a job in the session's slot for a stage, superseding the one waiting there
+static ScoreJob* stage_offer_locked(int stage, ScoreSession* s, ScoreJob* job) {
+    ScoreJob* stale = s->slot[stage];
+    s->slot[stage] = job;
+    if (stale) {
+        g_pool.dropped[stage]++;
+        s->dropped++;
+    }
+    if (!s->queued[stage]) {
+        s->queued[stage] = 1;
+        s->refs++;
+        stage_push_locked(stage, s);
+        pthread_cond_signal(&g_pool.cond);
+    }
+    return stale;
+}
+
+// First drop and then every 1000th: say which stage is falling behind
+static int drops_report_locked(char* buf, size_t cap) {
+    unsigned long total = 0;
+    for (int i = 0; i < STAGE_COUNT; ++i) total += g_pool.dropped[i];
+    if (total != 1 && total % 1000 != 0) return 0;
+    snprintf(buf, cap, "%lu of %lu frame(s) superseded (before %s %lu, %s %lu, %s %lu), %.1f per batch, %lu duplicate(s) not rescored",
+             total, g_pool.frames, STAGE_NAMES[0], g_pool.dropped[0], STAGE_NAMES[1], g_pool.dropped[1], STAGE_NAMES[2],
+             g_pool.dropped[2], g_pool.batches ? (double)g_pool.batched / (double)g_pool.batches : 0.0, g_pool.reused);
+    return 1;
+}
+
+// Latest result wins: a result the owner has not taken yet is overwritten in place (returns 1)
+static int mailbox_post(ScoreMailbox* mb, ScoreSession* s, ScoreResult* r, int score, int frame_no) {
+    pthread_mutex_lock(&mb->mtx);
+    if (s->posted) {
+        s->posted->score = score;
+        s->posted->frame_no = frame_no;
+        g_pool.dropped[STAGE_PUBLISH]++;
+        s->dropped++;
+        pthread_mutex_unlock(&mb->mtx);
+        free(r);
+        return 1;
+    }
+    if (!r) {
+        pthread_mutex_unlock(&mb->mtx);
+        return 0;
+    }
+    r->next = NULL;
+    r->session = s;
+    r->score = score;
+    r->frame_no = frame_no;
+    s->refs++;
+    s->posted = r;
+    int was_empty = mb->head == NULL;
+    if (mb->tail) mb->tail->next = r;
+    else mb->head = r;
+    mb->tail = r;
+    pthread_mutex_unlock(&mb->mtx);
+    uint64_t one = 1;
+    if (was_empty && write(mb->efd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        log_message("ERROR", "[Score] wake owner: %s", strerror(errno));
+    }
+    return 0;
+}
+
+// Hand a finished score to the session's owner (mailbox) or callback
+static void session_deliver(ScoreSession* s, int score, int frame_no) {
+    ScoreResult* r = (ScoreResult*)malloc(sizeof(ScoreResult));
+    char report[200];
+    pthread_mutex_lock(&g_pool.mtx);
+    if (s->closed) {
+        pthread_mutex_unlock(&g_pool.mtx);
+        free(r);
+        return;
+    }
+    if (s->mb) {
+        int rep = mailbox_post(s->mb, s, r, score, frame_no) && drops_report_locked(report, sizeof(report));
+        pthread_mutex_unlock(&g_pool.mtx);
+        if (rep) log_message("WARN", "[Score] pipeline behind: %s", report);
+        return;
+    }
+    ScoreDirectFn fn = s->direct;
+    uint64_t key = s->key;
+    pthread_mutex_unlock(&g_pool.mtx);
+    free(r);
+    if (fn) fn(key, score, frame_no);
+}
+
+// Decode stage: frame -> backend features, then on to the score stage
+static void decode_job(ScoreSession* s, ScoreJob* job, void* decoder) {
+    const FocusScorer* sc = s->scorer;
+    if (sc->decode && decoder && !job->dup) {
+        job->decoded = malloc(sc->decoded_size);
+        if (!job->decoded || sc->decode(decoder, job->data, job->length, job->decoded) < 0) {
+            // Not a frame this backend decodes: the checksum score is final, but it still goes
+            // through the score stage so results leave in frame order
+            job->score = scorer_checksum(job->data, job->length);
+            free(job->decoded);
+            job->decoded = NULL;
+        }
+    }
+    char report[200];
+    pthread_mutex_lock(&g_pool.mtx);
+    if (s->closed) {
+        pthread_mutex_unlock(&g_pool.mtx);
+        job_free(job);
+        return;
+    }
+    ScoreJob* stale = stage_offer_locked(STAGE_SCORE, s, job);
+    int rep = stale && drops_report_locked(report, sizeof(report));
+    pthread_mutex_unlock(&g_pool.mtx);
+    job_free(stale);
+    if (rep) log_message("WARN", "[Score] pipeline behind: %s", report);
+}
+
+// A duplicate of the frame scored just before gets its score without touching the backend
+static int score_reuse(ScoreSession* s, ScoreJob* job) {
+    if (!job->dup || s->cached_score < 0 || job->hash != s->cached_hash) return 0;
+    job->score = s->cached_score;
+    return 1;
+}
+
+// Score stage: the only place the backend's session state is touched
+static void score_job(ScoreSession* s, ScoreJob* job) {
+    const FocusScorer* sc = s->scorer;
+    int score = job->score >= 0 ? job->score
+              : job->decoded ? sc->score_decoded(s->state, job->decoded)
+              : sc->score(s->state, job->data, job->length);
+    s->cached_hash = job->hash;
+    s->cached_score = score;
+    int frame_no = job->frame_no;
+    job_free(job);
+    session_deliver(s, score, frame_no);
+}
+
+// Score a batch of sessions (jobs[i] NULL: closed meanwhile), results fan out per session
+static void score_batch(ScoreSession** batch, ScoreJob** jobs, int n) {
+    const FocusScorer* sc = scorer_active();
+    int reused = 0;
+    for (int i = 0; i < n; ++i) {
+        if (jobs[i]) reused += score_reuse(batch[i], jobs[i]);
+    }
+    if (reused) {
+        pthread_mutex_lock(&g_pool.mtx);
+        g_pool.reused += (unsigned long)reused;
+        pthread_mutex_unlock(&g_pool.mtx);
+    }
+    if (sc->score_batch) {
+        void* states[SCORE_BATCH_LIMIT];
+        const void* decoded[SCORE_BATCH_LIMIT];
+        int scores[SCORE_BATCH_LIMIT];
+        int idx[SCORE_BATCH_LIMIT];
+        int m = 0;
+        for (int i = 0; i < n; ++i) {
+            if (!jobs[i] || jobs[i]->score >= 0 || !jobs[i]->decoded) continue;
+            states[m] = batch[i]->state;
+            decoded[m] = jobs[i]->decoded;
+            idx[m++] = i;
+        }
+        if (m > 0) sc->score_batch(states, decoded, m, scores);
+        for (int j = 0; j < m; ++j) jobs[idx[j]]->score = scores[j];
+    }
+    for (int i = 0; i < n; ++i) {
+        if (jobs[i]) score_job(batch[i], jobs[i]);
+    }
+}
+
+// The stage is done with s: back on the queue if another frame arrived meanwhile, otherwise its
+// reference goes. Returns 1 when that was the last reference (free after unlocking).
+static int stage_done_locked(int stage, ScoreSession* s) {
+    if (s->slot[stage] && !s->closed) {
+        stage_push_locked(stage, s);
+        return 0;
+    }
+    s->queued[stage] = 0;
+    return --s->refs == 0;
+}
+
+// Decode the frame at the head of the decode queue; entered and left with g_pool.mtx held
+static void decode_one_locked(void* decoder) {
+    ScoreSession* s = stage_pop_locked(STAGE_DECODE);
+    ScoreJob* job = s->slot[STAGE_DECODE];
+    s->slot[STAGE_DECODE] = NULL;
+    pthread_mutex_unlock(&g_pool.mtx);
+    if (job) decode_job(s, job, decoder);
+    pthread_mutex_lock(&g_pool.mtx);
+    if (stage_done_locked(STAGE_DECODE, s)) {
+        pthread_mutex_unlock(&g_pool.mtx);
+        session_free(s);
+        pthread_mutex_lock(&g_pool.mtx);
+    }
+}
+
+static int deadline_passed(const struct timespec* deadline) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec > deadline->tv_sec || (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+}
+
+// Gather up to batch_max sessions from the score queue (at least one is there), waiting at most
+// batch_wait_us for more; frames waiting to be decoded are decoded meanwhile so they can join
+static int batch_collect_locked(ScoreSession** batch, ScoreJob** jobs, void* decoder) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += (long)g_pool.batch_wait_us * 1000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+
+    int n = 0, expired = g_pool.batch_wait_us == 0;
+    for (;;) {
+        while (g_pool.head[STAGE_SCORE] && n < g_pool.batch_max) {
+            ScoreSession* s = stage_pop_locked(STAGE_SCORE);
+            batch[n] = s;
+            jobs[n++] = s->slot[STAGE_SCORE];
+            s->slot[STAGE_SCORE] = NULL;
+        }
+        if (n >= g_pool.batch_max || expired) break;
+        if (g_pool.head[STAGE_DECODE]) {
+            decode_one_locked(decoder);
+            expired = deadline_passed(&deadline);
+        } else {
+            expired = pthread_cond_timedwait(&g_pool.cond, &g_pool.mtx, &deadline) == ETIMEDOUT;
+        }
+    }
+    return n;
+}
+
+static void* score_worker(void* arg) {
+    (void)arg;
+    const FocusScorer* sc = scorer_active();
+    void* decoder = sc->decoder_new ? sc->decoder_new() : NULL;    // NULL: frames are scored whole
+    ScoreSession* batch[SCORE_BATCH_LIMIT];
+    ScoreJob* jobs[SCORE_BATCH_LIMIT];
+    for (;;) {
+        pthread_mutex_lock(&g_pool.mtx);
+        while (!g_pool.head[STAGE_DECODE] && !g_pool.head[STAGE_SCORE]) pthread_cond_wait(&g_pool.cond, &g_pool.mtx);
+        if (!g_pool.head[STAGE_SCORE]) {
+            decode_one_locked(decoder);
+            pthread_mutex_unlock(&g_pool.mtx);
+            continue;
+        }
+
+        // Scoring first (closest to the client), many connections per call
+        int n = batch_collect_locked(batch, jobs, decoder);
+        pthread_mutex_unlock(&g_pool.mtx);
+        score_batch(batch, jobs, n);
+
+        int nfree = 0;
+        pthread_mutex_lock(&g_pool.mtx);
+        g_pool.batches++;
+        g_pool.batched += (unsigned long)n;
+        for (int i = 0; i < n; ++i) {
+            if (stage_done_locked(STAGE_SCORE, batch[i])) batch[nfree++] = batch[i];
+        }
+        pthread_mutex_unlock(&g_pool.mtx);
+        for (int i = 0; i < nfree; ++i) session_free(batch[i]);
+    }
+    return NULL;
+}
+
+int score_pool_start(int nthreads, int batch_max, int batch_wait_us) {
+    g_pool.batch_max = batch_max < 1 ? 1 : (batch_max > SCORE_BATCH_LIMIT ? SCORE_BATCH_LIMIT : batch_max);
+    g_pool.batch_wait_us = batch_wait_us < 0 ? 0 : batch_wait_us;
+    int started = 0;
+    for (int i = 0; i < nthreads; ++i) {
+        pthread_t th;
+        if (pthread_create(&th, NULL, score_worker, NULL) != 0) break;
+        pthread_detach(th);
+        started++;
+    }
+    pthread_mutex_lock(&g_pool.mtx);
+    g_pool.threads = started;
+    pthread_mutex_unlock(&g_pool.mtx);
+    if (started == 0) return -1;
+    log_message("INFO", "[Score] %d scoring thread(s) running, scorer '%s'%s, batches of up to %d within %d us",
+                started, scorer_active()->name, scorer_active()->decode ? ", decode/score pipelined" : "",
+                g_pool.batch_max, g_pool.batch_wait_us);
+    return 0;
+}
+
+void score_pool_load(ScorePoolLoad* out) {
+    pthread_mutex_lock(&g_pool.mtx);
+    out->frames = g_pool.frames;
+    out->superseded = 0;
+    for (int i = 0; i < STAGE_COUNT; ++i) out->superseded += g_pool.dropped[i];
+    out->waiting = g_pool.waiting;
+    out->capacity = (g_pool.threads > 0 ? g_pool.threads : 1) * g_pool.batch_max;
+    pthread_mutex_unlock(&g_pool.mtx);
+}
+
+int score_mailbox_init(ScoreMailbox* mb, int efd) {
+    memset(mb, 0, sizeof(*mb));
+    mb->own_efd = efd < 0;
+    mb->efd = efd < 0 ? eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) : efd;
+    if (mb->efd < 0) return -1;
+    pthread_mutex_init(&mb->mtx, NULL);
+    return 0;
+}
+
+void score_mailbox_drain(ScoreMailbox* mb, ScoreDeliverFn fn, void* user) {
+    if (mb->own_efd) {
+        uint64_t n;
+        while (read(mb->efd, &n, sizeof(n)) > 0) {}
+    }
+    pthread_mutex_lock(&mb->mtx);
+    ScoreResult* r = mb->head;
+    mb->head = mb->tail = NULL;
+    // From here on new results start a fresh entry instead of overwriting these
+    for (ScoreResult* it = r; it; it = it->next) it->session->posted = NULL;
+    pthread_mutex_unlock(&mb->mtx);
+
+    while (r) {
+        ScoreResult* next = r->next;
+        // closed only changes on this (the owner's) thread, e.g. inside fn
+        if (!r->session->closed) fn(user, r->session->ctx, r->score, r->frame_no);
+        session_release(r->session);
+        free(r);
+        r = next;
+    }
+}
+
+void score_mailbox_destroy(ScoreMailbox* mb) {
+    ScoreResult* r = mb->head;
+    while (r) {
+        ScoreResult* next = r->next;
+        r->session->posted = NULL;
+        session_release(r->session);
+        free(r);
+        r = next;
+    }
+    mb->head = mb->tail = NULL;
+    pthread_mutex_destroy(&mb->mtx);
+    if (mb->own_efd) close(mb->efd);
+    mb->efd = -1;
+}
+
+static ScoreSession* session_new(void) {
+    ScoreSession* s = (ScoreSession*)calloc(1, sizeof(ScoreSession));
+    if (!s) return NULL;
+    s->refs = 1;
+    s->cached_score = -1;
+    s->scorer = scorer_active();
+    if (s->scorer->session_new) {
+        s->state = s->scorer->session_new();
+        if (!s->state) {
+            free(s);
+            return NULL;
+        }
+    }
+    return s;
+}
+
+ScoreSession* score_session_open(ClientContext* ctx, ScoreMailbox* mb) {
+    if (!mb) return NULL;
+    ScoreSession* s = session_new();
+    if (!s) return NULL;
+    s->ctx = ctx;
+    s->mb = mb;
+    return s;
+}
+
+ScoreSession* score_session_open_direct(ScoreDirectFn fn, uint64_t key) {
+    ScoreSession* s = session_new();
+    if (!s) return NULL;
+    s->direct = fn;
+    s->key = key;
+    return s;
+}
+
+int score_submit(ScoreSession* s, const char* data, int length, int frame_no, uint64_t hash) {
+    if (!s || length < 0) return -1;
+    if (g_pool.threads == 0) {
+        // No workers: score on the caller's thread, the result still goes through the mailbox
+        if (s->cached_score < 0 || hash != s->cached_hash) {
+            s->cached_score = s->scorer->score(s->state, data, length);
+            s->cached_hash = hash;
+        } else {
+            pthread_mutex_lock(&g_pool.mtx);
+            g_pool.reused++;
+            pthread_mutex_unlock(&g_pool.mtx);
+        }
+        session_deliver(s, s->cached_score, frame_no);
+        return 0;
+    }
+
+    ScoreJob* job = (ScoreJob*)malloc(sizeof(ScoreJob) + (size_t)length);
+    if (!job) return -1;
+    job->frame_no = frame_no;
+    job->length = length;
+    job->score = -1;
+    job->hash = hash;
+    job->decoded = NULL;
+    if (length > 0) memcpy(job->data, data, (size_t)length);
+
+    char report[200];
+    pthread_mutex_lock(&g_pool.mtx);
+    if (s->closed) {
+        pthread_mutex_unlock(&g_pool.mtx);
+        job_free(job);
+        return 1;
+    }
+    g_pool.frames++;
+    job->dup = s->has_submit && s->submit_hash == hash;
+    s->submit_hash = hash;
+    s->has_submit = 1;
+    ScoreJob* stale = stage_offer_locked(STAGE_DECODE, s, job);
+    int rep = stale && drops_report_locked(report, sizeof(report));
+    pthread_mutex_unlock(&g_pool.mtx);
+    job_free(stale);
+    if (rep) log_message("WARN", "[Score] pipeline behind: %s", report);
+    return stale ? 1 : 0;
+}
+
+void score_session_close(ScoreSession* s) {
+    if (!s) return;
+    ScoreJob* jobs[STAGE_QUEUES];
+    pthread_mutex_lock(&g_pool.mtx);
+    s->closed = 1;
+    s->ctx = NULL;
+    s->mb = NULL;
+    s->direct = NULL;
+    // Frames still waiting are not worth scoring; a worker holding a stage ref lets go on its own
+    for (int i = 0; i < STAGE_QUEUES; ++i) {
+        jobs[i] = s->slot[i];
+        s->slot[i] = NULL;
+    }
+    unsigned long dropped = s->dropped;
+    int last = --s->refs == 0;
+    pthread_mutex_unlock(&g_pool.mtx);
+    if (dropped) log_message("DEBUG", "[Score] session closed, %lu stale frame(s) skipped under load", dropped);
+    for (int i = 0; i < STAGE_QUEUES; ++i) job_free(jobs[i]);
+    if (last) session_free(s);
+}
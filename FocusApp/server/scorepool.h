@@ -0,0 +1,75 @@
+/*
+ * Mục đích: Pipeline chấm điểm: giải mã → chấm → gửi, chạy trên thread riêng, tách khỏi thread I/O.
+ *  - Thread I/O chỉ chép frame vào phiên chấm điểm (ScoreSession, 1 phiên mỗi kết nối) rồi đọc tiếp;
+ *    worker giải mã frame (decode của backend, không cần trạng thái phiên) rồi chấm bằng backend
+ *    đang chọn (scorer.h).
+ *  - Quá tải: mỗi phiên có 1 slot "latest wins" cho mỗi stage (chờ giải mã, chờ chấm, chờ gửi);
+ *    frame/kết quả mới thay cái cũ chưa xử lý và được đếm theo stage, nên độ trễ có giới hạn.
+ *  - Frame của cùng 1 phiên được chấm theo thứ tự nhận (trạng thái backend như frame trước không bị
+ *    2 thread dùng cùng lúc), giải mã frame sau chạy song song với chấm frame trước; các phiên khác
+ *    nhau chạy song song.
+ *  - Kết quả được đưa vào ScoreMailbox của thread sở hữu kết nối và đánh thức thread đó qua
+ *    eventfd; chủ kết nối gửi MSG_FOCUS_UPDATE/MSG_FOCUS_WARN từ thread của mình (worker không
+ *    bao giờ chạm vào ClientContext). Kênh UDP không có chủ: kết quả được trả qua callback.
+ *  - Kết nối đóng: score_session_close() chặn mọi kết quả về sau; phiên được giải phóng khi frame
+ *    cuối cùng đang chấm/chờ giao xong (refcount).
+ *
+ * Hàm:
+ * - score_pool_start(nthreads, batch_max, batch_wait_us): Tạo worker; lỗi thì frame được chấm ngay
+ *   trên thread gọi submit (kết quả vẫn đi qua mailbox như bình thường). Stage score gom frame của
+ *   tối đa batch_max kết nối thành 1 lượt, chờ gom tối đa batch_wait_us (0 = chấm ngay phần đang có):
+ *   lượt lớn tiết kiệm chi phí mỗi lần gọi backend, đổi lại độ trễ mỗi frame tăng tối đa batch_wait_us.
+ * - score_pool_load(out): Ảnh chụp tải của pipeline (frame đã nhận, frame bị thay, số phiên đang
+ *   chờ giải mã/chấm so với số phiên 1 lượt của mọi worker) cho điều khiển tốc độ (ratectl.h).
+ * - score_mailbox_init(mb, efd): efd >= 0 dùng chung eventfd có sẵn của thread chủ (vd. wakefd của
+ *   reactor; chủ tự đọc sạch eventfd), efd < 0 tạo eventfd riêng (mb->efd).
+ * - score_mailbox_drain(mb, fn, user): Chủ lấy mọi kết quả đang chờ, gọi fn cho kết quả của phiên còn mở.
+ * - score_mailbox_destroy(mb): Bỏ kết quả còn lại; gọi sau khi mọi phiên giao về mb đã close.
+ * - score_session_open(ctx, mb) / score_session_open_direct(fn, key): Tạo phiên giao kết quả về
+ *   mailbox / callback (gọi trên thread worker, key nhận diện người nhận).
+ * - score_submit(s, data, length, frame_no, hash): Chép frame vào slot chờ giải mã; 1 nếu nó thay
+ *   1 frame cũ chưa kịp giải mã. hash = frame_hash64 của frame (framehash.h): frame giống hệt frame
+ *   trước không được giải mã / chấm lại mà nhận lại điểm đã có.
+ * - score_session_close(s): Chủ đóng phiên (thread sở hữu kết nối).
+ */
+#ifndef SERVER_SCOREPOOL_H
+#define SERVER_SCOREPOOL_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "handlers.h"
+
+typedef struct ScoreSession ScoreSession;
+typedef struct ScoreResult ScoreResult;
+
+typedef struct ScoreMailbox {
+    pthread_mutex_t mtx;
+    ScoreResult* head;
+    ScoreResult* tail;
+    int efd;
+    int own_efd;            // created by score_mailbox_init: drained (and closed) here
+} ScoreMailbox;
+
+typedef struct {
+    unsigned long frames;       // submitted since start
+    unsigned long superseded;   // of those, replaced by a newer frame at any stage
+    int waiting;                // sessions queued for decode or scoring right now
+    int capacity;               // sessions all workers take in one batch each
+} ScorePoolLoad;
+
+typedef void (*ScoreDeliverFn)(void* user, ClientContext* ctx, int score, int frame_no);
+typedef void (*ScoreDirectFn)(uint64_t key, int score, int frame_no);
+
+int score_pool_start(int nthreads, int batch_max, int batch_wait_us);
+void score_pool_load(ScorePoolLoad* out);
+
+int score_mailbox_init(ScoreMailbox* mb, int efd);
+void score_mailbox_drain(ScoreMailbox* mb, ScoreDeliverFn fn, void* user);
+void score_mailbox_destroy(ScoreMailbox* mb);
+
+ScoreSession* score_session_open(ClientContext* ctx, ScoreMailbox* mb);
+ScoreSession* score_session_open_direct(ScoreDirectFn fn, uint64_t key);
+int score_submit(ScoreSession* s, const char* data, int length, int frame_no, uint64_t hash);
+void score_session_close(ScoreSession* s);
+
+#endif // SERVER_SCOREPOOL_H
@@ -0,0 +1,60 @@
+/*
+ * Mục đích: Registry backend chấm điểm (xem scorer.h) + backend "checksum".
+ *  - Thêm backend: khai báo FocusScorer trong file riêng (vd. scorer_pixel.c) rồi thêm vào g_scorers.
+ *  - Backend được chọn 1 lần lúc khởi động (--scorer), trước khi có phiên nào.
+ */
+#include <string.h>
+
+#include "scorer.h"
+
+extern void log_message(const char* level, const char* format, ...);
+
+int scorer_checksum(const char* data, int length) {
+    // Tính điểm tập trung đơn giản dựa trên checksum payload (demo)
+    unsigned long long sum = 0;
+    int step = (length > 4096) ? length / 4096 : 1;
+    for (int i = 0; i < length; i += step) sum += (unsigned char)data[i];
+    return (int)((sum % 10100) / 100); // 0..100
+}
+
+static int checksum_score(void* state, const char* data, int length) {
+    (void)state;
+    return scorer_checksum(data, length);
+}
+
+static const FocusScorer g_scorer_checksum = {
+    "checksum", NULL, NULL, NULL, checksum_score, 0, NULL, NULL, NULL, NULL, NULL
+};
+
+static const FocusScorer* const g_scorers[] = {
+    &g_scorer_pixel,
+    &g_scorer_checksum,
+};
+
+static const FocusScorer* g_active = &g_scorer_checksum;
+
+const FocusScorer* scorer_find(const char* name) {
+    for (size_t i = 0; i < sizeof(g_scorers) / sizeof(g_scorers[0]); ++i) {
+        if (strcmp(g_scorers[i]->name, name) == 0) return g_scorers[i];
+    }
+    return NULL;
+}
+
+int scorer_select(const char* name) {
+    const FocusScorer* s = scorer_find(name);
+    if (!s) {
+        log_message("ERROR", "[Score] unknown scorer '%s'", name);
+        return -1;
+    }
+    if (s->init && s->init() < 0) {
+        log_message("WARN", "[Score] scorer '%s' is not available in this build", name);
+        return -1;
+    }
+    g_active = s;
+    log_message("INFO", "[Score] using scorer '%s'", s->name);
+    return 0;
+}
+
+const FocusScorer* scorer_active(void) {
+    return g_active;
+}
@@ -0,0 +1,54 @@
+/*
+ * Mục đích: Giao diện engine chấm điểm tập trung có thể thay thế (pluggable) + registry các backend.
+ *
+ * Cấu trúc:
+ * - FocusScorer: 1 backend chấm điểm: init 1 lần khi khởi động, tạo/huỷ trạng thái theo phiên
+ *   (mỗi kết nối 1 trạng thái: frame trước, khuôn mặt trước...), chấm 1 frame → điểm 0..100.
+ *   Trạng thái 1 phiên chỉ được 1 thread dùng tại 1 thời điểm (scorepool.c đảm bảo).
+ *   Backend có thể tách phần giải mã (không cần trạng thái phiên) khỏi phần chấm: pipeline của
+ *   scorepool.c giải mã frame mới trong lúc frame trước của cùng phiên đang được chấm. decode()
+ *   dùng bộ giải mã riêng của từng worker (decoder_new) và ghi decoded_size byte cho score_decoded().
+ *   score_batch() chấm 1 lượt frame đã giải mã của nhiều phiên khác nhau (pipeline gom lượt, xem
+ *   scorepool.h) để dùng chung phần chuẩn bị và giữ code/bảng tra nóng trong cache.
+ *
+ * Backend có sẵn:
+ * - "checksum": điểm demo từ checksum payload (không cần giải mã ảnh, không trạng thái).
+ * - "pixel": giải mã PNG (cần zlib), thu nhỏ về ảnh xám rồi kết hợp độ sáng, năng lượng chuyển
+ *   động giữa 2 frame liên tiếp và độ ổn định vùng mặt tìm bằng cascade Haar đơn giản. Frame
+ *   không phải PNG 8-bit không interlace được chấm bằng "checksum".
+ *
+ * Hàm:
+ * - scorer_find(name): Tìm backend theo tên, NULL nếu không có.
+ * - scorer_select(name): init backend và dùng nó cho mọi phiên mới; -1 nếu không có / init lỗi.
+ * - scorer_active(): Backend đang dùng (mặc định "checksum" khi chưa select).
+ * - scorer_checksum(data, length): Điểm demo, dùng chung cho backend "checksum" và fallback.
+ */
+#ifndef SERVER_SCORER_H
+#define SERVER_SCORER_H
+
+#include <stddef.h>
+
+typedef struct FocusScorer {
+    const char* name;
+    int (*init)(void);                  // NULL or 0 = ready, -1 = backend unusable in this build
+    void* (*session_new)(void);         // NULL for stateless backends
+    void (*session_free)(void* state);
+    int (*score)(void* state, const char* data, int length);   // 0..100
+    // Optional decode/score split (decode NULL = the whole frame goes through score)
+    size_t decoded_size;
+    void* (*decoder_new)(void);
+    void (*decoder_free)(void* decoder);
+    int (*decode)(void* decoder, const char* data, int length, void* out);  // -1 = scored with scorer_checksum
+    int (*score_decoded)(void* state, const void* decoded);
+    // Optional: score n decoded frames of different sessions in one call (NULL = score_decoded per frame)
+    void (*score_batch)(void* const* states, const void* const* decoded, int n, int* scores);
+} FocusScorer;
+
+const FocusScorer* scorer_find(const char* name);
+int scorer_select(const char* name);
+const FocusScorer* scorer_active(void);
+int scorer_checksum(const char* data, int length);
+
+extern const FocusScorer g_scorer_pixel;
+
+#endif // SERVER_SCORER_H
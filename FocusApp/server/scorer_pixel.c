@@ -0,0 +1,473 @@
+/*
+ * Mục đích: Backend chấm điểm "pixel" (xem scorer.h).
+ *  - Giải mã PNG 8-bit (xám / xám+alpha / RGB / RGBA, không interlace) bằng zlib, bỏ lọc từng dòng
+ *    rồi thu nhỏ về lưới xám PIXEL_GRID_W x PIXEL_GRID_H (trung bình từng ô).
+ *  - Độ sáng: trung bình và độ tương phản của lưới (camera bị che / quá tối / loá thì điểm thấp).
+ *  - Chuyển động: trung bình |chênh lệch| với lưới của frame trước trong cùng phiên.
+ *  - Khuôn mặt: cascade 3 tầng kiểu Haar trên integral image: (1) cửa sổ đủ tương phản,
+ *    (2) dải mắt tối hơn dải má, (3) sống mũi sáng hơn 2 hốc mắt. Cửa sổ qua cả 3 tầng với biên
+ *    lớn nhất là khuôn mặt; độ ổn định = vị trí/kích thước ít thay đổi so với frame trước.
+ *  - Điểm = 20% độ sáng + 30% (ít) chuyển động + 50% khuôn mặt ổn định.
+ *  - Gần trùng: lúc giải mã tính hash cảm quan 64 bit của lưới (dHash: 9x8 ô, mỗi bit = ô trái tối
+ *    hơn ô phải). Phiên nhớ hash + kết quả dò mặt của PIXEL_PHASH_HISTORY frame gần nhất; frame chỉ
+ *    khác 1 frame đó tối đa PIXEL_PHASH_NEAR bit (webcam đứng yên, màn hình tĩnh) đi đường rẻ: dùng
+ *    lại kết quả dò mặt thay vì chạy integral image + cascade, độ sáng và chuyển động vẫn tính lại.
+ *  - Giải mã (PNG → lưới) tách khỏi phần chấm: worker của pipeline giải mã bằng PixelDecoder riêng
+ *    (z_stream + buffer, dùng lại cho frame sau); phần chấm chỉ cần lưới và trạng thái phiên.
+ *    Khi chấm nguyên frame (không có worker), phiên dùng PixelDecoder của chính nó.
+ *  - Phần tính trên từng pixel (đổi xám, cộng dồn dòng, chuyển động, histogram, integral image) đi qua
+ *    pixkern.h nên dùng SIMD khi CPU hỗ trợ; kết quả giống hệt bản scalar.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "scorer.h"
+#include "pixkern.h"
+#include "../common/config.h"
+
+#ifndef FOCUS_HAVE_ZLIB
+
+static int pixel_init(void) {
+    return -1;
+}
+
+const FocusScorer g_scorer_pixel = {
+    "pixel", pixel_init, NULL, NULL, NULL, 0, NULL, NULL, NULL, NULL, NULL
+};
+
+#else
+
+#include <zlib.h>
+
+#define PIXEL_CELLS (PIXEL_GRID_W * PIXEL_GRID_H)
+
+typedef struct {
+    int x, y, size;
+    float margin;
+} FaceBox;
+
+typedef struct {
+    z_stream zs;
+    int zs_ready;
+    uint8_t* raw;               // inflated scanlines (filter byte + pixels per row)
+    size_t raw_cap;
+    uint8_t gray[PIXEL_MAX_DIM];    // one source row, grayscale
+    uint32_t acc[PIXEL_MAX_DIM];    // source rows summed into the current grid row
+} PixelDecoder;
+
+// Decoder output: the grid plus its perceptual hash
+typedef struct {
+    uint8_t grid[PIXEL_CELLS];
+    uint64_t phash;
+} PixelFrame;
+
+// A recently seen look of the session and what face detection made of it
+typedef struct {
+    uint64_t phash;
+    FaceBox face;
+    int has_face;
+} PixelSeen;
+
+typedef struct {
+    PixelDecoder dec;           // whole-frame scoring only
+    PixelFrame whole;           // whole-frame scoring only
+    uint8_t grid[PIXEL_CELLS];  // current frame, grayscale
+    uint8_t prev[PIXEL_CELLS];
+    int has_prev;
+    FaceBox face;
+    int has_face;
+    uint32_t ii[(PIXEL_GRID_W + 1) * (PIXEL_GRID_H + 1)];   // integral image
+    uint64_t ii2[(PIXEL_GRID_W + 1) * (PIXEL_GRID_H + 1)];  // integral of squares
+    PixelSeen seen[PIXEL_PHASH_HISTORY];    // ring, newest at seen_pos - 1
+    int seen_count;
+    int seen_pos;
+} PixelState;
+
+static const unsigned char PNG_SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+static uint32_t be32(const unsigned char* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+extern void log_message(const char* level, const char* format, ...);
+
+static int pixel_init(void) {
+    log_message("INFO", "[Score] pixel kernels: %s", pixkern_get()->name);
+    return 0;
+}
+
+static void* pixel_decoder_new(void) {
+    return calloc(1, sizeof(PixelDecoder));
+}
+
+static void pixel_decoder_release(PixelDecoder* dec) {
+    if (dec->zs_ready) inflateEnd(&dec->zs);
+    free(dec->raw);
+}
+
+static void pixel_decoder_free(void* decoder) {
+    if (!decoder) return;
+    pixel_decoder_release((PixelDecoder*)decoder);
+    free(decoder);
+}
+
+static void* pixel_session_new(void) {
+    return calloc(1, sizeof(PixelState));
+}
+
+static void pixel_session_free(void* state) {
+    PixelState* st = (PixelState*)state;
+    if (!st) return;
+    pixel_decoder_release(&st->dec);
+    free(st);
+}
+
+// ---------------------------------------------------------------------------
+// PNG decoding
+// ---------------------------------------------------------------------------
+
+static int paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    return pb <= pc ? b : c;
+}
+
+// Undo the per-row PNG filters in place
+static int png_unfilter(uint8_t* raw, int w, int h, int bpp) {
+    size_t stride = 1 + (size_t)w * bpp;
+    const uint8_t* prior = NULL;
+    for (int y = 0; y < h; ++y) {
+        uint8_t* row = raw + (size_t)y * stride;
+        uint8_t* px = row + 1;
+        size_t n = stride - 1;
+        switch (row[0]) {
+            case 0:
+                break;
+            case 1:
+                for (size_t i = (size_t)bpp; i < n; ++i) px[i] = (uint8_t)(px[i] + px[i - bpp]);
+                break;
+            case 2:
+                if (prior) for (size_t i = 0; i < n; ++i) px[i] = (uint8_t)(px[i] + prior[i]);
+                break;
+            case 3:
+                for (size_t i = 0; i < n; ++i) {
+                    int left = i >= (size_t)bpp ? px[i - bpp] : 0;
+                    int up = prior ? prior[i] : 0;
+                    px[i] = (uint8_t)(px[i] + ((left + up) >> 1));
+                }
+                break;
+            case 4:
+                for (size_t i = 0; i < n; ++i) {
+                    int left = i >= (size_t)bpp ? px[i - bpp] : 0;
+                    int up = prior ? prior[i] : 0;
+                    int ul = (prior && i >= (size_t)bpp) ? prior[i - bpp] : 0;
+                    px[i] = (uint8_t)(px[i] + paeth(left, up, ul));
+                }
+                break;
+            default:
+                return -1;
+        }
+        prior = px;
+    }
+    return 0;
+}
+
+// First source column (or row) that falls into grid cell g when n map onto cells
+static int cell_start(int g, int n, int cells) {
+    return (int)(((int64_t)g * n + cells - 1) / cells);
+}
+
+// Box-average the decoded image into the grayscale grid: source rows are summed per column
+// until the grid row changes, then the column sums are folded into cells
+static void gray_downsample(PixelDecoder* dec, const uint8_t* raw, int w, int h, int bpp, uint8_t* grid) {
+    const PixelKernels* k = pixkern_get();
+    size_t stride = 1 + (size_t)w * bpp;
+    memset(dec->acc, 0, sizeof(uint32_t) * (size_t)w);
+    int rows = 0;
+    for (int y = 0; y < h; ++y) {
+        k->gray_row(raw + (size_t)y * stride + 1, w, bpp, dec->gray);
+        k->accumulate_row(dec->acc, dec->gray, w);
+        rows++;
+        int gy = (int)((int64_t)y * PIXEL_GRID_H / h);
+        if (y + 1 < h && (int)((int64_t)(y + 1) * PIXEL_GRID_H / h) == gy) continue;
+
+        uint8_t* grow = grid + gy * PIXEL_GRID_W;
+        for (int gx = 0; gx < PIXEL_GRID_W; ++gx) {
+            int x0 = cell_start(gx, w, PIXEL_GRID_W), x1 = cell_start(gx + 1, w, PIXEL_GRID_W);
+            uint32_t sum = 0;
+            for (int x = x0; x < x1; ++x) sum += dec->acc[x];
+            uint32_t count = (uint32_t)(x1 - x0) * (uint32_t)rows;
+            grow[gx] = count ? (uint8_t)(sum / count) : 0;
+        }
+        memset(dec->acc, 0, sizeof(uint32_t) * (size_t)w);
+        rows = 0;
+    }
+    // Grid rows no source row maps to (image shorter than the grid)
+    for (int gy = 0; gy < PIXEL_GRID_H; ++gy) {
+        if (cell_start(gy, h, PIXEL_GRID_H) == cell_start(gy + 1, h, PIXEL_GRID_H)) {
+            memset(grid + gy * PIXEL_GRID_W, 0, PIXEL_GRID_W);
+        }
+    }
+}
+
+// Decode a PNG frame into grid. Returns -1 if it is not a PNG this backend handles.
+static int png_to_grid(PixelDecoder* dec, const unsigned char* data, size_t len, uint8_t* grid) {
+    if (len < 8 + 25 || memcmp(data, PNG_SIGNATURE, 8) != 0) return -1;
+    size_t pos = 8;
+    int w = 0, h = 0, bpp = 0;
+    size_t raw_len = 0;
+
+    if (!dec->zs_ready) {
+        if (inflateInit(&dec->zs) != Z_OK) return -1;
+        dec->zs_ready = 1;
+    } else if (inflateReset(&dec->zs) != Z_OK) {
+        return -1;
+    }
+
+    int done = 0;
+    while (!done && pos + 12 <= len) {
+        uint32_t clen = be32(data + pos);
+        const unsigned char* type = data + pos + 4;
+        const unsigned char* body = data + pos + 8;
+        if (clen > len - pos - 12) return -1;
+        pos += 12 + (size_t)clen;
+
+        if (memcmp(type, "IHDR", 4) == 0) {
+            if (clen != 13 || w) return -1;
+            uint32_t iw = be32(body), ih = be32(body + 4);
+            int depth = body[8], ctype = body[9], interlace = body[12];
+            if (iw == 0 || ih == 0 || iw > PIXEL_MAX_DIM || ih > PIXEL_MAX_DIM || depth != 8 || interlace != 0) return -1;
+            switch (ctype) {
+                case 0: bpp = 1; break;
+                case 2: bpp = 3; break;
+                case 4: bpp = 2; break;
+                case 6: bpp = 4; break;
+                default: return -1;     // palette images are left to the fallback
+            }
+            w = (int)iw;
+            h = (int)ih;
+            raw_len = (size_t)h * (1 + (size_t)w * bpp);
+            if (raw_len > PIXEL_MAX_RAW) return -1;
+            if (dec->raw_cap < raw_len) {
+                uint8_t* raw = (uint8_t*)realloc(dec->raw, raw_len);
+                if (!raw) return -1;
+                dec->raw = raw;
+                dec->raw_cap = raw_len;
+            }
+            dec->zs.next_out = dec->raw;
+            dec->zs.avail_out = (uInt)raw_len;
+        } else if (memcmp(type, "IDAT", 4) == 0) {
+            if (!w) return -1;
+            dec->zs.next_in = (Bytef*)body;
+            dec->zs.avail_in = clen;
+            while (dec->zs.avail_in > 0) {
+                int rc = inflate(&dec->zs, Z_NO_FLUSH);
+                if (rc == Z_STREAM_END) {
+                    done = 1;
+                    break;
+                }
+                if (rc != Z_OK) return -1;
+                if (dec->zs.avail_out == 0) {
+                    done = 1;           // trailing bytes past the image are ignored
+                    break;
+                }
+            }
+        } else if (memcmp(type, "IEND", 4) == 0) {
+            break;
+        }
+    }
+    if (!w || dec->zs.total_out != raw_len) return -1;
+    if (png_unfilter(dec->raw, w, h, bpp) < 0) return -1;
+    gray_downsample(dec, dec->raw, w, h, bpp, grid);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Features
+// ---------------------------------------------------------------------------
+
+static float clamp01(float v) {
+    return v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+}
+
+static uint32_t rect_sum(const uint32_t* ii, int x, int y, int w, int h) {
+    const int stride = PIXEL_GRID_W + 1;
+    return ii[(y + h) * stride + x + w] - ii[y * stride + x + w] - ii[(y + h) * stride + x] + ii[y * stride + x];
+}
+
+static float rect_mean(const uint32_t* ii, int x, int y, int w, int h) {
+    return (float)rect_sum(ii, x, y, w, h) / (float)(w * h);
+}
+
+// Variance of n samples from their sum and sum of squares. n*sum2 >= sum^2 holds exactly in
+// integers, so the result never goes negative the way E[x^2] - mean^2 can in float.
+static float variance(uint64_t sum, uint64_t sum2, uint64_t n) {
+    return (float)(n * sum2 - sum * sum) / ((float)n * (float)n);
+}
+
+// Returns 1 with the strongest window that passes every cascade stage
+static int face_detect(const PixelState* st, FaceBox* best) {
+    static const int sizes[] = { 24, 32, 40, 48 };
+    const int stride = PIXEL_GRID_W + 1;
+    int found = 0;
+    for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); ++k) {
+        int s = sizes[k];
+        int band = s / 5, side = s / 4, inset = s / 8;
+        for (int y = 0; y + s <= PIXEL_GRID_H; y += 2) {
+            for (int x = 0; x + s <= PIXEL_GRID_W; x += 2) {
+                // Stage 1: enough contrast inside the window to hold a face
+                uint64_t sq = st->ii2[(y + s) * stride + x + s] - st->ii2[y * stride + x + s] -
+                              st->ii2[(y + s) * stride + x] + st->ii2[y * stride + x];
+                float var = variance(rect_sum(st->ii, x, y, s, s), sq, (uint64_t)(s * s));
+                if (var < 144.0f) continue;
+                float sd = sqrtf(var);
+
+                // Stage 2: the eye band is darker than the cheeks below it
+                float eyes = rect_mean(st->ii, x + inset, y + s / 4, s - 2 * inset, band);
+                float cheeks = rect_mean(st->ii, x + inset, y + s / 2, s - 2 * inset, band);
+                float d1 = (cheeks - eyes) / sd;
+                if (d1 < 0.25f) continue;
+
+                // Stage 3: the nose bridge is brighter than both eye sockets
+                float left = rect_mean(st->ii, x + inset, y + s / 4, side, band);
+                float bridge = rect_mean(st->ii, x + inset + side, y + s / 4, side, band);
+                float right = rect_mean(st->ii, x + inset + 2 * side, y + s / 4, side, band);
+                float d2 = (bridge - 0.5f * (left + right)) / sd;
+                if (d2 < 0.1f) continue;
+
+                float margin = d1 + d2;
+                if (!found || margin > best->margin) {
+                    best->x = x;
+                    best->y = y;
+                    best->size = s;
+                    best->margin = margin;
+                    found = 1;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+// dHash: mean brightness of 9x8 blocks, one bit per horizontal neighbour pair
+static uint64_t grid_phash(const uint8_t* grid) {
+    uint32_t mean[8][9];
+    for (int by = 0; by < 8; ++by) {
+        int y0 = cell_start(by, PIXEL_GRID_H, 8), y1 = cell_start(by + 1, PIXEL_GRID_H, 8);
+        for (int bx = 0; bx < 9; ++bx) {
+            int x0 = cell_start(bx, PIXEL_GRID_W, 9), x1 = cell_start(bx + 1, PIXEL_GRID_W, 9);
+            uint32_t sum = 0;
+            for (int y = y0; y < y1; ++y) {
+                for (int x = x0; x < x1; ++x) sum += grid[y * PIXEL_GRID_W + x];
+            }
+            uint32_t count = (uint32_t)((y1 - y0) * (x1 - x0));
+            mean[by][bx] = count ? sum / count : 0;
+        }
+    }
+    uint64_t h = 0;
+    for (int by = 0; by < 8; ++by) {
+        for (int bx = 0; bx < 8; ++bx) h = (h << 1) | (mean[by][bx] < mean[by][bx + 1]);
+    }
+    return h;
+}
+
+static int pixel_decode(void* decoder, const char* data, int length, void* out) {
+    if (!decoder || length <= 0) return -1;
+    PixelFrame* f = (PixelFrame*)out;
+    if (png_to_grid((PixelDecoder*)decoder, (const unsigned char*)data, (size_t)length, f->grid) < 0) return -1;
+    f->phash = grid_phash(f->grid);
+    return 0;
+}
+
+// Most recent remembered look within PIXEL_PHASH_NEAR bits of phash, NULL if none
+static const PixelSeen* seen_near(const PixelState* st, uint64_t phash) {
+    for (int i = 1; i <= st->seen_count; ++i) {
+        const PixelSeen* s = &st->seen[(st->seen_pos - i + PIXEL_PHASH_HISTORY) % PIXEL_PHASH_HISTORY];
+        if (__builtin_popcountll(s->phash ^ phash) <= PIXEL_PHASH_NEAR) return s;
+    }
+    return NULL;
+}
+
+static int score_grid(PixelState* st, const PixelFrame* f, const PixelKernels* k) {
+    memcpy(st->grid, f->grid, sizeof(st->grid));
+
+    // Brightness: usable exposure and some contrast (a covered camera is flat)
+    uint32_t hist[256] = { 0 };
+    k->histogram(st->grid, PIXEL_CELLS, hist);
+    uint32_t sum = 0;
+    uint64_t sum2 = 0;
+    for (uint32_t v = 0; v < 256; ++v) {
+        sum += v * hist[v];
+        sum2 += (uint64_t)v * v * hist[v];
+    }
+    float mean = (float)sum / PIXEL_CELLS;
+    float sd = sqrtf(variance(sum, sum2, PIXEL_CELLS));
+    float exposure = mean < 60.0f ? (mean - 10.0f) / 50.0f : (mean > 200.0f ? (250.0f - mean) / 50.0f : 1.0f);
+    float bright = clamp01(exposure) * clamp01(sd / 16.0f);
+
+    // Motion energy: mean absolute change per cell against the previous frame
+    float motion = 0.75f;
+    if (st->has_prev) {
+        float energy = (float)k->abs_diff_sum(st->grid, st->prev, PIXEL_CELLS) / PIXEL_CELLS;
+        motion = clamp01(1.0f - (energy - 4.0f) / 26.0f);
+    }
+    memcpy(st->prev, st->grid, sizeof(st->prev));
+    st->has_prev = 1;
+
+    // Face-region stability; a near duplicate of a recent frame reuses that frame's detection
+    FaceBox face;
+    float stable = 0.0f;
+    int has_face;
+    const PixelSeen* near = seen_near(st, f->phash);
+    if (near) {
+        face = near->face;
+        has_face = near->has_face;
+    } else {
+        k->integral(st->grid, PIXEL_GRID_W, PIXEL_GRID_H, st->ii, st->ii2);
+        has_face = face_detect(st, &face);
+        PixelSeen* slot = &st->seen[st->seen_pos];
+        slot->phash = f->phash;
+        slot->face = face;
+        slot->has_face = has_face;
+        st->seen_pos = (st->seen_pos + 1) % PIXEL_PHASH_HISTORY;
+        if (st->seen_count < PIXEL_PHASH_HISTORY) st->seen_count++;
+    }
+    if (has_face && st->has_face) {
+        float shift = (float)(abs(face.x - st->face.x) + abs(face.y - st->face.y) + abs(face.size - st->face.size));
+        stable = clamp01(1.0f - 2.0f * shift / (float)face.size);
+    } else if (has_face) {
+        stable = 0.6f;
+    }
+    st->has_face = has_face;
+    if (has_face) st->face = face;
+
+    int score = (int)lrintf(100.0f * (0.2f * bright + 0.3f * motion + 0.5f * stable));
+    return score < 0 ? 0 : (score > 100 ? 100 : score);
+}
+
+static int pixel_score_decoded(void* state, const void* decoded) {
+    return score_grid((PixelState*)state, (const PixelFrame*)decoded, pixkern_get());
+}
+
+// Frames of many sessions back to back: the kernel table is looked up once and the feature
+// code stays hot in the instruction cache across the batch
+static void pixel_score_batch(void* const* states, const void* const* decoded, int n, int* scores) {
+    const PixelKernels* k = pixkern_get();
+    for (int i = 0; i < n; ++i) scores[i] = score_grid((PixelState*)states[i], (const PixelFrame*)decoded[i], k);
+}
+
+static int pixel_score(void* state, const char* data, int length) {
+    PixelState* st = (PixelState*)state;
+    if (!st || pixel_decode(&st->dec, data, length, &st->whole) < 0) return scorer_checksum(data, length);
+    return score_grid(st, &st->whole, pixkern_get());
+}
+
+const FocusScorer g_scorer_pixel = {
+    "pixel", pixel_init, pixel_session_new, pixel_session_free, pixel_score,
+    sizeof(PixelFrame), pixel_decoder_new, pixel_decoder_free, pixel_decode, pixel_score_decoded, pixel_score_batch
+};
+
+#endif // FOCUS_HAVE_ZLIB
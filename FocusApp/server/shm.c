@@ -0,0 +1,153 @@
+#define _GNU_SOURCE
+/*
+ * Mục đích: Cài đặt transport cục bộ qua Unix socket + ring bộ nhớ chia sẻ (xem shm.h).
+ *  - Bắt tay có thời hạn (SEND_TIMEOUT_MS): client không gửi đủ setup + 3 fd thì bị đóng.
+ *  - fd nhận được kiểm tra bằng shm_ring_attach (memfd đã niêm phong, đúng kích thước); thừa fd
+ *    hoặc thiếu thì đóng hết.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "shm.h"
+#include "handlers.h"
+#include "../common/config.h"
+#include "../common/shmring.h"
+
+extern void log_message(const char* level, const char* format, ...);
+
+#define SHM_SETUP_FDS 3
+
+static int g_shm_listen_fd = -1;
+
+static void set_recv_timeout(int fd, int ms) {
+    struct timeval tv;
+    tv.tv_sec = ms / 1000;
+    tv.tv_usec = (ms % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+// Receive ShmRingSetup + memfd/data_efd/space_efd and map the ring
+static int shm_accept_ring(int fd, ShmRing* ring) {
+    ShmRingSetup setup;
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * SHM_SETUP_FDS)];
+        struct cmsghdr align;
+    } ctrl;
+    struct iovec iov = { &setup, sizeof(setup) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+
+    set_recv_timeout(fd, SEND_TIMEOUT_MS);
+    ssize_t n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    set_recv_timeout(fd, 0);
+
+    int fds[SHM_SETUP_FDS];
+    int nfds = 0;
+    for (struct cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        int count = (int)((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        for (int i = 0; i < count; ++i) {
+            int got;
+            memcpy(&got, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+            if (nfds < SHM_SETUP_FDS) fds[nfds++] = got;
+            else close(got);
+        }
+    }
+    if (n != (ssize_t)sizeof(setup) || setup.magic != SHM_RING_MAGIC || nfds != SHM_SETUP_FDS ||
+        (msg.msg_flags & MSG_CTRUNC)) {
+        for (int i = 0; i < nfds; ++i) close(fds[i]);
+        return -1;
+    }
+    if (shm_ring_attach(ring, fds[0], fds[1], fds[2]) < 0) return -1;  // closes the fds on failure
+    if (ring->size != setup.size || send_all(fd, &setup, (int)sizeof(setup)) < 0) {
+        shm_ring_close(ring);
+        return -1;
+    }
+    return 0;
+}
+
+static void* shm_client_thread(void* arg) {
+    int fd = *(int*)arg;
+    free(arg);
+    ShmRing ring;
+    if (shm_accept_ring(fd, &ring) < 0) {
+        log_message("WARN", "[Local] fd=%d rejected: bad shared-memory ring setup", fd);
+        close(fd);
+        return NULL;
+    }
+    log_message("INFO", "[Local] fd=%d attached %u-byte ring", fd, ring.size);
+    client_serve(fd, &ring);
+    shm_ring_close(&ring);
+    close(fd);
+    return NULL;
+}
+
+static void* shm_accept_thread(void* arg) {
+    (void)arg;
+    for (;;) {
+        int* fd = (int*)malloc(sizeof(int));
+        if (!fd) break;
+        *fd = accept4(g_shm_listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (*fd < 0) {
+            free(fd);
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            log_message("ERROR", "[Local] accept: %s", strerror(errno));
+            break;
+        }
+        pthread_t th;
+        if (pthread_create(&th, NULL, shm_client_thread, fd) != 0) {
+            log_message("ERROR", "[Local] cannot start connection thread");
+            close(*fd);
+            free(fd);
+            continue;
+        }
+        pthread_detach(th);
+    }
+    return NULL;
+}
+
+int shm_listener_start(const char* path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        log_message("ERROR", "[Local] socket path too long: %s", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        log_message("ERROR", "[Local] socket: %s", strerror(errno));
+        return -1;
+    }
+    unlink(path); // stale socket from a previous run
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        log_message("ERROR", "[Local] bind %s: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    g_shm_listen_fd = fd;
+
+    pthread_t th;
+    if (pthread_create(&th, NULL, shm_accept_thread, NULL) != 0) {
+        log_message("ERROR", "[Local] cannot start accept thread");
+        close(fd);
+        g_shm_listen_fd = -1;
+        return -1;
+    }
+    pthread_detach(th);
+    log_message("INFO", "[Local] Shared-memory transport on %s", path);
+    return 0;
+}
@@ -0,0 +1,18 @@
+/*
+ * Mục đích: Transport cục bộ cho FocusClient chạy cùng máy với FocusServer.
+ *  - Server nghe trên 1 Unix socket. Client kết nối, gửi ShmRingSetup kèm 3 fd (memfd của ring
+ *    + 2 eventfd, SCM_RIGHTS); server map ring rồi trả lại ShmRingSetup để xác nhận.
+ *  - Từ đó gói client → server đi qua ring bộ nhớ chia sẻ (ghi 1 lần, server đọc tại chỗ, không
+ *    qua TCP loopback); phản hồi server → client đi trên chính Unix socket đó.
+ *  - Mỗi kết nối cục bộ có 1 thread riêng chạy client_serve() bất kể --io (máy kiosk chỉ có vài
+ *    client cục bộ).
+ *
+ * Hàm:
+ * - shm_listener_start(path): Tạo Unix socket (xoá file cũ nếu còn) và thread accept; trả -1 nếu lỗi.
+ */
+#ifndef SERVER_SHM_H
+#define SERVER_SHM_H
+
+int shm_listener_start(const char* path);
+
+#endif // SERVER_SHM_H
@@ -0,0 +1,122 @@
+/*
+ * Mục đích: Đo thông lượng (megapixel/giây) của từng kernel pixkern cho mọi cài đặt CPU này chạy được.
+ *  - Ảnh nguồn 1280x720 (cỡ frame webcam client gửi), lặp đến khi đủ ~0.2 giây mỗi phép đo.
+ *  - integral đo trên ảnh 320x240 vì scorer_pixel chỉ chạy nó trên lưới đã thu nhỏ.
+ *  - Chạy: make bench. Con số chỉ để so các cài đặt với nhau trên cùng máy.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pixkern.h"
+
+#define SRC_W 1280
+#define SRC_H 720
+#define II_W 320
+#define II_H 240
+#define MIN_SECONDS 0.2
+
+static volatile uint32_t g_sink;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+    uint8_t* rgba;
+    uint8_t* gray;
+    uint8_t* gray_prev;
+    uint32_t* acc;
+    uint32_t* ii;
+    uint64_t* ii2;
+} BenchBuffers;
+
+// One pass over the whole source image; returns the pixels processed
+static double run_once(const PixelKernels* k, int kernel, BenchBuffers* b) {
+    switch (kernel) {
+        case 0:
+            for (int y = 0; y < SRC_H; ++y)
+                k->gray_row(b->rgba + (size_t)y * SRC_W * 3, SRC_W, 3, b->gray + (size_t)y * SRC_W);
+            return (double)SRC_W * SRC_H;
+        case 1:
+            for (int y = 0; y < SRC_H; ++y)
+                k->gray_row(b->rgba + (size_t)y * SRC_W * 4, SRC_W, 4, b->gray + (size_t)y * SRC_W);
+            return (double)SRC_W * SRC_H;
+        case 2:
+            for (int y = 0; y < SRC_H; ++y) k->accumulate_row(b->acc, b->gray + (size_t)y * SRC_W, SRC_W);
+            return (double)SRC_W * SRC_H;
+        case 3:
+            g_sink += k->abs_diff_sum(b->gray, b->gray_prev, (size_t)SRC_W * SRC_H);
+            return (double)SRC_W * SRC_H;
+        case 4: {
+            uint32_t hist[256] = { 0 };
+            k->histogram(b->gray, (size_t)SRC_W * SRC_H, hist);
+            g_sink += hist[128];
+            return (double)SRC_W * SRC_H;
+        }
+        default:
+            k->integral(b->gray, II_W, II_H, b->ii, b->ii2);
+            g_sink += b->ii[(size_t)(II_W + 1) * (II_H + 1) - 1];
+            return (double)II_W * II_H;
+    }
+}
+
+static const char* const k_kernel_names[] = {
+    "gray_row rgb", "gray_row rgba", "accumulate_row", "abs_diff_sum", "histogram", "integral"
+};
+#define N_KERNELS ((int)(sizeof(k_kernel_names) / sizeof(k_kernel_names[0])))
+
+int main(void) {
+    BenchBuffers b;
+    size_t px = (size_t)SRC_W * SRC_H;
+    b.rgba = (uint8_t*)malloc(px * 4);
+    b.gray = (uint8_t*)malloc(px);
+    b.gray_prev = (uint8_t*)malloc(px);
+    b.acc = (uint32_t*)calloc(SRC_W, sizeof(uint32_t));
+    b.ii = (uint32_t*)malloc(sizeof(uint32_t) * (II_W + 1) * (II_H + 1));
+    b.ii2 = (uint64_t*)malloc(sizeof(uint64_t) * (II_W + 1) * (II_H + 1));
+    if (!b.rgba || !b.gray || !b.gray_prev || !b.acc || !b.ii || !b.ii2) {
+        perror("malloc");
+        return 1;
+    }
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < px * 4; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        b.rgba[i] = (uint8_t)(seed >> 16);
+    }
+    for (size_t i = 0; i < px; ++i) {
+        b.gray[i] = b.rgba[i];
+        b.gray_prev[i] = b.rgba[px + i];
+    }
+
+    const PixelKernels* variants[8];
+    int n = pixkern_variants(variants, 8);
+    printf("%-16s", "MP/s");
+    for (int v = 0; v < n; ++v) printf("%10s", variants[v]->name);
+    printf("\n");
+    for (int kernel = 0; kernel < N_KERNELS; ++kernel) {
+        printf("%-16s", k_kernel_names[kernel]);
+        for (int v = 0; v < n; ++v) {
+            run_once(variants[v], kernel, &b);  // warm up caches and dispatch
+            double pixels = 0;
+            double start = now_seconds(), elapsed;
+            do {
+                pixels += run_once(variants[v], kernel, &b);
+                elapsed = now_seconds() - start;
+            } while (elapsed < MIN_SECONDS);
+            printf("%10.0f", pixels / elapsed / 1e6);
+        }
+        printf("\n");
+    }
+
+    free(b.rgba);
+    free(b.gray);
+    free(b.gray_prev);
+    free(b.acc);
+    free(b.ii);
+    free(b.ii2);
+    return 0;
+}
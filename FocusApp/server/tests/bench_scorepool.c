@@ -0,0 +1,236 @@
+/*
+ * Mục đích: Đo ảnh hưởng của kích thước lượt chấm (--score-batch) và thời gian chờ gom
+ * (--score-batch-wait) lên thông lượng và độ trễ của scoring pool (scorepool.c).
+ *  - BENCH_SESSIONS phiên (score_session_open_direct, như kênh UDP) cùng gửi frame với nhịp
+ *    BENCH_FPS mỗi phiên; độ trễ = từ score_submit đến lúc callback nhận điểm.
+ *  - Frame là PNG RGB BENCH_W x BENCH_H (gradient + nhiễu, mỗi frame khác nhau) nên backend "pixel"
+ *    chạy đủ giải mã + chấm; build không có zlib thì đo backend "checksum".
+ *  - Pool là trạng thái toàn cục nên mỗi cấu hình chạy trong 1 tiến trình con (fork); log của pool
+ *    bị bỏ, chỉ dòng kết quả được in.
+ *  - Chạy: make bench. Cột "drop%" là frame bị frame mới hơn thay (latest wins) khi pool không theo kịp:
+ *    số frame đã gửi trừ số điểm nhận về, đếm sau khi pool chấm xong phần còn lại.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#ifdef FOCUS_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "scorepool.h"
+#include "scorer.h"
+#include "../common/config.h"
+
+#define BENCH_SESSIONS 64
+#define BENCH_FPS 15
+#define BENCH_PRODUCERS 4
+#define BENCH_SECONDS 1.5
+#define BENCH_DRAIN_SECONDS 0.2         // after the producers stop, for frames still in the pool
+#define BENCH_W 320
+#define BENCH_H 240
+#define BENCH_FRAMES 32                  // distinct frames cycled through by every session
+#define BENCH_RING 64                    // submit timestamps kept per session (frame_no % BENCH_RING)
+#define BENCH_MAX_SAMPLES (1 << 20)
+
+typedef struct {
+    char* data;
+    int length;
+} BenchFrame;
+
+static BenchFrame g_frames[BENCH_FRAMES];
+static double g_sent[BENCH_SESSIONS][BENCH_RING];
+static double* g_lat;
+static int g_nlat;
+static pthread_mutex_t g_lat_mtx = PTHREAD_MUTEX_INITIALIZER;
+static volatile int g_stop;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+#ifdef FOCUS_HAVE_ZLIB
+static unsigned char* png_chunk(unsigned char* p, const char* type, const unsigned char* body, uint32_t len) {
+    p[0] = (unsigned char)(len >> 24); p[1] = (unsigned char)(len >> 16);
+    p[2] = (unsigned char)(len >> 8);  p[3] = (unsigned char)len;
+    memcpy(p + 4, type, 4);
+    if (len) memcpy(p + 8, body, len);
+    uint32_t crc = (uint32_t)crc32(crc32(0L, Z_NULL, 0), p + 4, len + 4);
+    p[8 + len] = (unsigned char)(crc >> 24); p[9 + len] = (unsigned char)(crc >> 16);
+    p[10 + len] = (unsigned char)(crc >> 8); p[11 + len] = (unsigned char)crc;
+    return p + 12 + len;
+}
+
+// 8-bit RGB PNG: a moving gradient with a bright "face" block and some sensor noise
+static int make_frame(BenchFrame* f, int seed) {
+    size_t raw_len = (size_t)BENCH_H * (1 + BENCH_W * 3);
+    unsigned char* raw = (unsigned char*)malloc(raw_len);
+    uLongf zlen = compressBound((uLong)raw_len);
+    unsigned char* z = (unsigned char*)malloc(zlen);
+    f->data = (char*)malloc(zlen + 64);
+    if (!raw || !z || !f->data) return -1;
+    uint32_t rng = 2463534242u + (uint32_t)seed * 7919u;
+    int fx = 80 + (seed * 7) % 120, fy = 60 + (seed * 5) % 80;
+    unsigned char* r = raw;
+    for (int y = 0; y < BENCH_H; ++y) {
+        *r++ = 0;   // filter: none
+        for (int x = 0; x < BENCH_W; ++x) {
+            rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+            int v = (x + y + seed * 3) / 3 + (int)(rng & 15);
+            if (x >= fx && x < fx + 64 && y >= fy && y < fy + 80) v += 90;
+            if (v > 255) v = 255;
+            *r++ = (unsigned char)v;
+            *r++ = (unsigned char)(v * 3 / 4);
+            *r++ = (unsigned char)(v / 2);
+        }
+    }
+    if (compress2(z, &zlen, raw, (uLong)raw_len, 6) != Z_OK) return -1;
+    static const unsigned char sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    unsigned char ihdr[13] = { 0, 0, BENCH_W >> 8, BENCH_W & 0xff, 0, 0, BENCH_H >> 8, BENCH_H & 0xff,
+                               8, 2, 0, 0, 0 };
+    unsigned char* p = (unsigned char*)f->data;
+    memcpy(p, sig, 8);
+    p = png_chunk(p + 8, "IHDR", ihdr, 13);
+    p = png_chunk(p, "IDAT", z, (uint32_t)zlen);
+    p = png_chunk(p, "IEND", NULL, 0);
+    f->length = (int)(p - (unsigned char*)f->data);
+    free(raw);
+    free(z);
+    return 0;
+}
+#else
+static int make_frame(BenchFrame* f, int seed) {
+    f->length = BENCH_W * BENCH_H;
+    f->data = (char*)malloc((size_t)f->length);
+    if (!f->data) return -1;
+    for (int i = 0; i < f->length; ++i) f->data[i] = (char)(i * 31 + seed);
+    return 0;
+}
+#endif
+
+static void on_score(uint64_t key, int score, int frame_no) {
+    (void)score;
+    double lat = now_seconds() - g_sent[key][frame_no % BENCH_RING];
+    pthread_mutex_lock(&g_lat_mtx);
+    if (g_nlat < BENCH_MAX_SAMPLES) g_lat[g_nlat++] = lat;
+    pthread_mutex_unlock(&g_lat_mtx);
+}
+
+typedef struct {
+    ScoreSession** sessions;
+    int first, count;
+    long submitted;
+} Producer;
+
+// Each session sends BENCH_FPS frames per second, sessions of one producer staggered evenly
+static void* producer_thread(void* arg) {
+    Producer* p = (Producer*)arg;
+    double period = 1.0 / BENCH_FPS;
+    double start = now_seconds();
+    int frame_no = 0;
+    while (!g_stop) {
+        for (int i = 0; i < p->count && !g_stop; ++i) {
+            double due = start + period * (frame_no + (double)i / p->count);
+            double wait = due - now_seconds();
+            if (wait > 0) usleep((useconds_t)(wait * 1e6));
+            int s = p->first + i;
+            const BenchFrame* f = &g_frames[(frame_no + s) % BENCH_FRAMES];
+            g_sent[s][frame_no % BENCH_RING] = now_seconds();
+            score_submit(p->sessions[s], f->data, f->length, frame_no, (uint64_t)frame_no * BENCH_SESSIONS + s + 1);
+            p->submitted++;
+        }
+        frame_no++;
+    }
+    return NULL;
+}
+
+static int cmp_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void run_config(int threads, int batch, int wait_us) {
+    // Pool and scorer log to stdout; keep only the result row
+    int out_fd = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    if (devnull >= 0) { dup2(devnull, STDOUT_FILENO); close(devnull); }
+    if (scorer_select("pixel") < 0) scorer_select("checksum");
+    if (score_pool_start(threads, batch, wait_us) < 0) _exit(1);
+    g_lat = (double*)malloc(sizeof(double) * BENCH_MAX_SAMPLES);
+    ScoreSession* sessions[BENCH_SESSIONS];
+    for (int i = 0; i < BENCH_SESSIONS; ++i) {
+        sessions[i] = score_session_open_direct(on_score, (uint64_t)i);
+        if (!sessions[i] || !g_lat) _exit(1);
+    }
+
+    pthread_t th[BENCH_PRODUCERS];
+    Producer prod[BENCH_PRODUCERS];
+    int per = BENCH_SESSIONS / BENCH_PRODUCERS;
+    double start = now_seconds();
+    for (int i = 0; i < BENCH_PRODUCERS; ++i) {
+        prod[i].sessions = sessions;
+        prod[i].first = i * per;
+        prod[i].count = per;
+        prod[i].submitted = 0;
+        pthread_create(&th[i], NULL, producer_thread, &prod[i]);
+    }
+    usleep((useconds_t)(BENCH_SECONDS * 1e6));
+    g_stop = 1;
+    long submitted = 0;
+    for (int i = 0; i < BENCH_PRODUCERS; ++i) {
+        pthread_join(th[i], NULL);
+        submitted += prod[i].submitted;
+    }
+    double elapsed = now_seconds() - start;
+    usleep((useconds_t)(BENCH_DRAIN_SECONDS * 1e6));
+
+    pthread_mutex_lock(&g_lat_mtx);
+    int n = g_nlat;
+    qsort(g_lat, (size_t)n, sizeof(double), cmp_double);
+    double p50 = n ? g_lat[n / 2] : 0, p99 = n ? g_lat[(size_t)n * 99 / 100] : 0, max = n ? g_lat[n - 1] : 0;
+    pthread_mutex_unlock(&g_lat_mtx);
+    dprintf(out_fd, "%6d %8d %10.0f %7.1f %9.2f %9.2f %9.2f\n", batch, wait_us, n / elapsed,
+            submitted ? 100.0 * (double)(submitted - n) / (double)submitted : 0.0,
+            p50 * 1e3, p99 * 1e3, max * 1e3);
+    _exit(0);
+}
+
+int main(void) {
+    static const int batches[] = { 1, 2, 4, 8, 16, 32 };
+    static const int waits[] = { 0, SCORE_BATCH_WAIT_US };
+    int threads = SCORE_THREADS;
+
+    for (int i = 0; i < BENCH_FRAMES; ++i) {
+        if (make_frame(&g_frames[i], i) < 0) {
+            perror("make_frame");
+            return 1;
+        }
+    }
+    printf("%d sessions x %d fps, %d scoring threads, %dx%d frames (%d bytes)\n",
+           BENCH_SESSIONS, BENCH_FPS, threads, BENCH_W, BENCH_H, g_frames[0].length);
+    printf("%6s %8s %10s %7s %9s %9s %9s\n", "batch", "wait_us", "scored/s", "drop%", "p50 ms", "p99 ms", "max ms");
+    fflush(stdout);
+    for (size_t w = 0; w < sizeof(waits) / sizeof(waits[0]); ++w) {
+        for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); ++b) {
+            pid_t pid = fork();
+            if (pid < 0) {
+                perror("fork");
+                return 1;
+            }
+            if (pid == 0) run_config(threads, batches[b], waits[w]);
+            int status;
+            waitpid(pid, &status, 0);
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "batch=%d wait=%d failed\n", batches[b], waits[w]);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
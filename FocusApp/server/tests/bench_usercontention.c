@@ -0,0 +1,166 @@
+/*
+ * Mục đích: Đo thông lượng bảng người dùng khi nhiều thread cùng đọc hồ sơ / bảng xếp hạng và ghi kết
+ * quả phiên, so giữa userstore không khoá (seqlock mỗi bản ghi, userstore.h) và cùng thao tác đó bọc
+ * trong 1 mutex chung như SharedState cũ.
+ *  - Mỗi thao tác giống handler tương ứng: profile = tra username + đọc bộ đếm; leaderboard = đọc 10 bản
+ *    ghi đầu rồi dựng JSON; kết thúc phiên = tra username + cộng bộ đếm.
+ *  - Tỉ lệ: BENCH_PROFILE_PCT % profile, BENCH_LEADERBOARD_PCT % leaderboard, còn lại kết thúc phiên;
+ *    user được chọn ngẫu nhiên trong BENCH_USERS user.
+ *  - Mỗi số thread chạy BENCH_SECONDS giây; cuối lượt kiểm tra tổng số phiên đã cộng khớp số lần ghi.
+ *  - Chạy: make bench. Kết quả phụ thuộc số CPU (in ở dòng đầu).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "userstore.h"
+
+#define BENCH_USERS 10000
+#define BENCH_PROFILE_PCT 60
+#define BENCH_LEADERBOARD_PCT 20
+#define BENCH_SECONDS 0.3
+#define BENCH_MAX_THREADS 32
+
+static UserStore g_store;
+static pthread_mutex_t g_global_mtx = PTHREAD_MUTEX_INITIALIZER;
+static int g_use_global;
+static int g_stop;                  // atomic
+
+typedef struct {
+    pthread_t th;
+    uint32_t rng;
+    unsigned long ops;
+    unsigned long session_ends;
+    unsigned long sink;
+} Worker;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static uint32_t rng_next(uint32_t* s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 17;
+    *s ^= *s << 5;
+    return *s;
+}
+
+static void op_profile(Worker* w, const char* name) {
+    int idx = userstore_find(&g_store, name);
+    UserTotals t = { 0, 0, 0 };
+    if (idx >= 0) userstore_read(&g_store, idx, &t);
+    w->sink += (unsigned long)(t.coins + t.sessions);
+}
+
+static void op_leaderboard(Worker* w) {
+    char buf[2048];
+    int off = snprintf(buf, sizeof(buf), "[");
+    uint32_t users = userstore_count(&g_store);
+    for (uint32_t i = 0; i < users && i < 10; ++i) {
+        UserTotals t;
+        userstore_read(&g_store, (int)i, &t);
+        off += snprintf(buf + off, sizeof(buf) - (size_t)off, "%s{\"username\":\"%s\",\"coins\":%d,\"sessions\":%d}",
+                        i ? "," : "", userstore_at(&g_store, (int)i)->username, t.coins, t.sessions);
+    }
+    w->sink += (unsigned long)off;
+}
+
+static void op_session_end(Worker* w, const char* name) {
+    int idx = userstore_find(&g_store, name);
+    if (idx < 0) return;
+    UserTotals delta = { 2, 1, 60 };
+    userstore_add_totals(&g_store, idx, &delta);
+    w->session_ends++;
+}
+
+static void* worker_thread(void* arg) {
+    Worker* w = (Worker*)arg;
+    char name[32];
+    while (!__atomic_load_n(&g_stop, __ATOMIC_RELAXED)) {
+        uint32_t r = rng_next(&w->rng);
+        uint32_t pct = r % 100;
+        snprintf(name, sizeof(name), "student_%05u", (r >> 8) % BENCH_USERS);
+        if (g_use_global) pthread_mutex_lock(&g_global_mtx);
+        if (pct < BENCH_PROFILE_PCT) op_profile(w, name);
+        else if (pct < BENCH_PROFILE_PCT + BENCH_LEADERBOARD_PCT) op_leaderboard(w);
+        else op_session_end(w, name);
+        if (g_use_global) pthread_mutex_unlock(&g_global_mtx);
+        w->ops++;
+    }
+    return NULL;
+}
+
+static double run(int nthreads, int global) {
+    static Worker workers[BENCH_MAX_THREADS];
+    UserTotals zero = { 0, 0, 0 };
+    for (int i = 0; i < BENCH_USERS; ++i) userstore_set_totals(&g_store, i, &zero);
+    g_use_global = global;
+    __atomic_store_n(&g_stop, 0, __ATOMIC_RELAXED);
+    double start = now_seconds();
+    for (int i = 0; i < nthreads; ++i) {
+        memset(&workers[i], 0, sizeof(Worker));
+        workers[i].rng = 2463534242u + (uint32_t)i * 7919u;
+        if (pthread_create(&workers[i].th, NULL, worker_thread, &workers[i]) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    usleep((useconds_t)(BENCH_SECONDS * 1e6));
+    __atomic_store_n(&g_stop, 1, __ATOMIC_RELAXED);
+    unsigned long ops = 0, ends = 0;
+    for (int i = 0; i < nthreads; ++i) {
+        pthread_join(workers[i].th, NULL);
+        ops += workers[i].ops;
+        ends += workers[i].session_ends;
+    }
+    double elapsed = now_seconds() - start;
+
+    // No session end may be lost or torn, whichever way the table was synchronised
+    unsigned long sessions = 0;
+    for (int i = 0; i < BENCH_USERS; ++i) {
+        UserTotals t;
+        userstore_read(&g_store, i, &t);
+        if (t.coins != 2 * t.sessions || t.seconds != 60 * t.sessions) {
+            fprintf(stderr, "user %d has inconsistent totals\n", i);
+            exit(1);
+        }
+        sessions += (unsigned long)t.sessions;
+    }
+    if (sessions != ends) {
+        fprintf(stderr, "%lu session ends recorded, %lu applied\n", ends, sessions);
+        exit(1);
+    }
+    return (double)ops / elapsed;
+}
+
+int main(void) {
+    static const int threads[] = { 1, 2, 4, 8, 16, 32 };
+    if (userstore_init(&g_store) < 0) {
+        fprintf(stderr, "userstore_init failed\n");
+        return 1;
+    }
+    char name[32];
+    for (int i = 0; i < BENCH_USERS; ++i) {
+        snprintf(name, sizeof(name), "student_%05d", i);
+        if (userstore_add(&g_store, name, "pw", NULL) != i) {
+            fprintf(stderr, "userstore_add failed\n");
+            return 1;
+        }
+    }
+    printf("%d users, %d%% profile / %d%% leaderboard / %d%% session end, %ld CPU(s)\n", BENCH_USERS,
+           BENCH_PROFILE_PCT, BENCH_LEADERBOARD_PCT, 100 - BENCH_PROFILE_PCT - BENCH_LEADERBOARD_PCT,
+           sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%8s %14s %14s %8s\n", "threads", "global Mops/s", "store Mops/s", "gain");
+    for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i) {
+        double global = run(threads[i], 1);
+        double store = run(threads[i], 0);
+        printf("%8d %14.2f %14.2f %7.2fx\n", threads[i], global / 1e6, store / 1e6, store / global);
+    }
+    userstore_free(&g_store);
+    return 0;
+}
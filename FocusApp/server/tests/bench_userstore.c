@@ -0,0 +1,131 @@
+/*
+ * Mục đích: So tra cứu username của userstore (chỉ mục băm, userstore.h) với cách quét tuyến tính
+ * mảng UserStat cũ (strcmp từng ô in_use) ở 1K..1M user.
+ *  - add: ns mỗi userstore_add khi nạp N user (gồm cả các lần nhân đôi chỉ mục).
+ *  - hit / miss: ns mỗi lần tra username có / không có trong bảng, thứ tự ngẫu nhiên để đo cả
+ *    cache miss như khi login thật. Quét tuyến tính chỉ chạy đủ số lần cho ~0.3 giây mỗi cỡ.
+ *  - Chạy: make bench.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "userstore.h"
+
+#define BENCH_LOOKUPS 1000000
+#define LINEAR_BUDGET_SECONDS 0.3
+
+// Layout of the fixed-size user table the store replaced
+typedef struct {
+    char username[64];
+    char password[64];
+    int total_coins;
+    int total_sessions;
+    int total_seconds;
+    int in_use;
+} LegacyUser;
+
+static volatile long g_sink;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int legacy_find(const LegacyUser* users, int n, const char* username) {
+    for (int i = 0; i < n; ++i) {
+        if (users[i].in_use && strcmp(users[i].username, username) == 0) return i;
+    }
+    return -1;
+}
+
+static uint32_t g_rng = 2463534242u;
+
+static uint32_t rng_next(void) {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 17;
+    g_rng ^= g_rng << 5;
+    return g_rng;
+}
+
+static void user_name(char* out, size_t cap, int i, int miss) {
+    snprintf(out, cap, miss ? "ghost_%07d" : "student_%07d", i);
+}
+
+static void bench_size(int n) {
+    UserStore st;
+    if (userstore_init(&st) < 0) {
+        fprintf(stderr, "userstore_init failed\n");
+        exit(1);
+    }
+    LegacyUser* legacy = (LegacyUser*)calloc((size_t)n, sizeof(LegacyUser));
+    if (!legacy) {
+        perror("calloc");
+        exit(1);
+    }
+    char name[64];
+
+    double t = now_seconds();
+    for (int i = 0; i < n; ++i) {
+        int created = 0;
+        user_name(name, sizeof(name), i, 0);
+        if (userstore_add(&st, name, "pw", &created) != i || !created) {
+            fprintf(stderr, "userstore_add %s failed\n", name);
+            exit(1);
+        }
+    }
+    double add_ns = (now_seconds() - t) / n * 1e9;
+    for (int i = 0; i < n; ++i) {
+        user_name(legacy[i].username, sizeof(legacy[i].username), i, 0);
+        strcpy(legacy[i].password, "pw");
+        legacy[i].in_use = 1;
+    }
+
+    // Names are formatted up front so the timed loops measure the lookup alone
+    int lookups = BENCH_LOOKUPS;
+    char (*hits)[32] = malloc((size_t)lookups * 32);
+    char (*misses)[32] = malloc((size_t)lookups * 32);
+    if (!hits || !misses) {
+        perror("malloc");
+        exit(1);
+    }
+    for (int i = 0; i < lookups; ++i) {
+        user_name(hits[i], 32, (int)(rng_next() % (uint32_t)n), 0);
+        user_name(misses[i], 32, (int)(rng_next() % (uint32_t)n), 1);
+    }
+
+    double ns[4];
+    for (int kind = 0; kind < 4; ++kind) {
+        char (*names)[32] = kind & 1 ? misses : hits;
+        int linear = kind >= 2;
+        long sum = 0;
+        int done = 0;
+        t = now_seconds();
+        while (done < lookups) {
+            sum += linear ? legacy_find(legacy, n, names[done]) : userstore_find(&st, names[done]);
+            ++done;
+            if (linear && (done & 15) == 0 && now_seconds() - t > LINEAR_BUDGET_SECONDS) break;
+        }
+        ns[kind] = (now_seconds() - t) / done * 1e9;
+        g_sink += sum;
+        if ((kind & 1) && sum != -(long)done) {
+            fprintf(stderr, "lookup of a missing user succeeded\n");
+            exit(1);
+        }
+    }
+    printf("%9d %9.0f %9.0f %9.0f %12.0f %12.0f %9.0fx\n", n, add_ns, ns[0], ns[1], ns[2], ns[3], ns[2] / ns[0]);
+
+    free(hits);
+    free(misses);
+    free(legacy);
+    userstore_free(&st);
+}
+
+int main(void) {
+    static const int sizes[] = { 1000, 10000, 100000, 1000000 };
+    printf("%9s %9s %9s %9s %12s %12s %10s\n", "users", "add ns", "hit ns", "miss ns", "linear hit", "linear miss", "hit gain");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) bench_size(sizes[i]);
+    return 0;
+}
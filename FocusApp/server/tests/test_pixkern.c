@@ -0,0 +1,172 @@
+/*
+ * Mục đích: Kiểm tra mọi cài đặt trong pixkern (SSE4.1, AVX2) cho kết quả giống hệt bản scalar từng bit.
+ *  - Dữ liệu ngẫu nhiên (seed cố định) và dữ liệu biên (toàn 0, toàn 255) với mọi kích thước 0..N_SMALL
+ *    cùng vài kích thước lẻ lớn, để phủ cả khối vector lẫn phần đuôi đi qua scalar.
+ *  - Mỗi buffer được cấp phát đúng kích thước để ASan/valgrind bắt được đọc/ghi vượt biên.
+ *  - Chạy: make test (thoát khác 0 nếu có sai khác).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pixkern.h"
+
+#define N_SMALL 80
+
+static const int k_big_sizes[] = { 127, 255, 256, 257, 1023, 1920, 4099 };
+#define N_BIG ((int)(sizeof(k_big_sizes) / sizeof(k_big_sizes[0])))
+
+static uint64_t g_rng = 0x9E3779B97F4A7C15ull;
+static int g_failures = 0;
+
+static uint8_t rng_byte(void) {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return (uint8_t)(g_rng >> 24);
+}
+
+// mode 0: random, 1: all zero, 2: all 255
+static uint8_t* make_buf(size_t n, int mode) {
+    uint8_t* p = (uint8_t*)malloc(n ? n : 1);
+    if (!p) { perror("malloc"); exit(2); }
+    for (size_t i = 0; i < n; ++i) p[i] = mode == 0 ? rng_byte() : mode == 1 ? 0 : 255;
+    return p;
+}
+
+static void fail(const PixelKernels* k, const char* kernel, const char* detail) {
+    if (g_failures < 20) fprintf(stderr, "FAIL %s.%s: %s\n", k->name, kernel, detail);
+    ++g_failures;
+}
+
+static void check_gray_row(const PixelKernels* ref, const PixelKernels* k, int w, int mode) {
+    for (int bpp = 1; bpp <= 4; ++bpp) {
+        uint8_t* px = make_buf((size_t)w * bpp, mode);
+        uint8_t* want = make_buf((size_t)w, 1);
+        uint8_t* got = make_buf((size_t)w, 1);
+        ref->gray_row(px, w, bpp, want);
+        k->gray_row(px, w, bpp, got);
+        if (memcmp(want, got, (size_t)w) != 0) {
+            char d[64];
+            snprintf(d, sizeof(d), "w=%d bpp=%d mode=%d", w, bpp, mode);
+            fail(k, "gray_row", d);
+        }
+        free(px);
+        free(want);
+        free(got);
+    }
+}
+
+static void check_accumulate_row(const PixelKernels* ref, const PixelKernels* k, int w, int mode) {
+    uint8_t* row = make_buf((size_t)w, mode);
+    uint32_t* want = (uint32_t*)malloc(sizeof(uint32_t) * (size_t)(w ? w : 1));
+    uint32_t* got = (uint32_t*)malloc(sizeof(uint32_t) * (size_t)(w ? w : 1));
+    if (!want || !got) { perror("malloc"); exit(2); }
+    for (int x = 0; x < w; ++x) want[x] = got[x] = (uint32_t)x * 1000u + rng_byte();
+    // Several passes so a wrong lane shows up as a growing difference
+    for (int pass = 0; pass < 3; ++pass) {
+        ref->accumulate_row(want, row, w);
+        k->accumulate_row(got, row, w);
+    }
+    if (w && memcmp(want, got, sizeof(uint32_t) * (size_t)w) != 0) {
+        char d[64];
+        snprintf(d, sizeof(d), "w=%d mode=%d", w, mode);
+        fail(k, "accumulate_row", d);
+    }
+    free(row);
+    free(want);
+    free(got);
+}
+
+static void check_abs_diff_sum(const PixelKernels* ref, const PixelKernels* k, size_t n, int mode) {
+    uint8_t* a = make_buf(n, mode);
+    // Against the opposite extreme so the all-0 / all-255 cases hit the largest per-byte difference
+    uint8_t* b = make_buf(n, mode == 1 ? 2 : mode == 2 ? 1 : 0);
+    uint32_t want = ref->abs_diff_sum(a, b, n);
+    uint32_t got = k->abs_diff_sum(a, b, n);
+    uint32_t got_swapped = k->abs_diff_sum(b, a, n);
+    if (want != got || want != got_swapped) {
+        char d[96];
+        snprintf(d, sizeof(d), "n=%zu mode=%d want=%u got=%u/%u", n, mode, want, got, got_swapped);
+        fail(k, "abs_diff_sum", d);
+    }
+    free(a);
+    free(b);
+}
+
+static void check_histogram(const PixelKernels* ref, const PixelKernels* k, size_t n, int mode) {
+    uint8_t* img = make_buf(n, mode);
+    uint32_t want[256], got[256];
+    // hist is accumulated into, not cleared
+    for (int v = 0; v < 256; ++v) want[v] = got[v] = (uint32_t)v;
+    ref->histogram(img, n, want);
+    k->histogram(img, n, got);
+    if (memcmp(want, got, sizeof(want)) != 0) {
+        char d[64];
+        snprintf(d, sizeof(d), "n=%zu mode=%d", n, mode);
+        fail(k, "histogram", d);
+    }
+    free(img);
+}
+
+static void check_integral(const PixelKernels* ref, const PixelKernels* k, int w, int h, int mode) {
+    size_t cells = (size_t)(w + 1) * (size_t)(h + 1);
+    uint8_t* img = make_buf((size_t)w * h, mode);
+    uint32_t* ii_want = (uint32_t*)malloc(sizeof(uint32_t) * cells);
+    uint32_t* ii_got = (uint32_t*)malloc(sizeof(uint32_t) * cells);
+    uint64_t* ii2_want = (uint64_t*)malloc(sizeof(uint64_t) * cells);
+    uint64_t* ii2_got = (uint64_t*)malloc(sizeof(uint64_t) * cells);
+    if (!ii_want || !ii_got || !ii2_want || !ii2_got) { perror("malloc"); exit(2); }
+    memset(ii_got, 0xA5, sizeof(uint32_t) * cells);
+    memset(ii2_got, 0xA5, sizeof(uint64_t) * cells);
+    ref->integral(img, w, h, ii_want, ii2_want);
+    k->integral(img, w, h, ii_got, ii2_got);
+    if (memcmp(ii_want, ii_got, sizeof(uint32_t) * cells) != 0 ||
+        memcmp(ii2_want, ii2_got, sizeof(uint64_t) * cells) != 0) {
+        char d[64];
+        snprintf(d, sizeof(d), "w=%d h=%d mode=%d", w, h, mode);
+        fail(k, "integral", d);
+    }
+    free(img);
+    free(ii_want);
+    free(ii_got);
+    free(ii2_want);
+    free(ii2_got);
+}
+
+static void check_variant(const PixelKernels* ref, const PixelKernels* k) {
+    for (int mode = 0; mode < 3; ++mode) {
+        for (int n = 0; n <= N_SMALL + N_BIG; ++n) {
+            int size = n <= N_SMALL ? n : k_big_sizes[n - N_SMALL - 1];
+            check_gray_row(ref, k, size, mode);
+            check_accumulate_row(ref, k, size, mode);
+            check_abs_diff_sum(ref, k, (size_t)size, mode);
+            check_histogram(ref, k, (size_t)size, mode);
+        }
+        for (int w = 0; w <= 40; ++w) {
+            for (int h = 0; h <= 6; ++h) check_integral(ref, k, w, h, mode);
+        }
+        check_integral(ref, k, 320, 240, mode);
+        check_integral(ref, k, 1023, 3, mode);
+    }
+    // A full-HD RGBA frame: per-lane 32-bit sums must agree with the scalar total
+    check_abs_diff_sum(ref, k, 1920u * 1080u * 4u, 0);
+    check_histogram(ref, k, 1920u * 1080u, 0);
+}
+
+int main(void) {
+    const PixelKernels* variants[8];
+    int n = pixkern_variants(variants, 8);
+    const PixelKernels* ref = pixkern_scalar();
+    printf("pixkern: %d variant(s), dispatch picks %s\n", n, pixkern_get()->name);
+    for (int i = 0; i < n; ++i) {
+        int before = g_failures;
+        check_variant(ref, variants[i]);
+        printf("  %-8s %s\n", variants[i]->name, g_failures == before ? "ok" : "MISMATCH");
+    }
+    if (g_failures) {
+        fprintf(stderr, "%d mismatch(es)\n", g_failures);
+        return 1;
+    }
+    return 0;
+}
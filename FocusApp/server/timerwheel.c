@@ -0,0 +1,100 @@
+/*
+ * Mục đích: Cài đặt hashed timer wheel (xem timerwheel.h).
+ *  - Đặt/huỷ timer: nối/gỡ khỏi danh sách của 1 ô — O(1).
+ *  - Mỗi tick chỉ quét 1 ô; timer còn vòng sau (expires > tick hiện tại) được giữ lại.
+ *  - Nếu thread bị trễ nhiều tick, tw_advance quét tối đa 1 vòng wheel.
+ */
+#include <time.h>
+
+#include "timerwheel.h"
+
+uint64_t tw_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+static void list_init(TimerNode* head) {
+    head->prev = head->next = head;
+}
+
+static void list_unlink(TimerNode* t) {
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->prev = t->next = NULL;
+}
+
+static void list_push(TimerNode* head, TimerNode* t) {
+    t->prev = head->prev;
+    t->next = head;
+    head->prev->next = t;
+    head->prev = t;
+}
+
+void tw_init(TimerWheel* tw, uint64_t now_ms) {
+    for (int i = 0; i < TIMER_WHEEL_SLOTS; ++i) list_init(&tw->slots[i]);
+    tw->start_ms = now_ms;
+    tw->tick = 0;
+    tw->count = 0;
+}
+
+int tw_pending(const TimerNode* t) {
+    return t->prev != NULL;
+}
+
+void tw_cancel(TimerWheel* tw, TimerNode* t) {
+    if (!tw_pending(t)) return;
+    list_unlink(t);
+    tw->count--;
+}
+
+void tw_schedule(TimerWheel* tw, TimerNode* t, uint64_t delay_ms, TimerCallback cb, void* arg) {
+    tw_cancel(tw, t);
+    uint64_t ticks = (delay_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+    if (ticks == 0) ticks = 1;
+    t->expires = tw->tick + ticks;
+    t->cb = cb;
+    t->arg = arg;
+    list_push(&tw->slots[t->expires % TIMER_WHEEL_SLOTS], t);
+    tw->count++;
+}
+
+void tw_advance(TimerWheel* tw, uint64_t now_ms) {
+    if (now_ms < tw->start_ms) return;
+    uint64_t now_tick = (now_ms - tw->start_ms) / TIMER_TICK_MS;
+    if (now_tick <= tw->tick) return;
+
+    uint64_t steps = now_tick - tw->tick;
+    if (steps > TIMER_WHEEL_SLOTS) steps = TIMER_WHEEL_SLOTS;
+    uint64_t first = tw->tick + 1;
+    tw->tick = now_tick; // callbacks that reschedule count from the current tick
+
+    for (uint64_t i = 0; i < steps; ++i) {
+        TimerNode* head = &tw->slots[(first + i) % TIMER_WHEEL_SLOTS];
+        if (head->next == head) continue;
+
+        // Detach the slot first: callbacks may push timers back into it
+        TimerNode pending;
+        list_init(&pending);
+        pending.next = head->next;
+        pending.prev = head->prev;
+        pending.next->prev = &pending;
+        pending.prev->next = &pending;
+        list_init(head);
+
+        while (pending.next != &pending) {
+            TimerNode* t = pending.next;
+            list_unlink(t);
+            if (t->expires > now_tick) {
+                list_push(head, t); // a later round of the wheel
+                continue;
+            }
+            tw->count--;
+            t->cb(t, t->arg);
+        }
+    }
+}
+
+int tw_timeout_ms(const TimerWheel* tw) {
+    return tw->count > 0 ? TIMER_TICK_MS : -1;
+}
@@ -0,0 +1,53 @@
+/*
+ * Mục đích: Hashed timer wheel (Varghese & Lauck, scheme 6) cho heartbeat/idle timeout.
+ *
+ * Cấu trúc:
+ * - TimerNode: timer nhúng thẳng vào đối tượng sở hữu (kết nối...), không malloc.
+ * - TimerWheel: TIMER_WHEEL_SLOTS ô, mỗi ô là danh sách liên kết đôi vòng; timer hết hạn
+ *   ở tick T nằm ở ô T % SLOTS, timer xa hơn 1 vòng chỉ bị bỏ qua khi quét ô đó.
+ *
+ * Hàm:
+ * - tw_init(tw, now_ms): Khởi tạo, tick = TIMER_TICK_MS.
+ * - tw_schedule(tw, t, delay_ms, cb, arg): Đặt (hoặc đặt lại) timer — O(1).
+ * - tw_cancel(t): Huỷ timer nếu đang chờ — O(1).
+ * - tw_advance(tw, now_ms): Chạy mọi timer đã tới hạn; callback được phép đặt lại/huỷ timer.
+ * - tw_timeout_ms(tw): Thời gian chờ tối đa cho epoll_wait/io_uring (-1 nếu không có timer).
+ * - tw_now_ms(): Đồng hồ monotonic (ms).
+ *
+ * Không thread-safe: mỗi wheel thuộc 1 thread (reactor / uring worker).
+ */
+#ifndef SERVER_TIMERWHEEL_H
+#define SERVER_TIMERWHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../common/config.h"
+
+typedef struct TimerNode TimerNode;
+typedef void (*TimerCallback)(TimerNode* t, void* arg);
+
+struct TimerNode {
+    TimerNode* prev;        // NULL when not scheduled
+    TimerNode* next;
+    uint64_t expires;       // absolute tick
+    TimerCallback cb;
+    void* arg;
+};
+
+typedef struct {
+    TimerNode slots[TIMER_WHEEL_SLOTS];   // list heads (sentinels)
+    uint64_t start_ms;
+    uint64_t tick;                        // last processed tick
+    size_t count;
+} TimerWheel;
+
+uint64_t tw_now_ms(void);
+
+void tw_init(TimerWheel* tw, uint64_t now_ms);
+void tw_schedule(TimerWheel* tw, TimerNode* t, uint64_t delay_ms, TimerCallback cb, void* arg);
+void tw_cancel(TimerWheel* tw, TimerNode* t);
+int tw_pending(const TimerNode* t);
+void tw_advance(TimerWheel* tw, uint64_t now_ms);
+int tw_timeout_ms(const TimerWheel* tw);
+
+#endif // SERVER_TIMERWHEEL_H
@@ -0,0 +1,59 @@
+/*
+ * Mục đích: Công cụ đọc lại archive frame (archive.h) của server.
+ *  - archive_cat [--archive-dir=PATH] USER FRAME_NO > frame.png: ghi byte của frame FRAME_NO mới nhất
+ *    của USER ra stdout (tìm qua index, archive_lookup), kèm độ dài và hash nội dung ra stderr.
+ *  - Thư mục mặc định giống server (ARCHIVE_DIR); đọc được cả archive đang được server ghi vì index
+ *    chỉ được ghi sau dữ liệu.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "archive.h"
+#include "framehash.h"
+#include "../common/config.h"
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [--archive-dir=PATH] USER FRAME_NO > frame\n"
+                    "  --archive-dir=PATH   Archive written by FocusServer (default: %s)\n",
+            prog, ARCHIVE_DIR);
+}
+
+int main(int argc, char** argv) {
+    const char* dir = ARCHIVE_DIR;
+    int argi = 1;
+    if (argi < argc && strncmp(argv[argi], "--archive-dir=", 14) == 0) dir = argv[argi++] + 14;
+    if (argc - argi != 2 || !dir[0]) {
+        usage(argv[0]);
+        return 2;
+    }
+    const char* user = argv[argi];
+    char* end = NULL;
+    unsigned long frame_no = strtoul(argv[argi + 1], &end, 10);
+    if (!argv[argi + 1][0] || *end || frame_no > UINT32_MAX) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    char* data = NULL;
+    size_t len = 0;
+    if (archive_lookup(dir, user, (uint32_t)frame_no, &data, &len) < 0) {
+        fprintf(stderr, "Frame %lu of '%s' not found in %s/\n", frame_no, user, dir);
+        return 1;
+    }
+    fprintf(stderr, "Frame %lu of '%s': %zu bytes, hash %016llx\n", frame_no, user, len,
+            (unsigned long long)frame_hash64(data, len));
+    size_t off = 0;
+    while (off < len) {
+        ssize_t n = write(STDOUT_FILENO, data + off, len - off);
+        if (n <= 0) {
+            perror("write");
+            free(data);
+            return 1;
+        }
+        off += (size_t)n;
+    }
+    free(data);
+    return 0;
+}
@@ -0,0 +1,220 @@
+/*
+ * Mục đích: Cài đặt hàng đợi gửi vectored (xem txqueue.h).
+ *  - Mỗi TxMsg góp tối đa 3 iovec (tiền tố frame WebSocket, header, payload); 1 lần sendmsg gửi tối đa
+ *    TXQ_MAX_IOV iovec nên nhiều phản hồi nhỏ đi chung 1 syscall / 1 segment TCP.
+ *  - Node có payload <= TXQ_SMALL_PAYLOAD được giữ lại trong free-list để tránh
+ *    malloc/free cho mỗi phản hồi.
+ *  - Khi vượt high watermark: MSG_FOCUS_UPDATE chỉ là ảnh chụp điểm mới nhất nên bản
+ *    cũ chưa gửi bị thay bằng bản mới (policy drop); các phản hồi khác vẫn xếp hàng
+ *    vì caller đã ngừng đọc request mới của kết nối đó.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "txqueue.h"
+#include "websocket.h"
+#include "../common/config.h"
+#include "../common/protocol.h"
+
+#define TXQ_MAX_IOV 64
+#define TXQ_FREE_LIST_MAX 8
+
+void txq_init(TxQueue* q) {
+    memset(q, 0, sizeof(*q));
+}
+
+// Bytes this message puts on the wire
+static size_t txm_size(const TxMsg* m) {
+    return m->prefix_len + (size_t)m->hdr_len + (size_t)m->hdr.length;
+}
+
+static void txq_release(TxQueue* q, TxMsg* m) {
+    if (m->cap == TXQ_SMALL_PAYLOAD && q->free_count < TXQ_FREE_LIST_MAX) {
+        m->next = q->free_list;
+        q->free_list = m;
+        q->free_count++;
+    } else {
+        free(m);
+    }
+}
+
+void txq_free(TxQueue* q) {
+    TxMsg* m = q->head;
+    while (m) {
+        TxMsg* next = m->next;
+        free(m);
+        m = next;
+    }
+    m = q->free_list;
+    while (m) {
+        TxMsg* next = m->next;
+        free(m);
+        m = next;
+    }
+    memset(q, 0, sizeof(*q));
+}
+
+static TxMsg* txq_alloc(TxQueue* q, int length) {
+    TxMsg* m;
+    if ((size_t)length <= TXQ_SMALL_PAYLOAD && q->free_list) {
+        m = q->free_list;
+        q->free_list = m->next;
+        q->free_count--;
+    } else {
+        size_t cap = (size_t)length <= TXQ_SMALL_PAYLOAD ? TXQ_SMALL_PAYLOAD : (size_t)length;
+        m = (TxMsg*)malloc(sizeof(TxMsg) + cap);
+        if (!m) return NULL;
+        m->cap = cap;
+    }
+    m->next = NULL;
+    m->off = 0;
+    m->prefix_len = 0;
+    m->raw = 0;
+    m->hdr_len = 0;
+    return m;
+}
+
+static void txq_append(TxQueue* q, TxMsg* m) {
+    if (q->tail) q->tail->next = m;
+    else q->head = m;
+    q->tail = m;
+    q->bytes += txm_size(m);
+    q->count++;
+}
+
+int txq_push(TxQueue* q, int type, const void* payload, int length) {
+    if (length < 0 || (length > 0 && !payload)) length = 0;
+
+    TxMsg* m = txq_alloc(q, length);
+    if (!m) return -1;
+    m->hdr.type = type;
+    m->hdr.length = length;
+    m->hdr_len = HEADER_SIZE;
+    if (q->ext_header) {
+        m->hdr.type |= MSG_EXT_HEADER;
+        m->hdr.tag.request_id = q->reply_id;
+        m->hdr.tag.flags = q->reply_id ? 0 : PKT_FLAG_PUSH;
+        m->hdr_len = HEADER_EXT_SIZE;
+    }
+    if (length > 0) memcpy(m->payload, payload, (size_t)length);
+    if (q->websocket) {
+        unsigned char frame[WS_MAX_FRAME_HEADER];
+        int hlen = websocket_frame_header(frame, WS_OPCODE_BINARY, m->hdr_len + (uint64_t)length);
+        memcpy(m->prefix, frame, (size_t)hlen);
+        m->prefix_len = (unsigned char)hlen;
+    }
+    txq_append(q, m);
+    return 0;
+}
+
+int txq_push_raw(TxQueue* q, const void* data, int length) {
+    if (length <= 0 || !data) return 0;
+
+    TxMsg* m = txq_alloc(q, length);
+    if (!m) return -1;
+    m->raw = 1;
+    m->hdr.type = 0;
+    m->hdr.length = length;
+    memcpy(m->payload, data, (size_t)length);
+    txq_append(q, m);
+    return 0;
+}
+
+// Build iovecs for queued messages, skipping what was already written
+static int txq_fill_iov(TxQueue* q, struct iovec* iov) {
+    int n = 0;
+    for (TxMsg* m = q->head; m && n + 3 <= TXQ_MAX_IOV; m = m->next) {
+        struct iovec seg[3] = {
+            { m->prefix, m->prefix_len },
+            { &m->hdr, m->hdr_len },
+            { m->payload, (size_t)m->hdr.length },
+        };
+        size_t off = m->off;
+        for (int i = 0; i < 3; ++i) {
+            if (off >= seg[i].iov_len) {
+                off -= seg[i].iov_len;
+                continue;
+            }
+            iov[n].iov_base = (char*)seg[i].iov_base + off;
+            iov[n].iov_len = seg[i].iov_len - off;
+            n++;
+            off = 0;
+        }
+    }
+    return n;
+}
+
+// Advance past `written` bytes, recycling fully sent messages
+static void txq_consume(TxQueue* q, size_t written) {
+    q->bytes -= written;
+    while (written > 0 && q->head) {
+        TxMsg* m = q->head;
+        size_t left = txm_size(m) - m->off;
+        if (written < left) {
+            m->off += written;
+            return;
+        }
+        written -= left;
+        q->head = m->next;
+        if (!q->head) q->tail = NULL;
+        q->count--;
+        txq_release(q, m);
+    }
+}
+
+int txq_flush(TxQueue* q, int fd) {
+    struct iovec iov[TXQ_MAX_IOV];
+    while (q->head) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = (size_t)txq_fill_iov(q, iov);
+
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+        txq_consume(q, (size_t)n);
+    }
+    return 1;
+}
+
+int txq_drop_unsent(TxQueue* q, int type) {
+    int dropped = 0;
+    TxMsg* prev = NULL;
+    TxMsg* m = q->head;
+    while (m) {
+        TxMsg* next = m->next;
+        if (MSG_TYPE(m->hdr.type) == type && !m->raw && m->off == 0) {
+            if (prev) prev->next = next;
+            else q->head = next;
+            if (q->tail == m) q->tail = prev;
+            q->bytes -= txm_size(m);
+            q->count--;
+            txq_release(q, m);
+            dropped++;
+        } else {
+            prev = m;
+        }
+        m = next;
+    }
+    return dropped;
+}
+
+int txq_push_bounded(TxQueue* q, const TxLimits* limits, int type, const void* payload, int length) {
+    size_t need = (q->ext_header ? HEADER_EXT_SIZE : HEADER_SIZE) + (size_t)(length > 0 ? length : 0);
+    if (q->bytes + need > limits->high_watermark) {
+        if (limits->policy == SLOW_POLICY_DISCONNECT) return TXQ_OVERFLOW;
+        if (type == MSG_FOCUS_UPDATE) {
+            // Newest score supersedes queued ones; if still over, skip this push too
+            txq_drop_unsent(q, MSG_FOCUS_UPDATE);
+            if (q->bytes + need > limits->high_watermark) return TXQ_DROPPED;
+        }
+    }
+    return txq_push(q, type, payload, length) < 0 ? TXQ_OVERFLOW : TXQ_QUEUED;
+}
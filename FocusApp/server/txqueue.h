@@ -0,0 +1,79 @@
+/*
+ * Mục đích: Hàng đợi gửi (outbound) cho mỗi kết nối.
+ *  - Handler chỉ đưa gói TLV vào hàng đợi (cork); sau khi xử lý xong 1 lượt dữ liệu
+ *    nhận, txq_flush() gom header + payload của mọi gói bằng 1 lần sendmsg (iovec).
+ *  - Hỗ trợ socket non-blocking: ghi được bao nhiêu thì nhớ offset, phần còn lại
+ *    chờ EPOLLOUT.
+ *
+ * Cấu trúc:
+ * - TxMsg: 1 gói đang chờ (tiền tố frame WebSocket nếu có + header + payload đã chép,
+ *   offset đã gửi). Gói raw không có header TLV (handshake/control frame WebSocket).
+ * - TxQueue: danh sách TxMsg + tổng số byte chờ + free-list tái sử dụng gói nhỏ;
+ *   `websocket` = 1 thì mỗi gói TLV được bọc trong 1 frame nhị phân; `ext_header` = 1 thì
+ *   gói dùng header mở rộng mang `reply_id` (chủ kết nối cập nhật trước mỗi txq_push).
+ *
+ * Hàm:
+ * - txq_init/txq_free: Khởi tạo/giải phóng.
+ * - txq_push(q, type, payload, length): Thêm 1 gói vào cuối hàng đợi.
+ * - txq_push_raw(q, data, length): Thêm byte gửi nguyên văn (không header TLV).
+ * - txq_flush(q, fd): Ghi vectored; trả 1 nếu đã hết, 0 nếu còn (EAGAIN), -1 nếu lỗi.
+ * - txq_push_bounded(q, limits, ...): Như txq_push nhưng áp dụng giới hạn TxLimits khi
+ *   client đọc chậm: bỏ MSG_FOCUS_UPDATE cũ chưa gửi, hoặc báo tràn để ngắt kết nối.
+ * - txq_drop_unsent(q, type): Bỏ các gói `type` chưa gửi byte nào.
+ */
+#ifndef SERVER_TXQUEUE_H
+#define SERVER_TXQUEUE_H
+
+#include <stddef.h>
+#include "../common/protocol.h"
+
+// Slow-consumer limits (see --tx-high, --tx-low, --slow-policy)
+typedef enum {
+    SLOW_POLICY_DROP = 0,       // drop stale MSG_FOCUS_UPDATE pushes
+    SLOW_POLICY_DISCONNECT      // close the connection
+} SlowConsumerPolicy;
+
+typedef struct {
+    size_t high_watermark;      // stop reading / apply policy above this many queued bytes
+    size_t low_watermark;       // resume reading once drained below this
+    SlowConsumerPolicy policy;
+} TxLimits;
+
+// txq_push_bounded() results
+#define TXQ_QUEUED 0
+#define TXQ_DROPPED 1
+#define TXQ_OVERFLOW (-2)
+
+typedef struct TxMsg {
+    struct TxMsg* next;
+    size_t cap;         // payload capacity of this node
+    size_t off;         // bytes of prefix+header+payload already written
+    unsigned char prefix[10];   // WebSocket frame header, prefix_len bytes
+    unsigned char prefix_len;
+    unsigned char raw;          // no TLV header: payload is sent verbatim
+    unsigned char hdr_len;      // HEADER_SIZE or HEADER_EXT_SIZE
+    PacketHeaderExt hdr;
+    char payload[];
+} TxMsg;
+
+typedef struct {
+    TxMsg* head;
+    TxMsg* tail;
+    size_t bytes;       // bytes still to be written
+    int count;
+    TxMsg* free_list;   // recycled small nodes
+    int free_count;
+    int websocket;      // wrap every TLV packet in a binary WebSocket frame
+    int ext_header;     // use PacketHeaderExt tagged with reply_id
+    uint32_t reply_id;
+} TxQueue;
+
+void txq_init(TxQueue* q);
+void txq_free(TxQueue* q);
+int txq_push(TxQueue* q, int type, const void* payload, int length);
+int txq_push_raw(TxQueue* q, const void* data, int length);
+int txq_flush(TxQueue* q, int fd);
+int txq_push_bounded(TxQueue* q, const TxLimits* limits, int type, const void* payload, int length);
+int txq_drop_unsent(TxQueue* q, int type);
+
+#endif // SERVER_TXQUEUE_H
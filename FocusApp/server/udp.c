@@ -0,0 +1,359 @@
+#define _GNU_SOURCE
+/*
+ * Mục đích: Cài đặt kênh UDP cho frame ảnh (xem udp.h).
+ *  - Bảng token: UDP_PEER_BUCKETS danh sách móc nối, khoá bằng token (đã ngẫu nhiên nên lấy bit
+ *    thấp làm hash). 1 mutex chung: thread UDP giữ nó trong lúc xử lý 1 datagram, kết nối TCP chỉ
+ *    giữ lúc cấp/thu hồi token.
+ *  - Ghép frame: mỗi token 1 ô (buffer + bitmap mảnh đã nhận, giữ lại cho frame sau). seq cũ hơn
+ *    frame đang ghép hoặc frame vừa xong bị bỏ; seq mới hơn bỏ frame đang ghép dở và bắt đầu lại.
+ *  - Frame ghép xong được chép sang scoring pool (phiên chấm điểm riêng của token) sau khi nhả
+ *    g_udp_mtx: pool không có worker thì chấm ngay trên thread UDP và gọi lại udp_deliver_score.
+ *    Trong lúc đó peer được đánh dấu busy; udp_unregister gặp peer busy chỉ gỡ khỏi bảng và để thread
+ *    UDP giải phóng (chỉ thread UDP ghi vào buffer ghép nên buffer không đổi khi đã nhả mutex).
+ *  - Worker trả điểm qua udp_deliver_score, hàm này tìm lại token (đã thu hồi thì bỏ) và gửi sau khi nhả mutex.
+ *  - Thứ tự khoá: g_udp_mtx trước, mutex của scoring pool sau (ratectl_observe đo tải trong lúc giữ
+ *    g_udp_mtx); score_submit không bao giờ chạy khi đang giữ g_udp_mtx.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/random.h>
+
+#include "udp.h"
+#include "scorepool.h"
+#include "archive.h"
+#include "framehash.h"
+#include "ratectl.h"
+#include "../common/config.h"
+#include "../common/protocol.h"
+
+extern void log_message(const char* level, const char* format, ...);
+
+#define UDP_PEER_BUCKETS 256
+
+typedef struct UdpPeer {
+    struct UdpPeer* next;
+    uint64_t token;
+    uint32_t features;          // FEAT_* of the TCP connection (reply encoding)
+    struct in_addr ip;          // TCP peer address; datagrams from other hosts are dropped
+    struct sockaddr_in reply_to;// source of the latest accepted datagram
+    int frame_count;
+    char username[64];          // owner of the session, for the archive
+    RateState rate;             // FEAT_RATE_HINT: hints ride back with the scores
+    ScoreSession* score;        // frames of this token, scored on the pool
+    // Frame being reassembled
+    int active;
+    uint32_t seq;
+    uint32_t total;
+    uint16_t frag_size;
+    uint32_t frag_count;
+    uint32_t received;
+    int has_done;
+    uint32_t done_seq;          // last completed frame: it and anything older is stale
+    char* data;
+    size_t cap;
+    uint8_t* seen;              // bitmap of received fragments
+    size_t seen_cap;
+    unsigned long superseded;   // frames abandoned for a newer one
+    uint64_t done_hash;         // frame_hash64 of the last completed frame
+    int busy;                   // UDP thread is submitting peer->data without g_udp_mtx
+    int dead;                   // unregistered while busy: the UDP thread frees it
+} UdpPeer;
+
+static UdpPeer* g_peers[UDP_PEER_BUCKETS];
+static pthread_mutex_t g_udp_mtx = PTHREAD_MUTEX_INITIALIZER;
+static int g_udp_fd = -1;
+static int g_udp_port = 0;
+
+static void udp_deliver_score(uint64_t token, int score, int frame_no);
+
+// seq arithmetic modulo 2^32
+static int seq_newer(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) > 0;
+}
+
+static UdpPeer** peer_slot(uint64_t token) {
+    UdpPeer** pp = &g_peers[token % UDP_PEER_BUCKETS];
+    while (*pp && (*pp)->token != token) pp = &(*pp)->next;
+    return pp;
+}
+
+int udp_port(void) {
+    return g_udp_fd >= 0 ? g_udp_port : 0;
+}
+
+uint64_t udp_register(const ClientContext* ctx, uint32_t features) {
+    struct sockaddr_in addr;
+    socklen_t alen = sizeof(addr);
+    if (g_udp_fd < 0 || getpeername(ctx->client_fd, (struct sockaddr*)&addr, &alen) < 0 ||
+        addr.sin_family != AF_INET) {
+        return 0;
+    }
+    UdpPeer* peer = (UdpPeer*)calloc(1, sizeof(UdpPeer));
+    if (!peer) return 0;
+    peer->ip = addr.sin_addr;
+    peer->features = features;
+
+    pthread_mutex_lock(&g_udp_mtx);
+    uint64_t token = 0;
+    while (token == 0 || *peer_slot(token)) {
+        if (getrandom(&token, sizeof(token), 0) != (ssize_t)sizeof(token)) {
+            pthread_mutex_unlock(&g_udp_mtx);
+            free(peer);
+            log_message("ERROR", "[UDP] getrandom: %s", strerror(errno));
+            return 0;
+        }
+    }
+    peer->score = score_session_open_direct(udp_deliver_score, token);
+    if (!peer->score) {
+        pthread_mutex_unlock(&g_udp_mtx);
+        free(peer);
+        return 0;
+    }
+    peer->token = token;
+    UdpPeer** head = &g_peers[token % UDP_PEER_BUCKETS];
+    peer->next = *head;
+    *head = peer;
+    pthread_mutex_unlock(&g_udp_mtx);
+    return token;
+}
+
+static void peer_free(UdpPeer* peer) {
+    score_session_close(peer->score);
+    if (peer->superseded) {
+        log_message("DEBUG", "[UDP] token %016llx closed, %lu partial frames superseded",
+                    (unsigned long long)peer->token, peer->superseded);
+    }
+    free(peer->data);
+    free(peer->seen);
+    free(peer);
+}
+
+void udp_unregister(uint64_t token) {
+    if (!token) return;
+    pthread_mutex_lock(&g_udp_mtx);
+    UdpPeer** pp = peer_slot(token);
+    UdpPeer* peer = *pp;
+    if (peer) {
+        *pp = peer->next;
+        if (peer->busy) {
+            peer->dead = 1;
+            peer = NULL;
+        }
+    }
+    pthread_mutex_unlock(&g_udp_mtx);
+    if (peer) peer_free(peer);
+}
+
+void udp_reset_frames(uint64_t token, const char* username) {
+    if (!token) return;
+    pthread_mutex_lock(&g_udp_mtx);
+    UdpPeer* peer = *peer_slot(token);
+    if (peer) {
+        peer->frame_count = 0;
+        snprintf(peer->username, sizeof(peer->username), "%s", username ? username : "");
+    }
+    pthread_mutex_unlock(&g_udp_mtx);
+}
+
+// Start reassembling frame h->seq, dropping whatever was in progress. Returns -1 if h is invalid.
+static int peer_begin_frame(UdpPeer* peer, const UdpFrameHeader* h) {
+    if (h->total == 0 || h->total > UDP_MAX_FRAME || h->frag_size == 0 ||
+        h->frag_size > UDP_DATAGRAM_MAX - sizeof(UdpFrameHeader)) {
+        return -1;
+    }
+    uint32_t count = (h->total + h->frag_size - 1) / h->frag_size;
+    size_t bitmap = (count + 7) / 8;
+    if (peer->cap < h->total) {
+        char* data = (char*)realloc(peer->data, h->total);
+        if (!data) return -1;
+        peer->data = data;
+        peer->cap = h->total;
+    }
+    if (peer->seen_cap < bitmap) {
+        uint8_t* seen = (uint8_t*)realloc(peer->seen, bitmap);
+        if (!seen) return -1;
+        peer->seen = seen;
+        peer->seen_cap = bitmap;
+    }
+    if (peer->active) peer->superseded++;
+    memset(peer->seen, 0, bitmap);
+    peer->active = 1;
+    peer->seq = h->seq;
+    peer->total = h->total;
+    peer->frag_size = h->frag_size;
+    peer->frag_count = count;
+    peer->received = 0;
+    return 0;
+}
+
+// Caller holds g_udp_mtx. Returns 1 when the frame completed: peer->data holds it, ready for score_submit.
+static int peer_accept_fragment(UdpPeer* peer, const UdpFrameHeader* h, const char* frag, size_t len) {
+    if (peer->has_done && !seq_newer(h->seq, peer->done_seq)) return 0;   // stale or duplicate frame
+    if (!peer->active || seq_newer(h->seq, peer->seq)) {
+        if (peer_begin_frame(peer, h) < 0) return 0;
+    } else if (h->seq != peer->seq) {
+        return 0;                                                         // older than the one in progress
+    } else if (h->total != peer->total || h->frag_size != peer->frag_size) {
+        return 0;
+    }
+    if (h->frag >= peer->frag_count) return 0;
+    size_t offset = (size_t)h->frag * peer->frag_size;
+    size_t expect = peer->total - offset < peer->frag_size ? peer->total - offset : peer->frag_size;
+    if (len != expect) return 0;
+    uint8_t bit = (uint8_t)(1u << (h->frag & 7));
+    if (peer->seen[h->frag >> 3] & bit) return 0;
+    peer->seen[h->frag >> 3] |= bit;
+    memcpy(peer->data + offset, frag, len);
+    if (++peer->received < peer->frag_count) return 0;
+
+    peer->active = 0;
+    peer->has_done = 1;
+    peer->done_seq = peer->seq;
+    peer->frame_count++;
+    peer->done_hash = frame_hash64(peer->data, peer->total);
+    archive_submit(peer->username, peer->frame_count, peer->data, (int)peer->total, peer->done_hash);
+    return 1;
+}
+
+static void udp_handle_datagram(const char* buf, size_t len, const struct sockaddr_in* from) {
+    UdpFrameHeader h;
+    if (len < sizeof(h)) return;
+    memcpy(&h, buf, sizeof(h));
+
+    pthread_mutex_lock(&g_udp_mtx);
+    UdpPeer* peer = h.token ? *peer_slot(h.token) : NULL;
+    int done = 0;
+    if (peer && peer->ip.s_addr == from->sin_addr.s_addr) {
+        peer->reply_to = *from;
+        done = peer_accept_fragment(peer, &h, buf + sizeof(h), len - sizeof(h));
+    }
+    int frame_no = 0;
+    if (done) {
+        peer->busy = 1;
+        frame_no = peer->frame_count;   // udp_reset_frames may change it once the mutex is released
+    }
+    pthread_mutex_unlock(&g_udp_mtx);
+    if (!done) return;
+
+    // Without workers score_submit scores inline and calls udp_deliver_score, which takes g_udp_mtx
+    score_submit(peer->score, peer->data, (int)peer->total, frame_no, peer->done_hash);
+
+    pthread_mutex_lock(&g_udp_mtx);
+    peer->busy = 0;
+    int dead = peer->dead;
+    pthread_mutex_unlock(&g_udp_mtx);
+    if (dead) peer_free(peer);
+}
+
+// Scoring pool callback: reply to the latest source address of the token, if still registered
+static void udp_deliver_score(uint64_t token, int score, int frame_no) {
+    char update[HEADER_SIZE + 128];
+    char rate[HEADER_SIZE + sizeof(RateHintPayload)];
+    struct sockaddr_in to;
+    int n = -1, hint = 0;
+
+    pthread_mutex_lock(&g_udp_mtx);
+    UdpPeer* peer = *peer_slot(token);
+    if (peer) {
+        n = focus_update_payload(update + HEADER_SIZE, sizeof(update) - HEADER_SIZE, peer->features, score, frame_no);
+        to = peer->reply_to;
+        RateHintPayload h;
+        if ((peer->features & FEAT_RATE_HINT) && ratectl_observe(&peer->rate, score, &h)) {
+            PacketHeader rhdr = { MSG_RATE_HINT, (int32_t)sizeof(h) };
+            memcpy(rate, &rhdr, HEADER_SIZE);
+            memcpy(rate + HEADER_SIZE, &h, sizeof(h));
+            hint = 1;
+        }
+    }
+    pthread_mutex_unlock(&g_udp_mtx);
+    if (n < 0) return;
+
+    PacketHeader hdr = { MSG_FOCUS_UPDATE, n };
+    memcpy(update, &hdr, HEADER_SIZE);
+    log_message("INFO", "[Stream] UDP frame %d (token %016llx), score=%d", frame_no, (unsigned long long)token, score);
+    if (sendto(g_udp_fd, update, HEADER_SIZE + (size_t)n, 0, (const struct sockaddr*)&to, sizeof(to)) < 0) {
+        log_message("DEBUG", "[UDP] reply: %s", strerror(errno));
+    }
+    if (score < FOCUS_THRESHOLD) {
+        PacketHeader warn = { MSG_FOCUS_WARN, 0 };
+        if (sendto(g_udp_fd, &warn, HEADER_SIZE, 0, (const struct sockaddr*)&to, sizeof(to)) < 0) {
+            log_message("DEBUG", "[UDP] warn: %s", strerror(errno));
+        }
+    }
+    if (hint && sendto(g_udp_fd, rate, sizeof(rate), 0, (const struct sockaddr*)&to, sizeof(to)) < 0) {
+        log_message("DEBUG", "[UDP] rate hint: %s", strerror(errno));
+    }
+}
+
+static void* udp_thread(void* arg) {
+    (void)arg;
+    static char bufs[UDP_RECV_BATCH][UDP_DATAGRAM_MAX];
+    struct sockaddr_in from[UDP_RECV_BATCH];
+    struct iovec iov[UDP_RECV_BATCH];
+    struct mmsghdr msgs[UDP_RECV_BATCH];
+    for (;;) {
+        memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < UDP_RECV_BATCH; ++i) {
+            iov[i].iov_base = bufs[i];
+            iov[i].iov_len = sizeof(bufs[i]);
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &from[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+        }
+        int n = recvmmsg(g_udp_fd, msgs, UDP_RECV_BATCH, MSG_WAITFORONE, NULL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            log_message("ERROR", "[UDP] recvmmsg: %s", strerror(errno));
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            // Truncated datagrams cannot be a valid fragment
+            if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) continue;
+            udp_handle_datagram(bufs[i], msgs[i].msg_len, &from[i]);
+        }
+    }
+    return NULL;
+}
+
+int udp_start(int port) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        log_message("ERROR", "[UDP] socket: %s", strerror(errno));
+        return -1;
+    }
+    // Frames arrive in bursts of fragments; a larger buffer rides over scheduling hiccups
+    int rcvbuf = 4 * UDP_MAX_FRAME;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons((uint16_t)port);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        log_message("ERROR", "[UDP] bind port %d: %s", port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    g_udp_fd = fd;
+    g_udp_port = port;
+
+    pthread_t th;
+    if (pthread_create(&th, NULL, udp_thread, NULL) != 0) {
+        log_message("ERROR", "[UDP] cannot start receive thread");
+        g_udp_fd = -1;
+        close(fd);
+        return -1;
+    }
+    pthread_detach(th);
+    log_message("INFO", "[UDP] Frame channel listening on port %d", port);
+    return 0;
+}
@@ -0,0 +1,31 @@
+/*
+ * Mục đích: Kênh UDP phụ cho frame ảnh (FEAT_UDP_FRAMES): độ trễ thấp, chấp nhận mất gói.
+ *  - 1 thread riêng nhận datagram bằng recvmmsg, ghép mảnh theo token; frame mới hơn thay frame
+ *    đang ghép dở (latest-frame-wins), frame thiếu mảnh bị bỏ chứ không chờ gửi lại.
+ *  - Token do kết nối TCP cấp khi bắt tay MSG_HELLO; datagram chỉ được nhận khi token còn hiệu
+ *    lực và đến từ cùng địa chỉ IP với kết nối TCP đó.
+ *  - Frame ghép xong được lưu (archive.h) và chấm trên scoring pool (scorepool.h); MSG_FOCUS_UPDATE/MSG_FOCUS_WARN trả về
+ *    địa chỉ gửi gần nhất bằng 1 datagram chứa gói TLV header 8 byte. Thread UDP và worker của pool
+ *    không chạm vào ClientContext, nên không cần đồng bộ với backend I/O của kết nối TCP.
+ *
+ * Hàm:
+ * - udp_start(port): Bind socket UDP và tạo thread nhận; trả -1 nếu lỗi (server chạy tiếp không UDP).
+ * - udp_port(): Cổng đang nghe, 0 nếu kênh UDP tắt.
+ * - udp_register(ctx, features): Cấp token cho kết nối TCP (0 nếu không cấp được).
+ * - udp_unregister(token): Thu hồi token và giải phóng buffer ghép (gọi khi kết nối đóng).
+ * - udp_reset_frames(token, username): Đếm lại số frame khi bắt đầu phiên mới; username dùng để
+ *   lưu frame của token.
+ */
+#ifndef SERVER_UDP_H
+#define SERVER_UDP_H
+
+#include <stdint.h>
+#include "handlers.h"
+
+int udp_start(int port);
+int udp_port(void);
+uint64_t udp_register(const ClientContext* ctx, uint32_t features);
+void udp_unregister(uint64_t token);
+void udp_reset_frames(uint64_t token, const char* username);
+
+#endif // SERVER_UDP_H
@@ -0,0 +1,832 @@
+/*
+ * Mục đích: Cài đặt backend io_uring bằng syscall thô (không phụ thuộc liburing).
+ *
+ * Thành phần:
+ * - Ring: ánh xạ SQ/CQ/SQE, lấy SQE, submit, duyệt CQE.
+ * - BufRing: provided buffer ring (IORING_REGISTER_PBUF_RING) cho recv.
+ * - UringConn: trạng thái kết nối (RxBuffer ráp TLV, hàng đợi gửi, refcount thao tác đang chạy).
+ * - Acceptor: thread + ring riêng giữ multishot accept, chia fd mới round-robin
+ *   sang ring của worker bằng IORING_OP_MSG_RING (worker bận không làm nghẽn accept).
+ * - Worker: mỗi thread 1 ring phục vụ các kết nối được giao, kèm 1 timer wheel cho
+ *   heartbeat; IORING_OP_TIMEOUT 1 tick đánh thức worker khi còn timer.
+ * - Điểm do scoring pool chấm xong về ScoreMailbox của worker; IORING_OP_POLL_ADD trên eventfd
+ *   của mailbox đánh thức worker để gửi chúng.
+ *
+ * Quy tắc:
+ * - Mỗi kết nối chỉ có tối đa 1 chuỗi gửi (frame WebSocket + header + payload) đang chạy để giữ thứ tự byte.
+ * - Byte đầu tiên của kết nối chọn codec TLV hoặc WebSocket (codec.c); kết nối TLV vẫn
+ *   tách gói tại chỗ trong provided buffer.
+ * - Hàng đợi gửi bị giới hạn theo g_options.tx_limits (drop MSG_FOCUS_UPDATE cũ / ngắt);
+ *   vượt high watermark thì huỷ multishot recv (ngừng đọc), dưới low watermark thì đăng lại.
+ * - Đóng kết nối = shutdown() để huỷ recv/send đang treo; free khi refcount về 0.
+ * - Gửi thất bại (ngắt slow consumer, submit lỗi) chỉ đặt close_pending: conn_shutdown và
+ *   handle_disconnect chạy sau khi handler đang gửi đã trả về, không bao giờ ở giữa handle_packet.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "uring.h"
+#include "handlers.h"
+#include "rxbuf.h"
+#include "options.h"
+#include "timerwheel.h"
+#include "codec.h"
+#include "websocket.h"
+#include "scorepool.h"
+#include "../common/config.h"
+#include "../common/protocol.h"
+
+extern void log_message(const char* level, const char* format, ...);
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define FOCUS_HAVE_IO_URING 1
+#endif
+#endif
+
+#ifndef FOCUS_HAVE_IO_URING
+
+int uring_pool_start(int listen_fd, int nthreads) {
+    (void)listen_fd; (void)nthreads;
+    log_message("WARN", "[Uring] io_uring headers not available in this build");
+    return -1;
+}
+
+#else
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define URING_BGID 1
+
+// OP_ADOPT: fd handed to a worker by MSG_RING (cqe->res = fd)
+// OP_HANDOFF: acceptor-side MSG_RING completion, fd kept in the upper bits
+// OP_TICK: the worker's timer-wheel tick (IORING_OP_TIMEOUT)
+// OP_SCORE: the worker's score mailbox eventfd became readable (IORING_OP_POLL_ADD)
+enum { OP_ACCEPT = 1, OP_RECV = 2, OP_SEND = 3, OP_ADOPT = 4, OP_HANDOFF = 5, OP_TICK = 6, OP_SCORE = 7 };
+#define OP_TAG_MASK 7ULL
+
+typedef struct {
+    int fd;
+    unsigned sq_entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe* sqes;
+    unsigned sqe_tail;      // local tail, published on submit
+    unsigned sqe_submitted;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe* cqes;
+    void* sq_ptr;
+    size_t sq_sz;
+    void* cq_ptr;
+    size_t cq_sz;
+    size_t sqes_sz;
+} Ring;
+
+typedef struct {
+    struct io_uring_buf_ring* br;
+    size_t br_sz;
+    unsigned entries;
+    unsigned tail;
+    char* data;
+} BufRing;
+
+typedef struct UringWorker {
+    int index;
+    Ring ring;
+    BufRing bufs;
+    pthread_t thread;
+    TimerWheel wheel;
+    struct __kernel_timespec tick_ts;
+    int tick_armed;
+    ScoreMailbox scores;
+} UringWorker;
+
+typedef struct {
+    int listen_fd;
+    Ring ring;
+    UringWorker* workers;
+    int count;
+    int next;
+    pthread_t thread;
+} UringAcceptor;
+
+typedef struct UringConn UringConn;
+
+typedef struct {
+    void* base;
+    unsigned len;
+} UringSeg;
+
+typedef struct UringSend {
+    struct UringSend* next;
+    UringConn* conn;
+    int pending;            // CQEs still expected for this chain
+    int failed;
+    int nseg;
+    UringSeg seg[3];        // WebSocket frame header, TLV header, payload (empty ones left out)
+    unsigned char prefix[WS_MAX_FRAME_HEADER];
+    PacketHeaderExt hdr;    // hdr.type = 0 for raw sends
+    char payload[];
+} UringSend;
+
+struct UringConn {
+    ClientContext ctx;
+    UringWorker* worker;
+    TimerNode timer;
+    int refs;               // multishot recv + in-flight send chain
+    int closing;
+    int close_pending;      // slow-consumer policy or a failed submit: shut down once dispatch unwinds
+    int recv_armed;
+    UringSend* send_head;
+    UringSend* send_tail;
+    int send_inflight;
+    size_t send_bytes;      // bytes queued, including the in-flight chain
+    int paused;             // recv cancelled until the send queue drains
+    int linger;             // WebSocket close: shut down once the close frame is sent
+    unsigned long dropped;
+    RxBuffer rx;            // only holds packets split across provided buffers
+    ConnCodec codec;
+};
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// ---------------------------------------------------------------------------
+// Ring
+// ---------------------------------------------------------------------------
+
+// Unmap and close a ring set up (fully or partly) by ring_init; keeps errno for the caller's log
+static void ring_free(Ring* r) {
+    int saved = errno;
+    if (r->sqes && r->sqes != MAP_FAILED) munmap(r->sqes, r->sqes_sz);
+    if (r->cq_ptr && r->cq_ptr != MAP_FAILED && r->cq_ptr != r->sq_ptr) munmap(r->cq_ptr, r->cq_sz);
+    if (r->sq_ptr && r->sq_ptr != MAP_FAILED) munmap(r->sq_ptr, r->sq_sz);
+    if (r->fd >= 0) close(r->fd);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+    errno = saved;
+}
+
+static int ring_init(Ring* r, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = entries * 4;
+
+    memset(r, 0, sizeof(*r));
+    r->fd = sys_io_uring_setup(entries, &p);
+    if (r->fd < 0) return -1;
+
+    r->sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    int single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+        if (r->cq_sz > r->sq_sz) r->sq_sz = r->cq_sz;
+        r->cq_sz = r->sq_sz;
+    }
+
+    r->sq_ptr = mmap(NULL, r->sq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED) goto fail;
+    if (single) {
+        r->cq_ptr = r->sq_ptr;
+    } else {
+        r->cq_ptr = mmap(NULL, r->cq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_ptr == MAP_FAILED) goto fail;
+    }
+    r->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = (struct io_uring_sqe*)mmap(NULL, r->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) goto fail;
+
+    char* sq = (char*)r->sq_ptr;
+    r->sq_head = (unsigned*)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned*)(sq + p.sq_off.array);
+    r->sq_entries = p.sq_entries;
+    char* cq = (char*)r->cq_ptr;
+    r->cq_head = (unsigned*)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+    // SQEs are always used in ring order, so the index array is the identity
+    for (unsigned i = 0; i < r->sq_entries; ++i) r->sq_array[i] = i;
+    r->sqe_tail = r->sqe_submitted = *r->sq_tail;
+    return 0;
+
+fail:
+    ring_free(r);
+    return -1;
+}
+
+// Publish queued SQEs and optionally wait for completions
+static int ring_submit(Ring* r, unsigned wait_nr) {
+    __atomic_store_n(r->sq_tail, r->sqe_tail, __ATOMIC_RELEASE);
+    unsigned to_submit = r->sqe_tail - r->sqe_submitted;
+    unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+    int ret = sys_io_uring_enter(r->fd, to_submit, wait_nr, flags);
+    if (ret < 0) return -errno;
+    r->sqe_submitted += (unsigned)ret;
+    return ret;
+}
+
+// Make sure `count` SQEs can be taken back-to-back (needed for linked chains)
+static int ring_reserve(Ring* r, unsigned count) {
+    for (;;) {
+        unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+        if (r->sq_entries - (r->sqe_tail - head) >= count) return 0;
+        int ret = ring_submit(r, 0);
+        if (ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY) return -1;
+    }
+}
+
+static struct io_uring_sqe* ring_get_sqe(Ring* r) {
+    if (ring_reserve(r, 1) < 0) return NULL;
+    struct io_uring_sqe* sqe = &r->sqes[r->sqe_tail & *r->sq_mask];
+    r->sqe_tail++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+// ---------------------------------------------------------------------------
+// Provided buffer ring
+// ---------------------------------------------------------------------------
+
+static char* bufring_addr(BufRing* b, unsigned bid) {
+    return b->data + (size_t)bid * URING_BUF_SIZE;
+}
+
+static void bufring_push(BufRing* b, unsigned bid) {
+    struct io_uring_buf* buf = &b->br->bufs[b->tail & (b->entries - 1)];
+    buf->addr = (uint64_t)(uintptr_t)bufring_addr(b, bid);
+    buf->len = URING_BUF_SIZE;
+    buf->bid = (uint16_t)bid;
+    b->tail++;
+    __atomic_store_n(&b->br->tail, (uint16_t)b->tail, __ATOMIC_RELEASE);
+}
+
+// The registration goes away with the ring fd; only the memory is ours
+static void bufring_free(BufRing* b) {
+    if (b->br && b->br != MAP_FAILED) munmap(b->br, b->br_sz);
+    free(b->data);
+    memset(b, 0, sizeof(*b));
+}
+
+static int bufring_init(BufRing* b, Ring* r) {
+    memset(b, 0, sizeof(*b));
+    b->entries = URING_BUF_COUNT;
+    b->br_sz = b->entries * sizeof(struct io_uring_buf);
+    b->br = (struct io_uring_buf_ring*)mmap(NULL, b->br_sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (b->br == MAP_FAILED) return -1;
+    b->data = (char*)malloc((size_t)b->entries * URING_BUF_SIZE);
+    if (!b->data) return -1;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)b->br;
+    reg.ring_entries = b->entries;
+    reg.bgid = URING_BGID;
+    if (sys_io_uring_register(r->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) return -1;
+
+    for (unsigned i = 0; i < b->entries; ++i) bufring_push(b, i);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Operations
+// ---------------------------------------------------------------------------
+
+static uint64_t op_tag(void* ptr, int kind) {
+    return (uint64_t)(uintptr_t)ptr | (uint64_t)kind;
+}
+
+static int arm_accept(UringAcceptor* a) {
+    struct io_uring_sqe* sqe = ring_get_sqe(&a->ring);
+    if (!sqe) return -1;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = a->listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = op_tag(a, OP_ACCEPT);
+    return 0;
+}
+
+static int arm_recv(UringConn* c) {
+    struct io_uring_sqe* sqe = ring_get_sqe(&c->worker->ring);
+    if (!sqe) return -1;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = c->ctx.client_fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    sqe->user_data = op_tag(c, OP_RECV);
+    c->recv_armed = 1;
+    return 0;
+}
+
+// Stop reading a connection whose replies pile up (cancel the multishot recv)
+static void conn_pause(UringConn* c) {
+    if (c->paused) return;
+    c->paused = 1;
+    if (!c->recv_armed) return;
+    struct io_uring_sqe* sqe = ring_get_sqe(&c->worker->ring);
+    if (!sqe) return;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = op_tag(c, OP_RECV);
+    sqe->user_data = 0; // completion ignored
+}
+
+static void conn_resume(UringConn* c) {
+    if (c->linger) return;
+    c->paused = 0;
+    if (c->recv_armed || c->closing) return;
+    if (arm_recv(c) == 0) c->refs++;
+}
+
+static void conn_maybe_free(UringConn* c) {
+    if (!c->closing || c->refs > 0) return;
+    close(c->ctx.client_fd);
+    rxbuf_free(&c->rx);
+    codec_free(&c->codec);
+    free(c);
+    log_message("INFO", "Client disconnected");
+}
+
+static void conn_shutdown(UringConn* c) {
+    if (c->closing) return;
+    c->closing = 1;
+    tw_cancel(&c->worker->wheel, &c->timer);
+    handle_disconnect(&c->ctx);
+    // Wake pending recv/send with an error; memory is released once refs drop to 0
+    shutdown(c->ctx.client_fd, SHUT_RDWR);
+    UringSend* s = c->send_inflight ? c->send_head->next : c->send_head;
+    while (s) {
+        UringSend* next = s->next;
+        free(s);
+        s = next;
+    }
+    if (c->send_inflight) {
+        c->send_head->next = NULL;
+        c->send_tail = c->send_head;
+    } else {
+        c->send_head = c->send_tail = NULL;
+    }
+}
+
+static size_t usend_size(const UringSend* s) {
+    size_t total = 0;
+    for (int i = 0; i < s->nseg; ++i) total += s->seg[i].len;
+    return total;
+}
+
+static void usend_add_seg(UringSend* s, void* base, size_t len) {
+    if (len == 0) return;
+    s->seg[s->nseg].base = base;
+    s->seg[s->nseg].len = (unsigned)len;
+    s->nseg++;
+}
+
+// Submit every segment of the queue head as one linked chain
+static int submit_send_head(UringConn* c) {
+    UringSend* s = c->send_head;
+    Ring* r = &c->worker->ring;
+    if (ring_reserve(r, (unsigned)s->nseg) < 0) return -1;
+
+    for (int i = 0; i < s->nseg; ++i) {
+        struct io_uring_sqe* sqe = ring_get_sqe(r);
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = c->ctx.client_fd;
+        sqe->addr = (uint64_t)(uintptr_t)s->seg[i].base;
+        sqe->len = s->seg[i].len;
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        sqe->user_data = op_tag(s, OP_SEND);
+        if (i + 1 < s->nseg) sqe->flags = IOSQE_IO_LINK;
+    }
+    s->pending = s->nseg;
+    c->send_inflight = 1;
+    c->refs++;
+    return 0;
+}
+
+// Drop queued-but-not-submitted sends of `type` (the in-flight head is kept)
+static void drop_unsent(UringConn* c, int type) {
+    UringSend* prev = c->send_inflight ? c->send_head : NULL;
+    UringSend* s = prev ? prev->next : c->send_head;
+    while (s) {
+        UringSend* next = s->next;
+        if (MSG_TYPE(s->hdr.type) == type) {
+            if (prev) prev->next = next;
+            else c->send_head = next;
+            if (c->send_tail == s) c->send_tail = prev;
+            c->send_bytes -= usend_size(s);
+            free(s);
+        } else {
+            prev = s;
+        }
+        s = next;
+    }
+}
+
+static UringSend* usend_alloc(UringConn* c, int type, const void* payload, int length) {
+    UringSend* s = (UringSend*)malloc(sizeof(UringSend) + (size_t)length);
+    if (!s) return NULL;
+    s->next = NULL;
+    s->conn = c;
+    s->pending = 0;
+    s->failed = 0;
+    s->nseg = 0;
+    s->hdr.type = type;
+    s->hdr.length = length;
+    if (length > 0) memcpy(s->payload, payload, (size_t)length);
+    return s;
+}
+
+// Append to the send queue and start the chain if nothing is in flight
+static int usend_enqueue(UringConn* c, UringSend* s) {
+    if (c->send_tail) c->send_tail->next = s;
+    else c->send_head = s;
+    c->send_tail = s;
+    c->send_bytes += usend_size(s);
+    if (c->send_bytes >= g_options.tx_limits.high_watermark) conn_pause(c);
+
+    if (!c->send_inflight && submit_send_head(c) < 0) {
+        c->close_pending = 1;
+        return -1;
+    }
+    return 0;
+}
+
+static int uring_send(ClientContext* ctx, int type, const void* payload, int length) {
+    UringConn* c = (UringConn*)ctx->transport;
+    if (c->closing || c->close_pending) return -1;
+    if (length < 0 || (length > 0 && !payload)) length = 0;
+
+    const TxLimits* lim = &g_options.tx_limits;
+    size_t need = (ctx->ext_header ? HEADER_EXT_SIZE : HEADER_SIZE) + (size_t)length;
+    if (c->send_bytes + need > lim->high_watermark) {
+        if (lim->policy == SLOW_POLICY_DISCONNECT) {
+            log_message("WARN", "[Uring] slow consumer fd=%d: send queue over %zu bytes, disconnecting",
+                        ctx->client_fd, lim->high_watermark);
+            c->close_pending = 1;
+            return -1;
+        }
+        conn_pause(c);
+        if (type == MSG_FOCUS_UPDATE) {
+            drop_unsent(c, MSG_FOCUS_UPDATE);
+            if (c->send_bytes + need > lim->high_watermark) {
+                if (c->dropped++ == 0) log_message("WARN", "[Uring] slow consumer fd=%d: dropping stale focus updates", ctx->client_fd);
+                return 0;
+            }
+        }
+    }
+
+    UringSend* s = usend_alloc(c, type, payload, length);
+    if (!s) return -1;
+    int hsize = ctx_packet_header(ctx, type, length, &s->hdr);
+    if (ctx->is_websocket) {
+        int hlen = websocket_frame_header(s->prefix, WS_OPCODE_BINARY, need);
+        usend_add_seg(s, s->prefix, (size_t)hlen);
+    }
+    usend_add_seg(s, &s->hdr, (size_t)hsize);
+    usend_add_seg(s, s->payload, (size_t)length);
+    return usend_enqueue(c, s);
+}
+
+// WebSocket handshake / control frames: sent verbatim, never dropped
+static int uring_send_raw(ClientContext* ctx, const void* data, int length) {
+    UringConn* c = (UringConn*)ctx->transport;
+    if (c->closing || c->close_pending) return -1;
+    if (length <= 0 || !data) return 0;
+
+    UringSend* s = usend_alloc(c, 0, data, length);
+    if (!s) return -1;
+    usend_add_seg(s, s->payload, (size_t)length);
+    return usend_enqueue(c, s);
+}
+
+// Let a queued WebSocket close frame reach the peer before shutting down
+static void conn_close_after_send(UringConn* c) {
+    if (c->codec.kind == CODEC_CLOSED && c->send_head && !c->close_pending) {
+        c->linger = 1;
+        conn_pause(c);
+        return;
+    }
+    conn_shutdown(c);
+}
+
+static int uring_dispatch(void* user, int type, const char* payload, int length, const PacketTag* tag) {
+    UringConn* c = (UringConn*)user;
+    if (handle_packet(&c->ctx, type, payload, length, tag) < 0 || c->closing || c->close_pending) return -1;
+    return 0;
+}
+
+// Records that fit inside the provided buffer are dispatched in place; only a
+// trailing partial record is copied into the connection's RxBuffer.
+static int conn_feed(UringConn* c, const char* data, int len) {
+    return codec_feed(&c->codec, &c->ctx, &c->rx, data, (size_t)len, uring_dispatch, c) < 0 ? -1 : 0;
+}
+
+static int arm_tick(UringWorker* w) {
+    struct io_uring_sqe* sqe = ring_get_sqe(&w->ring);
+    if (!sqe) return -1;
+    w->tick_ts.tv_sec = 0;
+    w->tick_ts.tv_nsec = (long long)TIMER_TICK_MS * 1000000LL;
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = (uint64_t)(uintptr_t)&w->tick_ts;
+    sqe->len = 1;
+    sqe->user_data = op_tag(w, OP_TICK);
+    w->tick_armed = 1;
+    return 0;
+}
+
+static void conn_on_timer(TimerNode* t, void* arg) {
+    (void)t;
+    UringConn* c = (UringConn*)arg;
+    int next = handle_keepalive(&c->ctx, tw_now_ms());
+    if (next < 0 || c->close_pending) {
+        conn_shutdown(c);
+        return;
+    }
+    tw_schedule(&c->worker->wheel, &c->timer, (uint64_t)next, conn_on_timer, c);
+}
+
+static void on_tick(UringWorker* w) {
+    w->tick_armed = 0;
+    tw_advance(&w->wheel, tw_now_ms());
+    if (w->wheel.count > 0) arm_tick(w);
+}
+
+static int arm_scores(UringWorker* w) {
+    struct io_uring_sqe* sqe = ring_get_sqe(&w->ring);
+    if (!sqe) return -1;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = w->scores.efd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = op_tag(w, OP_SCORE);
+    return 0;
+}
+
+static void uring_deliver_score(void* user, ClientContext* ctx, int score, int frame_no) {
+    (void)user;
+    UringConn* c = (UringConn*)ctx->transport;
+    if (c->closing) return;
+    handle_focus_result(ctx, score, frame_no);
+    if (c->close_pending) conn_shutdown(c);
+}
+
+static void on_scores(UringWorker* w) {
+    score_mailbox_drain(&w->scores, uring_deliver_score, w);
+    arm_scores(w);
+}
+
+static void conn_adopt(UringWorker* w, int fd) {
+    UringConn* c = (UringConn*)calloc(1, sizeof(UringConn));
+    if (!c) {
+        close(fd);
+        return;
+    }
+    c->worker = w;
+    c->ctx.client_fd = fd;
+    c->ctx.send_fn = uring_send;
+    c->ctx.send_raw_fn = uring_send_raw;
+    c->ctx.transport = c;
+    c->ctx.score_mailbox = &w->scores;
+    rxbuf_init(&c->rx);
+    codec_init(&c->codec);
+    if (arm_recv(c) < 0) {
+        close(fd);
+        codec_free(&c->codec);
+        free(c);
+        return;
+    }
+    c->refs = 1;
+    c->ctx.last_rx_ms = tw_now_ms();
+    conn_on_timer(&c->timer, c);
+    if (!w->tick_armed) arm_tick(w);
+    log_message("INFO", "Accepted connection fd=%d on uring worker %d", fd, w->index);
+}
+
+// Post the accepted fd as a CQE on the worker's ring (fds are process-wide)
+static int handoff_fd(UringAcceptor* a, UringWorker* target, int fd) {
+    struct io_uring_sqe* sqe = ring_get_sqe(&a->ring);
+    if (!sqe) return -1;
+    sqe->opcode = IORING_OP_MSG_RING;
+    sqe->fd = target->ring.fd;
+    sqe->len = (unsigned)fd;
+    sqe->off = op_tag(target, OP_ADOPT);
+    sqe->user_data = ((uint64_t)fd << 3) | OP_HANDOFF;
+    return 0;
+}
+
+static void on_accept(UringAcceptor* a, struct io_uring_cqe* cqe) {
+    if (!(cqe->flags & IORING_CQE_F_MORE)) arm_accept(a);
+    if (cqe->res < 0) {
+        log_message("WARN", "[Uring] accept: %s", strerror(-cqe->res));
+        return;
+    }
+
+    UringWorker* target = &a->workers[a->next];
+    a->next = (a->next + 1) % a->count;
+    if (handoff_fd(a, target, cqe->res) < 0) close(cqe->res);
+}
+
+static void* uring_acceptor_thread(void* arg) {
+    UringAcceptor* a = (UringAcceptor*)arg;
+    Ring* r = &a->ring;
+    for (;;) {
+        int ret = ring_submit(r, 1);
+        if (ret < 0 && ret != -EINTR && ret != -EBUSY && ret != -EAGAIN) {
+            log_message("ERROR", "[Uring] acceptor io_uring_enter: %s", strerror(-ret));
+            break;
+        }
+        unsigned head = *r->cq_head;
+        unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            struct io_uring_cqe cqe = r->cqes[head & *r->cq_mask];
+            head++;
+            __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+            if ((cqe.user_data & OP_TAG_MASK) == OP_ACCEPT) {
+                on_accept(a, &cqe);
+            } else if (cqe.res < 0) {
+                // Hand-off failed: the fd never reached a worker
+                log_message("WARN", "[Uring] msg_ring: %s", strerror(-cqe.res));
+                close((int)(cqe.user_data >> 3));
+            }
+        }
+    }
+    return NULL;
+}
+
+static void on_recv(UringConn* c, struct io_uring_cqe* cqe) {
+    BufRing* b = &c->worker->bufs;
+    if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+        unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        if (!c->closing && !c->linger && (conn_feed(c, bufring_addr(b, bid), cqe->res) < 0 || c->close_pending)) {
+            conn_close_after_send(c);
+        }
+        bufring_push(b, bid);
+    } else if (cqe->res != -ENOBUFS && cqe->res != -ECANCELED && !c->linger) {
+        conn_shutdown(c); // EOF or error
+    }
+
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        c->recv_armed = 0;
+        // Multishot stops on -ENOBUFS (buffers now recycled), on conn_pause()'s
+        // cancel, or on internal limits: re-arm unless reading is paused
+        if (!c->closing && !c->paused && arm_recv(c) == 0) return;
+        c->refs--;
+        conn_maybe_free(c);
+    }
+}
+
+static void on_send(UringSend* s, struct io_uring_cqe* cqe) {
+    UringConn* c = s->conn;
+    // Linked CQEs arrive in chain order, one per segment
+    int expected = (int)s->seg[s->nseg - s->pending].len;
+    if (cqe->res != expected) s->failed = 1;
+    if (--s->pending > 0) return;
+
+    int failed = s->failed;
+    c->send_head = s->next;
+    if (!c->send_head) c->send_tail = NULL;
+    c->send_bytes -= usend_size(s);
+    free(s);
+    c->send_inflight = 0;
+    c->refs--;
+
+    if (c->paused && c->send_bytes <= g_options.tx_limits.low_watermark) conn_resume(c);
+    if (failed || (c->linger && !c->send_head)) conn_shutdown(c);
+    else if (c->send_head && !c->closing && submit_send_head(c) < 0) conn_shutdown(c);
+    conn_maybe_free(c);
+}
+
+static void* uring_worker_thread(void* arg) {
+    UringWorker* w = (UringWorker*)arg;
+    Ring* r = &w->ring;
+    log_message("INFO", "[Uring %d] worker started", w->index);
+    arm_scores(w);
+
+    for (;;) {
+        int ret = ring_submit(r, 1);
+        if (ret < 0 && ret != -EINTR && ret != -EBUSY && ret != -EAGAIN) {
+            log_message("ERROR", "[Uring %d] io_uring_enter: %s", w->index, strerror(-ret));
+            break;
+        }
+
+        // Snapshot the tail once: CQEs posted meanwhile wait for the next
+        // io_uring_enter, which also runs pending task_work (e.g. accepts)
+        unsigned head = *r->cq_head;
+        unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            struct io_uring_cqe cqe = r->cqes[head & *r->cq_mask];
+            head++;
+            __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+
+            if (cqe.user_data == 0) continue; // cancel requests
+            int kind = (int)(cqe.user_data & OP_TAG_MASK);
+            void* ptr = (void*)(uintptr_t)(cqe.user_data & ~OP_TAG_MASK);
+            if (kind == OP_RECV) {
+                on_recv((UringConn*)ptr, &cqe);
+            } else if (kind == OP_SEND) {
+                on_send((UringSend*)ptr, &cqe);
+            } else if (kind == OP_ADOPT) {
+                conn_adopt(w, cqe.res);
+            } else if (kind == OP_TICK) {
+                on_tick(w);
+            } else if (kind == OP_SCORE) {
+                on_scores(w);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Release workers [0, count) that never got a thread; `mailboxes` of them have a score mailbox
+static void workers_free(UringWorker* workers, int count, int mailboxes) {
+    for (int i = 0; i < count; ++i) {
+        if (i < mailboxes) score_mailbox_destroy(&workers[i].scores);
+        bufring_free(&workers[i].bufs);
+        ring_free(&workers[i].ring);
+    }
+}
+
+int uring_pool_start(int listen_fd, int nthreads) {
+    if (nthreads <= 0) nthreads = 1;
+    UringWorker* workers = (UringWorker*)calloc((size_t)nthreads, sizeof(UringWorker));
+    if (!workers) return -1;
+
+    // Set up every ring first so an unsupported kernel fails before any thread runs
+    for (int i = 0; i < nthreads; ++i) {
+        UringWorker* w = &workers[i];
+        w->index = i;
+        tw_init(&w->wheel, tw_now_ms());
+        const char* what = NULL;
+        if (ring_init(&w->ring, URING_ENTRIES) < 0) what = "io_uring_setup failed";
+        else if (bufring_init(&w->bufs, &w->ring) < 0) what = "provided buffer ring unsupported";
+        else if (score_mailbox_init(&w->scores, -1) < 0) what = "score mailbox";
+        if (what) {
+            log_message("WARN", "[Uring] %s: %s", what, strerror(errno));
+            workers_free(workers, i + 1, i);
+            free(workers);
+            return -1;
+        }
+    }
+
+    // The accept SQE is only queued here; the acceptor thread's first io_uring_enter submits it
+    static UringAcceptor acceptor;
+    acceptor.listen_fd = listen_fd;
+    acceptor.workers = workers;
+    acceptor.count = nthreads;
+    if (ring_init(&acceptor.ring, URING_ENTRIES) < 0 || arm_accept(&acceptor) < 0) {
+        log_message("WARN", "[Uring] acceptor ring setup failed: %s", strerror(errno));
+        if (acceptor.ring.fd >= 0) ring_free(&acceptor.ring);
+        workers_free(workers, nthreads, nthreads);
+        free(workers);
+        return -1;
+    }
+
+    int started = 0;
+    for (; started < nthreads; ++started) {
+        if (pthread_create(&workers[started].thread, NULL, uring_worker_thread, &workers[started]) != 0) break;
+        pthread_detach(workers[started].thread);
+    }
+    if (started == 0) {
+        log_message("ERROR", "[Uring] pthread_create failed");
+        ring_free(&acceptor.ring);
+        workers_free(workers, nthreads, nthreads);
+        free(workers);
+        return -1;
+    }
+    if (started < nthreads) {
+        // Running workers block on their rings and cannot be stopped: serve with those alone
+        log_message("WARN", "[Uring] pthread_create failed, running %d of %d worker(s)", started, nthreads);
+        workers_free(workers + started, nthreads - started, nthreads - started);
+        acceptor.count = started;
+    }
+    if (pthread_create(&acceptor.thread, NULL, uring_acceptor_thread, &acceptor) != 0) {
+        // Workers already own their rings: no clean way back to another I/O mode
+        log_message("ERROR", "[Uring] acceptor pthread_create failed, exiting");
+        exit(1);
+    }
+    pthread_detach(acceptor.thread);
+    log_message("INFO", "[Uring] %d worker(s) running", acceptor.count);
+    return 0;
+}
+
+#endif // FOCUS_HAVE_IO_URING
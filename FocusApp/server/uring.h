@@ -0,0 +1,19 @@
+/*
+ * Mục đích: Backend I/O io_uring cho Server (tuỳ chọn, --io=uring).
+ *  - Multishot accept trên socket lắng nghe.
+ *  - Multishot recv với provided buffer ring (kernel tự chọn buffer, không cần
+ *    cấp phát buffer cho từng lần nhận).
+ *  - Gửi TLV bằng 2 SQE nối nhau (IOSQE_IO_LINK): header rồi payload.
+ *
+ * Hàm:
+ * - uring_pool_start(listen_fd, nthreads): Tạo N worker, mỗi worker 1 ring.
+ *   Trả -1 nếu kernel/headers không hỗ trợ → caller fallback sang epoll; khi đó mọi ring,
+ *   buffer ring và mailbox đã tạo được giải phóng, chưa có thread nào chạy và chưa accept kết nối nào.
+ *   Tạo thread worker lỗi giữa chừng thì chạy với các worker đã có; thread acceptor lỗi thì dừng server.
+ */
+#ifndef SERVER_URING_H
+#define SERVER_URING_H
+
+int uring_pool_start(int listen_fd, int nthreads);
+
+#endif // SERVER_URING_H
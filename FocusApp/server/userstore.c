@@ -0,0 +1,200 @@
+/*
+ * Mục đích: Cài đặt bảng người dùng băm địa chỉ mở (xem userstore.h).
+ *  - Vị trí ô = 32 bit thấp của hash & mask, tag = 32 bit cao; khi nhân đôi số ô thì hash lại
+ *    username của từng bản ghi (hiếm: tổng chi phí vẫn O(1) mỗi lần thêm).
+ *  - Thứ tự công bố khi thêm: ghi bản ghi → count (release) → tag → idx của ô (release). Thread đọc
+ *    thấy idx != 0 (acquire) thì bản ghi và tag đã đầy đủ.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <stdbool.h>
+
+#include "userstore.h"
+#include "framehash.h"
+
+#define USER_NAME_MAX (sizeof(((UserStat*)0)->username) - 1)
+#define USER_SEQ_SPINS 64       // CAS attempts on a held record before yielding the CPU
+
+// Names are stored truncated to USER_NAME_MAX, so hash and compare only that much
+static uint64_t user_hash(const char* username) {
+    return frame_hash64(username, strnlen(username, USER_NAME_MAX));
+}
+
+static UserIndex* index_alloc(uint32_t nslots) {
+    UserIndex* ix = calloc(1, sizeof(UserIndex) + (size_t)nslots * sizeof(UserSlot));
+    if (ix) ix->mask = nslots - 1;
+    return ix;
+}
+
+// Empty slot where hash h would go (index has room: load stays below USER_STORE_MAX_LOAD)
+static uint32_t slot_free(const UserIndex* ix, uint64_t h) {
+    uint32_t i = (uint32_t)h & ix->mask;
+    while (ix->slots[i].idx) i = (i + 1) & ix->mask;
+    return i;
+}
+
+// Record index of username (hash h), or -1 with *slot = the empty slot that ended the probe run.
+// The slot is loaded once: a concurrent insert may fill the empty slot right after it was seen.
+static int slot_lookup(const UserStore* st, const UserIndex* ix, const char* username, uint64_t h, uint32_t* slot) {
+    uint32_t tag = (uint32_t)(h >> 32);
+    uint32_t i = (uint32_t)h & ix->mask;
+    for (;;) {
+        uint32_t r = __atomic_load_n(&ix->slots[i].idx, __ATOMIC_ACQUIRE);
+        if (!r) {
+            if (slot) *slot = i;
+            return -1;
+        }
+        if (ix->slots[i].tag == tag && strncmp(userstore_at(st, (int)r - 1)->username, username, USER_NAME_MAX) == 0) return (int)r - 1;
+        i = (i + 1) & ix->mask;
+    }
+}
+
+// Index with twice the slots holding every record; readers keep probing the old one until it is published
+static UserIndex* index_grow(UserStore* st, const UserIndex* old) {
+    UserIndex* ix = index_alloc((old->mask + 1) * 2);
+    if (!ix) return NULL;
+    for (uint32_t r = 0; r < st->count; ++r) {
+        uint64_t h = user_hash(userstore_at(st, (int)r)->username);
+        uint32_t i = slot_free(ix, h);
+        ix->slots[i].tag = (uint32_t)(h >> 32);
+        ix->slots[i].idx = r + 1;
+    }
+    return ix;
+}
+
+int userstore_init(UserStore* st) {
+    memset(st, 0, sizeof(*st));
+    st->chunks[0] = malloc(USER_STORE_INITIAL * sizeof(UserStat));
+    st->index = index_alloc(USER_STORE_INITIAL * 2);
+    if (!st->chunks[0] || !st->index || pthread_mutex_init(&st->add_mtx, NULL) != 0) {
+        free(st->chunks[0]);
+        free(st->index);
+        memset(st, 0, sizeof(*st));
+        return -1;
+    }
+    return 0;
+}
+
+void userstore_free(UserStore* st) {
+    for (int k = 0; k < USER_STORE_CHUNKS; ++k) free(st->chunks[k]);
+    UserIndex* ix = st->index;
+    while (ix) {
+        UserIndex* prev = ix->retired;
+        free(ix);
+        ix = prev;
+    }
+    pthread_mutex_destroy(&st->add_mtx);
+    memset(st, 0, sizeof(*st));
+}
+
+void userstore_clear(UserStore* st) {
+    st->count = 0;
+    memset(st->index->slots, 0, ((size_t)st->index->mask + 1) * sizeof(UserSlot));
+}
+
+int userstore_find(const UserStore* st, const char* username) {
+    const UserIndex* ix = __atomic_load_n(&st->index, __ATOMIC_ACQUIRE);
+    if (!ix) return -1;
+    return slot_lookup(st, ix, username, user_hash(username), NULL);
+}
+
+int userstore_add(UserStore* st, const char* username, const char* password, int* created) {
+    if (created) *created = 0;
+    int idx = userstore_find(st, username);
+    if (idx >= 0) return idx;
+
+    pthread_mutex_lock(&st->add_mtx);
+    UserIndex* ix = st->index;
+    if (!ix) goto fail;
+    uint64_t h = user_hash(username);
+    uint32_t i;
+    idx = slot_lookup(st, ix, username, h, &i);
+    if (idx >= 0) {
+        // Added by another thread since the lock-free lookup
+        pthread_mutex_unlock(&st->add_mtx);
+        return idx;
+    }
+
+    uint32_t r = st->count;
+    uint32_t k = 31 - __builtin_clz(r / USER_STORE_INITIAL + 1);
+    if (r == (uint32_t)INT32_MAX || k >= USER_STORE_CHUNKS) goto fail;
+    if (!st->chunks[k]) {
+        st->chunks[k] = malloc(((size_t)USER_STORE_INITIAL << k) * sizeof(UserStat));
+        if (!st->chunks[k]) goto fail;
+    }
+    if ((uint64_t)(r + 1) * 100 > ((uint64_t)ix->mask + 1) * USER_STORE_MAX_LOAD) {
+        UserIndex* grown = ix->mask < UINT32_MAX / 2 ? index_grow(st, ix) : NULL;
+        if (!grown) goto fail;
+        grown->retired = ix;
+        __atomic_store_n(&st->index, grown, __ATOMIC_RELEASE);
+        ix = grown;
+        i = slot_free(ix, h);
+    }
+
+    UserStat* u = userstore_at(st, (int)r);
+    memset(u, 0, sizeof(*u));
+    strncpy(u->username, username, sizeof(u->username) - 1);
+    strncpy(u->password, password ? password : "", sizeof(u->password) - 1);
+    __atomic_store_n(&st->count, r + 1, __ATOMIC_RELEASE);
+    ix->slots[i].tag = (uint32_t)(h >> 32);
+    __atomic_store_n(&ix->slots[i].idx, r + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&st->add_mtx);
+    if (created) *created = 1;
+    return (int)r;
+
+fail:
+    pthread_mutex_unlock(&st->add_mtx);
+    return -1;
+}
+
+void userstore_read(const UserStore* st, int idx, UserTotals* out) {
+    const UserStat* u = userstore_at(st, idx);
+    for (;;) {
+        uint32_t seq = __atomic_load_n(&u->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            sched_yield();
+            continue;
+        }
+        out->coins = __atomic_load_n(&u->total_coins, __ATOMIC_RELAXED);
+        out->sessions = __atomic_load_n(&u->total_sessions, __ATOMIC_RELAXED);
+        out->seconds = __atomic_load_n(&u->total_seconds, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&u->seq, __ATOMIC_RELAXED) == seq) return;
+    }
+}
+
+// Take the record's seqlock (even → odd); returns the even value to release with
+static uint32_t record_lock(UserStat* u) {
+    for (int spins = 0;; ++spins) {
+        uint32_t seq = __atomic_load_n(&u->seq, __ATOMIC_RELAXED);
+        if (!(seq & 1) && __atomic_compare_exchange_n(&u->seq, &seq, seq + 1, false,
+                                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+            return seq;
+        }
+        if (spins >= USER_SEQ_SPINS) sched_yield();
+    }
+}
+
+static void record_unlock(UserStat* u, uint32_t seq) {
+    __atomic_store_n(&u->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void userstore_add_totals(UserStore* st, int idx, const UserTotals* delta) {
+    UserStat* u = userstore_at(st, idx);
+    uint32_t seq = record_lock(u);
+    __atomic_store_n(&u->total_coins, u->total_coins + delta->coins, __ATOMIC_RELAXED);
+    __atomic_store_n(&u->total_sessions, u->total_sessions + delta->sessions, __ATOMIC_RELAXED);
+    __atomic_store_n(&u->total_seconds, u->total_seconds + delta->seconds, __ATOMIC_RELAXED);
+    record_unlock(u, seq);
+}
+
+void userstore_set_totals(UserStore* st, int idx, const UserTotals* totals) {
+    UserStat* u = userstore_at(st, idx);
+    uint32_t seq = record_lock(u);
+    __atomic_store_n(&u->total_coins, totals->coins, __ATOMIC_RELAXED);
+    __atomic_store_n(&u->total_sessions, totals->sessions, __ATOMIC_RELAXED);
+    __atomic_store_n(&u->total_seconds, totals->seconds, __ATOMIC_RELAXED);
+    record_unlock(u, seq);
+}
@@ -0,0 +1,89 @@
+/*
+ * Mục đích: Bảng người dùng của server (UserStat) tra theo username trong O(1), không giới hạn số user,
+ * đọc không khoá.
+ *  - Bản ghi nằm trong các chunk không bao giờ di chuyển: chunk k chứa USER_STORE_INITIAL << k bản ghi
+ *    liền nhau, cấp khi cần. Chỉ số bản ghi theo thứ tự thêm; duyệt bảng xếp hạng/lưu file chỉ đọc
+ *    tuần tự `count` bản ghi (không có ô trống).
+ *  - Chỉ mục băm địa chỉ mở (dò tuyến tính) trên username (frame_hash64): mỗi ô 8 byte gồm 32 bit
+ *    cao của hash + chỉ số bản ghi, nên lần dò chỉ chạm tới bản ghi khi hash khớp. Số ô là luỹ thừa
+ *    của 2 và được nhân đôi (dựng chỉ mục mới rồi công bố 1 con trỏ) trước khi vượt USER_STORE_MAX_LOAD %.
+ *    Chỉ mục cũ được giữ tới userstore_free vì thread đọc có thể vẫn đang dò trong đó (tổng bộ nhớ
+ *    giữ lại < chỉ mục hiện tại).
+ *  - Đồng bộ: chỉ thêm user mới phải khoá (add_mtx, các thread thêm user với nhau). Tra username,
+ *    username/password (không đổi sau khi công bố) và đọc bộ đếm không khoá. Bộ đếm của mỗi bản ghi
+ *    có seqlock riêng: thread ghi giữ bản ghi bằng CAS seq chẵn → lẻ rồi ghi bộ đếm bằng atomic; thread
+ *    đọc đọc lại khi seq lẻ hoặc đổi trong lúc đọc. Hai user khác nhau không bao giờ chờ nhau.
+ *  - Không có xoá từng user (server chưa có thao tác xoá tài khoản). userstore_clear chỉ dùng khi
+ *    chưa có thread nào khác truy cập bảng (nạp file lúc khởi động).
+ *
+ * Hàm:
+ * - userstore_init / userstore_free / userstore_clear.
+ * - userstore_find(st, username): chỉ số bản ghi hoặc -1 (không khoá).
+ * - userstore_add(st, username, password, created): chỉ số bản ghi của username, thêm bản ghi
+ *   (bộ đếm 0, password cho sẵn) nếu chưa có; *created = 1 khi vừa thêm. -1 khi hết bộ nhớ.
+ * - userstore_read(st, idx, out): đọc nhất quán 3 bộ đếm (không khoá).
+ * - userstore_add_totals / userstore_set_totals: cộng / gán bộ đếm của 1 bản ghi.
+ * - userstore_count(st), userstore_at(st, idx): số bản ghi đã công bố, bản ghi tại chỉ số.
+ */
+#ifndef SERVER_USERSTORE_H
+#define SERVER_USERSTORE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "../common/config.h"
+
+#define USER_STORE_CHUNKS 24    // USER_STORE_INITIAL * (2^24 - 1) records: beyond the int index range
+
+typedef struct {
+    int coins;
+    int sessions;
+    int seconds;
+} UserTotals;
+
+typedef struct {
+    char username[64];          // immutable once published
+    char password[64];          // immutable once published
+    uint32_t seq;               // counter seqlock: odd while a writer holds the record
+    int total_coins;            // atomic, written under seq
+    int total_sessions;
+    int total_seconds;
+} UserStat;
+
+typedef struct {
+    uint32_t tag;               // high 32 bits of the username hash
+    uint32_t idx;               // record index + 1, 0 = empty slot (atomic, published after tag)
+} UserSlot;
+
+typedef struct UserIndex {
+    uint32_t mask;              // slot count - 1
+    struct UserIndex* retired;  // previous (smaller) index, freed by userstore_free
+    UserSlot slots[];
+} UserIndex;
+
+typedef struct {
+    UserStat* chunks[USER_STORE_CHUNKS];
+    uint32_t count;             // published records (atomic)
+    UserIndex* index;           // current index (atomic)
+    pthread_mutex_t add_mtx;
+} UserStore;
+
+int userstore_init(UserStore* st);
+void userstore_free(UserStore* st);
+void userstore_clear(UserStore* st);
+int userstore_find(const UserStore* st, const char* username);
+int userstore_add(UserStore* st, const char* username, const char* password, int* created);
+void userstore_read(const UserStore* st, int idx, UserTotals* out);
+void userstore_add_totals(UserStore* st, int idx, const UserTotals* delta);
+void userstore_set_totals(UserStore* st, int idx, const UserTotals* totals);
+
+static inline uint32_t userstore_count(const UserStore* st) {
+    return __atomic_load_n(&st->count, __ATOMIC_ACQUIRE);
+}
+
+static inline UserStat* userstore_at(const UserStore* st, int idx) {
+    uint32_t n = (uint32_t)idx / USER_STORE_INITIAL + 1;
+    int k = 31 - __builtin_clz(n);
+    return &st->chunks[k][(uint32_t)idx - USER_STORE_INITIAL * ((1u << k) - 1)];
+}
+
+#endif // SERVER_USERSTORE_H
@@ -135,16 +135,28 @@ static void sha1_final(sha1_ctx* ctx, unsigned char digest[20]) {
 
 #define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
 
-int websocket_handshake(int fd) {
-    char req[4096];
-    int n = recv(fd, req, sizeof(req) - 1, 0);
-    if (n <= 0) return -1;
-    req[n] = '\0';
+// Locate "\r\n\r\n" in a (not NUL-terminated) request; returns header length or 0
+static size_t http_header_end(const char* req, size_t len) {
+    for (size_t i = 3; i < len; ++i) {
+        if (req[i] == '\n' && req[i - 1] == '\r' && req[i - 2] == '\n' && req[i - 3] == '\r') return i + 1;
+    }
+    return 0;
+}
+
+int websocket_handshake_response(const char* req, size_t len, size_t* consumed, char* out, size_t outcap,
+                                 const WsDeflateConfig* pmd_cfg, WsDeflateParams* pmd) {
+    size_t hdr_len = http_header_end(req, len);
+    if (hdr_len == 0) return len >= WS_MAX_HANDSHAKE ? -1 : 0;
+    if (hdr_len < 3 || strncmp(req, "GET", 3) != 0) return -1;
+
+    char head[WS_MAX_HANDSHAKE + 1];
+    if (hdr_len > WS_MAX_HANDSHAKE) return -1;
+    memcpy(head, req, hdr_len);
+    head[hdr_len] = '\0';
 
-    if (strncmp(req, "GET", 3) != 0) return -1;
     const char* key_hdr = "Sec-WebSocket-Key:";
-    char* key_pos = strcasestr(req, key_hdr);
-    if (!key_pos) key_pos = strcasestr_impl(req, key_hdr);
+    char* key_pos = strcasestr(head, key_hdr);
+    if (!key_pos) key_pos = strcasestr_impl(head, key_hdr);
     if (!key_pos) return -1;
     key_pos += strlen(key_hdr);
     while (*key_pos == ' ' || *key_pos == '\t') key_pos++;
@@ -170,81 +182,91 @@ int websocket_handshake(int fd) {
     if (enc_len + 1 > sizeof(accept_b64)) return -1;
     base64_encode(digest, 20, accept_b64, sizeof(accept_b64));
 
-    char resp[512];
-    int resp_len = snprintf(resp, sizeof(resp),
+    char ext[160] = "";
+    if (pmd_cfg && pmd) ws_deflate_negotiate(pmd_cfg, head, hdr_len, pmd, ext, sizeof(ext));
+
+    int resp_len = snprintf(out, outcap,
         "HTTP/1.1 101 Switching Protocols\r\n"
         "Upgrade: websocket\r\n"
         "Connection: Upgrade\r\n"
-        "Sec-WebSocket-Accept: %s\r\n\r\n",
-        accept_b64);
-    if (resp_len <= 0 || resp_len >= (int)sizeof(resp)) return -1;
+        "Sec-WebSocket-Accept: %s\r\n"
+        "%s\r\n",
+        accept_b64, ext);
+    if (resp_len <= 0 || (size_t)resp_len >= outcap) return -1;
+    *consumed = hdr_len;
+    return resp_len;
+}
+
+int websocket_handshake(int fd) {
+    char req[4096];
+    int n = recv(fd, req, sizeof(req) - 1, 0);
+    if (n <= 0) return -1;
+
+    char resp[512];
+    size_t consumed = 0;
+    int resp_len = websocket_handshake_response(req, (size_t)n, &consumed, resp, sizeof(resp), NULL, NULL);
+    if (resp_len <= 0) return -1;
     if (send(fd, resp, resp_len, 0) != resp_len) return -1;
     return 0;
 }
 
-static int read_exact(int fd, void* buf, int len) {
-    int got = 0;
-    char* p = (char*)buf;
-    while (got < len) {
-        int n = recv(fd, p + got, len - got, 0);
-        if (n <= 0) return -1;
-        got += n;
-    }
-    return got;
+int websocket_frame_header(unsigned char out[WS_MAX_FRAME_HEADER], uint8_t opcode, uint64_t len) {
+    return websocket_frame_header_ex(out, opcode, 0, len);
 }
 
-int websocket_recv_frame(int fd, char** payload, uint8_t* opcode) {
-    unsigned char hdr[2];
-    if (read_exact(fd, hdr, 2) < 0) return -1;
-    *opcode = hdr[0] & 0x0F;
-    int masked = (hdr[1] & 0x80) != 0;
-    uint64_t len = hdr[1] & 0x7F;
-    if (len == 126) {
-        unsigned char ext[2];
-        if (read_exact(fd, ext, 2) < 0) return -1;
-        len = (ext[0] << 8) | ext[1];
-    } else if (len == 127) {
-        unsigned char ext[8];
-        if (read_exact(fd, ext, 8) < 0) return -1;
-        // Only support up to 32-bit lengths for simplicity
-        len = ((uint64_t)ext[4] << 24) | ((uint64_t)ext[5] << 16) | ((uint64_t)ext[6] << 8) | ((uint64_t)ext[7]);
+int websocket_frame_header_ex(unsigned char out[WS_MAX_FRAME_HEADER], uint8_t opcode, int rsv1, uint64_t len) {
+    int hlen = 0;
+    out[hlen++] = 0x80 | (rsv1 ? 0x40 : 0) | (opcode & 0x0F);
+    if (len <= 125) {
+        out[hlen++] = (unsigned char)len;
+    } else if (len <= 65535) {
+        out[hlen++] = 126;
+        out[hlen++] = (len >> 8) & 0xFF;
+        out[hlen++] = len & 0xFF;
+    } else {
+        out[hlen++] = 127;
+        for (int shift = 56; shift >= 0; shift -= 8) out[hlen++] = (len >> shift) & 0xFF;
     }
-    unsigned char mask[4] = {0};
-    if (masked) {
-        if (read_exact(fd, mask, 4) < 0) return -1;
+    return hlen;
+}
+
+int websocket_parse_header(const char* data, size_t len, WsFrameHeader* hdr) {
+    const unsigned char* p = (const unsigned char*)data;
+    if (len < 2) return 0;
+    if (p[0] & 0x30) return -1; // RSV2/RSV3: no extension uses them
+    hdr->fin = (p[0] & 0x80) != 0;
+    hdr->rsv1 = (p[0] & 0x40) != 0;
+    hdr->opcode = p[0] & 0x0F;
+    if ((hdr->opcode & 0x08) && hdr->rsv1) return -1; // control frames are never compressed
+    hdr->masked = (p[1] & 0x80) != 0;
+    uint64_t plen = p[1] & 0x7F;
+    size_t pos = 2;
+    if (plen == 126) {
+        if (len < 4) return 0;
+        plen = ((uint64_t)p[2] << 8) | p[3];
+        pos = 4;
+    } else if (plen == 127) {
+        if (len < 10) return 0;
+        plen = 0;
+        for (int i = 0; i < 8; ++i) plen = (plen << 8) | p[2 + i];
+        if (plen >> 63) return -1; // most significant bit must be 0
+        pos = 10;
     }
-    if (len > 4 * 1024 * 1024) return -1; // avoid huge alloc
-    char* buf = (char*)malloc((size_t)len + 1);
-    if (!buf) return -1;
-    if (read_exact(fd, buf, (int)len) < 0) { free(buf); return -1; }
-    if (masked) {
-        for (uint64_t i = 0; i < len; ++i) {
-            buf[i] ^= mask[i % 4];
-        }
+    if ((hdr->opcode & 0x08) && (plen > WS_MAX_CONTROL_PAYLOAD || !hdr->fin)) return -1; // control frame rules
+    if (hdr->masked) {
+        if (len < pos + 4) return 0;
+        memcpy(hdr->mask, p + pos, 4);
+        pos += 4;
+    } else {
+        memset(hdr->mask, 0, sizeof(hdr->mask));
     }
-    buf[len] = '\0';
-    *payload = buf;
-    return (int)len;
+    hdr->length = plen;
+    return (int)pos;
 }
 
 static int websocket_send_frame(int fd, uint8_t opcode, const char* data, int len) {
-    unsigned char header[10];
-    int hlen = 0;
-    header[hlen++] = 0x80 | (opcode & 0x0F);
-    if (len <= 125) {
-        header[hlen++] = (unsigned char)len;
-    } else if (len <= 65535) {
-        header[hlen++] = 126;
-        header[hlen++] = (len >> 8) & 0xFF;
-        header[hlen++] = len & 0xFF;
-    } else {
-        header[hlen++] = 127;
-        header[hlen++] = 0; header[hlen++] = 0; header[hlen++] = 0; header[hlen++] = 0;
-        header[hlen++] = (len >> 24) & 0xFF;
-        header[hlen++] = (len >> 16) & 0xFF;
-        header[hlen++] = (len >> 8) & 0xFF;
-        header[hlen++] = len & 0xFF;
-    }
+    unsigned char header[WS_MAX_FRAME_HEADER];
+    int hlen = websocket_frame_header(header, opcode, (uint64_t)len);
     if (send(fd, header, hlen, 0) != hlen) return -1;
     if (len > 0 && data) {
         if (send(fd, data, len, 0) != len) return -1;
@@ -1,16 +1,51 @@
 #ifndef WEBSOCKET_H
 #define WEBSOCKET_H
 
+#include <stddef.h>
 #include <stdint.h>
+#include "../common/protocol.h"
+#include "../common/wsdeflate.h"
+
+#define WS_OPCODE_CONTINUATION 0x0
+#define WS_OPCODE_TEXT 0x1
+#define WS_OPCODE_BINARY 0x2
+#define WS_OPCODE_CLOSE 0x8
+#define WS_OPCODE_PING 0x9
+#define WS_OPCODE_PONG 0xA
+
+#define WS_MAX_FRAME_HEADER 14      // 2 + 8 (extended length) + 4 (mask)
+#define WS_MAX_HANDSHAKE 8192       // upgrade request headers larger than this are rejected
+#define WS_MAX_CONTROL_PAYLOAD 125
+
+// Decoded frame header; the payload follows and is unmasked by the caller (ws_unmask)
+typedef struct {
+    uint8_t opcode;
+    int fin;
+    int rsv1;               // permessage-deflate: message is compressed
+    int masked;
+    unsigned char mask[4];
+    uint64_t length;
+} WsFrameHeader;
 
 // Perform WebSocket handshake if the initial bytes look like HTTP GET.
 // Returns 0 on success, -1 on failure.
 int websocket_handshake(int fd);
 
-// Receive a WebSocket frame (text/binary). Allocates payload (caller free).
-// opcode out param stores the opcode (0x1 text, 0x2 binary, 0x8 close, 0x9 ping).
-// Returns payload length, or -1 on error/connection close.
-int websocket_recv_frame(int fd, char** payload, uint8_t* opcode);
+// Non-blocking handshake: if `req` holds a complete upgrade request, write the
+// 101 response to `out` and the request length to *consumed. With a non-NULL
+// pmd_cfg, permessage-deflate is negotiated and the result stored in *pmd.
+// Returns response length, 0 if more bytes are needed, -1 if the request is invalid.
+int websocket_handshake_response(const char* req, size_t len, size_t* consumed, char* out, size_t outcap,
+                                 const WsDeflateConfig* pmd_cfg, WsDeflateParams* pmd);
+
+// Encode a server frame header (FIN set, unmasked; rsv1 marks a compressed message).
+// Returns header length.
+int websocket_frame_header(unsigned char out[WS_MAX_FRAME_HEADER], uint8_t opcode, uint64_t len);
+int websocket_frame_header_ex(unsigned char out[WS_MAX_FRAME_HEADER], uint8_t opcode, int rsv1, uint64_t len);
+
+// Parse a frame header (payload not required to be present).
+// Returns header length, 0 if more bytes are needed, -1 on protocol error.
+int websocket_parse_header(const char* data, size_t len, WsFrameHeader* hdr);
 
 // Send a text frame (unmasked, as server side).
 int websocket_send_text(int fd, const char* data, int len);